@@ -8,7 +8,7 @@ Write-Host "Building proxy server..." -ForegroundColor White
 Write-Host ""
 
 # Build command
-$buildCmd = "gcc -o proxy_server.exe src/proxy_server.c src/components/cache.c src/components/connection_pool.c src/components/http_parser.c src/components/platform.c src/components/proxy_server.c src/components/thread_pool.c -I include -lws2_32 -lpthread"
+$buildCmd = "gcc -o proxy_server.exe src/proxy_server.c src/components/affinity.c src/components/cache.c src/components/collapse.c src/components/connection_pool.c src/components/connector.c src/components/coroutine.c src/components/event_loop.c src/components/http_parser.c src/components/listener_shard.c src/components/platform.c src/components/platform_uring.c src/components/proxy_server.c src/components/resolver.c src/components/slab.c src/components/thread_pool.c src/components/tunnel.c src/components/upgrade.c -I include -lws2_32 -lpthread"
 
 Write-Host "[BUILD] Compiling proxy server..." -ForegroundColor Cyan
 Write-Host "Command: $buildCmd" -ForegroundColor Gray
@@ -0,0 +1,39 @@
+#ifndef PROXY_AFFINITY_H
+#define PROXY_AFFINITY_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Affinity Module
+// Optional CPU pinning and NUMA-aware placement. The selected CPUs are ordered
+// node by node; acceptors, workers and schedulers take CPUs from that list, and
+// threads are pinned from creation so that their stacks (where the request and
+// relay buffers live) and per-thread I/O state are first touched on their
+// local node. Node-bound allocations (a listener shard's worker slots and
+// rings) are placed with mbind(). The cache is shared by every node and is
+// not placed. Linux only; elsewhere the option is ignored.
+
+#define AFFINITY_MAX_CPUS 1024
+#define AFFINITY_MAX_NODES 64
+
+// Select CPUs ("auto" = every CPU this process may run on, or a list such as
+// "0-7,16-23") and report the NUMA topology. Returns -1 for an unusable list.
+int affinity_init(const char* spec);
+int affinity_enabled(void);
+int affinity_node_count(void);               // Nodes that have selected CPUs (0 when disabled)
+
+// Placement: the index-th CPU of a node (node -1 = the whole list), and the
+// node a numbered group such as a listener shard belongs to. -1 when disabled.
+int affinity_cpu(int node, int index);
+int affinity_group_node(int group);
+int affinity_cpu_node(int cpu);
+
+// Pinning: the calling thread, or a thread about to be created
+int affinity_pin_self(int cpu, const char* role);
+int affinity_thread_attr(pthread_attr_t* attr, int cpu);
+
+// Zeroed memory preferring `node` (-1 = no preference); release with affinity_free
+void* affinity_alloc(size_t size, int node);
+void affinity_free(void* memory, size_t size);
+
+#endif // PROXY_AFFINITY_H
@@ -5,45 +5,117 @@
 #include <time.h>
 
 // Cache Module
-// Optimized O(1) hash table cache with LRU eviction
+// Optimized O(1) hash table cache with LRU eviction. The cache is split into
+// a power-of-two number of shards, each with its own hash table, LRU list and
+// lock; the URL hash picks the shard, so lookups of different URLs rarely wait
+// on each other. Capacity is a byte budget covering keys, responses and entry
+// metadata, split evenly between the shards; eviction is LRU within a shard
+// and frees as many entries as the incoming one needs. How long an entry is
+// served is decided by the caller from the response (see
+// http_response_cache_policy()); the cache only compares against `expires`.
+// Entries that can be revalidated stay past `expires` until evicted: a lookup
+// that asks for them gets the stale entry, and cache_refresh() stores it again,
+// updated with the headers of the origin's 304.
 
-#define CACHE_SIZE 1024
-#define HASH_TABLE_SIZE 1024
-#define CACHE_EXPIRY_TIME 300  // 5 minutes
+#define CACHE_DEFAULT_MAX_BYTES (64LL * 1024 * 1024)  // Budget across all shards
+#define CACHE_DEFAULT_MAX_OBJECT (1024 * 1024)        // Largest response accepted
+#define CACHE_BYTES_PER_BUCKET 1024    // Hash tables are sized for entries of about this charge
+#define CACHE_MIN_BUCKETS 16           // ...but never fewer buckets per shard than this
+#define CACHE_SHARDS 16                // Default shard count (power of two)
 
-// Cache node structure for hash table + LRU
+// Cache node structure for hash table + LRU. The URL and response bytes never
+// change once added; readers pin the entry with a reference, so an eviction
+// only unlinks it and the last cache_release() frees it.
 typedef struct cache_node {
     char* url;                    // Request URL (key)
     char* data;                   // Cached response data
     int data_size;                // Size of cached data
     time_t timestamp;             // When cached
+    time_t expires;               // Served as fresh until then
+    int keep_stale;               // Has a validator: kept past expires for revalidation
     int access_count;             // Access frequency
-    
+    int refcount;                 // Readers, plus one while linked into the cache
+    size_t block_size;            // Node, URL and data, allocated as one slab block
+    size_t charge;                // Bytes counted against the budget (the block's slab slot)
+
     struct cache_node* next;      // For hash collision chaining
     struct cache_node* lru_prev;  // For LRU doubly-linked list
     struct cache_node* lru_next;  // For LRU doubly-linked list
 } cache_node_t;
 
-// Optimized cache structure
+// One shard: an independent LRU cache holding its share of the capacity
 typedef struct {
-    cache_node_t** hash_table;                 // Hash table for O(1) lookup (pointer to array)
+    pthread_mutex_t cache_mutex;
+    cache_node_t** hash_table;                 // bucket_count chains
     cache_node_t* lru_head;                    // Most recently used
     cache_node_t* lru_tail;                    // Least recently used
-    pthread_mutex_t cache_mutex;
-    int current_size;
-    int max_size;
+    int entries;
+    size_t bytes_used;
+    size_t max_bytes;                          // This shard's share of the budget
+    long long evictions;                       // Entries dropped to make room
+    char pad[64];                              // Keeps the next shard's lock off this line
+} cache_shard_t;
+
+// Optimized cache structure
+typedef struct {
+    cache_shard_t* shards;
+    int shard_count;                           // Power of two
+    unsigned int shard_mask;                   // shard_count - 1
+    int bucket_count;                          // Buckets per shard
+    size_t max_bytes;                          // Budget across all shards
+    int max_object;                            // Larger responses are rejected
+    long long rejected;                        // Responses refused for their size
+    long long revalidated;                     // Stale entries refreshed by a 304
 } optimized_cache_t;
 
+// Counters for the status endpoint
+typedef struct {
+    size_t bytes_used;
+    size_t max_bytes;
+    int max_object;
+    int entries;
+    long long evictions;
+    long long rejected;
+    long long revalidated;                     // Stale entries refreshed by a 304
+} cache_stats_t;
+
 // Cache management functions
-optimized_cache_t* cache_create(void);
-cache_node_t* cache_get(optimized_cache_t* cache, const char* url);
-int cache_add(optimized_cache_t* cache, const char* url, const char* data, int size);
+optimized_cache_t* cache_create(void);        // Default budget, CACHE_SHARDS shards
+// Shards: power of two, 1 = a single lock. Fewer are used when the budget is too
+// small for every shard to hold a max_object response.
+optimized_cache_t* cache_create_sized(long long max_bytes, int max_object, int shards);
+// Pinned: cache_release() when done. With `stale` set, an expired entry kept for
+// revalidation is returned too and *stale tells the two apart.
+const cache_node_t* cache_get(optimized_cache_t* cache, const char* url, int* stale);
+void cache_release(const cache_node_t* node);
+int cache_contains(optimized_cache_t* cache, const char* url, int allow_stale);  // LRU untouched
+// Replaces any entry for the same URL
+int cache_add(optimized_cache_t* cache, const char* url, const char* data, int size, time_t expires,
+              int keep_stale);
+// A 304 confirmed `node`: `data` (NULL to keep the stored bytes) replaces it.
+// -1 if it is no longer cached.
+int cache_refresh(optimized_cache_t* cache, const cache_node_t* node, const char* data, int size,
+                  time_t expires);
 void cache_remove_expired(optimized_cache_t* cache);
+void cache_get_stats(optimized_cache_t* cache, cache_stats_t* stats);
+void cache_note_rejected(optimized_cache_t* cache);   // A response outgrew max_object before reaching cache_add()
 void cache_destroy(optimized_cache_t* cache);
 
-// Cache utilities
-unsigned int cache_hash(const char* url);
-void cache_move_to_front(optimized_cache_t* cache, cache_node_t* node);
-void cache_remove_lru(optimized_cache_t* cache);
+// Handing the cache to another process: each shard's entries are visited
+// least recently used first, so importing them in order rebuilds the same
+// per-shard LRU order. A visitor returning -1 ends the walk. Entries are only
+// pinned under the shard lock and visited after it is dropped, so a visitor
+// may block; it gets timestamp and expires as they were when pinned, since a
+// 304 can refresh the entry meanwhile.
+typedef int (*cache_visitor_t)(void* context, const cache_node_t* node, time_t timestamp, time_t expires);
+int cache_export(optimized_cache_t* cache, cache_visitor_t visit, void* context);
+int cache_import(optimized_cache_t* cache, const char* url, const char* data, int size, time_t timestamp,
+                 time_t expires, int keep_stale);
+
+// Cache utilities (the shard functions expect the shard locked)
+unsigned int cache_hash(const char* url);              // Low bits pick the shard, the rest the bucket
+cache_shard_t* cache_shard_for(optimized_cache_t* cache, unsigned int hash);
+void cache_move_to_front(cache_shard_t* shard, cache_node_t* node);
+cache_node_t* cache_remove_lru(optimized_cache_t* cache, cache_shard_t* shard); // Unlinked, caller releases
 
 #endif // PROXY_CACHE_H
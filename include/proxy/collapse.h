@@ -0,0 +1,80 @@
+#ifndef PROXY_COLLAPSE_H
+#define PROXY_COLLAPSE_H
+
+#include <pthread.h>
+#include <time.h>
+#include "thread_pool.h"
+
+// Collapse Module
+// Request collapsing for cache misses. The first request that misses on a URL
+// leads the upstream fetch; concurrent requests for the same URL wait for it
+// and are then answered from the cache, so an expired popular object costs
+// the origin one request instead of one per client. Worker threads wait on a
+// condition variable; coroutine handlers park on their scheduler and the event
+// loop polls with collapse_pending(), both woken through registered eventfds.
+// A waiter whose leader produced nothing cacheable, or who waited longer than
+// COLLAPSE_WAIT_TIMEOUT, fetches on its own. A leader whose response head
+// rules out caching lets its waiters go at once and leaves a pass marker, so
+// misses on that URL over the next COLLAPSE_PASS_TTL seconds fetch in parallel.
+
+#define COLLAPSE_BUCKETS 256
+#define COLLAPSE_WAIT_TIMEOUT 10     // Seconds a request waits on another's fetch
+#define COLLAPSE_PASS_TTL 10         // Seconds misses on an uncacheable URL skip collapsing
+#define COLLAPSE_MAX_WAKEUPS MAX_WORKER_THREADS  // Event loops and schedulers notified when a fetch ends
+
+// One upstream fetch in flight, or a pass marker once it turned out uncacheable
+typedef struct collapse_fetch {
+    char* url;
+    unsigned long long id;           // Tells a later fetch of the same URL apart (never 0)
+    int waiters;
+    time_t pass_until;               // Nonzero: a pass marker, no longer a fetch
+    struct collapse_fetch* next;     // Hash bucket chain
+} collapse_fetch_t;
+
+typedef struct {
+    long long fetches;               // Misses that led an upstream fetch
+    long long collapsed;             // Requests that waited on a fetch already in flight
+    long long timeouts;              // Waiters that gave up and fetched on their own
+    long long passes;                // Misses that skipped collapsing behind a pass marker
+    int in_flight;
+} collapse_stats_t;
+
+typedef struct {
+    collapse_fetch_t* buckets[COLLAPSE_BUCKETS];
+    unsigned long long next_id;
+    pthread_mutex_t mutex;
+    pthread_cond_t fetch_done;
+    int wakeup_fds[COLLAPSE_MAX_WAKEUPS];
+    int wakeup_count;
+    collapse_stats_t stats;
+} collapse_t;
+
+// Collapse management functions
+collapse_t* collapse_create(void);
+void collapse_destroy(collapse_t* collapse);
+
+// 1 if the caller now leads the fetch of `url` and must call collapse_end()
+// with *fetch_id once its response is cached (or turned out not to be
+// cacheable); 0 if a fetch is already in flight, identified by *fetch_id.
+// A NULL collapse, or a pass marker on `url`, lets every caller lead.
+int collapse_begin(collapse_t* collapse, const char* url, unsigned long long* fetch_id);
+void collapse_end(collapse_t* collapse, const char* url, unsigned long long fetch_id);
+
+// The leader's response head says it will not be cached: wake the waiters now
+// and mark the URL pass for COLLAPSE_PASS_TTL. collapse_end() is then a no-op.
+void collapse_pass(collapse_t* collapse, const char* url, unsigned long long fetch_id);
+
+// Waiting on a fetch: blocks (parks inside a coroutine) until it ends, 0 once
+// it has, -1 after COLLAPSE_WAIT_TIMEOUT. collapse_pending() never blocks.
+int collapse_wait(collapse_t* collapse, const char* url, unsigned long long fetch_id);
+int collapse_pending(collapse_t* collapse, const char* url, unsigned long long fetch_id);
+int collapse_active(collapse_t* collapse, const char* url);   // Some fetch of `url` is in flight
+void collapse_note_timeout(collapse_t* collapse);   // A non-blocking waiter gave up
+
+// eventfds written whenever a fetch ends (event loop and scheduler wakeups)
+int collapse_add_wakeup(collapse_t* collapse, int fd);
+void collapse_remove_wakeup(collapse_t* collapse, int fd);
+
+void collapse_get_stats(collapse_t* collapse, collapse_stats_t* stats);
+
+#endif // PROXY_COLLAPSE_H
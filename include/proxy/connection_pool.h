@@ -29,6 +29,7 @@ typedef struct {
 // Connection pool management functions
 connection_pool_t* connection_pool_create(int max_size);
 int connection_pool_get(connection_pool_t* pool, char* host, int port);
+int connection_pool_acquire(connection_pool_t* pool, char* host, int port);
 void connection_pool_return(connection_pool_t* pool, int socket_fd, char* host, int port, int keep_alive);
 void connection_pool_cleanup(connection_pool_t* pool);
 void connection_pool_destroy(connection_pool_t* pool);
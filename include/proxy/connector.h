@@ -0,0 +1,47 @@
+#ifndef PROXY_CONNECTOR_H
+#define PROXY_CONNECTOR_H
+
+#include "platform.h"
+#include "resolver.h"
+
+// Connector Module
+// Non-blocking upstream connects across every resolved address. Attempts
+// alternate between IPv6 and IPv4 and start CONNECT_ATTEMPT_DELAY_MS apart
+// (or as soon as the previous one fails); the first to complete wins and the
+// rest are closed. Each address keeps failure stats so addresses that failed
+// recently are tried last. The whole connect is bounded by a deadline.
+
+#define CONNECT_TIMEOUT_MS 5000          // Default deadline for one upstream connect
+#define CONNECT_ATTEMPT_DELAY_MS 250     // Head start each attempt gets before the next begins
+#define CONNECT_PENALTY_WINDOW 300       // Seconds a failed address stays at the back of the order
+#define CONNECTOR_MAX_TRACKED 256        // Addresses with failure stats
+
+// One connection attempt to one address
+typedef struct {
+    int socket_fd;                       // -1 once failed or handed out
+    int address_index;
+    long long started_ms;
+} connect_attempt_t;
+
+// An upstream connect in progress
+typedef struct {
+    char host[256];
+    int port;
+    resolver_result_t addresses;         // In attempt order
+    connect_attempt_t attempts[RESOLVER_MAX_ADDRESSES];
+    int attempt_count;                   // Attempts started so far
+    long long next_attempt_ms;           // When the next address gets its turn
+    long long deadline_ms;
+} connector_t;
+
+// Connect tracking functions
+connector_t* connector_start(const char* host, int port, int timeout_ms);
+int connector_poll(connector_t* connector, int* socket_fd);   // 1 connected, 0 pending, -1 failed
+int connector_timeout_ms(connector_t* connector);             // Until the next attempt or the deadline
+int connector_sockets(connector_t* connector, int* fds, int max);
+void connector_destroy(connector_t* connector);
+
+// Blocking connect through the same machinery (returns a blocking socket or -1)
+int connector_connect(const char* host, int port, int timeout_ms);
+
+#endif // PROXY_CONNECTOR_H
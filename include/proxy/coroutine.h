@@ -0,0 +1,103 @@
+#ifndef PROXY_COROUTINE_H
+#define PROXY_COROUTINE_H
+
+#include <pthread.h>
+#include "platform.h"
+
+// Coroutine Module
+// Runs handle_client_request() as a stackful coroutine per client connection,
+// many per thread. Each scheduler thread owns an epoll instance; when request
+// code would block on a socket (platform_recv/send, upstream connects, tunnel
+// relays, resolver lookups, shared cache fetches) the coroutine parks on its
+// descriptors and the scheduler switches to another one, so the straight-line
+// request code serves thousands of connections without a thread each. Linux
+// only (epoll, ucontext); other platforms use the thread pool.
+
+#define COROUTINE_STACK_SIZE (128 * 1024)   // Request path keeps ~40KB of buffers on the stack
+#define COROUTINE_STACK_CACHE 256           // Stacks kept per scheduler for reuse
+#define COROUTINE_MAX_PER_SCHEDULER 16384   // Accepting pauses while this many are live
+#define COROUTINE_MAX_EVENTS 256
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+
+#include <ucontext.h>
+
+struct coroutine_scheduler;
+
+// One client connection's handler
+typedef struct coroutine {
+    ucontext_t context;
+    char* stack;                        // Mapping including the guard page
+    struct coroutine_scheduler* scheduler;
+    int client_socket;
+    int waiting;                        // Parked until an event, a timer or a scheduler wakeup
+    int wakeup_wait;                    // Parked on the scheduler's wakeup waiter list
+    int finished;
+    long long deadline_ms;              // Timer while parked (0 = none)
+    int timer_index;                    // Position in the timer heap, -1 when not in it
+    struct coroutine* next_ready;
+    struct coroutine* next_waiter;      // Wakeup waiter list
+    struct coroutine* prev;             // Live list (closed on shutdown)
+    struct coroutine* next;
+} coroutine_t;
+
+// Per-thread scheduler
+typedef struct coroutine_scheduler {
+    int epoll_fd;
+    int listen_fd;
+    int listener_paused;                // Too many live coroutines: stop accepting for now
+    int wakeup_fd;                      // eventfd: resolver and fetch completions, stop requests
+    volatile int running;
+    volatile int draining;              // Stop accepting and return once no handler is live
+    int listener_released;              // Draining: listener taken out of epoll for good
+    ucontext_t main_context;
+    coroutine_t* current;
+    coroutine_t* ready_head;
+    coroutine_t* ready_tail;
+    coroutine_t* wakeup_waiters;
+    coroutine_t* live;
+    coroutine_t** timers;               // Min-heap on deadline_ms
+    int timer_count;
+    int timer_capacity;
+    char* stack_cache[COROUTINE_STACK_CACHE];
+    int stack_cache_count;
+    int live_count;
+    long long spawned;
+    long long switches;
+} coroutine_scheduler_t;
+
+#else
+
+typedef struct coroutine_scheduler {
+    int listen_fd;
+} coroutine_scheduler_t;
+
+#endif
+
+// Scheduler management functions (several schedulers may share one listener)
+int coroutines_supported(void);
+coroutine_scheduler_t* coroutine_scheduler_create(int listen_fd);
+void coroutine_scheduler_run(coroutine_scheduler_t* scheduler);
+void coroutine_scheduler_stop(coroutine_scheduler_t* scheduler);
+void coroutine_scheduler_drain(coroutine_scheduler_t* scheduler);  // Any thread; run returns once drained
+void coroutine_scheduler_destroy(coroutine_scheduler_t* scheduler);
+
+// Run `count` schedulers on one listener until they stop (one per thread)
+void coroutine_schedulers_run(int listen_fd, int count);
+void coroutine_schedulers_drain(void);      // Drain every scheduler coroutine_schedulers_run() started
+
+// Used by the blocking I/O helpers. Outside a coroutine they behave exactly
+// like the calls they replace.
+int coroutine_active(void);                                      // Called from inside a coroutine
+int coroutine_recv(socket_t sock, char* buf, int len, int flags);       // Honors SO_RCVTIMEO
+int coroutine_send(socket_t sock, const char* buf, int len, int flags); // Sends everything
+int coroutine_wait_wakeup(int timeout_ms);                       // Park until a lookup or fetch completes (0 = timed out)
+#ifndef _WIN32
+int coroutine_poll(struct pollfd* fds, int count, int timeout_ms);   // poll() that parks the coroutine
+#endif
+
+#endif // PROXY_COROUTINE_H
@@ -0,0 +1,140 @@
+#ifndef PROXY_EVENT_LOOP_H
+#define PROXY_EVENT_LOOP_H
+
+#include <time.h>
+#include "http_parser.h"
+#include "tunnel.h"
+#include "connector.h"
+#include "cache.h"
+
+// Event Loop Module
+// Non-blocking, edge-triggered epoll reactor. Client and upstream sockets are
+// owned by per-connection state machines so a single thread can carry many
+// concurrent requests. Linux only; other platforms use the thread pool.
+
+#define EVENT_LOOP_MAX_EVENTS 256
+#define EVENT_REQUEST_BUFFER_SIZE 4096
+#define EVENT_RELAY_BUFFER_SIZE 16384
+#define EVENT_UPSTREAM_REQUEST_SIZE 4096
+#define EVENT_IDLE_TIMEOUT 30        // Seconds without progress before a connection is dropped
+#define EVENT_CONNECT_TICK_MS 25     // Wakeup interval while upstream connects are staggering
+
+// Connection states (one request per client connection)
+typedef enum {
+    EV_STATE_READ_REQUEST,      // Accumulating request headers from the client
+    EV_STATE_READ_BODY,         // Accumulating a Content-Length request body
+    EV_STATE_WAIT_FETCH,        // Waiting for another request's upstream fetch of the same URL
+    EV_STATE_RESOLVING,         // Waiting for the resolver to answer the upstream host name
+    EV_STATE_CONNECTING,        // Non-blocking connect to upstream in progress
+    EV_STATE_SEND_UPSTREAM,     // Writing the rebuilt request to upstream
+    EV_STATE_RELAY_RESPONSE,    // Streaming upstream response bytes to the client
+    EV_STATE_WRITE_CLIENT,      // Flushing a locally generated response (cache hit / error)
+    EV_STATE_TUNNEL,            // Relaying raw bytes both ways after a CONNECT
+    EV_STATE_DONE               // Finished, connection will be closed
+} event_conn_state_t;
+
+struct event_conn;
+
+// epoll registration handle, one per socket owned by a connection
+typedef struct {
+    struct event_conn* conn;
+    int is_upstream;
+} event_handle_t;
+
+// Per-connection state machine
+typedef struct event_conn {
+    event_conn_state_t state;
+    int client_fd;
+    int upstream_fd;
+    event_handle_t client_handle;
+    event_handle_t upstream_handle;
+    time_t last_activity;
+    int closed;
+
+    // Client request (head plus any body, which must fit in the buffer)
+    char request[EVENT_REQUEST_BUFFER_SIZE];
+    int request_len;
+    int head_len;
+    int body_len;
+    int cacheable;              // The response may be stored (GET without no-store or credentials)
+    int idempotent;             // Safe to replay on a new connection
+    int tunnel_request;         // CONNECT: the upstream connection becomes a tunnel
+
+    // Upstream target and rebuilt request
+    char host[256];
+    int port;
+    char cache_key[512];
+    char upstream_request[EVENT_UPSTREAM_REQUEST_SIZE];
+    int upstream_request_len;
+    int upstream_request_sent;
+    int upstream_reused;        // Upstream socket came from the connection pool
+    int upstream_retried;       // Request already replayed after a stale pooled connection
+    connector_t* connector;     // Connect attempts in flight (CONNECTING state)
+    int connector_registered;   // Attempts already added to epoll
+
+    // Upstream response framing; the head is accumulated in the relay buffer
+    http_response_framer_t framer;
+    int head_received;
+    int upstream_trailing;      // Upstream sent bytes past the end of the response
+
+    // Pending bytes for the client (points into relay buffer or owned copy)
+    char relay[EVENT_RELAY_BUFFER_SIZE];
+    char* out_data;
+    int out_len;
+    int out_sent;
+    int out_owned;
+    long long bytes_relayed;
+
+    // Cached response being served: its body is sent from the pinned entry
+    // itself once the rewritten head in out_data has gone out. While a stale
+    // entry is revalidated upstream it is pinned here too, with no body pending.
+    const cache_node_t* cached;
+    int cached_body_offset;
+    int cached_body_length;
+
+    // Response copy collected for the cache (dropped once it grows too large)
+    char* capture;
+    int capture_len;
+    int capture_cap;
+    int capture_enabled;
+    time_t capture_expires;     // Freshness the response's headers allow
+    int capture_keep_stale;     // Has a validator: keep it past capture_expires
+
+    // Request collapsing: a miss either leads the fetch of its URL or waits for
+    // the one in flight, then looks in the cache again
+    unsigned long long fetch_id;
+    int fetch_leader;           // collapse_end() is owed once the response is cached
+    int fetch_waited;           // Already waited once: fetch alone if still a miss
+    time_t fetch_deadline;
+
+    tunnel_t* tunnel;           // Byte relay once a CONNECT has been answered
+
+    struct event_conn* prev;
+    struct event_conn* next;
+} event_conn_t;
+
+// Reactor instance (one per thread)
+typedef struct event_loop {
+    int epoll_fd;
+    int listen_fd;
+    volatile int running;
+    volatile int draining;        // Stop accepting and return once every connection is done
+    int listening;                // Listener still registered with epoll
+    int active_connections;
+    event_conn_t* connections;    // Live connections, swept for idle timeouts
+    event_conn_t* graveyard;      // Closed connections freed after each event batch
+    time_t last_sweep;
+    int connects_pending;         // Some connection is CONNECTING: tick for attempt timers
+    int wakeup_fd;                // eventfd written when a lookup or a shared fetch completes
+    event_handle_t wakeup_handle;
+} event_loop_t;
+
+// Event loop management functions
+int event_loop_supported(void);
+event_loop_t* event_loop_create(int listen_fd);
+void event_loop_run(event_loop_t* loop);
+void event_loop_stop(event_loop_t* loop);
+void event_loop_drain(event_loop_t* loop);   // Any thread; event_loop_run() returns once drained
+void event_loop_destroy(event_loop_t* loop);
+
+#endif // PROXY_EVENT_LOOP_H
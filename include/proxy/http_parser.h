@@ -1,6 +1,7 @@
 #ifndef PROXY_HTTP_PARSER_H
 #define PROXY_HTTP_PARSER_H
 
+#include <time.h>
 #include "../proxy_parse.h"
 
 // HTTP Parser Module
@@ -18,6 +19,87 @@ struct ParsedHeader* ParsedHeader_get(struct ParsedRequest *pr, const char *key)
 
 // HTTP request validation and utilities
 int validate_http_request(const char* request, int length);
+int http_request_keep_alive(struct ParsedRequest *pr);
 int extract_host_port(const char* host_header, char* host, int* port);
+int extract_connect_target(const char* authority, char* host, int host_size, int* port);
+
+// Request body length from its head: the Content-Length (0 when absent), or
+// one of the negative codes below. Repeated Content-Length headers must agree.
+#define HTTP_BODY_LENGTH_INVALID -1          // Malformed or conflicting Content-Length
+#define HTTP_BODY_LENGTH_TRANSFER_CODED -2   // Transfer-Encoding other than identity
+long long http_request_body_length(const char* head, int head_length);
+
+// HTTP response framing
+// Finds the exact end of an upstream response while its bytes are relayed
+
+#define MAX_RESPONSE_HEAD_SIZE 16384
+
+typedef enum {
+    HTTP_BODY_NONE,             // No body (HEAD, 1xx, 204, 304)
+    HTTP_BODY_LENGTH,           // Delimited by Content-Length
+    HTTP_BODY_CHUNKED,          // Transfer-Encoding: chunked
+    HTTP_BODY_UNTIL_CLOSE       // Delimited by upstream closing the connection
+} http_body_mode_t;
+
+typedef struct {
+    int head_request;           // Response to HEAD carries no body
+    int status_code;
+    int header_length;          // Status line + headers + blank line
+    http_body_mode_t body_mode;
+    long long content_length;   // -1 when absent
+    long long body_remaining;   // Content-Length bytes still expected
+    long long body_received;
+    int connection_close;       // Upstream will close after this response
+    int complete;               // Whole message has been seen
+    int chunk_state;
+    long long chunk_remaining;
+} http_response_framer_t;
+
+void http_response_framer_init(http_response_framer_t* framer, int head_request);
+// Interim 1xx heads (other than 101) precede the final response: drop complete
+// ones from the start of `data`, returning the bytes left
+int http_response_skip_interim(char* data, int length);
+int http_response_parse_head(http_response_framer_t* framer, const char* data, int length);
+int http_response_body(http_response_framer_t* framer, const char* data, int length);
+void http_response_body_forwarded(http_response_framer_t* framer, long long length);
+int http_response_finish_on_close(http_response_framer_t* framer);
+int http_response_rewrite_head(const char* head, int head_length, char* out, int out_size,
+                               const char* connection);
+
+// HTTP caching rules for a shared cache (RFC 9111)
+// Decides whether a request may be answered from the cache, whether its
+// response may be stored, and for how long a stored response stays fresh.
+// A response with a validator (ETag or Last-Modified) is worth keeping past
+// that point: the origin can confirm it with a bodiless 304.
+
+#define HTTP_CACHE_LOOKUP 1              // The request may be answered from the cache
+#define HTTP_CACHE_STORE 2               // Its response may be stored
+#define HTTP_HEURISTIC_FRACTION 10       // Heuristic lifetime: a tenth of the time since Last-Modified
+#define HTTP_HEURISTIC_MAX_LIFETIME 86400  // ...but never more than a day
+#define HTTP_MAX_LIFETIME (365LL * 86400)  // Longer lifetimes are clamped to a year
+
+typedef struct {
+    int storable;                   // A shared cache may keep the response
+    const char* reason;             // Why not, for the log
+    time_t expires;                 // Local time at which it becomes stale
+    int validator;                  // ETag or Last-Modified: revalidatable once stale
+} http_cache_policy_t;
+
+int http_request_cache_mode(struct ParsedRequest* request);   // HTTP_CACHE_* bits
+void http_response_cache_policy(const char* head, int head_length, time_t now, http_cache_policy_t* policy);
+// Policy for a stored response the origin just confirmed with a 304, whose headers take precedence
+void http_revalidated_cache_policy(const char* stored_head, int stored_length,
+                                   const char* not_modified_head, int not_modified_length,
+                                   time_t now, http_cache_policy_t* policy);
+// The stored response as updated by a 304: the 304's header fields replace stored
+// ones of the same name (Date, ETag, Cache-Control, Expires...), except those
+// about its own connection and framing; the stored body is kept. malloc'd, NULL
+// if either head is malformed or the merged head would be too large.
+char* http_merge_not_modified(const char* stored, int stored_length,
+                              const char* not_modified_head, int not_modified_length, int* merged_length);
+// If-None-Match / If-Modified-Since lines built from a stored response's validators.
+// Returns their length, 0 if it has none, -1 if they do not fit.
+int http_conditional_headers(const char* head, int head_length, char* out, int out_size);
+time_t http_parse_date(const char* value, int value_length);  // -1 if not an HTTP-date
 
 #endif // PROXY_HTTP_PARSER_H
@@ -0,0 +1,43 @@
+#ifndef PROXY_LISTENER_SHARD_H
+#define PROXY_LISTENER_SHARD_H
+
+#include <pthread.h>
+#include "thread_pool.h"
+#include "event_loop.h"
+#include "coroutine.h"
+
+// Listener Shard Module
+// One SO_REUSEPORT listener per core, each with its own accept loop and
+// worker set, so the kernel spreads connections with no shared queue between shards
+
+#define MAX_LISTENER_SHARDS 64
+
+// A single shard: listener + acceptor thread + private workers
+typedef struct {
+    int id;
+    int node;                     // NUMA node the shard runs on (-1 = not pinned)
+    int listen_fd;
+    pthread_t thread;
+    int thread_started;
+    volatile int running;
+    thread_pool_t* pool;          // Thread pool mode: shard-private worker set
+    event_loop_t* loop;           // Event loop mode: shard-private reactor
+    coroutine_scheduler_t* scheduler; // Coroutine mode: shard-private scheduler
+} listener_shard_t;
+
+// All shards of the running server
+typedef struct {
+    listener_shard_t shards[MAX_LISTENER_SHARDS];
+    int count;
+    int mode;                     // server_mode_t the shards run
+} shard_group_t;
+
+// Shard management functions
+int listener_shards_supported(void);
+int listener_shards_default_count(void);
+shard_group_t* shard_group_start(int port, int count, int mode);
+void shard_group_drain(shard_group_t* group);   // Stop accepting; shard threads end once idle
+void shard_group_wait(shard_group_t* group);
+void shard_group_destroy(shard_group_t* group);
+
+#endif // PROXY_LISTENER_SHARD_H
@@ -30,6 +30,12 @@
     
 #endif
 
+// I/O backends for the blocking socket calls (selected at startup)
+typedef enum {
+    IO_BACKEND_SOCKETS = 0,   // Plain socket syscalls (all platforms)
+    IO_BACKEND_URING          // Linux io_uring: multishot accept, registered buffers, batched submits
+} io_backend_t;
+
 // Platform abstraction functions
 void platform_init(void);
 void platform_cleanup(void);
@@ -39,6 +45,42 @@ void print_socket_error(const char* message);
 // Cross-platform socket close function
 int socket_close(socket_t sock);
 
+// Switch a socket to non-blocking / blocking mode (0 on success, -1 on failure)
+int socket_set_nonblocking(socket_t sock);
+int socket_set_blocking(socket_t sock);
+
+// I/O backend selection (falls back to IO_BACKEND_SOCKETS when unavailable)
+io_backend_t platform_io_init(io_backend_t requested);
+io_backend_t platform_io_backend(void);
+const char* platform_io_backend_name(io_backend_t backend);
+
+// Socket I/O routed through the active backend (same return/errno conventions as the syscalls)
+socket_t platform_accept(socket_t sock, struct sockaddr* addr, socklen_t* addrlen);
+int platform_recv(socket_t sock, char* buf, int len, int flags);
+int platform_send(socket_t sock, const char* buf, int len, int flags);
+int platform_send_all(socket_t sock, const char* buf, int len);
+int platform_send_recv(socket_t sock, const char* request, int request_len, char* response, int response_len);
+int platform_set_recv_timeout(socket_t sock, int timeout_ms);
+
+// Per-thread receive buffer registered with the backend (NULL when the backend has none)
+char* platform_io_buffer(int size);
+
+// Zero-copy socket-to-socket relay through a per-thread pipe (Linux splice)
+int platform_splice_supported(void);
+long long platform_splice(socket_t from, socket_t to, long long length, int* eof);
+
+#ifdef __linux__
+// io_uring backend (platform_uring.c)
+int uring_available(void);
+int uring_accept(int sock, struct sockaddr* addr, socklen_t* addrlen);
+int uring_recv(int sock, char* buf, int len, int flags);
+int uring_send(int sock, const char* buf, int len, int flags);
+int uring_send_recv(int sock, const char* request, int request_len, char* response, int response_len);
+void uring_set_recv_timeout(int sock, int timeout_ms);
+void uring_forget_fd(int sock);
+char* uring_fixed_buffer(int size);
+#endif
+
 // Cross-platform utility functions
 void bzero(void *s, size_t n);
 void bcopy(const void *src, void *dest, size_t n);
@@ -9,30 +9,120 @@
 #include "thread_pool.h"
 #include "connection_pool.h"
 #include "cache.h"
+#include "slab.h"
+#include "event_loop.h"
+#include "coroutine.h"
+#include "listener_shard.h"
+#include "tunnel.h"
+#include "resolver.h"
+#include "collapse.h"
+#include "connector.h"
+#include "affinity.h"
+#include "upgrade.h"
 
 // Server configuration
 #define DEFAULT_PORT 8080
 #define MAX_REQUEST_SIZE 4096
-#define MAX_RESPONSE_SIZE 1048576  // 1MB
+#define MAX_RESPONSE_SIZE CACHE_DEFAULT_MAX_OBJECT  // Default largest response kept in the cache (1MB)
+#define MAX_CONDITIONAL_HEADERS 512     // If-None-Match / If-Modified-Since added when revalidating
+#define MAX_CACHE_OBJECT_LIMIT (256 * 1024 * 1024)  // Ceiling for --cache-max-object
+#define RELAY_BUFFER_SIZE 16384    // Per-request buffer for streaming upstream responses
+#define MAX_REQUEST_BODY_SIZE 1048576  // Largest request body forwarded upstream
+#define PROXY_STATUS_PATH "/proxy-status"  // Origin-form requests for this path get the proxy's metrics
+#define STATUS_RESPONSE_SIZE 8192
+
+// Client keep-alive
+#define KEEPALIVE_IDLE_TIMEOUT 5   // Seconds a persistent client connection may sit idle
+#define KEEPALIVE_MAX_REQUESTS 100 // Requests served before the connection is closed
+
+// Admission control (thread pool accept loops)
+#define DEFAULT_LATENCY_TARGET_MS 2000  // Estimated queue wait above which new connections are shed
+#define ADMISSION_PEEK_SIZE 1024        // Request bytes inspected for a cache hit before shedding
+#define ADMISSION_PEEK_WAIT_MS 5        // Longest the acceptor waits for those bytes
+
+// Binary upgrades (listener handoff)
+#define DEFAULT_DRAIN_TIMEOUT_MS 30000  // How long a stopping server finishes in-flight requests
+
+// Client request pipelining
+#define CLIENT_BUFFER_SIZE 16384   // Bytes buffered from a client (several pipelined requests)
+#define PIPELINE_MAX_DEPTH 8       // Requests read ahead and sent upstream early per connection
+
+// Execution modes selectable at startup
+typedef enum {
+    SERVER_MODE_THREAD_POOL = 0,  // Blocking accept, one request per worker thread (default)
+    SERVER_MODE_EVENT_LOOP,       // Non-blocking epoll reactor (Linux only)
+    SERVER_MODE_COROUTINES        // Stackful handler per connection, epoll scheduler per core (Linux only)
+} server_mode_t;
+
+// Startup configuration (filled from the command line)
+typedef struct {
+    server_mode_t mode;
+    int shards;                   // SO_REUSEPORT listener shards (0 = single listener)
+    io_backend_t io_backend;      // Backend for blocking socket I/O in the thread pool path
+    int zero_copy;                // splice() response bodies that bypass the cache
+    const char* hosts_file;       // Host names pinned to fixed addresses (NULL = none)
+    int connect_timeout_ms;       // Deadline for establishing an upstream connection
+    int min_workers;              // Thread pool sizing bounds (equal for a fixed-size pool)
+    int max_workers;
+    int latency_target_ms;        // Shed new connections beyond this queue wait (0 = never)
+    const char* cpu_affinity;     // CPUs to pin threads to ("auto" or a list, NULL = no pinning)
+    const char* upgrade_socket;   // Unix socket for listener handoff between binaries (NULL = none)
+    int drain_timeout_ms;         // On shutdown or after a handoff: longest wait for in-flight requests
+    int cache_handoff;            // Ask the previous server for its cache when taking over
+    long long cache_max_bytes;    // Cache budget: keys, responses and entry metadata
+    int cache_max_object;         // Larger responses are relayed but not cached
+    int cache_huge_pages;         // Back cache arenas with transparent huge pages
+} proxy_config_t;
+
+// A request read from a client connection. Pipelined requests queued behind
+// the one being answered may already have been sent upstream.
+typedef struct {
+    struct ParsedRequest* request;
+    char* body;
+    int body_length;
+    int keep_alive;               // In: client connection continues after this response; out: still usable
+    int upstream_socket;          // Request already sent on this socket, -1 if not dispatched
+    int upstream_reused;          // upstream_socket came from the connection pool
+    char host[256];
+    int port;
+} client_request_t;
 
 // Global server state
 extern int port_number;
+extern proxy_config_t proxy_config;
 extern thread_pool_t* thread_pool;
 extern optimized_cache_t* optimized_cache;
 extern connection_pool_t* connection_pool;
+extern resolver_t* dns_resolver;
+extern collapse_t* request_collapse;
+extern shard_group_t* shard_group;
 
 // Core server functions
 int proxy_server_init(int port);
 void proxy_server_start(void);
+int proxy_server_run(void);          // Main thread: start, then drain on a stop request; -1 past the drain deadline
+void proxy_server_stop(int sig);     // Async-signal-safe; sig 0 when the listeners were handed over
 void proxy_server_shutdown(void);
+void proxy_server_drain(void);       // Listeners handed over: stop accepting, finish in-flight requests
+int proxy_server_draining(void);
 
 // Request handling functions
 void handle_client_request(int client_socket);
-int forward_request_to_server(struct ParsedRequest* request, int client_socket);
+int forward_request_to_server(client_request_t* entry, int client_socket);
+int dispatch_upstream_request(client_request_t* entry);
 int send_error_response(int client_socket, int error_code, const char* message);
+int format_error_response(char* buffer, size_t size, int error_code, const char* message);
+int is_status_request(struct ParsedRequest* request);
+int format_status_response(char* buffer, size_t size);
+int send_overload_response(int client_socket, int retry_after);
+int build_upstream_request(struct ParsedRequest* request, const char* host, const char* extra_headers,
+                           char* buffer, size_t size);   // extra_headers: NULL or complete "Name: value\r\n" lines
+long long request_body_length(struct ParsedRequest* request);
 
 // Utility functions
 int create_server_socket(int port);
+int create_listener_socket(int port, int reuse_port);
+void run_accept_loop(int server_socket, thread_pool_t* pool, volatile int* running);
 int parse_request_url(const char* url, char* host, int* port, char* path);
 
 #endif // PROXY_SERVER_H
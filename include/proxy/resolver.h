@@ -0,0 +1,91 @@
+#ifndef PROXY_RESOLVER_H
+#define PROXY_RESOLVER_H
+
+#include <pthread.h>
+#include <time.h>
+#include "platform.h"
+#include "thread_pool.h"
+
+// Resolver Module
+// Host name lookups run on dedicated resolver threads and their answers are
+// cached: successes for RESOLVER_POSITIVE_TTL, failures for RESOLVER_NEGATIVE_TTL.
+// Concurrent lookups of the same name share one query. Worker threads wait for
+// the answer (bounded by RESOLVER_LOOKUP_TIMEOUT); the event loop polls with
+// resolver_lookup_nowait and is woken through a registered eventfd, as are
+// coroutine schedulers, whose handlers park instead of blocking.
+
+#define RESOLVER_THREADS 2
+#define RESOLVER_MAX_ADDRESSES 8
+#define RESOLVER_CACHE_BUCKETS 256
+#define RESOLVER_MAX_ENTRIES 1024
+#define RESOLVER_POSITIVE_TTL 60     // Seconds a resolved name is served from the cache
+#define RESOLVER_NEGATIVE_TTL 5      // Seconds a failed name is answered without a new query
+#define RESOLVER_LOOKUP_TIMEOUT 5    // Seconds a blocking caller waits for an answer
+#define RESOLVER_MAX_WAKEUPS MAX_WORKER_THREADS  // Event loops and schedulers (one per worker at most)
+
+// Addresses for one name (IPv4 first, then IPv6)
+typedef struct {
+    int count;
+    struct sockaddr_storage addresses[RESOLVER_MAX_ADDRESSES];
+    socklen_t lengths[RESOLVER_MAX_ADDRESSES];
+} resolver_result_t;
+
+typedef enum {
+    RESOLVER_ENTRY_PENDING,          // Query queued or running
+    RESOLVER_ENTRY_RESOLVED,
+    RESOLVER_ENTRY_FAILED
+} resolver_entry_state_t;
+
+// Cached answer for one (lower-cased) host name
+typedef struct resolver_entry {
+    char name[256];
+    resolver_entry_state_t state;
+    resolver_result_t result;
+    time_t expires;                  // 0 for pinned hosts-file entries
+    struct resolver_entry* next;     // Hash bucket chain
+    struct resolver_entry* next_job; // Lookup queue
+} resolver_entry_t;
+
+typedef struct {
+    long long hits;                  // Answered from a cached success
+    long long negative_hits;         // Answered from a cached failure
+    long long misses;                // Started a new query
+    long long shared;                // Waited on a query another caller started
+    long long failures;              // Queries that returned no address
+    long long timeouts;              // Blocking callers that gave up waiting
+} resolver_stats_t;
+
+typedef struct {
+    resolver_entry_t* buckets[RESOLVER_CACHE_BUCKETS];
+    int entry_count;
+    resolver_entry_t* jobs_head;
+    resolver_entry_t* jobs_tail;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_ready;
+    pthread_cond_t lookup_done;
+    pthread_t threads[RESOLVER_THREADS];
+    int thread_count;
+    int shutdown;
+    int wakeup_fds[RESOLVER_MAX_WAKEUPS];
+    int wakeup_count;
+    resolver_stats_t stats;
+} resolver_t;
+
+// Resolver management functions
+resolver_t* resolver_create(const char* hosts_file);
+void resolver_destroy(resolver_t* resolver);
+int resolver_load_hosts(resolver_t* resolver, const char* path);
+
+// Lookups: 0 with `result` filled, -1 when the name does not resolve.
+// resolver_lookup_nowait returns 1 while the query is still in flight.
+// A NULL resolver falls back to a direct blocking getaddrinfo().
+int resolver_lookup(resolver_t* resolver, const char* host, resolver_result_t* result);
+int resolver_lookup_nowait(resolver_t* resolver, const char* host, resolver_result_t* result);
+
+// eventfds written whenever a query completes (event loop wakeups)
+int resolver_add_wakeup(resolver_t* resolver, int fd);
+void resolver_remove_wakeup(resolver_t* resolver, int fd);
+
+void resolver_get_stats(resolver_t* resolver, resolver_stats_t* stats);
+
+#endif // PROXY_RESOLVER_H
@@ -0,0 +1,39 @@
+#ifndef PROXY_SLAB_H
+#define PROXY_SLAB_H
+
+#include <stddef.h>
+
+// Slab Module
+// Size-class allocator for cache entries. Requests up to SLAB_MAX_SLOT bytes
+// are rounded up to one of SLAB_CLASS_COUNT classes (four per power of two,
+// so at most 25% is lost to rounding) and carved from SLAB_ARENA_SIZE arenas
+// dedicated to that class. Arenas are aligned to their size, which lets a
+// free find its arena from the address alone; an arena left empty is
+// returned to the system, except for one spare per class whose pages are
+// dropped instead. Larger requests get their own mapping and are unmapped
+// when freed. Optionally arenas are backed by transparent huge pages (Linux).
+
+#define SLAB_ARENA_SIZE (2 * 1024 * 1024)   // One huge page on x86-64
+#define SLAB_MIN_SLOT 128
+#define SLAB_MAX_SLOT (256 * 1024)          // At least 8 slots per arena
+#define SLAB_CLASS_COUNT 45                 // 128, then 4 classes per doubling up to 256 KB
+
+// Allocator occupancy since startup
+typedef struct {
+    int arenas;                  // Arenas holding slots
+    int spare_arenas;            // Empty, kept mapped with their pages dropped
+    size_t arena_bytes;          // Size of the arenas holding slots
+    size_t slot_bytes;           // Arena slots handed out
+    int large_blocks;
+    size_t large_bytes;          // Mapped for requests above SLAB_MAX_SLOT
+    size_t requested_bytes;      // What callers asked for, slab and large together
+} slab_stats_t;
+
+void slab_use_huge_pages(int enabled);        // Call before the first allocation
+
+size_t slab_slot_size(size_t size);           // Bytes actually reserved for a request of `size`
+void* slab_alloc(size_t size);                // NULL when out of memory
+void slab_free(void* block, size_t size);     // `size` as passed to slab_alloc
+void slab_get_stats(slab_stats_t* stats);
+
+#endif // PROXY_SLAB_H
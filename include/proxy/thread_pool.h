@@ -5,32 +5,133 @@
 #include <semaphore.h>
 
 // Thread Pool Module
-// Manages worker threads and task queue for concurrent request handling
+// Manages worker threads for concurrent request handling. Every worker owns a
+// preallocated, bounded, lock-free MPMC ring of accepted client sockets; the
+// acceptor hands sockets out round-robin and a worker whose ring is empty
+// steals from the others. Idle workers spin briefly, then sleep on a futex
+// (a condition variable where futexes are unavailable). Queueing a socket
+// allocates nothing, and a full set of rings is reported to the acceptor.
+//
+// The number of workers adapts between a minimum and a maximum: a sizing
+// thread samples queue wait time and how many workers are busy (blocked on
+// client or upstream I/O) and grows the pool under sustained pressure, or
+// retires one worker at a time after a long quiet spell.
+//
+// Workers also keep a moving average of how long they hold a connection, from
+// which the acceptor estimates the queue wait a new connection would face
+// (admission control).
 
 #define MAX_CLIENTS 200
-#define NUM_WORKER_THREADS 4
+#define DEFAULT_WORKER_THREADS 4         // Workers the pool starts with (within min..max)
+#define DEFAULT_MIN_WORKER_THREADS 2
+#define DEFAULT_MAX_WORKER_THREADS 64
+#define MAX_WORKER_THREADS 256
+#define THREAD_POOL_RING_SIZE 256        // Sockets queued per worker (power of two)
+#define THREAD_POOL_SPIN_ROUNDS 64       // Empty polls of every ring before a worker sleeps
+#define CACHE_LINE_SIZE 64
 
-// Task structure for thread pool
-typedef struct task {
+// Sizing policy (hysteresis: growing needs brief pressure, shrinking a long quiet spell)
+#define THREAD_POOL_SIZING_INTERVAL_MS 250
+#define THREAD_POOL_GROW_WAIT_US 5000    // Mean queue wait that counts as pressure
+#define THREAD_POOL_GROW_SAMPLES 2       // Consecutive pressured samples before growing
+#define THREAD_POOL_SHRINK_SAMPLES 20    // Consecutive quiet samples before retiring a worker
+#define THREAD_POOL_SERVICE_WEIGHT 8     // Service time average: each connection counts 1/8
+#define THREAD_POOL_IDLE_POLL_MS 50      // How often thread_pool_wait_idle() looks again
+
+// One ring cell: `sequence` says whose turn the cell is (producer at position
+// p sees p, consumer sees p + 1)
+typedef struct {
+    long sequence;
     int client_socket;
-    struct task* next;
-} task_t;
+    long long queued_us;                 // When the socket was queued (queue wait metric)
+} thread_pool_slot_t;
 
-// Thread pool structure
+// Bounded MPMC ring (Vyukov). Producer and consumer cursors live on their own
+// cache lines so the acceptor and the workers do not share a line.
 typedef struct {
-    pthread_t workers[NUM_WORKER_THREADS];
-    task_t* task_queue_head;
-    task_t* task_queue_tail;
-    pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_condition;
-    int queue_size;
+    char pad0[CACHE_LINE_SIZE];
+    long enqueue_pos;
+    char pad1[CACHE_LINE_SIZE - sizeof(long)];
+    long dequeue_pos;
+    char pad2[CACHE_LINE_SIZE - sizeof(long)];
+    thread_pool_slot_t slots[THREAD_POOL_RING_SIZE];
+} thread_pool_ring_t;
+
+typedef enum {
+    THREAD_POOL_WORKER_STOPPED = 0,      // No thread (never started, or exited and joined)
+    THREAD_POOL_WORKER_RUNNING,
+    THREAD_POOL_WORKER_RETIRING,         // Drains its ring, then exits
+    THREAD_POOL_WORKER_EXITED            // Thread finished, not yet joined
+} thread_pool_worker_state_t;
+
+struct thread_pool;
+
+// One worker thread and the ring it owns
+typedef struct {
+    struct thread_pool* pool;
+    int id;
+    pthread_t thread;
+    int state;                           // thread_pool_worker_state_t
+    thread_pool_ring_t ring;
+    long long executed;                  // Tasks run by this worker
+    long long stolen;                    // ...of which were taken from another worker's ring
+} thread_pool_worker_t;
+
+// Pool counters and the sizing thread's latest view
+typedef struct {
+    int workers;                         // Receiving new sockets
+    int min_workers;
+    int max_workers;
+    int busy_workers;                    // Serving a client (mostly blocked on socket I/O)
+    int queued;                          // Sockets waiting in the rings
+    long long queue_wait_us;             // Mean queue wait over the last sizing interval
+    long long service_us;                // Moving average of time a worker holds a connection
+    long long grows;                     // Sizing decisions that added workers
+    long long shrinks;                   // ...that retired a worker
+    long long executed;
+    long long stolen;
+    long long rejected;
+} thread_pool_stats_t;
+
+// Thread pool structure
+typedef struct thread_pool {
+    thread_pool_worker_t* workers;       // max_workers slots (allocated on the pool's node)
+    int node;                            // NUMA node the workers run on (-1 = any selected CPU)
+    int min_workers;
+    int max_workers;
+    int active_workers;                  // Slots [0, active) receive new sockets
+    int worker_span;                     // Slots [0, span) have ever run a thread (thieves scan these)
+    unsigned int next_worker;            // Round-robin cursor for new tasks
+    thread_pool_ring_t priority;         // Checked before any worker ring (cheap requests admitted under load)
+    int wake_sequence;                   // Futex word, bumped whenever sleepers should look again
+    int idle_workers;                    // Workers asleep or about to sleep
+    int busy_workers;
+    pthread_mutex_t idle_mutex;          // Sleep/wake fallback without futexes
+    pthread_cond_t work_available;
+    long long wait_total_us;             // Queue wait summed over every dequeued socket
+    long long wait_count;
+    long long rejected;                  // Sockets refused because every ring was full
+    long long service_us;                // Moving average of per-connection service time
+    pthread_t sizer;                     // Only when min_workers < max_workers
+    int sizer_started;
+    pthread_mutex_t sizer_mutex;
+    pthread_cond_t sizer_wakeup;
+    long long last_wait_us;              // Sizer's latest mean queue wait
+    long long grows;
+    long long shrinks;
     int shutdown;
 } thread_pool_t;
 
 // Thread pool management functions
-thread_pool_t* thread_pool_create(void);
+thread_pool_t* thread_pool_create(int min_workers, int max_workers);
+thread_pool_t* thread_pool_create_on_node(int min_workers, int max_workers, int node);
 int thread_pool_add_task(thread_pool_t* pool, int client_socket);
+int thread_pool_add_priority_task(thread_pool_t* pool, int client_socket);  // Served ahead of queued sockets
 void thread_pool_destroy(thread_pool_t* pool);
+void thread_pool_get_stats(thread_pool_t* pool, thread_pool_stats_t* stats);
+int thread_pool_default_workers(void);   // One worker per online core
+long long thread_pool_estimate_wait_us(thread_pool_t* pool);  // Queue wait a socket added now would see
+void thread_pool_wait_idle(thread_pool_t* pool);  // Until nothing is queued and no worker is busy
 
 // Worker thread function
 void* worker_thread(void* arg);
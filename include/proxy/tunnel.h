@@ -0,0 +1,56 @@
+#ifndef PROXY_TUNNEL_H
+#define PROXY_TUNNEL_H
+
+#include <time.h>
+
+// Tunnel Module
+// Byte relay between a client and an upstream for CONNECT requests. On Linux
+// each direction moves bytes with splice() through its own pipe; elsewhere it
+// copies through a small buffer. The same pump serves blocking worker threads
+// (through tunnel_run) and the event loop (which calls tunnel_pump on events).
+
+#define TUNNEL_IDLE_TIMEOUT 300      // Seconds without traffic before a tunnel is closed
+#define TUNNEL_BUFFER_SIZE 16384     // Copy buffer / pipe batch per direction
+
+// One direction of the tunnel (from -> to)
+typedef struct {
+    int from_fd;
+    int to_fd;
+    int pipe_fds[2];                 // splice() pipe, -1 when copying through the buffer
+    int pipe_pending;                // Bytes sitting in the pipe
+    char* buffer;                    // Copy buffer; also holds initial data in splice mode
+    int buffer_capacity;
+    int buffer_start;
+    int buffer_end;
+    int eof;                         // `from_fd` has closed
+    int shut;                        // `to_fd` has been shut down for writing
+    long long bytes;                 // Bytes delivered to `to_fd`
+} tunnel_direction_t;
+
+typedef struct {
+    tunnel_direction_t upstream;     // client -> upstream
+    tunnel_direction_t downstream;   // upstream -> client
+    time_t started;
+    time_t last_activity;
+} tunnel_t;
+
+// Totals across all tunnels since startup
+typedef struct {
+    long long tunnels_opened;
+    long long tunnels_active;
+    long long bytes_upstream;
+    long long bytes_downstream;
+} tunnel_totals_t;
+
+// Tunnel management functions. Both sockets are switched to non-blocking mode
+// and stay owned by the caller; the initial data is sent before anything read
+// from the peer (e.g. the 200 reply to the client, pipelined bytes upstream).
+tunnel_t* tunnel_create(int client_fd, int upstream_fd,
+                        const char* to_upstream, int to_upstream_len,
+                        const char* to_client, int to_client_len);
+int tunnel_pump(tunnel_t* tunnel);                  // 1 finished, 0 would block, -1 error
+int tunnel_run(tunnel_t* tunnel, int idle_timeout); // Blocking driver, 0 on clean close
+void tunnel_destroy(tunnel_t* tunnel);
+void tunnel_get_totals(tunnel_totals_t* totals);
+
+#endif // PROXY_TUNNEL_H
@@ -0,0 +1,60 @@
+#ifndef PROXY_UPGRADE_H
+#define PROXY_UPGRADE_H
+
+#include <stdint.h>
+#include "cache.h"
+#include "listener_shard.h"
+
+// Upgrade Module
+// Zero-downtime binary upgrades. A server started with --upgrade-socket PATH
+// listens for its successor on that Unix socket. A new server started with the
+// same option connects, receives the listening sockets (SCM_RIGHTS) and, if it
+// asks for them, the fresh cache entries. The old server keeps accepting until
+// the new one reports that it is serving; then it stops accepting, finishes its
+// in-flight requests (up to --drain-timeout) and exits. The listening sockets
+// never close, so no connection is refused during the switch. Unix only.
+
+#define UPGRADE_MAGIC 0x50585550        // "PUXP"
+#define UPGRADE_VERSION 3              // 2: records carry the freshness lifetime, 3: and keep_stale
+#define UPGRADE_IO_TIMEOUT_MS 10000     // Either side gives up on a peer silent this long
+#define UPGRADE_MAX_URL 8192            // Sanity limits on a handed-over cache entry
+#define UPGRADE_MAX_ENTRY (64 * 1024 * 1024)
+
+// Replies from the new server
+#define UPGRADE_WANT_CACHE 'C'          // Send the cache, then wait for UPGRADE_SERVING
+#define UPGRADE_NO_CACHE 'L'            // Listeners only
+#define UPGRADE_SERVING 'G'             // Accepting now: stop accepting and drain
+
+// First message from the old server; the listening sockets ride along as SCM_RIGHTS
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t listener_count;
+    int32_t sharded;                    // SO_REUSEPORT shards rather than one listener
+} upgrade_hello_t;
+
+// Cache entry header, followed by the URL and the cached bytes. A zero URL
+// length ends the stream. Entries arrive least recently used first.
+typedef struct {
+    uint32_t url_length;
+    uint32_t data_length;
+    int64_t timestamp;                  // When the entry was cached (keeps its age)
+    int64_t expires;                    // Fresh until then
+    int32_t keep_stale;                 // Kept past expires for revalidation
+    int32_t reserved;
+} upgrade_record_t;
+
+int upgrade_supported(void);
+
+// New server: take the listeners of the server waiting on `path`. Returns how
+// many were received, 0 if no server is waiting there, -1 on a failed handoff.
+int upgrade_takeover(const char* path, int* sharded);
+int upgrade_inherited_listener(int index);                     // -1 if not inherited
+int upgrade_receive_cache(optimized_cache_t* cache, int wanted); // Entries imported, -1 on failure
+
+// Serving is about to begin: release the previous server, if any, and wait
+// for a successor on `path` (NULL = upgrades disabled)
+void upgrade_start(const char* path, const int* listen_fds, int count, int sharded);
+void upgrade_stop(void);                // Remove the control socket unless a successor owns it
+
+#endif // PROXY_UPGRADE_H
@@ -0,0 +1,321 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // sched_getaffinity(), pthread_setaffinity_np(), syscall()
+#endif
+
+#include "../../include/proxy/affinity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Affinity Implementation
+
+#ifdef __linux__
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+static int affinity_on = 0;
+static int cpu_nodes[AFFINITY_MAX_CPUS];        // NUMA node of every CPU
+static int selected[AFFINITY_MAX_CPUS];         // Chosen CPUs, node by node
+static int selected_count = 0;
+static int nodes[AFFINITY_MAX_NODES];           // Nodes with chosen CPUs, ascending
+static int node_first[AFFINITY_MAX_NODES];      // ...and where each starts in `selected`
+static int node_cpus[AFFINITY_MAX_NODES];
+static int node_total = 0;
+
+// "0-3,8,10-11" into a CPU set; -1 on a malformed list
+static int affinity_parse_list(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = list;
+
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= AFFINITY_MAX_CPUS) {
+            return -1;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first || last >= AFFINITY_MAX_CPUS) {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET((int)cpu, set);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p && *p != '\n') {
+            return -1;
+        } else {
+            break;
+        }
+    }
+    return 0;
+}
+
+// CPU-to-node map from sysfs; without it every CPU is on node 0
+static int affinity_read_topology(void) {
+    int found = 0;
+    memset(cpu_nodes, 0, sizeof(cpu_nodes));
+
+    for (int node = 0; node < AFFINITY_MAX_NODES; node++) {
+        char path[64];
+        char list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        int ok = fgets(list, sizeof(list), file) != NULL;
+        fclose(file);
+
+        cpu_set_t set;
+        if (!ok || affinity_parse_list(list, &set) < 0) {
+            continue;
+        }
+        for (int cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpu_nodes[cpu] = node;
+            }
+        }
+        found++;
+    }
+    return found > 0 ? found : 1;
+}
+
+// Print a sorted CPU list back in range form
+static void affinity_format_cpus(const int* cpus, int count, char* buffer, size_t size) {
+    size_t used = 0;
+    buffer[0] = '\0';
+
+    for (int i = 0; i < count && used < size; i++) {
+        int last = i;
+        while (last + 1 < count && cpus[last + 1] == cpus[last] + 1) {
+            last++;
+        }
+        int written = last > i
+            ? snprintf(buffer + used, size - used, "%s%d-%d", used ? "," : "", cpus[i], cpus[last])
+            : snprintf(buffer + used, size - used, "%s%d", used ? "," : "", cpus[i]);
+        if (written < 0) {
+            break;
+        }
+        used += (size_t)written;
+        i = last;
+    }
+}
+
+int affinity_init(const char* spec) {
+    affinity_on = 0;
+    if (!spec) {
+        return 0;
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        printf("[AFFINITY] Cannot read the CPUs this process may use, not pinning\n");
+        return 0;
+    }
+
+    cpu_set_t requested;
+    if (strcmp(spec, "auto") == 0) {
+        requested = allowed;
+    } else if (affinity_parse_list(spec, &requested) < 0) {
+        printf("[AFFINITY] Invalid CPU list: %s\n", spec);
+        return -1;
+    }
+
+    int system_nodes = affinity_read_topology();
+
+    // Node-major order: a pool smaller than a node stays on one node
+    selected_count = 0;
+    node_total = 0;
+    for (int node = 0; node < AFFINITY_MAX_NODES; node++) {
+        int first = selected_count;
+        for (int cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+            if (cpu_nodes[cpu] == node && CPU_ISSET(cpu, &requested) && CPU_ISSET(cpu, &allowed)) {
+                selected[selected_count++] = cpu;
+            }
+        }
+        if (selected_count > first) {
+            nodes[node_total] = node;
+            node_first[node_total] = first;
+            node_cpus[node_total] = selected_count - first;
+            node_total++;
+        }
+    }
+
+    if (selected_count == 0) {
+        printf("[AFFINITY] None of the CPUs in \"%s\" is available to this process\n", spec);
+        return -1;
+    }
+
+    printf("[AFFINITY] Topology: %d NUMA node%s, %d of %d online CPUs selected\n",
+           system_nodes, system_nodes == 1 ? "" : "s", selected_count, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    for (int i = 0; i < node_total; i++) {
+        char cpus[512];
+        affinity_format_cpus(selected + node_first[i], node_cpus[i], cpus, sizeof(cpus));
+        printf("[AFFINITY]   node %d: CPUs %s\n", nodes[i], cpus);
+    }
+
+    affinity_on = 1;
+    return 0;
+}
+
+int affinity_enabled(void) {
+    return affinity_on;
+}
+
+int affinity_node_count(void) {
+    return affinity_on ? node_total : 0;
+}
+
+int affinity_cpu(int node, int index) {
+    if (!affinity_on || index < 0) {
+        return -1;
+    }
+
+    for (int i = 0; node >= 0 && i < node_total; i++) {
+        if (nodes[i] == node) {
+            return selected[node_first[i] + index % node_cpus[i]];
+        }
+    }
+    return selected[index % selected_count];
+}
+
+int affinity_group_node(int group) {
+    if (!affinity_on || group < 0) {
+        return -1;
+    }
+    return nodes[group % node_total];
+}
+
+int affinity_cpu_node(int cpu) {
+    if (cpu < 0 || cpu >= AFFINITY_MAX_CPUS) {
+        return -1;
+    }
+    return cpu_nodes[cpu];
+}
+
+int affinity_pin_self(int cpu, const char* role) {
+    if (cpu < 0) {
+        return -1;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        printf("[AFFINITY] Failed to pin %s to CPU %d\n", role, cpu);
+        return -1;
+    }
+
+    printf("[AFFINITY] %s pinned to CPU %d (node %d)\n", role, cpu, cpu_nodes[cpu]);
+    return 0;
+}
+
+int affinity_thread_attr(pthread_attr_t* attr, int cpu) {
+    if (cpu < 0 || pthread_attr_init(attr) != 0) {
+        return -1;
+    }
+
+    // Pinned before it runs, so the new thread's stack is first touched on its node
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_attr_setaffinity_np(attr, sizeof(set), &set) != 0) {
+        pthread_attr_destroy(attr);
+        return -1;
+    }
+    return 0;
+}
+
+void* affinity_alloc(size_t size, int node) {
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Preferred rather than bound: a full node falls back to another one
+    if (affinity_on && node >= 0 && node < AFFINITY_MAX_NODES) {
+        unsigned long mask[AFFINITY_MAX_NODES / (8 * sizeof(unsigned long))];
+        memset(mask, 0, sizeof(mask));
+        mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_mbind, memory, size, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0) {
+            printf("[AFFINITY] Could not place %zu bytes on node %d, using the default policy\n", size, node);
+        }
+    }
+    return memory;
+}
+
+void affinity_free(void* memory, size_t size) {
+    if (memory) {
+        munmap(memory, size);
+    }
+}
+
+#else
+
+// No pinning outside Linux: every thread runs wherever the scheduler puts it
+int affinity_init(const char* spec) {
+    if (spec) {
+        printf("[AFFINITY] CPU pinning is Linux only, ignoring --cpu-affinity\n");
+    }
+    return 0;
+}
+
+int affinity_enabled(void) {
+    return 0;
+}
+
+int affinity_node_count(void) {
+    return 0;
+}
+
+int affinity_cpu(int node, int index) {
+    (void)node;
+    (void)index;
+    return -1;
+}
+
+int affinity_group_node(int group) {
+    (void)group;
+    return -1;
+}
+
+int affinity_cpu_node(int cpu) {
+    (void)cpu;
+    return -1;
+}
+
+int affinity_pin_self(int cpu, const char* role) {
+    (void)cpu;
+    (void)role;
+    return -1;
+}
+
+int affinity_thread_attr(pthread_attr_t* attr, int cpu) {
+    (void)attr;
+    (void)cpu;
+    return -1;
+}
+
+void* affinity_alloc(size_t size, int node) {
+    (void)node;
+    return calloc(1, size);
+}
+
+void affinity_free(void* memory, size_t size) {
+    (void)size;
+    free(memory);
+}
+
+#endif
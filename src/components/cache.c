@@ -1,9 +1,15 @@
 #include "../../include/proxy/cache.h"
+#include "../../include/proxy/slab.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // Cache Implementation
+// Only list and table updates happen under a shard lock: copies, frees and
+// log lines are done outside it. Entries are reference counted, so one that
+// is unlinked while a reader is still sending it stays allocated until that
+// reader releases it. Each entry is a single slab block: the node, then the
+// URL, then the response bytes.
 
 // Hash function for URLs
 unsigned int cache_hash(const char* url) {
@@ -14,154 +20,420 @@ unsigned int cache_hash(const char* url) {
         hash = ((hash << 5) + hash) + c; // hash * 33 + c
     }
     
-    return hash % HASH_TABLE_SIZE;
+    return hash;
+}
+
+cache_shard_t* cache_shard_for(optimized_cache_t* cache, unsigned int hash) {
+    return &cache->shards[hash & cache->shard_mask];
+}
+
+// Bits above the shard index choose the bucket inside the shard
+static unsigned int cache_bucket(optimized_cache_t* cache, unsigned int hash) {
+    return (hash / (unsigned int)cache->shard_count) % (unsigned int)cache->bucket_count;
+}
+
+// Block holding an entry's node, key and response
+static size_t cache_entry_block(size_t url_length, int size) {
+    return sizeof(cache_node_t) + url_length + 1 + (size_t)size;
+}
+
+// Bytes an entry costs: the slab slot its block occupies
+static size_t cache_entry_charge(size_t url_length, int size) {
+    return slab_slot_size(cache_entry_block(url_length, size));
 }
 
 optimized_cache_t* cache_create(void) {
+    return cache_create_sized(CACHE_DEFAULT_MAX_BYTES, CACHE_DEFAULT_MAX_OBJECT, CACHE_SHARDS);
+}
+
+optimized_cache_t* cache_create_sized(long long max_bytes, int max_object, int shards) {
+    if (shards < 1 || (shards & (shards - 1)) != 0) {
+        printf("[CACHE] Shard count must be a power of two (got %d)\n", shards);
+        return NULL;
+    }
+    if (max_object <= 0 || max_bytes < (long long)cache_entry_charge(0, max_object)) {
+        printf("[CACHE] A %lld byte budget cannot hold a %d byte response\n", max_bytes, max_object);
+        return NULL;
+    }
+
+    // Every shard must be able to hold the largest response on its own (the
+    // URL adds to the charge too: cache_insert() refuses what still does not fit)
+    size_t largest = cache_entry_charge(0, max_object);
+    while (shards > 1 && (size_t)(max_bytes / shards) < largest) {
+        shards /= 2;
+    }
+
     optimized_cache_t* cache = malloc(sizeof(optimized_cache_t));
     if (!cache) {
         printf("[CACHE] Failed to allocate memory for cache\n");
         return NULL;
     }
     
-    // Initialize hash table
-    cache->hash_table = malloc(sizeof(cache_node_t*) * HASH_TABLE_SIZE);
-    if (!cache->hash_table) {
-        printf("[CACHE] Failed to allocate memory for hash table\n");
+    cache->shards = calloc(shards, sizeof(cache_shard_t));
+    if (!cache->shards) {
+        printf("[CACHE] Failed to allocate memory for cache shards\n");
         free(cache);
         return NULL;
     }
-    
-    // Initialize hash table slots
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        cache->hash_table[i] = NULL;
+    cache->shard_count = shards;
+    cache->shard_mask = (unsigned int)shards - 1;
+    cache->max_bytes = (size_t)max_bytes;
+    cache->max_object = max_object;
+    cache->rejected = 0;
+    cache->revalidated = 0;
+    
+    // Tables sized for the number of average entries the budget holds
+    size_t shard_bytes = cache->max_bytes / shards;
+    cache->bucket_count = CACHE_MIN_BUCKETS;
+    while ((size_t)cache->bucket_count * CACHE_BYTES_PER_BUCKET < shard_bytes && cache->bucket_count < (1 << 20)) {
+        cache->bucket_count *= 2;
     }
     
-    // Initialize LRU list
-    cache->lru_head = NULL;
-    cache->lru_tail = NULL;
-    cache->current_size = 0;
-    cache->max_size = CACHE_SIZE;
-    
-    // Initialize mutex
-    if (pthread_mutex_init(&cache->cache_mutex, NULL) != 0) {
-        printf("[CACHE] Failed to initialize cache mutex\n");
-        free(cache->hash_table);
-        free(cache);
-        return NULL;
+    // The budget is split evenly between the shards
+    for (int i = 0; i < shards; i++) {
+        cache_shard_t* shard = &cache->shards[i];
+        
+        // Initialize hash table (all slots empty)
+        shard->hash_table = calloc(cache->bucket_count, sizeof(cache_node_t*));
+        if (!shard->hash_table || pthread_mutex_init(&shard->cache_mutex, NULL) != 0) {
+            printf("[CACHE] Failed to initialize cache shard %d\n", i);
+            free(shard->hash_table);
+            while (--i >= 0) {
+                pthread_mutex_destroy(&cache->shards[i].cache_mutex);
+                free(cache->shards[i].hash_table);
+            }
+            free(cache->shards);
+            free(cache);
+            return NULL;
+        }
+        
+        // Initialize LRU list
+        shard->lru_head = NULL;
+        shard->lru_tail = NULL;
+        shard->entries = 0;
+        shard->bytes_used = 0;
+        shard->max_bytes = shard_bytes;
+        shard->evictions = 0;
     }
     
-    printf("[CACHE] Optimized cache created with hash table (O(1) lookups)\n");
+    printf("[CACHE] Optimized cache created with hash table (O(1) lookups, %d shard%s, %zu byte budget, "
+           "responses up to %d bytes)\n", shards, shards == 1 ? "" : "s", cache->max_bytes, max_object);
     return cache;
 }
 
-cache_node_t* cache_get(optimized_cache_t* cache, const char* url) {
+const cache_node_t* cache_get(optimized_cache_t* cache, const char* url, int* stale) {
+    if (stale) {
+        *stale = 0;
+    }
     if (!cache || !url) {
         return NULL;
     }
     
-    pthread_mutex_lock(&cache->cache_mutex);
-    
     unsigned int hash = cache_hash(url);
-    cache_node_t* node = cache->hash_table[hash];
+    cache_shard_t* shard = cache_shard_for(cache, hash);
+    cache_node_t* found = NULL;
+    int expired = 0;
+    
+    pthread_mutex_lock(&shard->cache_mutex);
     
     // Search in hash chain
-    while (node) {
+    for (cache_node_t* node = shard->hash_table[cache_bucket(cache, hash)]; node; node = node->next) {
         if (strcmp(node->url, url) == 0) {
-            // Check if not expired
-            time_t current_time = time(NULL);
-            if (current_time - node->timestamp < CACHE_EXPIRY_TIME) {
+            // Check if not expired (a stale entry is handed out only for revalidation)
+            expired = time(NULL) >= node->expires;
+            if (!expired || (stale && node->keep_stale)) {
                 // Move to front of LRU list
-                cache_move_to_front(cache, node);
+                cache_move_to_front(shard, node);
                 node->access_count++;
-                
-                printf("[CACHE] Cache hit for URL: %.50s...\n", url);
-                pthread_mutex_unlock(&cache->cache_mutex);
-                return node;
-            } else {
-                // Entry expired, will be removed
-                printf("[CACHE] Cache entry expired for URL: %.50s...\n", url);
-                break;
+                __atomic_add_fetch(&node->refcount, 1, __ATOMIC_RELAXED);
+                found = node;
             }
+            break;
         }
-        node = node->next;
     }
     
-    printf("[CACHE] Cache miss for URL: %.50s...\n", url);
-    pthread_mutex_unlock(&cache->cache_mutex);
-    return NULL;
+    pthread_mutex_unlock(&shard->cache_mutex);
+    
+    if (found && expired) {
+        *stale = 1;
+        printf("[CACHE] Stale entry for URL: %.50s... (revalidating)\n", url);
+    } else if (found) {
+        printf("[CACHE] Cache hit for URL: %.50s...\n", url);
+    } else if (expired) {
+        printf("[CACHE] Cache entry expired for URL: %.50s...\n", url);
+    } else {
+        printf("[CACHE] Cache miss for URL: %.50s...\n", url);
+    }
+    return found;
 }
 
-int cache_add(optimized_cache_t* cache, const char* url, const char* data, int size) {
-    if (!cache || !url || !data || size <= 0) {
-        return -1;
+int cache_contains(optimized_cache_t* cache, const char* url, int allow_stale) {
+    if (!cache || !url) {
+        return 0;
+    }
+
+    unsigned int hash = cache_hash(url);
+    cache_shard_t* shard = cache_shard_for(cache, hash);
+
+    pthread_mutex_lock(&shard->cache_mutex);
+
+    int found = 0;
+    for (cache_node_t* node = shard->hash_table[cache_bucket(cache, hash)]; node; node = node->next) {
+        if (strcmp(node->url, url) == 0) {
+            found = time(NULL) < node->expires || (allow_stale && node->keep_stale);
+            break;
+        }
     }
+
+    pthread_mutex_unlock(&shard->cache_mutex);
+    return found;
+}
+
+// Takes a node out of its chain (`link` points at it) and the LRU list
+static void cache_unlink(cache_shard_t* shard, cache_node_t** link) {
+    cache_node_t* node = *link;
+    *link = node->next;
     
-    pthread_mutex_lock(&cache->cache_mutex);
+    if (node->lru_prev) {
+        node->lru_prev->lru_next = node->lru_next;
+    } else {
+        shard->lru_head = node->lru_next;
+    }
+    if (node->lru_next) {
+        node->lru_next->lru_prev = node->lru_prev;
+    } else {
+        shard->lru_tail = node->lru_prev;
+    }
     
-    // Check if we need to make space
-    if (cache->current_size >= cache->max_size) {
-        cache_remove_lru(cache);
+    shard->entries--;
+    shard->bytes_used -= node->charge;
+}
+
+static int cache_insert(optimized_cache_t* cache, const char* url, const char* data, int size,
+                        time_t timestamp, time_t expires, int keep_stale) {
+    if (!cache || !url || !data || size <= 0) {
+        return -1;
     }
     
-    // Create new cache node
-    cache_node_t* node = malloc(sizeof(cache_node_t));
-    if (!node) {
-        printf("[CACHE] Failed to allocate memory for cache node\n");
-        pthread_mutex_unlock(&cache->cache_mutex);
+    // Refuse what the budget is not meant for before copying anything
+    if (size > cache->max_object) {
+        cache_note_rejected(cache);
+        printf("[CACHE] Not caching URL: %.50s... (%d bytes exceeds the %d byte limit)\n",
+               url, size, cache->max_object);
         return -1;
     }
     
-    // Allocate and copy URL
-    node->url = malloc(strlen(url) + 1);
-    if (!node->url) {
-        printf("[CACHE] Failed to allocate memory for URL\n");
-        free(node);
-        pthread_mutex_unlock(&cache->cache_mutex);
+    // Evicting the whole shard would not make room for an entry larger than the shard
+    size_t url_length = strlen(url);
+    size_t block_size = cache_entry_block(url_length, size);
+    unsigned int hash = cache_hash(url);
+    cache_shard_t* shard = cache_shard_for(cache, hash);
+    if (slab_slot_size(block_size) > shard->max_bytes) {
+        cache_note_rejected(cache);
+        printf("[CACHE] Not caching URL: %.50s... (%zu bytes with its key exceeds the %zu byte shard)\n",
+               url, slab_slot_size(block_size), shard->max_bytes);
         return -1;
     }
-    strcpy(node->url, url);
     
-    // Allocate and copy data
-    node->data = malloc(size);
-    if (!node->data) {
-        printf("[CACHE] Failed to allocate memory for data\n");
-        free(node->url);
-        free(node);
-        pthread_mutex_unlock(&cache->cache_mutex);
+    // Build the entry before taking the lock: one block, key and body right after the node
+    cache_node_t* node = slab_alloc(block_size);
+    if (!node) {
+        printf("[CACHE] Failed to allocate memory for cache entry\n");
         return -1;
     }
+    
+    node->url = (char*)(node + 1);
+    memcpy(node->url, url, url_length + 1);
+    node->data = node->url + url_length + 1;
     memcpy(node->data, data, size);
     
+    node->block_size = block_size;
     node->data_size = size;
-    node->timestamp = time(NULL);
+    node->timestamp = timestamp;
+    node->expires = expires;
+    node->keep_stale = keep_stale;
     node->access_count = 1;
+    node->refcount = 1;                     // The cache's own reference
+    node->charge = slab_slot_size(block_size);
+    
+    unsigned int bucket = cache_bucket(cache, hash);
+    cache_node_t* evicted = NULL;
+    size_t evicted_bytes = 0;
+    int evicted_count = 0;
+    cache_node_t* replaced = NULL;
+    
+    pthread_mutex_lock(&shard->cache_mutex);
+    
+    // A newer response for the URL takes the old entry's place
+    for (cache_node_t** link = &shard->hash_table[bucket]; *link; link = &(*link)->next) {
+        if (strcmp((*link)->url, url) == 0) {
+            replaced = *link;
+            cache_unlink(shard, link);
+            break;
+        }
+    }
+    
+    // Evict least recently used entries until the new one fits
+    while (shard->bytes_used + node->charge > shard->max_bytes && shard->lru_tail) {
+        cache_node_t* victim = cache_remove_lru(cache, shard);
+        evicted_bytes += victim->charge;
+        evicted_count++;
+        victim->next = evicted;
+        evicted = victim;
+    }
+    shard->evictions += evicted_count;
     
     // Add to hash table
-    unsigned int hash = cache_hash(url);
-    node->next = cache->hash_table[hash];
-    cache->hash_table[hash] = node;
+    node->next = shard->hash_table[bucket];
+    shard->hash_table[bucket] = node;
     
     // Add to front of LRU list
     node->lru_prev = NULL;
-    node->lru_next = cache->lru_head;
+    node->lru_next = shard->lru_head;
     
-    if (cache->lru_head) {
-        cache->lru_head->lru_prev = node;
+    if (shard->lru_head) {
+        shard->lru_head->lru_prev = node;
     } else {
-        cache->lru_tail = node;
+        shard->lru_tail = node;
     }
-    cache->lru_head = node;
+    shard->lru_head = node;
+    
+    shard->entries++;
+    shard->bytes_used += node->charge;
     
-    cache->current_size++;
+    pthread_mutex_unlock(&shard->cache_mutex);
     
-    printf("[CACHE] Added entry for URL: %.50s... (size: %d bytes)\n", url, size);
-    pthread_mutex_unlock(&cache->cache_mutex);
+    if (evicted_count > 0) {
+        printf("[CACHE] Evicted %d LRU entr%s (%zu bytes) for URL: %.50s...\n",
+               evicted_count, evicted_count == 1 ? "y" : "ies", evicted_bytes, url);
+    }
+    while (evicted) {
+        cache_node_t* next = evicted->next;
+        cache_release(evicted);
+        evicted = next;
+    }
+    cache_release(replaced);
+    long fresh_for = (long)(expires - time(NULL));
+    printf("[CACHE] %s entry for URL: %.50s... (size: %d bytes, fresh for %lds)\n",
+           replaced ? "Replaced" : "Added", url, size, fresh_for > 0 ? fresh_for : 0);
     return 0;
 }
 
-void cache_move_to_front(optimized_cache_t* cache, cache_node_t* node) {
-    if (!cache || !node || node == cache->lru_head) {
+int cache_add(optimized_cache_t* cache, const char* url, const char* data, int size, time_t expires,
+              int keep_stale) {
+    if (expires <= time(NULL) && !keep_stale) {
+        return -1;
+    }
+    return cache_insert(cache, url, data, size, time(NULL), expires, keep_stale);
+}
+
+// Keeps the entry's original age, so a handed-over entry expires when it would have
+int cache_import(optimized_cache_t* cache, const char* url, const char* data, int size, time_t timestamp,
+                 time_t expires, int keep_stale) {
+    if (expires <= time(NULL) && !keep_stale) {
+        return -1;
+    }
+    return cache_insert(cache, url, data, size, timestamp, expires, keep_stale);
+}
+
+// The response updated by the 304 replaces the entry; readers still sending the
+// old bytes keep them pinned. Without it only the freshness changes.
+int cache_refresh(optimized_cache_t* cache, const cache_node_t* node, const char* data, int size,
+                  time_t expires) {
+    if (!cache || !node) {
+        return -1;
+    }
+    
+    unsigned int hash = cache_hash(node->url);
+    cache_shard_t* shard = cache_shard_for(cache, hash);
+    int found = 0;
+    
+    pthread_mutex_lock(&shard->cache_mutex);
+    
+    // The entry may have been evicted or replaced while the origin was asked
+    for (cache_node_t* current = shard->hash_table[cache_bucket(cache, hash)]; current; current = current->next) {
+        if (current == node) {
+            if (!data) {
+                current->timestamp = time(NULL);
+                current->expires = expires;
+                cache_move_to_front(shard, current);
+            }
+            found = 1;
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&shard->cache_mutex);
+    
+    if (!found) {
+        return -1;
+    }
+    if (data && cache_insert(cache, node->url, data, size, time(NULL), expires, node->keep_stale) < 0) {
+        return -1;
+    }
+    __atomic_add_fetch(&cache->revalidated, 1, __ATOMIC_RELAXED);
+    printf("[CACHE] Revalidated entry for URL: %.50s... (fresh for %lds)\n",
+           node->url, (long)(expires - time(NULL)));
+    return 0;
+}
+
+// An entry held by cache_export() between the shard walk and its visit
+typedef struct {
+    const cache_node_t* node;
+    time_t timestamp;
+    time_t expires;
+} cache_export_pin_t;
+
+int cache_export(optimized_cache_t* cache, cache_visitor_t visit, void* context) {
+    if (!cache || !visit) {
+        return -1;
+    }
+
+    time_t current_time = time(NULL);
+    int exported = 0;
+    for (int i = 0; i < cache->shard_count && exported >= 0; i++) {
+        cache_shard_t* shard = &cache->shards[i];
+
+        // Pin the shard's entries in LRU order; the visitor may block on I/O,
+        // so it must not run while requests wait for this lock
+        pthread_mutex_lock(&shard->cache_mutex);
+        cache_export_pin_t* pinned = shard->entries > 0 ? malloc(shard->entries * sizeof(cache_export_pin_t)) : NULL;
+        if (!pinned && shard->entries > 0) {
+            pthread_mutex_unlock(&shard->cache_mutex);
+            printf("[CACHE] Failed to allocate memory for export\n");
+            return -1;
+        }
+        int pinned_count = 0;
+        for (cache_node_t* node = shard->lru_tail; node && pinned_count < shard->entries; node = node->lru_prev) {
+            if (current_time >= node->expires && !node->keep_stale) {
+                continue;
+            }
+            __atomic_add_fetch(&node->refcount, 1, __ATOMIC_RELAXED);
+            pinned[pinned_count].node = node;
+            pinned[pinned_count].timestamp = node->timestamp;
+            pinned[pinned_count].expires = node->expires;
+            pinned_count++;
+        }
+        pthread_mutex_unlock(&shard->cache_mutex);
+
+        for (int j = 0; j < pinned_count; j++) {
+            if (exported >= 0) {
+                if (visit(context, pinned[j].node, pinned[j].timestamp, pinned[j].expires) < 0) {
+                    exported = -1;
+                } else {
+                    exported++;
+                }
+            }
+            cache_release(pinned[j].node);
+        }
+        free(pinned);
+    }
+
+    return exported;
+}
+
+void cache_move_to_front(cache_shard_t* shard, cache_node_t* node) {
+    if (!shard || !node || node == shard->lru_head) {
         return; // Already at front or invalid
     }
     
@@ -172,40 +444,40 @@ void cache_move_to_front(optimized_cache_t* cache, cache_node_t* node) {
     if (node->lru_next) {
         node->lru_next->lru_prev = node->lru_prev;
     } else {
-        cache->lru_tail = node->lru_prev;
+        shard->lru_tail = node->lru_prev;
     }
     
     // Move to front
     node->lru_prev = NULL;
-    node->lru_next = cache->lru_head;
+    node->lru_next = shard->lru_head;
     
-    if (cache->lru_head) {
-        cache->lru_head->lru_prev = node;
+    if (shard->lru_head) {
+        shard->lru_head->lru_prev = node;
     } else {
-        cache->lru_tail = node;
+        shard->lru_tail = node;
     }
-    cache->lru_head = node;
+    shard->lru_head = node;
 }
 
-void cache_remove_lru(optimized_cache_t* cache) {
-    if (!cache || !cache->lru_tail) {
-        return;
+cache_node_t* cache_remove_lru(optimized_cache_t* cache, cache_shard_t* shard) {
+    if (!cache || !shard || !shard->lru_tail) {
+        return NULL;
     }
     
-    cache_node_t* lru_node = cache->lru_tail;
+    cache_node_t* lru_node = shard->lru_tail;
     
     // Remove from LRU list
     if (lru_node->lru_prev) {
         lru_node->lru_prev->lru_next = NULL;
-        cache->lru_tail = lru_node->lru_prev;
+        shard->lru_tail = lru_node->lru_prev;
     } else {
-        cache->lru_head = NULL;
-        cache->lru_tail = NULL;
+        shard->lru_head = NULL;
+        shard->lru_tail = NULL;
     }
     
     // Remove from hash table
-    unsigned int hash = cache_hash(lru_node->url);
-    cache_node_t* current = cache->hash_table[hash];
+    unsigned int bucket = cache_bucket(cache, cache_hash(lru_node->url));
+    cache_node_t* current = shard->hash_table[bucket];
     cache_node_t* prev = NULL;
     
     while (current) {
@@ -213,7 +485,7 @@ void cache_remove_lru(optimized_cache_t* cache) {
             if (prev) {
                 prev->next = current->next;
             } else {
-                cache->hash_table[hash] = current->next;
+                shard->hash_table[bucket] = current->next;
             }
             break;
         }
@@ -221,75 +493,116 @@ void cache_remove_lru(optimized_cache_t* cache) {
         current = current->next;
     }
     
-    printf("[CACHE] Removed LRU entry for URL: %.50s...\n", lru_node->url);
+    shard->entries--;
+    shard->bytes_used -= lru_node->charge;
+    return lru_node;
+}
+
+void cache_release(const cache_node_t* node) {
+    if (!node) return;
     
-    // Free memory
-    free(lru_node->url);
-    free(lru_node->data);
-    free(lru_node);
+    cache_node_t* entry = (cache_node_t*)node;
+    if (__atomic_sub_fetch(&entry->refcount, 1, __ATOMIC_ACQ_REL) > 0) {
+        return; // Still linked or still being sent
+    }
     
-    cache->current_size--;
+    slab_free(entry, entry->block_size);
 }
 
 void cache_remove_expired(optimized_cache_t* cache) {
     if (!cache) return;
     
-    pthread_mutex_lock(&cache->cache_mutex);
-    
     time_t current_time = time(NULL);
     int removed = 0;
     
-    // Check all hash table entries
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        cache_node_t* current = cache->hash_table[i];
-        cache_node_t* prev = NULL;
+    for (int s = 0; s < cache->shard_count; s++) {
+        cache_shard_t* shard = &cache->shards[s];
+        cache_node_t* expired_list = NULL;
         
-        while (current) {
-            if (current_time - current->timestamp >= CACHE_EXPIRY_TIME) {
-                // Remove expired entry
-                cache_node_t* expired = current;
-                
-                // Remove from hash chain
-                if (prev) {
-                    prev->next = current->next;
-                } else {
-                    cache->hash_table[i] = current->next;
-                }
-                
-                // Remove from LRU list
-                if (expired->lru_prev) {
-                    expired->lru_prev->lru_next = expired->lru_next;
-                } else {
-                    cache->lru_head = expired->lru_next;
-                }
-                
-                if (expired->lru_next) {
-                    expired->lru_next->lru_prev = expired->lru_prev;
+        pthread_mutex_lock(&shard->cache_mutex);
+        
+        // Check all hash table entries
+        for (int i = 0; i < cache->bucket_count; i++) {
+            cache_node_t* current = shard->hash_table[i];
+            cache_node_t* prev = NULL;
+            
+            while (current) {
+                if (current_time >= current->expires && !current->keep_stale) {
+                    // Remove expired entry
+                    cache_node_t* expired = current;
+                    
+                    // Remove from hash chain
+                    if (prev) {
+                        prev->next = current->next;
+                    } else {
+                        shard->hash_table[i] = current->next;
+                    }
+                    current = current->next;
+                    
+                    // Remove from LRU list
+                    if (expired->lru_prev) {
+                        expired->lru_prev->lru_next = expired->lru_next;
+                    } else {
+                        shard->lru_head = expired->lru_next;
+                    }
+                    
+                    if (expired->lru_next) {
+                        expired->lru_next->lru_prev = expired->lru_prev;
+                    } else {
+                        shard->lru_tail = expired->lru_prev;
+                    }
+                    
+                    // Released once the shard is unlocked
+                    expired->next = expired_list;
+                    expired_list = expired;
+                    
+                    shard->entries--;
+                    shard->bytes_used -= expired->charge;
+                    removed++;
                 } else {
-                    cache->lru_tail = expired->lru_prev;
+                    prev = current;
+                    current = current->next;
                 }
-                
-                // Free memory
-                free(expired->url);
-                free(expired->data);
-                free(expired);
-                
-                cache->current_size--;
-                removed++;
-                
-                current = prev ? prev->next : cache->hash_table[i];
-            } else {
-                prev = current;
-                current = current->next;
             }
         }
+        
+        pthread_mutex_unlock(&shard->cache_mutex);
+        
+        while (expired_list) {
+            cache_node_t* next = expired_list->next;
+            cache_release(expired_list);
+            expired_list = next;
+        }
     }
     
     if (removed > 0) {
         printf("[CACHE] Removed %d expired entries\n", removed);
     }
+}
+
+void cache_note_rejected(optimized_cache_t* cache) {
+    if (cache) {
+        __atomic_add_fetch(&cache->rejected, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void cache_get_stats(optimized_cache_t* cache, cache_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!cache) return;
     
-    pthread_mutex_unlock(&cache->cache_mutex);
+    stats->max_bytes = cache->max_bytes;
+    stats->max_object = cache->max_object;
+    stats->rejected = __atomic_load_n(&cache->rejected, __ATOMIC_RELAXED);
+    stats->revalidated = __atomic_load_n(&cache->revalidated, __ATOMIC_RELAXED);
+    for (int i = 0; i < cache->shard_count; i++) {
+        cache_shard_t* shard = &cache->shards[i];
+        
+        pthread_mutex_lock(&shard->cache_mutex);
+        stats->bytes_used += shard->bytes_used;
+        stats->entries += shard->entries;
+        stats->evictions += shard->evictions;
+        pthread_mutex_unlock(&shard->cache_mutex);
+    }
 }
 
 void cache_destroy(optimized_cache_t* cache) {
@@ -297,29 +610,32 @@ void cache_destroy(optimized_cache_t* cache) {
     
     printf("[CACHE] Destroying cache...\n");
     
-    pthread_mutex_lock(&cache->cache_mutex);
-    
-    // Free all cache entries
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        cache_node_t* current = cache->hash_table[i];
-        while (current) {
-            cache_node_t* next = current->next;
-            free(current->url);
-            free(current->data);
-            free(current);
-            current = next;
+    for (int s = 0; s < cache->shard_count; s++) {
+        cache_shard_t* shard = &cache->shards[s];
+        
+        pthread_mutex_lock(&shard->cache_mutex);
+        
+        // Drop the cache's references (entries still being sent outlive it)
+        for (int i = 0; i < cache->bucket_count; i++) {
+            cache_node_t* current = shard->hash_table[i];
+            while (current) {
+                cache_node_t* next = current->next;
+                cache_release(current);
+                current = next;
+            }
         }
+        
+        // Free hash table
+        free(shard->hash_table);
+        
+        pthread_mutex_unlock(&shard->cache_mutex);
+        
+        // Destroy mutex
+        pthread_mutex_destroy(&shard->cache_mutex);
     }
     
-    // Free hash table
-    free(cache->hash_table);
-    
-    pthread_mutex_unlock(&cache->cache_mutex);
-    
-    // Destroy mutex
-    pthread_mutex_destroy(&cache->cache_mutex);
-    
     // Free cache structure
+    free(cache->shards);
     free(cache);
     
     printf("[CACHE] Cache destroyed\n");
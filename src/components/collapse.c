@@ -0,0 +1,335 @@
+#include "../../include/proxy/collapse.h"
+#include "../../include/proxy/coroutine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <stdint.h>
+#include <unistd.h>
+#endif
+
+// Collapse Implementation
+// A fetch record lives from collapse_begin() to collapse_end(). Waiters only
+// hold its URL and id, so the leader frees it on the spot: a waiter that looks
+// again and no longer finds that id knows the fetch is over. collapse_pass()
+// turns the record into a pass marker instead; expired markers are dropped
+// whenever collapse_begin() walks their bucket.
+
+static unsigned int collapse_hash(const char* url) {
+    unsigned int hash = 5381;
+    while (*url) {
+        hash = ((hash << 5) + hash) + (unsigned char)*url++;
+    }
+    return hash % COLLAPSE_BUCKETS;
+}
+
+static collapse_fetch_t* collapse_find(collapse_t* collapse, const char* url) {
+    for (collapse_fetch_t* fetch = collapse->buckets[collapse_hash(url)]; fetch; fetch = fetch->next) {
+        if (strcmp(fetch->url, url) == 0) {
+            return fetch;
+        }
+    }
+    return NULL;
+}
+
+// Expects the mutex held
+static int collapse_in_flight(collapse_t* collapse, const char* url, unsigned long long fetch_id) {
+    collapse_fetch_t* fetch = collapse_find(collapse, url);
+    return fetch && !fetch->pass_until && fetch->id == fetch_id;
+}
+
+// Expects the mutex held; the link to the fetch record itself, or to NULL
+static collapse_fetch_t** collapse_link(collapse_t* collapse, const char* url, unsigned long long fetch_id) {
+    collapse_fetch_t** link = &collapse->buckets[collapse_hash(url)];
+    while (*link && ((*link)->pass_until || (*link)->id != fetch_id || strcmp((*link)->url, url) != 0)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// Expects the mutex held
+static void collapse_prune(collapse_t* collapse, unsigned int bucket, time_t now) {
+    collapse_fetch_t** link = &collapse->buckets[bucket];
+    while (*link) {
+        collapse_fetch_t* fetch = *link;
+        if (fetch->pass_until && fetch->pass_until <= now) {
+            *link = fetch->next;
+            free(fetch);
+        } else {
+            link = &fetch->next;
+        }
+    }
+}
+
+static void collapse_notify(collapse_t* collapse) {
+#ifdef __linux__
+    uint64_t one = 1;
+    for (int i = 0; i < collapse->wakeup_count; i++) {
+        if (write(collapse->wakeup_fds[i], &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            printf("[COLLAPSE] Failed to wake event loop (fd %d)\n", collapse->wakeup_fds[i]);
+        }
+    }
+#else
+    (void)collapse;
+#endif
+}
+
+collapse_t* collapse_create(void) {
+    collapse_t* collapse = calloc(1, sizeof(collapse_t));
+    if (!collapse) {
+        printf("[COLLAPSE] Failed to allocate memory for fetch tracking\n");
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&collapse->mutex, NULL) != 0 ||
+        pthread_cond_init(&collapse->fetch_done, NULL) != 0) {
+        printf("[COLLAPSE] Failed to initialize fetch tracking synchronization\n");
+        free(collapse);
+        return NULL;
+    }
+
+    printf("[COLLAPSE] Concurrent misses on one URL share a single upstream fetch (wait up to %ds)\n",
+           COLLAPSE_WAIT_TIMEOUT);
+    return collapse;
+}
+
+void collapse_destroy(collapse_t* collapse) {
+    if (!collapse) return;
+
+    printf("[COLLAPSE] Fetch stats: %lld fetches, %lld collapsed, %lld timeouts, %lld passed\n",
+           collapse->stats.fetches, collapse->stats.collapsed, collapse->stats.timeouts,
+           collapse->stats.passes);
+
+    for (int i = 0; i < COLLAPSE_BUCKETS; i++) {
+        collapse_fetch_t* fetch = collapse->buckets[i];
+        while (fetch) {
+            collapse_fetch_t* next = fetch->next;
+            free(fetch);
+            fetch = next;
+        }
+    }
+
+    pthread_cond_destroy(&collapse->fetch_done);
+    pthread_mutex_destroy(&collapse->mutex);
+    free(collapse);
+}
+
+int collapse_begin(collapse_t* collapse, const char* url, unsigned long long* fetch_id) {
+    if (!collapse || !url) {
+        return 1;
+    }
+
+    size_t url_length = strlen(url);
+    unsigned int bucket = collapse_hash(url);
+    pthread_mutex_lock(&collapse->mutex);
+
+    collapse_prune(collapse, bucket, time(NULL));
+    collapse_fetch_t* fetch = collapse_find(collapse, url);
+    if (fetch && fetch->pass_until) {
+        // Recently answered uncacheable: waiting would only serialize the fetches
+        collapse->stats.passes++;
+        *fetch_id = 0;
+        pthread_mutex_unlock(&collapse->mutex);
+        return 1;
+    }
+    if (fetch) {
+        fetch->waiters++;
+        collapse->stats.collapsed++;
+        *fetch_id = fetch->id;
+        pthread_mutex_unlock(&collapse->mutex);
+        printf("[COLLAPSE] Waiting on the fetch in flight for URL: %.50s...\n", url);
+        return 0;
+    }
+
+    // The URL is stored right after the record
+    fetch = malloc(sizeof(collapse_fetch_t) + url_length + 1);
+    if (!fetch) {
+        // Without a record nobody can wait on this fetch; it simply goes ahead alone
+        pthread_mutex_unlock(&collapse->mutex);
+        *fetch_id = 0;
+        return 1;
+    }
+    fetch->url = (char*)(fetch + 1);
+    memcpy(fetch->url, url, url_length + 1);
+    fetch->id = ++collapse->next_id;
+    fetch->waiters = 0;
+    fetch->pass_until = 0;
+
+    fetch->next = collapse->buckets[bucket];
+    collapse->buckets[bucket] = fetch;
+    collapse->stats.fetches++;
+    collapse->stats.in_flight++;
+    *fetch_id = fetch->id;
+
+    pthread_mutex_unlock(&collapse->mutex);
+    return 1;
+}
+
+void collapse_end(collapse_t* collapse, const char* url, unsigned long long fetch_id) {
+    if (!collapse || !url || fetch_id == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&collapse->mutex);
+
+    collapse_fetch_t** link = collapse_link(collapse, url, fetch_id);
+    collapse_fetch_t* fetch = *link;
+    if (fetch) {
+        *link = fetch->next;
+        collapse->stats.in_flight--;
+    }
+    int waiters = fetch ? fetch->waiters : 0;
+    if (waiters > 0) {
+        pthread_cond_broadcast(&collapse->fetch_done);
+        collapse_notify(collapse);
+    }
+
+    pthread_mutex_unlock(&collapse->mutex);
+
+    if (waiters > 0) {
+        printf("[COLLAPSE] Fetch done, %d waiting request%s served from it: %.50s...\n",
+               waiters, waiters == 1 ? "" : "s", url);
+    }
+    free(fetch);
+}
+
+void collapse_pass(collapse_t* collapse, const char* url, unsigned long long fetch_id) {
+    if (!collapse || !url || fetch_id == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&collapse->mutex);
+
+    collapse_fetch_t* fetch = *collapse_link(collapse, url, fetch_id);
+    int waiters = fetch ? fetch->waiters : 0;
+    if (fetch) {
+        // The record stays where it is; collapse_end() no longer finds it as a fetch
+        fetch->pass_until = time(NULL) + COLLAPSE_PASS_TTL;
+        fetch->waiters = 0;
+        collapse->stats.in_flight--;
+    }
+    if (waiters > 0) {
+        pthread_cond_broadcast(&collapse->fetch_done);
+        collapse_notify(collapse);
+    }
+
+    pthread_mutex_unlock(&collapse->mutex);
+
+    if (waiters > 0) {
+        printf("[COLLAPSE] Response not cacheable, %d waiting request%s fetch on their own: %.50s...\n",
+               waiters, waiters == 1 ? "" : "s", url);
+    }
+}
+
+// A coroutine handler parks on its scheduler (woken through the eventfd)
+// instead of holding the whole scheduler thread on the condition variable
+static int collapse_wait_parked(collapse_t* collapse, const char* url, unsigned long long fetch_id) {
+    time_t deadline = time(NULL) + COLLAPSE_WAIT_TIMEOUT;
+
+    while (collapse_pending(collapse, url, fetch_id)) {
+        int remaining = (int)(deadline - time(NULL));
+        if (remaining <= 0 || !coroutine_wait_wakeup(remaining * 1000)) {
+            if (!collapse_pending(collapse, url, fetch_id)) {
+                break;
+            }
+            collapse_note_timeout(collapse);
+            printf("[COLLAPSE] Timed out waiting on the fetch for URL: %.50s...\n", url);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int collapse_wait(collapse_t* collapse, const char* url, unsigned long long fetch_id) {
+    if (!collapse || !url) {
+        return 0;
+    }
+    if (coroutine_active()) {
+        return collapse_wait_parked(collapse, url, fetch_id);
+    }
+
+    struct timespec deadline;
+    deadline.tv_sec = time(NULL) + COLLAPSE_WAIT_TIMEOUT;
+    deadline.tv_nsec = 0;
+    int status = 0;
+
+    pthread_mutex_lock(&collapse->mutex);
+    while (collapse_in_flight(collapse, url, fetch_id)) {
+        if (pthread_cond_timedwait(&collapse->fetch_done, &collapse->mutex, &deadline) == ETIMEDOUT &&
+            collapse_in_flight(collapse, url, fetch_id)) {
+            collapse->stats.timeouts++;
+            printf("[COLLAPSE] Timed out waiting on the fetch for URL: %.50s...\n", url);
+            status = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&collapse->mutex);
+    return status;
+}
+
+int collapse_pending(collapse_t* collapse, const char* url, unsigned long long fetch_id) {
+    if (!collapse || !url) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&collapse->mutex);
+    int pending = collapse_in_flight(collapse, url, fetch_id);
+    pthread_mutex_unlock(&collapse->mutex);
+    return pending;
+}
+
+int collapse_active(collapse_t* collapse, const char* url) {
+    if (!collapse || !url) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&collapse->mutex);
+    collapse_fetch_t* fetch = collapse_find(collapse, url);
+    int active = fetch && !fetch->pass_until;
+    pthread_mutex_unlock(&collapse->mutex);
+    return active;
+}
+
+void collapse_note_timeout(collapse_t* collapse) {
+    if (!collapse) return;
+
+    pthread_mutex_lock(&collapse->mutex);
+    collapse->stats.timeouts++;
+    pthread_mutex_unlock(&collapse->mutex);
+}
+
+int collapse_add_wakeup(collapse_t* collapse, int fd) {
+    if (!collapse) return -1;
+
+    pthread_mutex_lock(&collapse->mutex);
+    int added = collapse->wakeup_count < COLLAPSE_MAX_WAKEUPS;
+    if (added) {
+        collapse->wakeup_fds[collapse->wakeup_count++] = fd;
+    }
+    pthread_mutex_unlock(&collapse->mutex);
+    return added ? 0 : -1;
+}
+
+void collapse_remove_wakeup(collapse_t* collapse, int fd) {
+    if (!collapse) return;
+
+    pthread_mutex_lock(&collapse->mutex);
+    for (int i = 0; i < collapse->wakeup_count; i++) {
+        if (collapse->wakeup_fds[i] == fd) {
+            collapse->wakeup_fds[i] = collapse->wakeup_fds[--collapse->wakeup_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&collapse->mutex);
+}
+
+void collapse_get_stats(collapse_t* collapse, collapse_stats_t* stats) {
+    if (!collapse || !stats) return;
+
+    pthread_mutex_lock(&collapse->mutex);
+    *stats = collapse->stats;
+    pthread_mutex_unlock(&collapse->mutex);
+}
@@ -1,5 +1,6 @@
 #include "../../include/proxy/connection_pool.h"
 #include "../../include/proxy/platform.h"
+#include "../../include/proxy/proxy_server.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #ifndef _WIN32
 #include <unistd.h>
 #include <netdb.h>
+#include <poll.h>
 #endif
 
 // Connection Pool Implementation
@@ -40,28 +42,10 @@ connection_pool_t* connection_pool_create(int max_size) {
 }
 
 int create_persistent_connection(char* host_address, int port_number) {
-    int remote_socket = socket(AF_INET, SOCK_STREAM, 0);
+    // Staggered non-blocking attempts across every address, bounded by the connect deadline
+    int remote_socket = connector_connect(host_address, port_number, proxy_config.connect_timeout_ms);
     if (remote_socket < 0) {
-        print_socket_error("Failed to create socket for remote server");
-        return -1;
-    }
-    
-    struct hostent* host = gethostbyname(host_address);
-    if (host == NULL) {
-        printf("[CONN] Failed to resolve host: %s\n", host_address);
-        socket_close(remote_socket);
-        return -1;
-    }
-    
-    struct sockaddr_in remote_address;
-    bzero(&remote_address, sizeof(remote_address));
-    remote_address.sin_family = AF_INET;
-    remote_address.sin_port = htons(port_number);
-    bcopy(host->h_addr, &remote_address.sin_addr.s_addr, host->h_length);
-    
-    if (connect(remote_socket, (struct sockaddr*)&remote_address, sizeof(remote_address)) < 0) {
-        print_socket_error("Failed to connect to remote server");
-        socket_close(remote_socket);
+        printf("[CONN] Failed to connect to %s:%d\n", host_address, port_number);
         return -1;
     }
     
@@ -70,7 +54,26 @@ int create_persistent_connection(char* host_address, int port_number) {
     return remote_socket;
 }
 
-int connection_pool_get(connection_pool_t* pool, char* host, int port) {
+// An idle keep-alive connection must have nothing to read: readable means the
+// upstream closed it (or sent bytes nobody asked for), so it cannot be reused
+static int connection_is_idle(int socket_fd) {
+#ifdef _WIN32
+    fd_set read_set;
+    struct timeval no_wait = { 0, 0 };
+
+    FD_ZERO(&read_set);
+    FD_SET(socket_fd, &read_set);
+    return select(0, &read_set, NULL, NULL, &no_wait) == 0;
+#else
+    struct pollfd pfd;
+    pfd.fd = socket_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) == 0;
+#endif
+}
+
+int connection_pool_acquire(connection_pool_t* pool, char* host, int port) {
     if (!pool || !host) {
         return -1;
     }
@@ -86,8 +89,9 @@ int connection_pool_get(connection_pool_t* pool, char* host, int port) {
         if (conn->socket_fd > 0 && !conn->in_use &&
             strcmp(conn->host, host) == 0 && conn->port == port) {
             
-            // Check if connection hasn't timed out
-            if (current_time - conn->last_used < CONNECTION_TIMEOUT) {
+            // Check if connection hasn't timed out or been closed by the server
+            if (current_time - conn->last_used < CONNECTION_TIMEOUT &&
+                connection_is_idle(conn->socket_fd)) {
                 conn->in_use = 1;
                 conn->last_used = current_time;
                 
@@ -97,8 +101,8 @@ int connection_pool_get(connection_pool_t* pool, char* host, int port) {
                 pthread_mutex_unlock(&pool->pool_mutex);
                 return conn->socket_fd;
             } else {
-                // Connection timed out, close it
-                printf("[CONN_POOL] Connection to %s:%d timed out, closing socket %d\n", 
+                // Connection timed out or went stale, close it
+                printf("[CONN_POOL] Connection to %s:%d timed out or closed, closing socket %d\n", 
                        host, port, conn->socket_fd);
                 socket_close(conn->socket_fd);
                 memset(conn, 0, sizeof(connection_pool_entry_t));
@@ -109,6 +113,18 @@ int connection_pool_get(connection_pool_t* pool, char* host, int port) {
     }
     
     pthread_mutex_unlock(&pool->pool_mutex);
+    return -1;
+}
+
+int connection_pool_get(connection_pool_t* pool, char* host, int port) {
+    if (!pool || !host) {
+        return -1;
+    }
+    
+    int pooled_socket = connection_pool_acquire(pool, host, port);
+    if (pooled_socket > 0) {
+        return pooled_socket;
+    }
     
     // No suitable connection found, create a new one
     int new_socket = create_persistent_connection(host, port);
@@ -128,7 +144,16 @@ void connection_pool_return(connection_pool_t* pool, int socket_fd, char* host,
     pthread_mutex_lock(&pool->pool_mutex);
     
     if (!keep_alive) {
-        // Connection doesn't support keep-alive, close it
+        // Connection doesn't support keep-alive, drop its pool slot and close it
+        for (int i = 0; i < MAX_POOL_SIZE; i++) {
+            connection_pool_entry_t* conn = &pool->connections[i];
+            if (conn->socket_fd == socket_fd) {
+                memset(conn, 0, sizeof(connection_pool_entry_t));
+                conn->socket_fd = -1;
+                pool->pool_size--;
+                break;
+            }
+        }
         socket_close(socket_fd);
         printf("[CONN_POOL] Connection to %s:%d closed (no keep-alive)\n", host, port);
         pthread_mutex_unlock(&pool->pool_mutex);
@@ -140,7 +165,11 @@ void connection_pool_return(connection_pool_t* pool, int socket_fd, char* host,
         connection_pool_entry_t* conn = &pool->connections[i];
         
         if (conn->socket_fd == socket_fd) {
-            // Connection already in pool, just mark as not in use
+            // Connection already in pool, just mark as not in use (the descriptor
+            // number is the key, so the slot takes the returning connection's target)
+            strncpy(conn->host, host, sizeof(conn->host) - 1);
+            conn->host[sizeof(conn->host) - 1] = '\0';
+            conn->port = port;
             conn->in_use = 0;
             conn->last_used = time(NULL);
             
@@ -0,0 +1,431 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // getnameinfo(), NI_NUMERICHOST
+#endif
+
+#include "../../include/proxy/connector.h"
+#include "../../include/proxy/proxy_server.h"
+#include "../../include/proxy/coroutine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <time.h>
+#endif
+
+// Connector Implementation
+
+// Failure history for one upstream address (port independent)
+typedef struct {
+    int family;
+    unsigned char address[16];
+    int failures;                // Consecutive failed connects
+    time_t last_failure;
+    long long successes;
+} address_stats_t;
+
+static address_stats_t address_stats[CONNECTOR_MAX_TRACKED];
+static int address_stats_count = 0;
+static pthread_mutex_t address_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long long connector_now_ms(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+static int address_key(const struct sockaddr_storage* address, unsigned char* key) {
+    if (address->ss_family == AF_INET6) {
+        memcpy(key, &((const struct sockaddr_in6*)address)->sin6_addr, 16);
+        return 16;
+    }
+    memcpy(key, &((const struct sockaddr_in*)address)->sin_addr, 4);
+    return 4;
+}
+
+static void address_format(const struct sockaddr_storage* address, socklen_t length, char* text, size_t size) {
+    if (getnameinfo((const struct sockaddr*)address, length, text, (socklen_t)size,
+                    NULL, 0, NI_NUMERICHOST) != 0) {
+        snprintf(text, size, "?");
+    }
+}
+
+static void address_set_port(struct sockaddr_storage* address, int port) {
+    if (address->ss_family == AF_INET6) {
+        ((struct sockaddr_in6*)address)->sin6_port = htons(port);
+    } else {
+        ((struct sockaddr_in*)address)->sin_port = htons(port);
+    }
+}
+
+// Stats slot for an address (caller holds the mutex). When the table is full the
+// entry with the oldest failure is recycled; never-failed addresses go first.
+static address_stats_t* address_stats_find(const struct sockaddr_storage* address, int create) {
+    unsigned char key[16];
+    int key_length = address_key(address, key);
+
+    for (int i = 0; i < address_stats_count; i++) {
+        if (address_stats[i].family == address->ss_family &&
+            memcmp(address_stats[i].address, key, key_length) == 0) {
+            return &address_stats[i];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    address_stats_t* slot;
+    if (address_stats_count < CONNECTOR_MAX_TRACKED) {
+        slot = &address_stats[address_stats_count++];
+    } else {
+        slot = &address_stats[0];
+        for (int i = 1; i < CONNECTOR_MAX_TRACKED; i++) {
+            if (address_stats[i].last_failure < slot->last_failure) {
+                slot = &address_stats[i];
+            }
+        }
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->family = address->ss_family;
+    memcpy(slot->address, key, key_length);
+    return slot;
+}
+
+static void connector_record(const struct sockaddr_storage* address, int success) {
+    pthread_mutex_lock(&address_stats_mutex);
+    address_stats_t* stats = address_stats_find(address, !success);
+    if (stats) {
+        if (success) {
+            stats->failures = 0;
+            stats->successes++;
+        } else {
+            stats->failures++;
+            stats->last_failure = time(NULL);
+        }
+    }
+    pthread_mutex_unlock(&address_stats_mutex);
+}
+
+// Recent consecutive failures for an address, 0 when it is considered healthy
+static int connector_penalty(const struct sockaddr_storage* address, time_t now) {
+    pthread_mutex_lock(&address_stats_mutex);
+    address_stats_t* stats = address_stats_find(address, 0);
+    int penalty = 0;
+    if (stats && stats->failures > 0 && now - stats->last_failure < CONNECT_PENALTY_WINDOW) {
+        penalty = stats->failures;
+    }
+    pthread_mutex_unlock(&address_stats_mutex);
+    return penalty;
+}
+
+// Attempt order: alternate IPv6/IPv4 (IPv6 first), then move addresses that failed
+// recently behind the healthy ones, fewest failures first
+static void connector_order(const resolver_result_t* resolved, resolver_result_t* ordered) {
+    int v6[RESOLVER_MAX_ADDRESSES], v4[RESOLVER_MAX_ADDRESSES];
+    int v6_count = 0, v4_count = 0;
+    for (int i = 0; i < resolved->count; i++) {
+        if (resolved->addresses[i].ss_family == AF_INET6) {
+            v6[v6_count++] = i;
+        } else {
+            v4[v4_count++] = i;
+        }
+    }
+
+    int penalties[RESOLVER_MAX_ADDRESSES];
+    time_t now = time(NULL);
+    ordered->count = 0;
+    for (int i = 0; i < v6_count || i < v4_count; i++) {
+        int pair[2] = { i < v6_count ? v6[i] : -1, i < v4_count ? v4[i] : -1 };
+        for (int j = 0; j < 2; j++) {
+            if (pair[j] < 0) {
+                continue;
+            }
+            int slot = ordered->count++;
+            ordered->addresses[slot] = resolved->addresses[pair[j]];
+            ordered->lengths[slot] = resolved->lengths[pair[j]];
+            penalties[slot] = connector_penalty(&ordered->addresses[slot], now);
+        }
+    }
+
+    // Stable insertion sort on the penalty keeps the family interleaving among equals
+    for (int i = 1; i < ordered->count; i++) {
+        struct sockaddr_storage address = ordered->addresses[i];
+        socklen_t length = ordered->lengths[i];
+        int penalty = penalties[i];
+        int j = i - 1;
+        while (j >= 0 && penalties[j] > penalty) {
+            ordered->addresses[j + 1] = ordered->addresses[j];
+            ordered->lengths[j + 1] = ordered->lengths[j];
+            penalties[j + 1] = penalties[j];
+            j--;
+        }
+        ordered->addresses[j + 1] = address;
+        ordered->lengths[j + 1] = length;
+        penalties[j + 1] = penalty;
+    }
+}
+
+static void connector_attempt_failed(connector_t* connector, connect_attempt_t* attempt) {
+    char text[64];
+    int index = attempt->address_index;
+    address_format(&connector->addresses.addresses[index], connector->addresses.lengths[index],
+                   text, sizeof(text));
+    printf("[CONN] Connect to %s:%d via %s failed\n", connector->host, connector->port, text);
+    connector_record(&connector->addresses.addresses[index], 0);
+}
+
+// Attempts still pending when another wins (after their head start) or at the deadline
+// count as failures, so blackholed addresses move to the back next time
+static void connector_penalize_pending(connector_t* connector, long long now, connect_attempt_t* winner) {
+    for (int i = 0; i < connector->attempt_count; i++) {
+        connect_attempt_t* attempt = &connector->attempts[i];
+        if (attempt != winner && attempt->socket_fd >= 0 &&
+            now - attempt->started_ms >= CONNECT_ATTEMPT_DELAY_MS) {
+            connector_attempt_failed(connector, attempt);
+        }
+    }
+}
+
+// Start the next address that accepts a non-blocking connect. Returns 1 if one is in flight.
+static int connector_launch(connector_t* connector, long long now) {
+    while (connector->attempt_count < connector->addresses.count) {
+        connect_attempt_t* attempt = &connector->attempts[connector->attempt_count];
+        attempt->address_index = connector->attempt_count;
+        attempt->started_ms = now;
+        attempt->socket_fd = -1;
+        connector->attempt_count++;
+
+        struct sockaddr_storage* address = &connector->addresses.addresses[attempt->address_index];
+        int socket_fd = socket(address->ss_family, SOCK_STREAM, 0);
+        if (socket_fd < 0) {
+            continue;
+        }
+        if (socket_set_nonblocking(socket_fd) < 0) {
+            socket_close(socket_fd);
+            continue;
+        }
+
+        if (connect(socket_fd, (struct sockaddr*)address,
+                    connector->addresses.lengths[attempt->address_index]) < 0) {
+#ifdef _WIN32
+            int pending = (get_socket_error() == WSAEWOULDBLOCK);
+#else
+            int pending = (get_socket_error() == EINPROGRESS);
+#endif
+            if (!pending) {
+                socket_close(socket_fd);
+                connector_attempt_failed(connector, attempt);
+                continue;
+            }
+        }
+
+        attempt->socket_fd = socket_fd;
+        connector->next_attempt_ms = now + CONNECT_ATTEMPT_DELAY_MS;
+        return 1;
+    }
+    return 0;
+}
+
+// 1 when the non-blocking connect completed, 0 while pending, -1 if it failed
+static int connector_check_attempt(int socket_fd) {
+#ifdef _WIN32
+    fd_set write_set, error_set;
+    struct timeval no_wait = { 0, 0 };
+    FD_ZERO(&write_set);
+    FD_ZERO(&error_set);
+    FD_SET(socket_fd, &write_set);
+    FD_SET(socket_fd, &error_set);
+    if (select(0, NULL, &write_set, &error_set, &no_wait) <= 0) {
+        return 0;
+    }
+    if (FD_ISSET(socket_fd, &error_set)) {
+        return -1;
+    }
+#else
+    struct pollfd pfd;
+    pfd.fd = socket_fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) <= 0) {
+        return 0;
+    }
+#endif
+
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, (char*)&error, &length) < 0 || error != 0) {
+        return -1;
+    }
+    return 1;
+}
+
+connector_t* connector_start(const char* host, int port, int timeout_ms) {
+    connector_t* connector = calloc(1, sizeof(connector_t));
+    if (!connector) {
+        printf("[CONN] Failed to allocate memory for connect to %s:%d\n", host, port);
+        return NULL;
+    }
+    snprintf(connector->host, sizeof(connector->host), "%s", host);
+    connector->port = port;
+
+    resolver_result_t resolved;
+    if (resolver_lookup(dns_resolver, host, &resolved) < 0) {
+        printf("[CONN] Failed to resolve host: %s\n", host);
+        free(connector);
+        return NULL;
+    }
+
+    connector_order(&resolved, &connector->addresses);
+    for (int i = 0; i < connector->addresses.count; i++) {
+        address_set_port(&connector->addresses.addresses[i], port);
+    }
+
+    long long now = connector_now_ms();
+    connector->deadline_ms = now + (timeout_ms > 0 ? timeout_ms : CONNECT_TIMEOUT_MS);
+    if (!connector_launch(connector, now)) {
+        printf("[CONN] No address of %s:%d accepted a connection\n", host, port);
+        free(connector);
+        return NULL;
+    }
+    return connector;
+}
+
+int connector_poll(connector_t* connector, int* socket_fd) {
+    long long now = connector_now_ms();
+    int in_flight = 0;
+
+    for (int i = 0; i < connector->attempt_count; i++) {
+        connect_attempt_t* attempt = &connector->attempts[i];
+        if (attempt->socket_fd < 0) {
+            continue;
+        }
+
+        int status = connector_check_attempt(attempt->socket_fd);
+        if (status > 0) {
+            char text[64];
+            int index = attempt->address_index;
+            address_format(&connector->addresses.addresses[index], connector->addresses.lengths[index],
+                           text, sizeof(text));
+            printf("[CONN] Connected to %s:%d via %s in %lld ms (attempt %d of %d)\n",
+                   connector->host, connector->port, text, now - attempt->started_ms,
+                   i + 1, connector->addresses.count);
+            connector_record(&connector->addresses.addresses[index], 1);
+            connector_penalize_pending(connector, now, attempt);
+
+            *socket_fd = attempt->socket_fd;
+            attempt->socket_fd = -1;
+            return 1;
+        }
+        if (status < 0) {
+            connector_attempt_failed(connector, attempt);
+            socket_close(attempt->socket_fd);
+            attempt->socket_fd = -1;
+            connector->next_attempt_ms = now;   // A failure hands the turn to the next address at once
+            continue;
+        }
+        in_flight++;
+    }
+
+    if (now >= connector->deadline_ms) {
+        connector_penalize_pending(connector, now, NULL);
+        printf("[CONN] Connect to %s:%d timed out after %d of %d addresses\n",
+               connector->host, connector->port, connector->attempt_count, connector->addresses.count);
+        return -1;
+    }
+
+    if ((in_flight == 0 || now >= connector->next_attempt_ms) && connector_launch(connector, now)) {
+        in_flight++;
+    }
+    if (in_flight == 0) {
+        printf("[CONN] All %d addresses of %s:%d failed\n",
+               connector->addresses.count, connector->host, connector->port);
+        return -1;
+    }
+    return 0;
+}
+
+int connector_timeout_ms(connector_t* connector) {
+    long long now = connector_now_ms();
+    long long wake = connector->deadline_ms;
+    if (connector->attempt_count < connector->addresses.count && connector->next_attempt_ms < wake) {
+        wake = connector->next_attempt_ms;
+    }
+    return wake > now ? (int)(wake - now) : 0;
+}
+
+int connector_sockets(connector_t* connector, int* fds, int max) {
+    int count = 0;
+    for (int i = 0; i < connector->attempt_count && count < max; i++) {
+        if (connector->attempts[i].socket_fd >= 0) {
+            fds[count++] = connector->attempts[i].socket_fd;
+        }
+    }
+    return count;
+}
+
+void connector_destroy(connector_t* connector) {
+    if (!connector) return;
+
+    for (int i = 0; i < connector->attempt_count; i++) {
+        if (connector->attempts[i].socket_fd >= 0) {
+            socket_close(connector->attempts[i].socket_fd);
+        }
+    }
+    free(connector);
+}
+
+// Wait until one of the attempts changes state or `timeout_ms` passes
+static void connector_wait(const int* fds, int count, int timeout_ms) {
+#ifdef _WIN32
+    fd_set write_set, error_set;
+    FD_ZERO(&write_set);
+    FD_ZERO(&error_set);
+    for (int i = 0; i < count; i++) {
+        FD_SET(fds[i], &write_set);
+        FD_SET(fds[i], &error_set);
+    }
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    select(0, NULL, &write_set, &error_set, &timeout);
+#else
+    struct pollfd pfds[RESOLVER_MAX_ADDRESSES];
+    for (int i = 0; i < count; i++) {
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLOUT;
+        pfds[i].revents = 0;
+    }
+    coroutine_poll(pfds, count, timeout_ms);
+#endif
+}
+
+int connector_connect(const char* host, int port, int timeout_ms) {
+    connector_t* connector = connector_start(host, port, timeout_ms);
+    if (!connector) {
+        return -1;
+    }
+
+    int socket_fd = -1;
+    int status;
+    while ((status = connector_poll(connector, &socket_fd)) == 0) {
+        int fds[RESOLVER_MAX_ADDRESSES];
+        int count = connector_sockets(connector, fds, RESOLVER_MAX_ADDRESSES);
+        connector_wait(fds, count, connector_timeout_ms(connector));
+    }
+    connector_destroy(connector);
+
+    if (status < 0 || socket_set_blocking(socket_fd) < 0) {
+        if (status > 0) {
+            socket_close(socket_fd);
+        }
+        return -1;
+    }
+    return socket_fd;
+}
@@ -0,0 +1,845 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // MAP_ANONYMOUS, clock_gettime(), pthread_sigmask()
+#endif
+
+#include "../../include/proxy/coroutine.h"
+#include "../../include/proxy/proxy_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Coroutine Implementation
+
+#ifdef __linux__
+
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+// The scheduler running on this thread (NULL on threads that are not schedulers)
+static pthread_key_t scheduler_key;
+static pthread_once_t scheduler_key_once = PTHREAD_ONCE_INIT;
+
+static void scheduler_key_create(void) {
+    pthread_key_create(&scheduler_key, NULL);
+}
+
+static coroutine_t* coroutine_current(void) {
+    pthread_once(&scheduler_key_once, scheduler_key_create);
+    coroutine_scheduler_t* scheduler = pthread_getspecific(scheduler_key);
+    return scheduler ? scheduler->current : NULL;
+}
+
+static long long coroutine_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int coroutines_supported(void) {
+    return 1;
+}
+
+// Stacks: one guard page below each, recycled through a per-scheduler cache
+
+static char* coroutine_stack_get(coroutine_scheduler_t* scheduler) {
+    if (scheduler->stack_cache_count > 0) {
+        return scheduler->stack_cache[--scheduler->stack_cache_count];
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    char* stack = mmap(NULL, COROUTINE_STACK_SIZE + page, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+        return NULL;
+    }
+    // An overflowing handler faults on the guard page instead of corrupting a neighbour
+    if (mprotect(stack, page, PROT_NONE) < 0) {
+        munmap(stack, COROUTINE_STACK_SIZE + page);
+        return NULL;
+    }
+    return stack;
+}
+
+static void coroutine_stack_put(coroutine_scheduler_t* scheduler, char* stack) {
+    if (scheduler->stack_cache_count < COROUTINE_STACK_CACHE) {
+        scheduler->stack_cache[scheduler->stack_cache_count++] = stack;
+        return;
+    }
+    munmap(stack, COROUTINE_STACK_SIZE + sysconf(_SC_PAGESIZE));
+}
+
+// Timer min-heap on deadline_ms
+
+static void timer_swap(coroutine_scheduler_t* scheduler, int a, int b) {
+    coroutine_t* first = scheduler->timers[a];
+    scheduler->timers[a] = scheduler->timers[b];
+    scheduler->timers[b] = first;
+    scheduler->timers[a]->timer_index = a;
+    scheduler->timers[b]->timer_index = b;
+}
+
+static void timer_sift(coroutine_scheduler_t* scheduler, int index) {
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (scheduler->timers[parent]->deadline_ms <= scheduler->timers[index]->deadline_ms) {
+            break;
+        }
+        timer_swap(scheduler, parent, index);
+        index = parent;
+    }
+
+    while (1) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < scheduler->timer_count &&
+            scheduler->timers[left]->deadline_ms < scheduler->timers[smallest]->deadline_ms) {
+            smallest = left;
+        }
+        if (right < scheduler->timer_count &&
+            scheduler->timers[right]->deadline_ms < scheduler->timers[smallest]->deadline_ms) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        timer_swap(scheduler, smallest, index);
+        index = smallest;
+    }
+}
+
+static int timer_add(coroutine_scheduler_t* scheduler, coroutine_t* co) {
+    if (scheduler->timer_count == scheduler->timer_capacity) {
+        int capacity = scheduler->timer_capacity ? scheduler->timer_capacity * 2 : 64;
+        coroutine_t** timers = realloc(scheduler->timers, capacity * sizeof(coroutine_t*));
+        if (!timers) {
+            return -1;
+        }
+        scheduler->timers = timers;
+        scheduler->timer_capacity = capacity;
+    }
+
+    co->timer_index = scheduler->timer_count++;
+    scheduler->timers[co->timer_index] = co;
+    timer_sift(scheduler, co->timer_index);
+    return 0;
+}
+
+static void timer_remove(coroutine_scheduler_t* scheduler, coroutine_t* co) {
+    int index = co->timer_index;
+    if (index < 0) {
+        return;
+    }
+
+    co->timer_index = -1;
+    scheduler->timer_count--;
+    if (index != scheduler->timer_count) {
+        scheduler->timers[index] = scheduler->timers[scheduler->timer_count];
+        scheduler->timers[index]->timer_index = index;
+        timer_sift(scheduler, index);
+    }
+}
+
+// Scheduling
+
+static void coroutine_make_ready(coroutine_scheduler_t* scheduler, coroutine_t* co) {
+    if (!co->waiting) {
+        return;
+    }
+
+    co->waiting = 0;
+    co->next_ready = NULL;
+    if (scheduler->ready_tail) {
+        scheduler->ready_tail->next_ready = co;
+    } else {
+        scheduler->ready_head = co;
+    }
+    scheduler->ready_tail = co;
+}
+
+// Give the thread back to the scheduler until an event, a timer or a wakeup readies `co`
+static void coroutine_park(coroutine_t* co) {
+    co->waiting = 1;
+    swapcontext(&co->context, &co->scheduler->main_context);
+}
+
+static void coroutine_entry(void) {
+    coroutine_t* co = coroutine_current();
+    handle_client_request(co->client_socket);
+    co->finished = 1;
+    // Returning resumes the scheduler through uc_link
+}
+
+static void coroutine_listener_set(coroutine_scheduler_t* scheduler, int paused) {
+    if (scheduler->listener_paused == paused) {
+        return;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+    // Schedulers sharing one listener: wake one of them per connection, not all
+    event.events |= EPOLLEXCLUSIVE;
+#endif
+    event.data.ptr = NULL;
+    if (epoll_ctl(scheduler->epoll_fd, paused ? EPOLL_CTL_DEL : EPOLL_CTL_ADD,
+                  scheduler->listen_fd, &event) == 0) {
+        scheduler->listener_paused = paused;
+    }
+}
+
+static void coroutine_free(coroutine_scheduler_t* scheduler, coroutine_t* co) {
+    if (co->prev) {
+        co->prev->next = co->next;
+    } else {
+        scheduler->live = co->next;
+    }
+    if (co->next) {
+        co->next->prev = co->prev;
+    }
+    scheduler->live_count--;
+
+    coroutine_stack_put(scheduler, co->stack);
+    free(co);
+
+    if (scheduler->listener_paused && scheduler->running && !scheduler->draining &&
+        scheduler->live_count < COROUTINE_MAX_PER_SCHEDULER) {
+        coroutine_listener_set(scheduler, 0);
+    }
+}
+
+static int coroutine_spawn(coroutine_scheduler_t* scheduler, int client_socket) {
+    coroutine_t* co = calloc(1, sizeof(coroutine_t));
+    if (!co) {
+        return -1;
+    }
+
+    co->stack = coroutine_stack_get(scheduler);
+    if (!co->stack || getcontext(&co->context) < 0) {
+        if (co->stack) {
+            coroutine_stack_put(scheduler, co->stack);
+        }
+        free(co);
+        return -1;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    co->context.uc_stack.ss_sp = co->stack + page;
+    co->context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+    co->context.uc_link = &scheduler->main_context;
+    makecontext(&co->context, coroutine_entry, 0);
+
+    co->scheduler = scheduler;
+    co->client_socket = client_socket;
+    co->timer_index = -1;
+    co->next = scheduler->live;
+    if (scheduler->live) {
+        scheduler->live->prev = co;
+    }
+    scheduler->live = co;
+    scheduler->live_count++;
+    scheduler->spawned++;
+
+    // New handlers start on the next pass over the ready queue
+    co->waiting = 1;
+    coroutine_make_ready(scheduler, co);
+    return 0;
+}
+
+static void coroutine_run_ready(coroutine_scheduler_t* scheduler) {
+    // Only what is ready now: handlers readied meanwhile wait for the next pass,
+    // so a busy connection cannot starve the event poll
+    coroutine_t* co = scheduler->ready_head;
+    coroutine_t* last = scheduler->ready_tail;
+    while (co) {
+        coroutine_t* next = co->next_ready;
+        scheduler->ready_head = next;
+        if (!next) {
+            scheduler->ready_tail = NULL;
+        }
+
+        scheduler->current = co;
+        scheduler->switches++;
+        swapcontext(&scheduler->main_context, &co->context);
+        scheduler->current = NULL;
+
+        int was_last = co == last;
+        if (co->finished) {
+            coroutine_free(scheduler, co);
+        }
+        if (was_last) {
+            break;
+        }
+        co = scheduler->ready_head;
+    }
+}
+
+static void coroutine_accept_clients(coroutine_scheduler_t* scheduler) {
+    // Bounded batch per wakeup; the level-triggered listener reports any remainder
+    for (int i = 0; i < COROUTINE_MAX_EVENTS; i++) {
+        if (scheduler->live_count >= COROUTINE_MAX_PER_SCHEDULER) {
+            printf("[CORO] %d handlers live, pausing accepts\n", scheduler->live_count);
+            coroutine_listener_set(scheduler, 1);
+            return;
+        }
+
+        struct sockaddr_in client_address;
+        socklen_t client_length = sizeof(client_address);
+        int client_fd = accept(scheduler->listen_fd, (struct sockaddr*)&client_address, &client_length);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                print_socket_error("Accept failed");
+            }
+            return;
+        }
+
+        if (coroutine_spawn(scheduler, client_fd) < 0) {
+            printf("[CORO] Failed to start handler for socket %d\n", client_fd);
+            socket_close(client_fd);
+            continue;
+        }
+
+        printf("[CORO] Client connected from %s:%d (socket %d, %d live)\n",
+               inet_ntoa(client_address.sin_addr), ntohs(client_address.sin_port),
+               client_fd, scheduler->live_count);
+    }
+}
+
+// A lookup or fetch finished (or the scheduler is stopping): every waiter looks again
+static void coroutine_resume_waiters(coroutine_scheduler_t* scheduler) {
+    uint64_t completions;
+    while (read(scheduler->wakeup_fd, &completions, sizeof(completions)) > 0) {
+    }
+
+    coroutine_t* co = scheduler->wakeup_waiters;
+    scheduler->wakeup_waiters = NULL;
+    while (co) {
+        coroutine_t* next = co->next_waiter;
+        co->wakeup_wait = 0;
+        co->next_waiter = NULL;
+        coroutine_make_ready(scheduler, co);
+        co = next;
+    }
+}
+
+static void coroutine_expire_timers(coroutine_scheduler_t* scheduler) {
+    long long now = coroutine_now_ms();
+    while (scheduler->timer_count > 0 && scheduler->timers[0]->deadline_ms <= now) {
+        coroutine_t* co = scheduler->timers[0];
+        timer_remove(scheduler, co);
+        coroutine_make_ready(scheduler, co);
+    }
+}
+
+static int coroutine_next_timeout(coroutine_scheduler_t* scheduler) {
+    if (scheduler->ready_head) {
+        return 0;
+    }
+    if (scheduler->timer_count == 0) {
+        return 1000;
+    }
+
+    long long wait = scheduler->timers[0]->deadline_ms - coroutine_now_ms();
+    if (wait < 0) {
+        return 0;
+    }
+    return wait > 1000 ? 1000 : (int)wait;
+}
+
+coroutine_scheduler_t* coroutine_scheduler_create(int listen_fd) {
+    coroutine_scheduler_t* scheduler = calloc(1, sizeof(coroutine_scheduler_t));
+    if (!scheduler) {
+        printf("[CORO] Failed to allocate memory for scheduler\n");
+        return NULL;
+    }
+
+    scheduler->listen_fd = listen_fd;
+    scheduler->listener_paused = 1;
+    scheduler->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (scheduler->epoll_fd < 0) {
+        print_socket_error("Failed to create epoll instance");
+        free(scheduler);
+        return NULL;
+    }
+
+    // Several schedulers may take turns accepting from the same listener
+    if (socket_set_nonblocking(listen_fd) < 0) {
+        print_socket_error("Failed to make listening socket non-blocking");
+        close(scheduler->epoll_fd);
+        free(scheduler);
+        return NULL;
+    }
+    coroutine_listener_set(scheduler, 0);
+    if (scheduler->listener_paused) {
+        print_socket_error("Failed to register listening socket");
+        close(scheduler->epoll_fd);
+        free(scheduler);
+        return NULL;
+    }
+
+    // Resolver and fetch completions and stop requests arrive on an eventfd
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &scheduler->wakeup_fd;
+    scheduler->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (scheduler->wakeup_fd < 0 ||
+        epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_ADD, scheduler->wakeup_fd, &event) < 0 ||
+        resolver_add_wakeup(dns_resolver, scheduler->wakeup_fd) < 0 ||
+        collapse_add_wakeup(request_collapse, scheduler->wakeup_fd) < 0) {
+        print_socket_error("Failed to set up resolver wakeups");
+        if (scheduler->wakeup_fd >= 0) {
+            resolver_remove_wakeup(dns_resolver, scheduler->wakeup_fd);
+            close(scheduler->wakeup_fd);
+        }
+        close(scheduler->epoll_fd);
+        free(scheduler);
+        return NULL;
+    }
+
+    printf("[CORO] Scheduler created (epoll fd %d, listening socket %d, %d KB stacks)\n",
+           scheduler->epoll_fd, listen_fd, COROUTINE_STACK_SIZE / 1024);
+    return scheduler;
+}
+
+// Draining: give up the listener (another process accepts from it now) and
+// report once the last handler has finished
+static int coroutine_drained(coroutine_scheduler_t* scheduler) {
+    if (!scheduler->listener_released) {
+        coroutine_listener_set(scheduler, 1);
+        scheduler->listener_released = 1;
+        printf("[CORO] Draining %d live handlers\n", scheduler->live_count);
+    }
+    return scheduler->live_count == 0;
+}
+
+void coroutine_scheduler_run(coroutine_scheduler_t* scheduler) {
+    if (!scheduler) return;
+
+    pthread_once(&scheduler_key_once, scheduler_key_create);
+    pthread_setspecific(scheduler_key, scheduler);
+
+    struct epoll_event events[COROUTINE_MAX_EVENTS];
+    scheduler->running = 1;
+
+    printf("[CORO] Scheduler running\n");
+
+    while (scheduler->running) {
+        coroutine_run_ready(scheduler);
+        if (scheduler->draining && coroutine_drained(scheduler)) {
+            break;
+        }
+
+        int count = epoll_wait(scheduler->epoll_fd, events, COROUTINE_MAX_EVENTS,
+                               coroutine_next_timeout(scheduler));
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            print_socket_error("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                coroutine_accept_clients(scheduler);
+            } else if (events[i].data.ptr == &scheduler->wakeup_fd) {
+                coroutine_resume_waiters(scheduler);
+            } else {
+                coroutine_make_ready(scheduler, (coroutine_t*)events[i].data.ptr);
+            }
+        }
+
+        coroutine_expire_timers(scheduler);
+    }
+
+    scheduler->running = 0;
+    printf("[CORO] Scheduler stopped (%d handlers live)\n", scheduler->live_count);
+}
+
+void coroutine_scheduler_stop(coroutine_scheduler_t* scheduler) {
+    if (!scheduler) return;
+
+    uint64_t one = 1;
+    scheduler->running = 0;
+    if (write(scheduler->wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        print_socket_error("Failed to wake scheduler");
+    }
+}
+
+void coroutine_scheduler_drain(coroutine_scheduler_t* scheduler) {
+    if (!scheduler) return;
+
+    uint64_t one = 1;
+    scheduler->draining = 1;
+    if (write(scheduler->wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        print_socket_error("Failed to wake scheduler");
+    }
+}
+
+// Call once the scheduler has stopped; live handlers finish on the calling thread
+void coroutine_scheduler_destroy(coroutine_scheduler_t* scheduler) {
+    if (!scheduler) return;
+
+    printf("[CORO] Destroying scheduler (%d handlers live, %lld spawned, %lld switches)...\n",
+           scheduler->live_count, scheduler->spawned, scheduler->switches);
+
+    pthread_setspecific(scheduler_key, scheduler);
+    coroutine_listener_set(scheduler, 1);
+
+    // With the scheduler stopped every wait fails at once, so each handler
+    // unwinds through its error path and releases what it holds
+    scheduler->running = 0;
+    while (scheduler->live) {
+        for (coroutine_t* co = scheduler->live; co; co = co->next) {
+            timer_remove(scheduler, co);
+            coroutine_make_ready(scheduler, co);
+        }
+        scheduler->wakeup_waiters = NULL;
+        coroutine_run_ready(scheduler);
+    }
+    pthread_setspecific(scheduler_key, NULL);
+
+    while (scheduler->stack_cache_count > 0) {
+        munmap(scheduler->stack_cache[--scheduler->stack_cache_count],
+               COROUTINE_STACK_SIZE + sysconf(_SC_PAGESIZE));
+    }
+
+    resolver_remove_wakeup(dns_resolver, scheduler->wakeup_fd);
+    collapse_remove_wakeup(request_collapse, scheduler->wakeup_fd);
+    close(scheduler->wakeup_fd);
+    close(scheduler->epoll_fd);
+    free(scheduler->timers);
+    free(scheduler);
+
+    printf("[CORO] Scheduler destroyed\n");
+}
+
+// Schedulers started by coroutine_schedulers_run(), reachable for draining
+// until each is destroyed
+static pthread_mutex_t group_lock = PTHREAD_MUTEX_INITIALIZER;
+static coroutine_scheduler_t* group[MAX_WORKER_THREADS];
+static int group_count = 0;
+
+static void group_leave(coroutine_scheduler_t* scheduler) {
+    pthread_mutex_lock(&group_lock);
+    for (int i = 0; i < group_count; i++) {
+        if (group[i] == scheduler) {
+            group[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&group_lock);
+}
+
+void coroutine_schedulers_drain(void) {
+    pthread_mutex_lock(&group_lock);
+    for (int i = 0; i < group_count; i++) {
+        coroutine_scheduler_drain(group[i]);
+    }
+    pthread_mutex_unlock(&group_lock);
+}
+
+static void* coroutine_scheduler_thread(void* arg) {
+    coroutine_scheduler_t* scheduler = (coroutine_scheduler_t*)arg;
+    coroutine_scheduler_run(scheduler);
+    group_leave(scheduler);
+    coroutine_scheduler_destroy(scheduler);
+    return NULL;
+}
+
+void coroutine_schedulers_run(int listen_fd, int count) {
+    coroutine_scheduler_t* schedulers[MAX_WORKER_THREADS];
+    pthread_t threads[MAX_WORKER_THREADS];
+    int started = 0;
+
+    if (count < 1) {
+        count = 1;
+    }
+    if (count > MAX_WORKER_THREADS) {
+        count = MAX_WORKER_THREADS;
+    }
+
+    for (int i = 0; i < count; i++) {
+        schedulers[i] = coroutine_scheduler_create(listen_fd);
+        if (!schedulers[i]) {
+            count = i;
+            break;
+        }
+    }
+    if (count == 0) {
+        printf("[CORO] Failed to create any scheduler\n");
+        return;
+    }
+
+    pthread_mutex_lock(&group_lock);
+    memcpy(group, schedulers, count * sizeof(coroutine_scheduler_t*));
+    group_count = count;
+    pthread_mutex_unlock(&group_lock);
+
+    // Extra scheduler threads leave shutdown signals to the calling thread
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    for (started = 1; started < count; started++) {
+        pthread_attr_t attr;
+        int cpu = affinity_cpu(-1, started);
+        int pinned = affinity_thread_attr(&attr, cpu) == 0;
+        int created = pthread_create(&threads[started], pinned ? &attr : NULL,
+                                     coroutine_scheduler_thread, schedulers[started]);
+        if (pinned) {
+            pthread_attr_destroy(&attr);
+        }
+        if (created != 0) {
+            printf("[CORO] Failed to start scheduler thread %d\n", started);
+            break;
+        }
+        if (pinned) {
+            printf("[AFFINITY] Scheduler %d pinned to CPU %d (node %d)\n", started, cpu, affinity_cpu_node(cpu));
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    affinity_pin_self(affinity_cpu(-1, 0), "Scheduler 0");
+
+    for (int i = started; i < count; i++) {
+        group_leave(schedulers[i]);
+        coroutine_scheduler_destroy(schedulers[i]);
+    }
+
+    printf("[CORO] %d schedulers running on socket %d\n", started, listen_fd);
+    coroutine_scheduler_run(schedulers[0]);
+
+    // A draining group ends on its own: each thread returns once its handlers are done
+    int draining = schedulers[0]->draining;
+    for (int i = 1; i < started; i++) {
+        if (!draining) {
+            coroutine_scheduler_stop(schedulers[i]);
+        }
+        pthread_join(threads[i], NULL);
+    }
+    group_leave(schedulers[0]);
+    coroutine_scheduler_destroy(schedulers[0]);
+}
+
+// Blocking-call replacements
+
+int coroutine_active(void) {
+    return coroutine_current() != NULL;
+}
+
+int coroutine_poll(struct pollfd* fds, int count, int timeout_ms) {
+    coroutine_t* co = coroutine_current();
+    if (!co || timeout_ms == 0) {
+        return poll(fds, count, timeout_ms);
+    }
+
+    coroutine_scheduler_t* scheduler = co->scheduler;
+    long long deadline = timeout_ms > 0 ? coroutine_now_ms() + timeout_ms : 0;
+
+    while (1) {
+        int ready = poll(fds, count, 0);
+        if (ready != 0) {
+            return ready;
+        }
+        if (!scheduler->running) {
+            errno = ECANCELED;
+            return -1;
+        }
+        if (deadline && coroutine_now_ms() >= deadline) {
+            return 0;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (fds[i].fd < 0 || fds[i].events == 0) {
+                continue;
+            }
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = (fds[i].events & POLLIN ? EPOLLIN : 0) | (fds[i].events & POLLOUT ? EPOLLOUT : 0);
+            event.data.ptr = co;
+            if (epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_ADD, fds[i].fd, &event) < 0 && errno == EEXIST) {
+                epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_MOD, fds[i].fd, &event);
+            }
+        }
+        co->deadline_ms = deadline;
+        if (deadline) {
+            timer_add(scheduler, co);
+        }
+
+        coroutine_park(co);
+
+        timer_remove(scheduler, co);
+        for (int i = 0; i < count; i++) {
+            if (fds[i].fd >= 0 && fds[i].events != 0) {
+                epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_DEL, fds[i].fd, NULL);
+            }
+        }
+    }
+}
+
+// Wait for the socket, honoring the timeout a blocking call would have used (0 = none)
+static int coroutine_wait_socket(socket_t sock, short events, int timeout_option) {
+    struct timeval timeout;
+    socklen_t length = sizeof(timeout);
+    int timeout_ms = -1;
+    if (getsockopt(sock, SOL_SOCKET, timeout_option, &timeout, &length) == 0 &&
+        (timeout.tv_sec > 0 || timeout.tv_usec > 0)) {
+        timeout_ms = (int)(timeout.tv_sec * 1000 + timeout.tv_usec / 1000);
+    }
+
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = events;
+    pfd.revents = 0;
+    int ready = coroutine_poll(&pfd, 1, timeout_ms);
+    if (ready == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return ready < 0 ? -1 : 0;
+}
+
+int coroutine_recv(socket_t sock, char* buf, int len, int flags) {
+    if (!coroutine_active()) {
+        return recv(sock, buf, len, flags);
+    }
+
+    while (1) {
+        int received = recv(sock, buf, len, flags | MSG_DONTWAIT);
+        if (received >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            return received;
+        }
+        if (errno != EINTR && coroutine_wait_socket(sock, POLLIN, SO_RCVTIMEO) < 0) {
+            return -1;
+        }
+    }
+}
+
+int coroutine_send(socket_t sock, const char* buf, int len, int flags) {
+    if (!coroutine_active()) {
+        return send(sock, buf, len, flags);
+    }
+
+    // A blocking send() returns once everything is queued; keep that contract
+    int sent = 0;
+    while (sent < len) {
+        int n = send(sock, buf + sent, len - sent, flags | MSG_DONTWAIT);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK) ||
+            coroutine_wait_socket(sock, POLLOUT, SO_SNDTIMEO) < 0) {
+            return sent > 0 ? sent : -1;
+        }
+    }
+    return sent;
+}
+
+int coroutine_wait_wakeup(int timeout_ms) {
+    coroutine_t* co = coroutine_current();
+    if (!co) {
+        return 0;
+    }
+
+    coroutine_scheduler_t* scheduler = co->scheduler;
+    if (!scheduler->running) {
+        return 0;
+    }
+
+    co->wakeup_wait = 1;
+    co->next_waiter = scheduler->wakeup_waiters;
+    scheduler->wakeup_waiters = co;
+    co->deadline_ms = coroutine_now_ms() + (timeout_ms > 0 ? timeout_ms : 0);
+    timer_add(scheduler, co);
+
+    coroutine_park(co);
+
+    timer_remove(scheduler, co);
+    if (co->wakeup_wait) {
+        // Timed out: leave the waiter list
+        coroutine_t** link = &scheduler->wakeup_waiters;
+        while (*link && *link != co) {
+            link = &(*link)->next_waiter;
+        }
+        if (*link) {
+            *link = co->next_waiter;
+        }
+        co->wakeup_wait = 0;
+        co->next_waiter = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+#else
+
+// Stackful handlers rely on epoll and ucontext; other platforms keep using the thread pool
+int coroutines_supported(void) {
+    return 0;
+}
+
+coroutine_scheduler_t* coroutine_scheduler_create(int listen_fd) {
+    (void)listen_fd;
+    return NULL;
+}
+
+void coroutine_scheduler_run(coroutine_scheduler_t* scheduler) {
+    (void)scheduler;
+}
+
+void coroutine_scheduler_stop(coroutine_scheduler_t* scheduler) {
+    (void)scheduler;
+}
+
+void coroutine_scheduler_drain(coroutine_scheduler_t* scheduler) {
+    (void)scheduler;
+}
+
+void coroutine_scheduler_destroy(coroutine_scheduler_t* scheduler) {
+    (void)scheduler;
+}
+
+void coroutine_schedulers_run(int listen_fd, int count) {
+    (void)listen_fd;
+    (void)count;
+}
+
+void coroutine_schedulers_drain(void) {
+}
+
+int coroutine_active(void) {
+    return 0;
+}
+
+int coroutine_recv(socket_t sock, char* buf, int len, int flags) {
+    return recv(sock, buf, len, flags);
+}
+
+int coroutine_send(socket_t sock, const char* buf, int len, int flags) {
+    return send(sock, buf, len, flags);
+}
+
+int coroutine_wait_wakeup(int timeout_ms) {
+    (void)timeout_ms;
+    return 0;
+}
+
+#ifndef _WIN32
+int coroutine_poll(struct pollfd* fds, int count, int timeout_ms) {
+    return poll(fds, count, timeout_ms);
+}
+#endif
+
+#endif
@@ -0,0 +1,1157 @@
+#include "../../include/proxy/event_loop.h"
+#include "../../include/proxy/proxy_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Event Loop Implementation
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+int event_loop_supported(void) {
+    return 1;
+}
+
+event_loop_t* event_loop_create(int listen_fd) {
+    event_loop_t* loop = malloc(sizeof(event_loop_t));
+    if (!loop) {
+        printf("[EVENT] Failed to allocate memory for event loop\n");
+        return NULL;
+    }
+
+    loop->epoll_fd = epoll_create1(0);
+    if (loop->epoll_fd < 0) {
+        print_socket_error("Failed to create epoll instance");
+        free(loop);
+        return NULL;
+    }
+
+    loop->listen_fd = listen_fd;
+    loop->running = 0;
+    loop->draining = 0;
+    loop->active_connections = 0;
+    loop->connections = NULL;
+    loop->graveyard = NULL;
+    loop->last_sweep = time(NULL);
+    loop->connects_pending = 0;
+
+    // Listener stays level-triggered so a full accept backlog is never missed
+    if (socket_set_nonblocking(listen_fd) < 0) {
+        print_socket_error("Failed to make listening socket non-blocking");
+        close(loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0) {
+        print_socket_error("Failed to register listening socket");
+        close(loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+    loop->listening = 1;
+
+    // Resolver and fetch completions arrive on an eventfd so waiting connections can resume
+    loop->wakeup_handle.conn = NULL;
+    loop->wakeup_handle.is_upstream = 0;
+    loop->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = &loop->wakeup_handle;
+    if (loop->wakeup_fd < 0 || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wakeup_fd, &event) < 0 ||
+        resolver_add_wakeup(dns_resolver, loop->wakeup_fd) < 0 ||
+        collapse_add_wakeup(request_collapse, loop->wakeup_fd) < 0) {
+        print_socket_error("Failed to set up resolver wakeups");
+        if (loop->wakeup_fd >= 0) {
+            resolver_remove_wakeup(dns_resolver, loop->wakeup_fd);
+            close(loop->wakeup_fd);
+        }
+        close(loop->epoll_fd);
+        free(loop);
+        return NULL;
+    }
+
+    printf("[EVENT] Event loop created (epoll fd %d, listening socket %d)\n",
+           loop->epoll_fd, listen_fd);
+    return loop;
+}
+
+static int event_register(event_loop_t* loop, int fd, event_handle_t* handle) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = handle;
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void event_release_output(event_conn_t* conn) {
+    if (conn->out_owned && conn->out_data) {
+        free(conn->out_data);
+    }
+    conn->out_data = NULL;
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    conn->out_owned = 0;
+}
+
+// Unpin a cache entry served by this connection
+static void event_release_cached(event_conn_t* conn) {
+    cache_release(conn->cached);
+    conn->cached = NULL;
+    conn->cached_body_length = 0;
+}
+
+// Hand the upstream socket back; a reusable one leaves this reactor before going to the pool
+static void event_release_upstream(event_loop_t* loop, event_conn_t* conn, int reusable) {
+    if (conn->upstream_fd < 0) {
+        return;
+    }
+
+    if (reusable && epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->upstream_fd, NULL) < 0) {
+        reusable = 0;
+    }
+    connection_pool_return(connection_pool, conn->upstream_fd, conn->host, conn->port, reusable);
+    conn->upstream_fd = -1;
+}
+
+// Requests waiting on this connection's fetch look in the cache again
+static void event_end_fetch(event_conn_t* conn) {
+    if (conn->fetch_leader) {
+        collapse_end(request_collapse, conn->cache_key, conn->fetch_id);
+        conn->fetch_leader = 0;
+    }
+}
+
+// The response will not be cached: waiters fetch on their own instead of after us
+static void event_pass_fetch(event_conn_t* conn) {
+    if (conn->fetch_leader) {
+        collapse_pass(request_collapse, conn->cache_key, conn->fetch_id);
+        conn->fetch_leader = 0;
+    }
+}
+
+static void event_conn_close(event_loop_t* loop, event_conn_t* conn) {
+    if (conn->closed) {
+        return;
+    }
+    conn->closed = 1;
+    conn->state = EV_STATE_DONE;
+    event_end_fetch(conn);
+
+    tunnel_destroy(conn->tunnel);
+    conn->tunnel = NULL;
+    connector_destroy(conn->connector);
+    conn->connector = NULL;
+    event_release_upstream(loop, conn, 0);
+    socket_close(conn->client_fd);
+    event_release_output(conn);
+    event_release_cached(conn);
+    free(conn->capture);
+    conn->capture = NULL;
+
+    // Unlink from the live list; memory is freed once the current batch is done
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        loop->connections = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+
+    conn->prev = NULL;
+    conn->next = loop->graveyard;
+    loop->graveyard = conn;
+    loop->active_connections--;
+}
+
+static void event_free_graveyard(event_loop_t* loop) {
+    while (loop->graveyard) {
+        event_conn_t* next = loop->graveyard->next;
+        free(loop->graveyard);
+        loop->graveyard = next;
+    }
+}
+
+static void event_respond_error(event_conn_t* conn, int error_code, const char* message) {
+    char response[1024];
+    int length = format_error_response(response, sizeof(response), error_code, message);
+
+    event_release_output(conn);
+    conn->out_data = malloc(length);
+    if (!conn->out_data) {
+        conn->state = EV_STATE_DONE;
+        return;
+    }
+    memcpy(conn->out_data, response, length);
+    conn->out_len = length;
+    conn->out_owned = 1;
+    conn->state = EV_STATE_WRITE_CLIENT;
+}
+
+static void event_upstream_failed(event_conn_t* conn) {
+    printf("[EVENT] Upstream %s:%d failed (client socket %d)\n",
+           conn->host, conn->port, conn->client_fd);
+    event_release_upstream(NULL, conn, 0);
+    event_respond_error(conn, 502, "Bad Gateway");
+}
+
+// Returns 1 when all pending output is flushed, 0 if the client would block, -1 on error
+static int event_flush_client(event_conn_t* conn) {
+    while (conn->out_sent < conn->out_len) {
+        int sent = send(conn->client_fd, conn->out_data + conn->out_sent,
+                        conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            conn->out_sent += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        return -1;
+    }
+
+    event_release_output(conn);
+    return 1;
+}
+
+static void event_capture(event_conn_t* conn, const char* data, int length) {
+    if (!conn->capture_enabled) {
+        return;
+    }
+
+    if (conn->capture_len + length > proxy_config.cache_max_object) {
+        // Too large for the cache, keep streaming without a copy
+        cache_note_rejected(optimized_cache);
+        free(conn->capture);
+        conn->capture = NULL;
+        conn->capture_len = 0;
+        conn->capture_cap = 0;
+        conn->capture_enabled = 0;
+        return;
+    }
+
+    if (conn->capture_len + length > conn->capture_cap) {
+        int new_cap = conn->capture_cap ? conn->capture_cap : EVENT_RELAY_BUFFER_SIZE;
+        while (new_cap < conn->capture_len + length) {
+            new_cap *= 2;
+        }
+        if (new_cap > proxy_config.cache_max_object) {
+            new_cap = proxy_config.cache_max_object;
+        }
+
+        char* grown = realloc(conn->capture, new_cap);
+        if (!grown) {
+            free(conn->capture);
+            conn->capture = NULL;
+            conn->capture_len = 0;
+            conn->capture_cap = 0;
+            conn->capture_enabled = 0;
+            return;
+        }
+        conn->capture = grown;
+        conn->capture_cap = new_cap;
+    }
+
+    memcpy(conn->capture + conn->capture_len, data, length);
+    conn->capture_len += length;
+}
+
+// Serve a cache entry, rewriting its Connection header since this reactor closes after each response.
+// Only the head is copied; the connection keeps the entry pinned until its body has been sent.
+static int event_serve_cached(event_conn_t* conn, const cache_node_t* cached, int head_only) {
+    http_response_framer_t framer;
+    http_response_framer_init(&framer, 0);
+
+    int head_length = http_response_parse_head(&framer, cached->data, cached->data_size);
+    if (head_length <= 0) {
+        return -1;
+    }
+
+    int head_capacity = MAX_RESPONSE_HEAD_SIZE + 64;
+    char* out = malloc(head_capacity);
+    if (!out) {
+        return -1;
+    }
+
+    int head_out = http_response_rewrite_head(cached->data, head_length, out, head_capacity, "close");
+    if (head_out < 0) {
+        free(out);
+        return -1;
+    }
+
+    conn->out_data = out;
+    conn->out_len = head_out;
+    conn->out_sent = 0;
+    conn->out_owned = 1;
+    conn->cached = cached;
+    conn->cached_body_offset = head_length;
+    conn->cached_body_length = head_only ? 0 : cached->data_size - head_length;
+    conn->state = EV_STATE_WRITE_CLIENT;
+    return 0;
+}
+
+// Every connect attempt reports through the upstream handle; the winner keeps the registration
+static void event_register_attempts(event_loop_t* loop, event_conn_t* conn) {
+    connector_t* connector = conn->connector;
+    while (conn->connector_registered < connector->attempt_count) {
+        int attempt_fd = connector->attempts[conn->connector_registered++].socket_fd;
+        if (attempt_fd >= 0 && event_register(loop, attempt_fd, &conn->upstream_handle) < 0) {
+            print_socket_error("Failed to register upstream connect attempt");
+        }
+    }
+}
+
+// Connection pool stage: reuse an idle upstream socket or start a non-blocking connect.
+// Non-idempotent requests and retries always get a fresh connection.
+static int event_connect_upstream(event_loop_t* loop, event_conn_t* conn) {
+    int upstream_fd = -1;
+    if (conn->idempotent && !conn->upstream_retried) {
+        upstream_fd = connection_pool_acquire(connection_pool, conn->host, conn->port);
+    }
+    conn->upstream_reused = upstream_fd > 0;
+    conn->upstream_request_sent = 0;
+
+    if (upstream_fd <= 0) {
+        // New connections need the host name resolved without blocking the reactor
+        if (resolver_lookup_nowait(dns_resolver, conn->host, NULL) > 0) {
+            conn->state = EV_STATE_RESOLVING;
+            return 1;
+        }
+
+        conn->connector = connector_start(conn->host, conn->port, proxy_config.connect_timeout_ms);
+        if (!conn->connector) {
+            event_upstream_failed(conn);
+            return 1;
+        }
+        conn->connector_registered = 0;
+        event_register_attempts(loop, conn);
+        loop->connects_pending = 1;
+        conn->state = EV_STATE_CONNECTING;
+        return 1;
+    }
+
+    socket_set_nonblocking(upstream_fd);
+    conn->upstream_fd = upstream_fd;
+    if (event_register(loop, upstream_fd, &conn->upstream_handle) < 0) {
+        print_socket_error("Failed to register upstream socket");
+        event_upstream_failed(conn);
+        return 1;
+    }
+
+    conn->state = conn->tunnel_request ? EV_STATE_TUNNEL : EV_STATE_SEND_UPSTREAM;
+    return 1;
+}
+
+// A pooled connection the server already closed fails before any response byte
+// arrives; idempotent requests are then replayed once on a new connection
+static int event_retry_upstream(event_loop_t* loop, event_conn_t* conn) {
+    if (!conn->upstream_reused || conn->upstream_retried || !conn->idempotent ||
+        conn->head_received > 0) {
+        return 0;
+    }
+
+    printf("[EVENT] Pooled connection to %s:%d was stale, retrying on a new connection\n",
+           conn->host, conn->port);
+    event_release_upstream(NULL, conn, 0);
+    conn->upstream_retried = 1;
+    event_connect_upstream(loop, conn);
+    return 1;
+}
+
+static int event_dispatch_request(event_loop_t* loop, event_conn_t* conn) {
+    // The request body follows the rebuilt head
+    if (conn->body_len > 0) {
+        memcpy(conn->upstream_request + conn->upstream_request_len,
+               conn->request + conn->head_len, conn->body_len);
+        conn->upstream_request_len += conn->body_len;
+    }
+    return event_connect_upstream(loop, conn);
+}
+
+static int event_start_request(event_loop_t* loop, event_conn_t* conn) {
+    if (!validate_http_request(conn->request, conn->head_len)) {
+        printf("[EVENT] Invalid HTTP request on socket %d\n", conn->client_fd);
+        event_respond_error(conn, 400, "Bad Request");
+        return 1;
+    }
+
+    struct ParsedRequest* request = ParsedRequest_create();
+    if (!request) {
+        event_respond_error(conn, 500, "Internal Server Error");
+        return 1;
+    }
+
+    if (ParsedRequest_parse(request, conn->request, conn->head_len) < 0 ||
+        !request->method || !request->path) {
+        printf("[EVENT] Failed to parse HTTP request on socket %d\n", conn->client_fd);
+        ParsedRequest_destroy(request);
+        event_respond_error(conn, 400, "Bad Request");
+        return 1;
+    }
+
+    if (is_status_request(request)) {
+        char response[STATUS_RESPONSE_SIZE];
+        int length = format_status_response(response, sizeof(response));
+        ParsedRequest_destroy(request);
+
+        conn->out_data = malloc(length);
+        if (!conn->out_data) {
+            conn->state = EV_STATE_DONE;
+            return 1;
+        }
+        memcpy(conn->out_data, response, length);
+        conn->out_len = length;
+        conn->out_sent = 0;
+        conn->out_owned = 1;
+        conn->state = EV_STATE_WRITE_CLIENT;
+        return 1;
+    }
+
+    // CONNECT: open a fresh connection to the authority-form target and tunnel to it
+    if (strcmp(request->method, "CONNECT") == 0) {
+        int valid = extract_connect_target(request->path, conn->host, sizeof(conn->host), &conn->port) == 0;
+        ParsedRequest_destroy(request);
+        if (!valid) {
+            printf("[EVENT] Invalid CONNECT target on socket %d\n", conn->client_fd);
+            event_respond_error(conn, 400, "Bad Request");
+            return 1;
+        }
+        conn->tunnel_request = 1;
+        return event_connect_upstream(loop, conn);
+    }
+
+    if (!request->host || strlen(request->host) >= sizeof(conn->host) ||
+        extract_host_port(request->host, conn->host, &conn->port) < 0) {
+        printf("[EVENT] Failed to parse HTTP request on socket %d\n", conn->client_fd);
+        ParsedRequest_destroy(request);
+        event_respond_error(conn, 400, "Bad Request");
+        return 1;
+    }
+
+    long long body_length = request_body_length(request);
+    if (body_length < 0) {
+        ParsedRequest_destroy(request);
+        if (body_length == HTTP_BODY_LENGTH_TRANSFER_CODED) {
+            event_respond_error(conn, 411, "Length Required");
+        } else {
+            event_respond_error(conn, 400, "Bad Request");
+        }
+        return 1;
+    }
+
+    // Cache stage: only GET responses are stored; HEAD is answered from the same entry
+    int head_request = strcmp(request->method, "HEAD") == 0;
+    int cache_mode = http_request_cache_mode(request);
+    conn->cacheable = (cache_mode & HTTP_CACHE_STORE) != 0;
+    conn->idempotent = head_request || strcmp(request->method, "GET") == 0 ||
+                       strcmp(request->method, "PUT") == 0 || strcmp(request->method, "DELETE") == 0;
+    snprintf(conn->cache_key, sizeof(conn->cache_key), "%s", request->path);
+    int stale = 0;
+    const cache_node_t* cached = (cache_mode & HTTP_CACHE_LOOKUP) ? cache_get(optimized_cache, conn->cache_key, &stale) : NULL;
+    if (cached && !stale) {
+        ParsedRequest_destroy(request);
+        printf("[EVENT] Serving cached response (%d bytes) on socket %d\n",
+               cached->data_size, conn->client_fd);
+        if (event_serve_cached(conn, cached, head_request) < 0) {
+            cache_release(cached);
+            event_respond_error(conn, 500, "Internal Server Error");
+        }
+        return 1;
+    }
+
+    // Concurrent misses on this URL share one upstream fetch; the request is
+    // parsed again from the buffer once the fetch in flight has ended
+    if ((cache_mode & HTTP_CACHE_LOOKUP) && conn->cacheable && !conn->fetch_waited) {
+        if (!collapse_begin(request_collapse, conn->cache_key, &conn->fetch_id)) {
+            ParsedRequest_destroy(request);
+            cache_release(cached);
+            conn->fetch_deadline = time(NULL) + COLLAPSE_WAIT_TIMEOUT;
+            conn->state = EV_STATE_WAIT_FETCH;
+            return 1;
+        }
+        conn->fetch_leader = 1;
+    }
+
+    // A stale entry stays pinned while the origin is asked whether it is still current
+    char conditional[MAX_CONDITIONAL_HEADERS];
+    conditional[0] = '\0';
+    if (cached && http_conditional_headers(cached->data, cached->data_size, conditional, sizeof(conditional)) <= 0) {
+        cache_release(cached);
+        cached = NULL;
+    }
+    conn->cached = cached;
+
+    conn->upstream_request_len = build_upstream_request(request, conn->host, conditional,
+                                                        conn->upstream_request,
+                                                        sizeof(conn->upstream_request));
+    http_response_framer_init(&conn->framer, head_request);
+    conn->head_received = 0;
+    ParsedRequest_destroy(request);
+    if (conn->upstream_request_len <= 0 ||
+        conn->upstream_request_len >= (int)sizeof(conn->upstream_request)) {
+        event_respond_error(conn, 400, "Bad Request");
+        return 1;
+    }
+
+    // Bodies are relayed from the fixed request buffer, so they must fit in both buffers
+    if (conn->head_len + body_length > EVENT_REQUEST_BUFFER_SIZE - 1 ||
+        conn->upstream_request_len + body_length > EVENT_UPSTREAM_REQUEST_SIZE) {
+        printf("[EVENT] Request body too large on socket %d\n", conn->client_fd);
+        event_respond_error(conn, 413, "Payload Too Large");
+        return 1;
+    }
+    conn->body_len = (int)body_length;
+
+    if (conn->request_len < conn->head_len + conn->body_len) {
+        conn->state = EV_STATE_READ_BODY;
+        return 1;
+    }
+    return event_dispatch_request(loop, conn);
+}
+
+// Read client bytes into the request buffer until it holds `target` bytes.
+// Returns 1 when reached, 0 if the client would block, -1 on close/error.
+static int event_fill_request(event_conn_t* conn, int target) {
+    while (conn->request_len < target) {
+        int received = recv(conn->client_fd, conn->request + conn->request_len,
+                            EVENT_REQUEST_BUFFER_SIZE - 1 - conn->request_len, 0);
+        if (received > 0) {
+            conn->request_len += received;
+            conn->request[conn->request_len] = '\0';
+            if (target == EVENT_REQUEST_BUFFER_SIZE - 1 && strstr(conn->request, "\r\n\r\n")) {
+                return 1;
+            }
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        return -1;
+    }
+    return 1;
+}
+
+static int event_read_request(event_loop_t* loop, event_conn_t* conn) {
+    int filled = event_fill_request(conn, EVENT_REQUEST_BUFFER_SIZE - 1);
+    if (filled == 0) {
+        return 0;
+    }
+    if (filled < 0) {
+        // Client closed or failed before sending a complete request
+        conn->state = EV_STATE_DONE;
+        return 1;
+    }
+
+    char* head_end = strstr(conn->request, "\r\n\r\n");
+    if (!head_end) {
+        printf("[EVENT] Request headers too large on socket %d\n", conn->client_fd);
+        event_respond_error(conn, 400, "Bad Request");
+        return 1;
+    }
+
+    conn->head_len = (int)(head_end - conn->request) + 4;
+    return event_start_request(loop, conn);
+}
+
+static int event_read_body(event_loop_t* loop, event_conn_t* conn) {
+    int filled = event_fill_request(conn, conn->head_len + conn->body_len);
+    if (filled == 0) {
+        return 0;
+    }
+    if (filled < 0) {
+        conn->state = EV_STATE_DONE;
+        return 1;
+    }
+    return event_dispatch_request(loop, conn);
+}
+
+// The fetch this request waits on has ended (or taken too long): start over,
+// normally finding the response in the cache
+static int event_wait_fetch(event_loop_t* loop, event_conn_t* conn) {
+    if (collapse_pending(request_collapse, conn->cache_key, conn->fetch_id)) {
+        if (time(NULL) < conn->fetch_deadline) {
+            return 0;
+        }
+        collapse_note_timeout(request_collapse);
+        printf("[EVENT] Timed out waiting on the fetch for socket %d, fetching it alone\n", conn->client_fd);
+    }
+    conn->fetch_waited = 1;
+    return event_start_request(loop, conn);
+}
+
+static int event_resolve_upstream(event_loop_t* loop, event_conn_t* conn) {
+    int status = resolver_lookup_nowait(dns_resolver, conn->host, NULL);
+    if (status > 0) {
+        return 0;
+    }
+    if (status < 0) {
+        event_upstream_failed(conn);
+        return 1;
+    }
+    return event_connect_upstream(loop, conn);
+}
+
+static int event_check_connect(event_loop_t* loop, event_conn_t* conn) {
+    int upstream_fd = -1;
+    int status = connector_poll(conn->connector, &upstream_fd);
+    if (status == 0) {
+        event_register_attempts(loop, conn);
+        return 0;
+    }
+
+    // The losing attempts close with the connector (which also drops them from epoll)
+    connector_destroy(conn->connector);
+    conn->connector = NULL;
+    if (status < 0) {
+        event_upstream_failed(conn);
+        return 1;
+    }
+
+    conn->upstream_fd = upstream_fd;
+    conn->state = conn->tunnel_request ? EV_STATE_TUNNEL : EV_STATE_SEND_UPSTREAM;
+    return 1;
+}
+
+static int event_send_upstream(event_loop_t* loop, event_conn_t* conn) {
+    while (conn->upstream_request_sent < conn->upstream_request_len) {
+        int sent = send(conn->upstream_fd, conn->upstream_request + conn->upstream_request_sent,
+                        conn->upstream_request_len - conn->upstream_request_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            conn->upstream_request_sent += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+
+        if (!event_retry_upstream(loop, conn)) {
+            event_upstream_failed(conn);
+        }
+        return 1;
+    }
+
+    printf("[EVENT] Request sent to %s:%d for socket %d\n", conn->host, conn->port, conn->client_fd);
+    conn->state = EV_STATE_RELAY_RESPONSE;
+    return 1;
+}
+
+static void event_finish_response(event_loop_t* loop, event_conn_t* conn) {
+    printf("[EVENT] Relayed %lld bytes from %s:%d to socket %d\n",
+           conn->bytes_relayed, conn->host, conn->port, conn->client_fd);
+
+    if (conn->capture_enabled && conn->capture_len > 0) {
+        cache_add(optimized_cache, conn->cache_key, conn->capture, conn->capture_len, conn->capture_expires,
+                  conn->capture_keep_stale);
+    }
+    event_end_fetch(conn);
+
+    // Pool the upstream connection only if it sits exactly at a message boundary
+    event_release_upstream(loop, conn, !conn->framer.connection_close && !conn->upstream_trailing);
+    conn->state = EV_STATE_DONE;
+}
+
+// Not modified: store the response again with the 304's headers merged in, and serve it
+static int event_serve_revalidated(event_loop_t* loop, event_conn_t* conn, int head_length) {
+    const cache_node_t* cached = conn->cached;
+    http_cache_policy_t policy;
+    http_revalidated_cache_policy(cached->data, cached->data_size, conn->relay, head_length, time(NULL), &policy);
+    if (policy.storable) {
+        int merged_length = 0;
+        char* merged = http_merge_not_modified(cached->data, cached->data_size, conn->relay, head_length,
+                                               &merged_length);
+        int replaced = cache_refresh(optimized_cache, cached, merged, merged_length, policy.expires) == 0 &&
+                       merged != NULL;
+        free(merged);
+
+        const cache_node_t* updated = replaced ? cache_get(optimized_cache, conn->cache_key, NULL) : NULL;
+        if (updated) {
+            event_release_cached(conn);
+            cached = updated;
+        }
+    }
+    event_end_fetch(conn);
+    event_release_upstream(loop, conn, !conn->framer.connection_close && conn->head_received == head_length);
+
+    printf("[EVENT] %s:%d confirmed the cached response for socket %d (%d bytes)\n",
+           conn->host, conn->port, conn->client_fd, cached->data_size);
+    if (event_serve_cached(conn, cached, conn->framer.head_request) < 0) {
+        return -1;
+    }
+    return head_length;
+}
+
+// Forward the rewritten response head plus any body bytes that arrived with it
+static int event_relay_head(event_loop_t* loop, event_conn_t* conn) {
+    conn->head_received = http_response_skip_interim(conn->relay, conn->head_received);
+    int head_length = http_response_parse_head(&conn->framer, conn->relay, conn->head_received);
+    if (head_length <= 0) {
+        return head_length;
+    }
+
+    // A stale entry was being revalidated; anything but a 304 replaces it
+    if (conn->cached) {
+        if (conn->framer.status_code == 304) {
+            return event_serve_revalidated(loop, conn, head_length);
+        }
+        event_release_cached(conn);
+    }
+
+    int body_available = conn->head_received - head_length;
+    int head_capacity = MAX_RESPONSE_HEAD_SIZE + 64;
+    char* out = malloc(head_capacity + body_available);
+    if (!out) {
+        return -1;
+    }
+
+    int head_out = http_response_rewrite_head(conn->relay, head_length, out, head_capacity, "close");
+    int body_bytes = http_response_body(&conn->framer, conn->relay + head_length, body_available);
+    if (head_out < 0 || body_bytes < 0) {
+        free(out);
+        return -1;
+    }
+    memcpy(out + head_out, conn->relay + head_length, body_bytes);
+    conn->upstream_trailing = body_bytes < body_available;
+
+    // Only copy responses the headers allow to be stored and that can fit in the cache
+    conn->capture_enabled = 0;
+    if (conn->cacheable) {
+        http_cache_policy_t policy;
+        http_response_cache_policy(conn->relay, head_length, time(NULL), &policy);
+        if (!policy.storable) {
+            printf("[EVENT] Not caching response for socket %d: %s\n", conn->client_fd, policy.reason);
+        } else if (conn->framer.content_length > proxy_config.cache_max_object) {
+            cache_note_rejected(optimized_cache);
+        } else {
+            conn->capture_enabled = 1;
+            conn->capture_expires = policy.expires;
+            conn->capture_keep_stale = policy.validator;
+        }
+    }
+    if (!conn->capture_enabled) {
+        event_pass_fetch(conn);
+    }
+    event_capture(conn, out, head_out + body_bytes);
+
+    conn->out_data = out;
+    conn->out_len = head_out + body_bytes;
+    conn->out_sent = 0;
+    conn->out_owned = 1;
+    conn->bytes_relayed += conn->out_len;
+    return head_length;
+}
+
+static int event_relay_response(event_loop_t* loop, event_conn_t* conn) {
+    while (1) {
+        // Backpressure: only read upstream once the client has taken the previous chunk
+        if (conn->out_sent < conn->out_len) {
+            int flushed = event_flush_client(conn);
+            if (flushed < 0) {
+                conn->state = EV_STATE_DONE;
+                return 1;
+            }
+            if (flushed == 0) {
+                return 0;
+            }
+        }
+
+        if (conn->framer.complete) {
+            event_finish_response(loop, conn);
+            return 1;
+        }
+
+        int head_pending = conn->framer.header_length == 0;
+        char* target = head_pending ? conn->relay + conn->head_received : conn->relay;
+        int space = head_pending ? (int)sizeof(conn->relay) - conn->head_received : (int)sizeof(conn->relay);
+
+        int received = recv(conn->upstream_fd, target, space, 0);
+        if (received > 0) {
+            if (head_pending) {
+                conn->head_received += received;
+                int parsed = event_relay_head(loop, conn);
+                if (parsed < 0) {
+                    printf("[EVENT] Invalid response head from %s:%d\n", conn->host, conn->port);
+                    event_upstream_failed(conn);
+                    return 1;
+                }
+                if (conn->state != EV_STATE_RELAY_RESPONSE) {
+                    return 1;       // Answered from the cache after a 304
+                }
+                continue;
+            }
+
+            int body_bytes = http_response_body(&conn->framer, conn->relay, received);
+            if (body_bytes < 0) {
+                conn->state = EV_STATE_DONE;
+                return 1;
+            }
+            conn->upstream_trailing = body_bytes < received;
+            event_capture(conn, conn->relay, body_bytes);
+            conn->out_data = conn->relay;
+            conn->out_len = body_bytes;
+            conn->out_sent = 0;
+            conn->out_owned = 0;
+            conn->bytes_relayed += body_bytes;
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+
+        if (head_pending) {
+            if (!event_retry_upstream(loop, conn)) {
+                event_upstream_failed(conn);
+            }
+            return 1;
+        }
+
+        // A close-delimited body ends here; anything else was cut short
+        if (received == 0 && http_response_finish_on_close(&conn->framer)) {
+            continue;
+        }
+        printf("[EVENT] Response from %s:%d truncated after %lld bytes\n",
+               conn->host, conn->port, conn->bytes_relayed);
+        conn->state = EV_STATE_DONE;
+        return 1;
+    }
+}
+
+// Answer the CONNECT once the upstream is reached, then pump both directions until they close.
+// Anything the client sent after the CONNECT head is the start of the upstream stream.
+static int event_relay_tunnel(event_conn_t* conn) {
+    static const char established[] = "HTTP/1.1 200 Connection Established\r\n\r\n";
+
+    if (!conn->tunnel) {
+        conn->tunnel = tunnel_create(conn->client_fd, conn->upstream_fd,
+                                     conn->request + conn->head_len, conn->request_len - conn->head_len,
+                                     established, (int)sizeof(established) - 1);
+        if (!conn->tunnel) {
+            event_release_upstream(NULL, conn, 0);
+            event_respond_error(conn, 500, "Internal Server Error");
+            return 1;
+        }
+        printf("[EVENT] Tunneling socket %d to %s:%d\n", conn->client_fd, conn->host, conn->port);
+    }
+
+    int status = tunnel_pump(conn->tunnel);
+    if (status == 0) {
+        return 0;
+    }
+
+    conn->state = EV_STATE_DONE;
+    return 1;
+}
+
+static int event_write_client(event_conn_t* conn) {
+    int flushed = event_flush_client(conn);
+
+    // Head sent: a cached body follows straight from the entry, without a copy
+    if (flushed > 0 && conn->cached_body_length > 0) {
+        conn->out_data = conn->cached->data + conn->cached_body_offset;
+        conn->out_len = conn->cached_body_length;
+        conn->out_sent = 0;
+        conn->out_owned = 0;
+        conn->cached_body_length = 0;
+        flushed = event_flush_client(conn);
+    }
+    if (flushed == 0) {
+        return 0;
+    }
+
+    event_release_cached(conn);
+    conn->state = EV_STATE_DONE;
+    return 1;
+}
+
+// Run the connection's state machine until it would block
+static void event_conn_drive(event_loop_t* loop, event_conn_t* conn) {
+    if (conn->closed) {
+        return;
+    }
+
+    conn->last_activity = time(NULL);
+
+    int progress = 1;
+    while (progress) {
+        switch (conn->state) {
+            case EV_STATE_READ_REQUEST:
+                progress = event_read_request(loop, conn);
+                break;
+            case EV_STATE_READ_BODY:
+                progress = event_read_body(loop, conn);
+                break;
+            case EV_STATE_WAIT_FETCH:
+                progress = event_wait_fetch(loop, conn);
+                break;
+            case EV_STATE_RESOLVING:
+                progress = event_resolve_upstream(loop, conn);
+                break;
+            case EV_STATE_CONNECTING:
+                progress = event_check_connect(loop, conn);
+                break;
+            case EV_STATE_SEND_UPSTREAM:
+                progress = event_send_upstream(loop, conn);
+                break;
+            case EV_STATE_RELAY_RESPONSE:
+                progress = event_relay_response(loop, conn);
+                break;
+            case EV_STATE_WRITE_CLIENT:
+                progress = event_write_client(conn);
+                break;
+            case EV_STATE_TUNNEL:
+                progress = event_relay_tunnel(conn);
+                break;
+            case EV_STATE_DONE:
+            default:
+                event_conn_close(loop, conn);
+                return;
+        }
+    }
+}
+
+static void event_accept_clients(event_loop_t* loop) {
+    // Bounded batch per wakeup; the level-triggered listener reports any remainder
+    for (int i = 0; i < EVENT_LOOP_MAX_EVENTS; i++) {
+        struct sockaddr_in client_address;
+        socklen_t client_length = sizeof(client_address);
+        int client_fd = accept(loop->listen_fd, (struct sockaddr*)&client_address, &client_length);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                print_socket_error("Accept failed");
+            }
+            return;
+        }
+
+        event_conn_t* conn = calloc(1, sizeof(event_conn_t));
+        if (!conn || socket_set_nonblocking(client_fd) < 0) {
+            printf("[EVENT] Failed to set up connection for socket %d\n", client_fd);
+            free(conn);
+            socket_close(client_fd);
+            continue;
+        }
+
+        conn->state = EV_STATE_READ_REQUEST;
+        conn->client_fd = client_fd;
+        conn->upstream_fd = -1;
+        conn->client_handle.conn = conn;
+        conn->client_handle.is_upstream = 0;
+        conn->upstream_handle.conn = conn;
+        conn->upstream_handle.is_upstream = 1;
+        conn->last_activity = time(NULL);
+
+        if (event_register(loop, client_fd, &conn->client_handle) < 0) {
+            print_socket_error("Failed to register client socket");
+            free(conn);
+            socket_close(client_fd);
+            continue;
+        }
+
+        conn->next = loop->connections;
+        if (loop->connections) {
+            loop->connections->prev = conn;
+        }
+        loop->connections = conn;
+        loop->active_connections++;
+
+        printf("[EVENT] Client connected from %s:%d (socket %d, %d active)\n",
+               inet_ntoa(client_address.sin_addr), ntohs(client_address.sin_port),
+               client_fd, loop->active_connections);
+    }
+}
+
+// A lookup or a shared fetch finished somewhere: give every connection waiting on one another try
+static void event_resume_waiting(event_loop_t* loop) {
+    uint64_t completions;
+    while (read(loop->wakeup_fd, &completions, sizeof(completions)) > 0) {
+    }
+
+    event_conn_t* conn = loop->connections;
+    while (conn) {
+        event_conn_t* next = conn->next;
+        if (conn->state == EV_STATE_RESOLVING || conn->state == EV_STATE_WAIT_FETCH) {
+            event_conn_drive(loop, conn);
+        }
+        conn = next;
+    }
+}
+
+// Attempt staggering and connect deadlines are timers, not socket events
+static void event_poll_connecting(event_loop_t* loop) {
+    int connecting = 0;
+    event_conn_t* conn = loop->connections;
+    while (conn) {
+        event_conn_t* next = conn->next;
+        if (conn->state == EV_STATE_CONNECTING) {
+            event_conn_drive(loop, conn);
+            connecting += !conn->closed && conn->state == EV_STATE_CONNECTING;
+        }
+        conn = next;
+    }
+    loop->connects_pending = connecting > 0;
+}
+
+static void event_sweep_idle(event_loop_t* loop) {
+    time_t now = time(NULL);
+    if (now == loop->last_sweep) {
+        return;
+    }
+    loop->last_sweep = now;
+
+    event_conn_t* conn = loop->connections;
+    while (conn) {
+        event_conn_t* next = conn->next;
+        int idle_timeout = conn->tunnel ? TUNNEL_IDLE_TIMEOUT : EVENT_IDLE_TIMEOUT;
+        if (now - conn->last_activity >= idle_timeout) {
+            printf("[EVENT] Closing idle connection (socket %d)\n", conn->client_fd);
+            event_conn_close(loop, conn);
+        } else if (conn->state == EV_STATE_WAIT_FETCH && now >= conn->fetch_deadline) {
+            event_conn_drive(loop, conn);
+        }
+        conn = next;
+    }
+}
+
+// Draining: give up the listener (another process accepts from it now) and
+// report once the last connection has finished
+static int event_drained(event_loop_t* loop) {
+    if (loop->listening) {
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, loop->listen_fd, NULL) < 0) {
+            print_socket_error("Failed to unregister listening socket");
+        }
+        loop->listening = 0;
+        printf("[EVENT] Draining %d active connections\n", loop->active_connections);
+    }
+    return loop->active_connections == 0;
+}
+
+void event_loop_run(event_loop_t* loop) {
+    if (!loop) return;
+
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    loop->running = 1;
+
+    printf("[EVENT] Event loop running\n");
+
+    while (loop->running) {
+        if (loop->draining && event_drained(loop)) {
+            break;
+        }
+
+        int timeout = loop->connects_pending ? EVENT_CONNECT_TICK_MS : 1000;
+        int count = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, timeout);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            print_socket_error("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                event_accept_clients(loop);
+                continue;
+            }
+
+            event_handle_t* handle = (event_handle_t*)events[i].data.ptr;
+            if (handle == &loop->wakeup_handle) {
+                event_resume_waiting(loop);
+                continue;
+            }
+            event_conn_drive(loop, handle->conn);
+        }
+
+        if (loop->connects_pending) {
+            event_poll_connecting(loop);
+        }
+        event_sweep_idle(loop);
+        event_free_graveyard(loop);
+    }
+
+    printf("[EVENT] Event loop stopped\n");
+}
+
+void event_loop_stop(event_loop_t* loop) {
+    if (loop) {
+        loop->running = 0;
+    }
+}
+
+void event_loop_drain(event_loop_t* loop) {
+    if (!loop) return;
+
+    uint64_t one = 1;
+    loop->draining = 1;
+    if (write(loop->wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        print_socket_error("Failed to wake event loop");
+    }
+}
+
+void event_loop_destroy(event_loop_t* loop) {
+    if (!loop) return;
+
+    printf("[EVENT] Destroying event loop (%d active connections)...\n", loop->active_connections);
+
+    while (loop->connections) {
+        event_conn_close(loop, loop->connections);
+    }
+    event_free_graveyard(loop);
+
+    resolver_remove_wakeup(dns_resolver, loop->wakeup_fd);
+    collapse_remove_wakeup(request_collapse, loop->wakeup_fd);
+    close(loop->wakeup_fd);
+    close(loop->epoll_fd);
+    free(loop);
+
+    printf("[EVENT] Event loop destroyed\n");
+}
+
+#else
+
+// The reactor relies on epoll; other platforms keep using the thread pool
+int event_loop_supported(void) {
+    return 0;
+}
+
+event_loop_t* event_loop_create(int listen_fd) {
+    (void)listen_fd;
+    return NULL;
+}
+
+void event_loop_run(event_loop_t* loop) {
+    (void)loop;
+}
+
+void event_loop_stop(event_loop_t* loop) {
+    (void)loop;
+}
+
+void event_loop_drain(event_loop_t* loop) {
+    (void)loop;
+}
+
+void event_loop_destroy(event_loop_t* loop) {
+    (void)loop;
+}
+
+#endif
@@ -6,11 +6,16 @@
 // Windows compatibility for strcasecmp
 #ifdef _WIN32
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
+#else
+#include <strings.h>
 #endif
 
 // HTTP Parser Implementation
 // Note: Enhanced implementation for proper proxy functionality
 
+static int header_has_token(const char* value, int value_len, const char* token);
+
 struct ParsedRequest* ParsedRequest_create(void) {
     return (struct ParsedRequest*)calloc(1, sizeof(struct ParsedRequest));
 }
@@ -25,6 +30,11 @@ void ParsedRequest_destroy(struct ParsedRequest *pr) {
         if (pr->port) free(pr->port);
         if (pr->path) free(pr->path);
         if (pr->version) free(pr->version);
+        for (size_t i = 0; i < pr->headersused; i++) {
+            free(pr->headers[i].key);
+            free(pr->headers[i].value);
+        }
+        if (pr->headers) free(pr->headers);
         free(pr);
     }
 }
@@ -121,12 +131,16 @@ int ParsedRequest_parse(struct ParsedRequest *parse, const char *buf, int buflen
             printf("[PARSER] Header: '%s' = '%s'\n", header_name, header_value);
             
             // Check for Host header
-            if (strcasecmp(header_name, "Host") == 0) {
+            if (strcasecmp(header_name, "Host") == 0 && !parse->host) {
                 parse->host = malloc(strlen(header_value) + 1);
                 strcpy(parse->host, header_value);
                 printf("[PARSER] Found Host header: %s\n", parse->host);
+            }
+
+            // Keep every header for Connection / Content-Length handling
+            if (ParsedHeader_set(parse, header_name, header_value) < 0) {
                 free(header_line);
-                break;
+                return -1;
             }
         }
         
@@ -160,15 +174,76 @@ int ParsedRequest_unparse_headers(struct ParsedRequest *pr, char *buf, size_t bu
 }
 
 int ParsedHeader_set(struct ParsedRequest *pr, const char *key, const char *value) {
-    // Simplified implementation - would need proper header linked list
+    if (!pr || !key || !value) return -1;
+
+    char* value_copy = malloc(strlen(value) + 1);
+    if (!value_copy) return -1;
+    strcpy(value_copy, value);
+
+    // Replace an existing header of the same name
+    struct ParsedHeader* existing = ParsedHeader_get(pr, key);
+    if (existing) {
+        free(existing->value);
+        existing->value = value_copy;
+        existing->valuelen = strlen(value_copy);
+        return 0;
+    }
+
+    if (pr->headersused == pr->headerslen) {
+        size_t new_len = pr->headerslen ? pr->headerslen * 2 : 8;
+        struct ParsedHeader* grown = realloc(pr->headers, new_len * sizeof(struct ParsedHeader));
+        if (!grown) {
+            free(value_copy);
+            return -1;
+        }
+        pr->headers = grown;
+        pr->headerslen = new_len;
+    }
+
+    struct ParsedHeader* header = &pr->headers[pr->headersused];
+    header->key = malloc(strlen(key) + 1);
+    if (!header->key) {
+        free(value_copy);
+        return -1;
+    }
+    strcpy(header->key, key);
+    header->keylen = strlen(key);
+    header->value = value_copy;
+    header->valuelen = strlen(value_copy);
+    pr->headersused++;
     return 0;
 }
 
 struct ParsedHeader* ParsedHeader_get(struct ParsedRequest *pr, const char *key) {
-    // Simplified implementation - would need proper header lookup
+    if (!pr || !key) return NULL;
+
+    for (size_t i = 0; i < pr->headersused; i++) {
+        if (strcasecmp(pr->headers[i].key, key) == 0) {
+            return &pr->headers[i];
+        }
+    }
     return NULL;
 }
 
+int http_request_keep_alive(struct ParsedRequest *pr) {
+    if (!pr) return 0;
+
+    // Clients talking to a proxy often use Proxy-Connection instead of Connection
+    struct ParsedHeader* connection = ParsedHeader_get(pr, "Connection");
+    if (!connection) {
+        connection = ParsedHeader_get(pr, "Proxy-Connection");
+    }
+
+    if (connection) {
+        int length = (int)connection->valuelen;
+        if (header_has_token(connection->value, length, "close")) return 0;
+        if (header_has_token(connection->value, length, "keep-alive")) return 1;
+    }
+
+    // HTTP/1.1 is persistent by default, HTTP/1.0 is not
+    return pr->version && strcmp(pr->version, "HTTP/1.1") == 0;
+}
+
 int validate_http_request(const char* request, int length) {
     if (!request || length <= 0) {
         return 0; // Invalid
@@ -180,7 +255,8 @@ int validate_http_request(const char* request, int length) {
         strncmp(request, "POST ", 5) == 0 ||
         strncmp(request, "PUT ", 4) == 0 ||
         strncmp(request, "DELETE ", 7) == 0 ||
-        strncmp(request, "HEAD ", 5) == 0) {
+        strncmp(request, "HEAD ", 5) == 0 ||
+        strncmp(request, "CONNECT ", 8) == 0) {
         return 1; // Valid
     }
     
@@ -215,3 +291,992 @@ int extract_host_port(const char* host_header, char* host, int* port) {
     
     return 0;
 }
+
+int extract_connect_target(const char* authority, char* host, int host_size, int* port) {
+    if (!authority || !host || !port || host_size <= 0) {
+        return -1;
+    }
+
+    // CONNECT targets are authority-form "host:port"; the port defaults to HTTPS
+    const char* port_separator = strrchr(authority, ':');
+    int host_len = port_separator ? (int)(port_separator - authority) : (int)strlen(authority);
+    if (host_len <= 0 || host_len >= host_size) {
+        return -1;
+    }
+
+    *port = 443;
+    if (port_separator) {
+        char* port_end = NULL;
+        long value = strtol(port_separator + 1, &port_end, 10);
+        if (port_end == port_separator + 1 || *port_end != '\0' || value <= 0 || value > 65535) {
+            return -1;
+        }
+        *port = (int)value;
+    }
+
+    memcpy(host, authority, host_len);
+    host[host_len] = '\0';
+    return 0;
+}
+
+// HTTP Response Framing Implementation
+
+// Chunked transfer decoder states
+enum {
+    CHUNK_SIZE,
+    CHUNK_EXTENSION,
+    CHUNK_SIZE_LF,
+    CHUNK_DATA,
+    CHUNK_DATA_CR,
+    CHUNK_DATA_LF,
+    CHUNK_TRAILER_START,
+    CHUNK_TRAILER_LINE,
+    CHUNK_TRAILER_LF,
+    CHUNK_FINAL_LF
+};
+
+void http_response_framer_init(http_response_framer_t* framer, int head_request) {
+    memset(framer, 0, sizeof(*framer));
+    framer->head_request = head_request;
+    framer->content_length = -1;
+    framer->chunk_state = CHUNK_SIZE;
+}
+
+// Next element of a comma-separated header value, whitespace trimmed; 0 when none are left
+static int next_header_token(const char* value, int value_len, int* pos, const char** token, int* token_len) {
+    while (*pos < value_len) {
+        int start = *pos;
+        while (*pos < value_len && value[*pos] != ',') (*pos)++;
+        int end = *pos;
+        (*pos)++;
+
+        while (start < end && (value[start] == ' ' || value[start] == '\t')) start++;
+        while (end > start && (value[end - 1] == ' ' || value[end - 1] == '\t' || value[end - 1] == '\r')) end--;
+        if (end > start) {
+            *token = value + start;
+            *token_len = end - start;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int token_equals(const char* token, int token_len, const char* expected) {
+    return (int)strlen(expected) == token_len && strncasecmp(token, expected, token_len) == 0;
+}
+
+static int header_has_token(const char* value, int value_len, const char* token) {
+    const char* element;
+    int element_len;
+    int pos = 0;
+    while (next_header_token(value, value_len, &pos, &element, &element_len)) {
+        if (token_equals(element, element_len, token)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Last element of a comma-separated header value; 0 if it has none
+static int header_last_token(const char* value, int value_len, const char** token, int* token_len) {
+    int found = 0;
+    int pos = 0;
+    while (next_header_token(value, value_len, &pos, token, token_len)) {
+        found = 1;
+    }
+    return found;
+}
+
+// Length of the head up to and including its blank line, 0 if not all here yet
+static int response_head_end(const char* data, int length) {
+    for (int i = 0; i + 3 < length; i++) {
+        if (data[i] == '\r' && data[i + 1] == '\n' && data[i + 2] == '\r' && data[i + 3] == '\n') {
+            return i + 4;
+        }
+    }
+    return 0;
+}
+
+// Content-Length value: digits only, or a list of identical values ("5, 5")
+static long long parse_content_length(const char* value, int value_len) {
+    long long result = -1;
+    int pos = 0;
+
+    while (pos < value_len) {
+        while (pos < value_len && (value[pos] == ' ' || value[pos] == '\t' || value[pos] == '\r')) pos++;
+        if (pos == value_len) {
+            break;
+        }
+
+        long long parsed = 0;
+        int digits = 0;
+        while (pos < value_len && value[pos] >= '0' && value[pos] <= '9') {
+            if (parsed > (0x7fffffffffffffffLL - 9) / 10) {
+                return -1;
+            }
+            parsed = parsed * 10 + (value[pos++] - '0');
+            digits++;
+        }
+        while (pos < value_len && (value[pos] == ' ' || value[pos] == '\t' || value[pos] == '\r')) pos++;
+        if (digits == 0 || (pos < value_len && value[pos] != ',') || (result >= 0 && parsed != result)) {
+            return -1;
+        }
+        result = parsed;
+        pos++;
+    }
+    return result;
+}
+
+int http_response_skip_interim(char* data, int length) {
+    if (!data) {
+        return length;
+    }
+
+    while (length >= 12 && strncmp(data, "HTTP/1.", 7) == 0 && data[9] == '1' &&
+           !(data[10] == '0' && data[11] == '1')) {
+        int head_len = response_head_end(data, length);
+        if (head_len == 0) {
+            break;
+        }
+        printf("[PARSER] Skipping interim %.3s response\n", data + 9);
+        memmove(data, data + head_len, length - head_len);
+        length -= head_len;
+    }
+    return length;
+}
+
+int http_response_parse_head(http_response_framer_t* framer, const char* data, int length) {
+    if (!framer || !data) {
+        return -1;
+    }
+
+    // Locate the blank line that ends the head
+    int head_len = response_head_end(data, length);
+    if (head_len == 0) {
+        return length >= MAX_RESPONSE_HEAD_SIZE ? -1 : 0;
+    }
+
+    // Status line: HTTP/1.x NNN Reason
+    if (head_len < 12 || strncmp(data, "HTTP/1.", 7) != 0) {
+        printf("[PARSER] Malformed response status line\n");
+        return -1;
+    }
+    int http_minor = data[7] - '0';
+    framer->status_code = atoi(data + 9);
+    if (framer->status_code < 100 || framer->status_code > 999) {
+        printf("[PARSER] Invalid response status code\n");
+        return -1;
+    }
+
+    int chunked = 0;
+    int transfer_coded = 0;
+    int keep_alive = 0;
+    int close_requested = 0;
+
+    const char* line = memchr(data, '\n', head_len);
+    while (line && line + 1 < data + head_len) {
+        line++;
+        const char* line_end = memchr(line, '\n', data + head_len - line);
+        if (!line_end || line_end - line <= 1) {
+            break;
+        }
+
+        const char* colon = memchr(line, ':', line_end - line);
+        if (colon) {
+            int name_len = colon - line;
+            const char* value = colon + 1;
+            while (value < line_end && (*value == ' ' || *value == '\t')) value++;
+            int value_len = line_end - value;
+
+            if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+                // A length the framing cannot trust would desync a pooled connection
+                long long parsed = parse_content_length(value, value_len);
+                if (parsed < 0 || (framer->content_length >= 0 && parsed != framer->content_length)) {
+                    printf("[PARSER] Invalid Content-Length in response\n");
+                    return -1;
+                }
+                framer->content_length = parsed;
+            } else if (name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+                // Codings apply in order and repeated lines continue the list:
+                // only a final "chunked" frames the body
+                const char* coding;
+                int coding_len;
+                if (header_last_token(value, value_len, &coding, &coding_len)) {
+                    transfer_coded = 1;
+                    chunked = token_equals(coding, coding_len, "chunked");
+                }
+            } else if (name_len == 10 && strncasecmp(line, "Connection", 10) == 0) {
+                close_requested |= header_has_token(value, value_len, "close");
+                keep_alive |= header_has_token(value, value_len, "keep-alive");
+            }
+        }
+
+        line = line_end;
+    }
+
+    // HTTP/1.0 closes unless it explicitly asked to stay open
+    framer->connection_close = close_requested || (http_minor == 0 && !keep_alive);
+
+    if (framer->head_request || framer->status_code / 100 == 1 ||
+        framer->status_code == 204 || framer->status_code == 304) {
+        framer->body_mode = HTTP_BODY_NONE;
+        framer->complete = 1;
+    } else if (chunked) {
+        framer->body_mode = HTTP_BODY_CHUNKED;
+    } else if (transfer_coded) {
+        // Any other final coding has no length of its own; Content-Length does not apply
+        framer->body_mode = HTTP_BODY_UNTIL_CLOSE;
+        framer->connection_close = 1;
+    } else if (framer->content_length >= 0) {
+        framer->body_mode = HTTP_BODY_LENGTH;
+        framer->body_remaining = framer->content_length;
+        framer->complete = (framer->content_length == 0);
+    } else {
+        framer->body_mode = HTTP_BODY_UNTIL_CLOSE;
+        framer->connection_close = 1;
+    }
+
+    framer->header_length = head_len;
+    return head_len;
+}
+
+static int chunked_body(http_response_framer_t* framer, const char* data, int length) {
+    int pos = 0;
+
+    while (pos < length && !framer->complete) {
+        char c = data[pos];
+
+        switch (framer->chunk_state) {
+            case CHUNK_SIZE:
+                if (isxdigit((unsigned char)c)) {
+                    int digit = isdigit((unsigned char)c) ? c - '0' : (tolower((unsigned char)c) - 'a' + 10);
+                    if (framer->chunk_remaining > (0x7fffffffffffLL >> 4)) {
+                        return -1;
+                    }
+                    framer->chunk_remaining = framer->chunk_remaining * 16 + digit;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    framer->chunk_state = CHUNK_EXTENSION;
+                } else if (c == '\r') {
+                    framer->chunk_state = CHUNK_SIZE_LF;
+                } else {
+                    return -1;
+                }
+                pos++;
+                break;
+
+            case CHUNK_EXTENSION:
+                if (c == '\r') {
+                    framer->chunk_state = CHUNK_SIZE_LF;
+                }
+                pos++;
+                break;
+
+            case CHUNK_SIZE_LF:
+                if (c != '\n') {
+                    return -1;
+                }
+                framer->chunk_state = framer->chunk_remaining == 0 ? CHUNK_TRAILER_START : CHUNK_DATA;
+                pos++;
+                break;
+
+            case CHUNK_DATA: {
+                long long available = length - pos;
+                long long take = available < framer->chunk_remaining ? available : framer->chunk_remaining;
+                framer->chunk_remaining -= take;
+                pos += (int)take;
+                if (framer->chunk_remaining == 0) {
+                    framer->chunk_state = CHUNK_DATA_CR;
+                }
+                break;
+            }
+
+            case CHUNK_DATA_CR:
+                if (c != '\r') {
+                    return -1;
+                }
+                framer->chunk_state = CHUNK_DATA_LF;
+                pos++;
+                break;
+
+            case CHUNK_DATA_LF:
+                if (c != '\n') {
+                    return -1;
+                }
+                framer->chunk_state = CHUNK_SIZE;
+                pos++;
+                break;
+
+            case CHUNK_TRAILER_START:
+                framer->chunk_state = (c == '\r') ? CHUNK_FINAL_LF : CHUNK_TRAILER_LINE;
+                pos++;
+                break;
+
+            case CHUNK_TRAILER_LINE:
+                if (c == '\r') {
+                    framer->chunk_state = CHUNK_TRAILER_LF;
+                }
+                pos++;
+                break;
+
+            case CHUNK_TRAILER_LF:
+                if (c != '\n') {
+                    return -1;
+                }
+                framer->chunk_state = CHUNK_TRAILER_START;
+                pos++;
+                break;
+
+            case CHUNK_FINAL_LF:
+                if (c != '\n') {
+                    return -1;
+                }
+                framer->complete = 1;
+                pos++;
+                break;
+        }
+    }
+
+    return pos;
+}
+
+int http_response_body(http_response_framer_t* framer, const char* data, int length) {
+    if (!framer || length < 0) {
+        return -1;
+    }
+    if (framer->complete || length == 0) {
+        return 0;
+    }
+
+    int used;
+    switch (framer->body_mode) {
+        case HTTP_BODY_LENGTH:
+            used = framer->body_remaining < length ? (int)framer->body_remaining : length;
+            framer->body_remaining -= used;
+            framer->complete = (framer->body_remaining == 0);
+            break;
+        case HTTP_BODY_CHUNKED:
+            used = chunked_body(framer, data, length);
+            if (used < 0) {
+                printf("[PARSER] Malformed chunked response body\n");
+                return -1;
+            }
+            break;
+        case HTTP_BODY_UNTIL_CLOSE:
+            used = length;
+            break;
+        case HTTP_BODY_NONE:
+        default:
+            used = 0;
+            break;
+    }
+
+    framer->body_received += used;
+    return used;
+}
+
+// Account for body bytes relayed without passing through user space
+// (only meaningful for Content-Length and close-delimited bodies)
+void http_response_body_forwarded(http_response_framer_t* framer, long long length) {
+    if (framer->body_mode == HTTP_BODY_LENGTH) {
+        if (length > framer->body_remaining) {
+            length = framer->body_remaining;
+        }
+        framer->body_remaining -= length;
+        framer->complete = (framer->body_remaining == 0);
+    }
+    framer->body_received += length;
+}
+
+int http_response_finish_on_close(http_response_framer_t* framer) {
+    // Only a close-delimited body may legitimately end with the connection
+    if (framer->body_mode == HTTP_BODY_UNTIL_CLOSE) {
+        framer->complete = 1;
+    }
+    return framer->complete;
+}
+
+int http_response_rewrite_head(const char* head, int head_length, char* out, int out_size,
+                               const char* connection) {
+    int written = 0;
+    const char* line = head;
+    const char* head_end = head + head_length;
+
+    while (line < head_end) {
+        const char* line_end = memchr(line, '\n', head_end - line);
+        if (!line_end) {
+            break;
+        }
+        int line_len = line_end - line + 1;
+
+        // Stop at the blank line; it is re-emitted after our own Connection header
+        if (line_len <= 2) {
+            break;
+        }
+
+        // Hop-by-hop headers describe the upstream connection, not ours
+        int hop_by_hop = (line_len > 11 && strncasecmp(line, "Connection:", 11) == 0) ||
+                         (line_len > 11 && strncasecmp(line, "Keep-Alive:", 11) == 0) ||
+                         (line_len > 17 && strncasecmp(line, "Proxy-Connection:", 17) == 0);
+        if (!hop_by_hop) {
+            if (written + line_len >= out_size) {
+                return -1;
+            }
+            memcpy(out + written, line, line_len);
+            written += line_len;
+        }
+
+        line = line_end + 1;
+    }
+
+    int tail = connection
+        ? snprintf(out + written, out_size - written, "Connection: %s\r\n\r\n", connection)
+        : snprintf(out + written, out_size - written, "\r\n");
+    if (tail < 0 || written + tail >= out_size) {
+        return -1;
+    }
+    return written + tail;
+}
+
+// ---------------------------------------------------------------------------
+// Cacheability and freshness (RFC 9111, shared cache)
+// ---------------------------------------------------------------------------
+
+// Cache-Control directives a shared cache acts on
+typedef struct {
+    int no_store;
+    int no_cache;
+    int is_private;
+    int is_public;
+    long long max_age;              // -1 when absent
+    long long s_maxage;
+} cache_directives_t;
+
+static void cache_directives_init(cache_directives_t* directives) {
+    memset(directives, 0, sizeof(*directives));
+    directives->max_age = -1;
+    directives->s_maxage = -1;
+}
+
+// delta-seconds; a malformed value counts as 0 (already stale)
+static long long parse_delta_seconds(const char* value, int value_len) {
+    long long seconds = 0;
+    int digits = 0;
+    while (digits < value_len && value[digits] >= '0' && value[digits] <= '9') {
+        if (seconds < HTTP_MAX_LIFETIME) {
+            seconds = seconds * 10 + (value[digits] - '0');
+        }
+        digits++;
+    }
+    return digits > 0 ? seconds : 0;
+}
+
+// Comma-separated directives, each "name" or "name=value" (value possibly quoted).
+// Qualified no-cache="..." and private="..." are treated as their unqualified forms.
+static void parse_cache_control(const char* value, int value_len, cache_directives_t* directives) {
+    const char* end = value + value_len;
+    const char* p = value;
+
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char* name = p;
+        while (p < end && *p != '=' && *p != ',' && *p != ' ' && *p != '\t' && *p != '\r') p++;
+        int name_len = p - name;
+
+        const char* argument = NULL;
+        int argument_len = 0;
+        if (p < end && *p == '=') {
+            p++;
+            if (p < end && *p == '"') {
+                argument = ++p;
+                while (p < end && *p != '"') p++;
+                argument_len = p - argument;
+                if (p < end) p++;
+            } else {
+                argument = p;
+                while (p < end && *p != ',' && *p != ' ' && *p != '\t' && *p != '\r') p++;
+                argument_len = p - argument;
+            }
+        }
+        while (p < end && *p != ',') p++;
+
+        if (name_len == 8 && strncasecmp(name, "no-store", 8) == 0) {
+            directives->no_store = 1;
+        } else if (name_len == 8 && strncasecmp(name, "no-cache", 8) == 0) {
+            directives->no_cache = 1;
+        } else if (name_len == 7 && strncasecmp(name, "private", 7) == 0) {
+            directives->is_private = 1;
+        } else if (name_len == 6 && strncasecmp(name, "public", 6) == 0) {
+            directives->is_public = 1;
+        } else if (name_len == 7 && strncasecmp(name, "max-age", 7) == 0) {
+            directives->max_age = parse_delta_seconds(argument ? argument : "", argument_len);
+        } else if (name_len == 8 && strncasecmp(name, "s-maxage", 8) == 0) {
+            directives->s_maxage = parse_delta_seconds(argument ? argument : "", argument_len);
+        }
+    }
+}
+
+int http_request_cache_mode(struct ParsedRequest* request) {
+    if (!request || !request->method) {
+        return 0;
+    }
+
+    int get = strcmp(request->method, "GET") == 0;
+    int head = strcmp(request->method, "HEAD") == 0;
+    if (!get && !head) {
+        return 0;
+    }
+
+    // Credentials make the response specific to this client
+    if (ParsedHeader_get(request, "Authorization")) {
+        return 0;
+    }
+
+    cache_directives_t directives;
+    cache_directives_init(&directives);
+    struct ParsedHeader* cache_control = ParsedHeader_get(request, "Cache-Control");
+    if (cache_control) {
+        parse_cache_control(cache_control->value, (int)cache_control->valuelen, &directives);
+    }
+    struct ParsedHeader* pragma = ParsedHeader_get(request, "Pragma");
+
+    // A reload (no-cache, max-age=0) goes to the origin but may refresh the cache
+    int mode = 0;
+    if (!directives.no_cache && directives.max_age != 0 &&
+        !(pragma && !cache_control && header_has_token(pragma->value, (int)pragma->valuelen, "no-cache"))) {
+        mode |= HTTP_CACHE_LOOKUP;
+    }
+    if (get && !directives.no_store) {
+        mode |= HTTP_CACHE_STORE;
+    }
+    return mode;
+}
+
+// Days from 1970-01-01 to a proleptic Gregorian date
+static long long days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - (int)(era * 400);
+    int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+time_t http_parse_date(const char* value, int value_length) {
+    static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char text[64];
+    char month_name[4] = "";
+    int day = 0, year = 0, hour = 0, minute = 0, second = 0;
+
+    if (!value || value_length <= 0 || value_length >= (int)sizeof(text)) {
+        return -1;
+    }
+    memcpy(text, value, value_length);
+    text[value_length] = '\0';
+
+    // IMF-fixdate "Sun, 06 Nov 1994 08:49:37 GMT", RFC 850 "Sunday, 06-Nov-94 08:49:37 GMT",
+    // asctime "Sun Nov  6 08:49:37 1994"
+    if (sscanf(text, "%*[A-Za-z], %d %3s %d %d:%d:%d GMT", &day, month_name, &year, &hour, &minute, &second) == 6) {
+        // IMF-fixdate
+    } else if (sscanf(text, "%*[A-Za-z], %d-%3s-%d %d:%d:%d GMT", &day, month_name, &year, &hour, &minute, &second) == 6) {
+        year += year < 70 ? 2000 : (year < 100 ? 1900 : 0);
+    } else if (sscanf(text, "%*[A-Za-z] %3s %d %d:%d:%d %d", month_name, &day, &hour, &minute, &second, &year) != 6) {
+        return -1;
+    }
+
+    const char* found = strlen(month_name) == 3 ? strstr(months, month_name) : NULL;
+    if (!found || (found - months) % 3 != 0 || day < 1 || day > 31 ||
+        hour > 23 || minute > 59 || second > 60 || year < 1970) {
+        return -1;
+    }
+
+    long long days = days_from_civil(year, (int)(found - months) / 3 + 1, day);
+    return (time_t)(days * 86400 + hour * 3600 + minute * 60 + second);
+}
+
+// Final status codes a cache may store with a heuristic lifetime (RFC 9110 15.1)
+static int status_heuristically_cacheable(int status) {
+    switch (status) {
+        case 200: case 203: case 204: case 300: case 301: case 308:
+        case 404: case 405: case 410: case 414: case 501:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Response headers that decide freshness
+typedef struct {
+    cache_directives_t directives;
+    int has_cache_control;
+    time_t date;                    // -1 when absent
+    time_t expires;
+    int has_expires;
+    time_t last_modified;
+    long long age;
+    int has_age;
+    int has_etag;
+    int vary_any;
+} freshness_headers_t;
+
+static void freshness_headers_init(freshness_headers_t* headers) {
+    memset(headers, 0, sizeof(*headers));
+    cache_directives_init(&headers->directives);
+    headers->date = -1;
+    headers->expires = -1;
+    headers->last_modified = -1;
+}
+
+// Calls visit() for every header line of a message head, value trimmed
+static void for_each_header(const char* head, int head_length, void* context,
+                            void (*visit)(void* context, const char* name, int name_len,
+                                          const char* value, int value_len)) {
+    const char* head_end = head + head_length;
+    const char* line = memchr(head, '\n', head_length);
+    while (line && line + 1 < head_end) {
+        line++;
+        const char* line_end = memchr(line, '\n', head_end - line);
+        if (!line_end || line_end - line <= 1) {
+            break;
+        }
+
+        const char* colon = memchr(line, ':', line_end - line);
+        if (colon) {
+            const char* value = colon + 1;
+            while (value < line_end && (*value == ' ' || *value == '\t')) value++;
+            int value_len = line_end - value;
+            while (value_len > 0 && (value[value_len - 1] == '\r' || value[value_len - 1] == ' ')) value_len--;
+            visit(context, line, colon - line, value, value_len);
+        }
+        line = line_end;
+    }
+}
+
+typedef struct {
+    long long length;           // -1 until a Content-Length is seen
+    int invalid;
+    int transfer_coded;
+} request_framing_t;
+
+static void collect_request_framing(void* context, const char* name, int name_len,
+                                    const char* value, int value_len) {
+    request_framing_t* framing = (request_framing_t*)context;
+
+    if (name_len == 14 && strncasecmp(name, "Content-Length", 14) == 0) {
+        long long length = parse_content_length(value, value_len);
+        if (length < 0 || (framing->length >= 0 && length != framing->length)) {
+            framing->invalid = 1;
+        }
+        framing->length = length;
+    } else if (name_len == 17 && strncasecmp(name, "Transfer-Encoding", 17) == 0) {
+        if (value_len != 8 || strncasecmp(value, "identity", 8) != 0) {
+            framing->transfer_coded = 1;
+        }
+    }
+}
+
+long long http_request_body_length(const char* head, int head_length) {
+    request_framing_t framing = { -1, 0, 0 };
+    for_each_header(head, head_length, &framing, collect_request_framing);
+
+    // Chunked request bodies are not supported; the client must send a length
+    if (framing.transfer_coded) {
+        return HTTP_BODY_LENGTH_TRANSFER_CODED;
+    }
+    if (framing.invalid) {
+        return HTTP_BODY_LENGTH_INVALID;
+    }
+    return framing.length < 0 ? 0 : framing.length;
+}
+
+static void collect_freshness_header(void* context, const char* name, int name_len,
+                                     const char* value, int value_len) {
+    freshness_headers_t* headers = (freshness_headers_t*)context;
+
+    if (name_len == 13 && strncasecmp(name, "Cache-Control", 13) == 0) {
+        headers->has_cache_control = 1;
+        parse_cache_control(value, value_len, &headers->directives);
+    } else if (name_len == 4 && strncasecmp(name, "Date", 4) == 0) {
+        headers->date = http_parse_date(value, value_len);
+    } else if (name_len == 7 && strncasecmp(name, "Expires", 7) == 0) {
+        headers->has_expires = 1;
+        headers->expires = http_parse_date(value, value_len);   // Invalid means already expired
+    } else if (name_len == 13 && strncasecmp(name, "Last-Modified", 13) == 0) {
+        headers->last_modified = http_parse_date(value, value_len);
+    } else if (name_len == 3 && strncasecmp(name, "Age", 3) == 0) {
+        headers->has_age = 1;
+        headers->age = parse_delta_seconds(value, value_len);
+    } else if (name_len == 4 && strncasecmp(name, "ETag", 4) == 0) {
+        headers->has_etag = value_len > 0;
+    } else if (name_len == 4 && strncasecmp(name, "Vary", 4) == 0) {
+        headers->vary_any |= memchr(value, '*', value_len) != NULL;
+    }
+}
+
+static int response_status(const char* head, int head_length) {
+    if (!head || head_length < 12 || strncmp(head, "HTTP/1.", 7) != 0) {
+        return -1;
+    }
+    return atoi(head + 9);
+}
+
+static void evaluate_cache_policy(int status, const freshness_headers_t* headers, time_t now,
+                                  http_cache_policy_t* policy) {
+    const cache_directives_t* directives = &headers->directives;
+    time_t date = headers->date >= 0 ? headers->date : now;
+
+    memset(policy, 0, sizeof(*policy));
+    policy->validator = headers->has_etag || headers->last_modified >= 0;
+
+    if (status < 200 || status == 206 || status == 304) {
+        policy->reason = "status not storable";
+        return;
+    }
+    if (directives->no_store) {
+        policy->reason = "no-store";
+        return;
+    }
+    if (directives->is_private) {
+        policy->reason = "private";
+        return;
+    }
+    if (headers->vary_any) {
+        policy->reason = "Vary: *";
+        return;
+    }
+
+    // Explicit lifetime: s-maxage, then max-age, then Expires relative to Date
+    long long lifetime = -1;
+    if (directives->s_maxage >= 0) {
+        lifetime = directives->s_maxage;
+    } else if (directives->max_age >= 0) {
+        lifetime = directives->max_age;
+    } else if (headers->has_expires) {
+        lifetime = headers->expires > date ? (long long)(headers->expires - date) : 0;
+    } else if (status_heuristically_cacheable(status) || directives->is_public) {
+        // Heuristic: a resource unchanged for a long time is likely to stay unchanged
+        if (headers->last_modified >= 0 && headers->last_modified < date) {
+            lifetime = (long long)(date - headers->last_modified) / HTTP_HEURISTIC_FRACTION;
+            if (lifetime > HTTP_HEURISTIC_MAX_LIFETIME) {
+                lifetime = HTTP_HEURISTIC_MAX_LIFETIME;
+            }
+        } else if (policy->validator) {
+            lifetime = 0;               // Reusable only after asking the origin
+        }
+    }
+    if (lifetime < 0) {
+        policy->reason = "no freshness information";
+        return;
+    }
+    if (lifetime > HTTP_MAX_LIFETIME) {
+        lifetime = HTTP_MAX_LIFETIME;
+    }
+    if (directives->no_cache) {
+        lifetime = 0;                   // Must be revalidated before any reuse
+    }
+
+    // Age on arrival: the larger of the Age header and the Date-based estimate
+    long long apparent_age = now > date ? (long long)(now - date) : 0;
+    long long initial_age = headers->age > apparent_age ? headers->age : apparent_age;
+    policy->expires = now + (time_t)(lifetime - initial_age);
+
+    // A stale response is still worth keeping if it can be revalidated cheaply
+    if (lifetime <= initial_age && !policy->validator) {
+        policy->reason = "stale on arrival";
+        return;
+    }
+    policy->storable = 1;
+    policy->reason = NULL;
+}
+
+void http_response_cache_policy(const char* head, int head_length, time_t now, http_cache_policy_t* policy) {
+    int status = response_status(head, head_length);
+    if (status < 0) {
+        memset(policy, 0, sizeof(*policy));
+        policy->reason = "malformed response";
+        return;
+    }
+
+    freshness_headers_t headers;
+    freshness_headers_init(&headers);
+    for_each_header(head, head_length, &headers, collect_freshness_header);
+    evaluate_cache_policy(status, &headers, now, policy);
+}
+
+void http_revalidated_cache_policy(const char* stored_head, int stored_length,
+                                   const char* not_modified_head, int not_modified_length,
+                                   time_t now, http_cache_policy_t* policy) {
+    int status = response_status(stored_head, stored_length);
+    if (status < 0 || response_status(not_modified_head, not_modified_length) != 304) {
+        memset(policy, 0, sizeof(*policy));
+        policy->reason = "malformed response";
+        return;
+    }
+
+    // Headers in the 304 replace the stored ones; Date and Age describe the 304 itself
+    freshness_headers_t stored;
+    freshness_headers_t headers;
+    freshness_headers_init(&stored);
+    freshness_headers_init(&headers);
+    for_each_header(stored_head, stored_length, &stored, collect_freshness_header);
+    for_each_header(not_modified_head, not_modified_length, &headers, collect_freshness_header);
+
+    if (!headers.has_cache_control) {
+        headers.directives = stored.directives;
+    }
+    if (!headers.has_expires) {
+        headers.has_expires = stored.has_expires;
+        headers.expires = stored.expires;
+    }
+    if (headers.last_modified < 0) {
+        headers.last_modified = stored.last_modified;
+    }
+    headers.has_etag |= stored.has_etag;
+    headers.vary_any |= stored.vary_any;
+    evaluate_cache_policy(status, &headers, now, policy);
+}
+
+// Fields a 304 never updates: they describe its own connection or framing
+static int not_modified_excluded(const char* name, int name_len) {
+    static const char* const excluded[] = {
+        "Connection", "Keep-Alive", "Proxy-Connection", "Transfer-Encoding", "Content-Length",
+        "TE", "Trailer", "Upgrade"
+    };
+    for (size_t i = 0; i < sizeof(excluded) / sizeof(excluded[0]); i++) {
+        if ((int)strlen(excluded[i]) == name_len && strncasecmp(name, excluded[i], name_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    const char* name;
+    int name_len;
+    int found;
+} field_lookup_t;
+
+static void find_field(void* context, const char* name, int name_len, const char* value, int value_len) {
+    field_lookup_t* lookup = (field_lookup_t*)context;
+    (void)value;
+    (void)value_len;
+    if (name_len == lookup->name_len && strncasecmp(name, lookup->name, name_len) == 0) {
+        lookup->found = 1;
+    }
+}
+
+static int head_has_field(const char* head, int head_length, const char* name, int name_len) {
+    field_lookup_t lookup = { name, name_len, 0 };
+    for_each_header(head, head_length, &lookup, find_field);
+    return lookup.found;
+}
+
+// Appends the header lines of `head` (status line and blank line excluded) that keep() accepts
+static int copy_header_lines(char* out, const char* head, int head_length, const char* other, int other_length,
+                             int (*keep)(const char* name, int name_len, const char* other, int other_length)) {
+    int written = 0;
+    const char* head_end = head + head_length;
+    const char* line = memchr(head, '\n', head_length);
+    while (line && line + 1 < head_end) {
+        line++;
+        const char* line_end = memchr(line, '\n', head_end - line);
+        if (!line_end || line_end - line <= 1) {
+            break;
+        }
+
+        const char* colon = memchr(line, ':', line_end - line);
+        if (colon && keep(line, colon - line, other, other_length)) {
+            memcpy(out + written, line, line_end - line + 1);
+            written += line_end - line + 1;
+        }
+        line = line_end;
+    }
+    return written;
+}
+
+// A stored field survives unless the 304 replaces it; its Date makes the stored Age meaningless
+static int keep_stored_field(const char* name, int name_len, const char* not_modified, int not_modified_length) {
+    if (name_len == 3 && strncasecmp(name, "Age", 3) == 0 &&
+        head_has_field(not_modified, not_modified_length, "Date", 4)) {
+        return 0;
+    }
+    return not_modified_excluded(name, name_len) ||
+           !head_has_field(not_modified, not_modified_length, name, name_len);
+}
+
+static int keep_not_modified_field(const char* name, int name_len, const char* stored, int stored_length) {
+    (void)stored;
+    (void)stored_length;
+    return !not_modified_excluded(name, name_len);
+}
+
+char* http_merge_not_modified(const char* stored, int stored_length,
+                              const char* not_modified_head, int not_modified_length, int* merged_length) {
+    int stored_head = response_head_end(stored, stored_length);
+    if (stored_head == 0 || response_status(stored, stored_head) < 0 ||
+        response_status(not_modified_head, not_modified_length) != 304) {
+        return NULL;
+    }
+
+    // Every line comes from one head or the other, so both together bound the result
+    char* merged = malloc(stored_length + not_modified_length);
+    if (!merged) {
+        return NULL;
+    }
+
+    const char* status_end = memchr(stored, '\n', stored_head);
+    int written = status_end - stored + 1;
+    memcpy(merged, stored, written);
+    written += copy_header_lines(merged + written, stored, stored_head, not_modified_head, not_modified_length,
+                                 keep_stored_field);
+    written += copy_header_lines(merged + written, not_modified_head, not_modified_length, stored, stored_head,
+                                 keep_not_modified_field);
+    if (written + 2 > MAX_RESPONSE_HEAD_SIZE) {
+        free(merged);
+        return NULL;
+    }
+    memcpy(merged + written, "\r\n", 2);
+    written += 2;
+
+    memcpy(merged + written, stored + stored_head, stored_length - stored_head);
+    *merged_length = written + stored_length - stored_head;
+    return merged;
+}
+
+typedef struct {
+    char* out;
+    int out_size;
+    int written;
+} conditional_writer_t;
+
+static void collect_validator(void* context, const char* name, int name_len,
+                              const char* value, int value_len) {
+    conditional_writer_t* writer = (conditional_writer_t*)context;
+    const char* header = NULL;
+
+    if (name_len == 4 && strncasecmp(name, "ETag", 4) == 0) {
+        header = "If-None-Match";
+    } else if (name_len == 13 && strncasecmp(name, "Last-Modified", 13) == 0 &&
+               http_parse_date(value, value_len) >= 0) {
+        header = "If-Modified-Since";
+    }
+    if (!header || value_len <= 0 || writer->written < 0) {
+        return;
+    }
+
+    int room = writer->out_size - writer->written;
+    int length = snprintf(writer->out + writer->written, room, "%s: %.*s\r\n", header, value_len, value);
+    writer->written = (length < 0 || length >= room) ? -1 : writer->written + length;
+}
+
+int http_conditional_headers(const char* head, int head_length, char* out, int out_size) {
+    conditional_writer_t writer = { out, out_size, 0 };
+    if (out_size <= 0) {
+        return -1;
+    }
+    out[0] = '\0';
+    for_each_header(head, head_length, &writer, collect_validator);
+    if (writer.written < 0) {
+        out[0] = '\0';
+    }
+    return writer.written;
+}
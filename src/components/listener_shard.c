@@ -0,0 +1,226 @@
+#include "../../include/proxy/listener_shard.h"
+#include "../../include/proxy/proxy_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+// Listener Shard Implementation
+
+int listener_shards_supported(void) {
+#ifdef SO_REUSEPORT
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int listener_shards_default_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int cores = (int)info.dwNumberOfProcessors;
+#else
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (cores < 1) {
+        cores = 1;
+    }
+    if (cores > MAX_LISTENER_SHARDS) {
+        cores = MAX_LISTENER_SHARDS;
+    }
+    return cores;
+}
+
+static void* shard_thread(void* arg) {
+    listener_shard_t* shard = (listener_shard_t*)arg;
+
+    printf("[SHARD] Shard %d accepting on socket %d\n", shard->id, shard->listen_fd);
+
+    if (shard->loop) {
+        event_loop_run(shard->loop);
+    } else if (shard->scheduler) {
+        coroutine_scheduler_run(shard->scheduler);
+    } else {
+        run_accept_loop(shard->listen_fd, shard->pool, &shard->running);
+        if (proxy_server_draining()) {
+            thread_pool_wait_idle(shard->pool);
+        }
+    }
+
+    printf("[SHARD] Shard %d stopped\n", shard->id);
+    return NULL;
+}
+
+shard_group_t* shard_group_start(int port, int count, int mode) {
+    if (!listener_shards_supported()) {
+        printf("[SHARD] SO_REUSEPORT not supported on this platform\n");
+        return NULL;
+    }
+
+    if (count < 1) {
+        count = 1;
+    }
+    if (count > MAX_LISTENER_SHARDS) {
+        count = MAX_LISTENER_SHARDS;
+    }
+
+    shard_group_t* group = calloc(1, sizeof(shard_group_t));
+    if (!group) {
+        printf("[SHARD] Failed to allocate memory for shard group\n");
+        return NULL;
+    }
+    group->mode = mode;
+
+#ifndef _WIN32
+    // Shard threads inherit a mask that leaves shutdown signals to the main thread
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+#endif
+
+    for (int i = 0; i < count; i++) {
+        listener_shard_t* shard = &group->shards[i];
+        shard->id = i;
+        shard->node = affinity_group_node(i);
+        shard->running = 1;
+
+        // After an upgrade handoff the previous process's listeners are reused
+        shard->listen_fd = upgrade_inherited_listener(i);
+        if (shard->listen_fd < 0) {
+            shard->listen_fd = create_listener_socket(port, 1);
+        }
+        if (shard->listen_fd < 0) {
+            printf("[SHARD] Failed to create listener for shard %d\n", i);
+            break;
+        }
+        group->count++;
+
+        if (mode == SERVER_MODE_EVENT_LOOP) {
+            shard->loop = event_loop_create(shard->listen_fd);
+            if (!shard->loop) {
+                printf("[SHARD] Failed to create event loop for shard %d\n", i);
+                break;
+            }
+        } else if (mode == SERVER_MODE_COROUTINES) {
+            shard->scheduler = coroutine_scheduler_create(shard->listen_fd);
+            if (!shard->scheduler) {
+                printf("[SHARD] Failed to create coroutine scheduler for shard %d\n", i);
+                break;
+            }
+        } else {
+            shard->pool = thread_pool_create_on_node(proxy_config.min_workers, proxy_config.max_workers,
+                                                     shard->node);
+            if (!shard->pool) {
+                printf("[SHARD] Failed to create worker set for shard %d\n", i);
+                break;
+            }
+        }
+
+        // Shards are dealt to nodes round-robin; each takes the next CPU of its node
+        pthread_attr_t attr;
+        int nodes = affinity_node_count() > 0 ? affinity_node_count() : 1;
+        int cpu = affinity_cpu(shard->node, i / nodes);
+        int pinned = affinity_thread_attr(&attr, cpu) == 0;
+        int created = pthread_create(&shard->thread, pinned ? &attr : NULL, shard_thread, shard);
+        if (pinned) {
+            pthread_attr_destroy(&attr);
+        }
+        if (created != 0) {
+            printf("[SHARD] Failed to start shard %d\n", i);
+            break;
+        }
+        shard->thread_started = 1;
+        if (pinned) {
+            printf("[AFFINITY] Shard %d pinned to CPU %d (node %d)\n", i, cpu, shard->node);
+        }
+    }
+
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+#endif
+
+    if (group->count != count || !group->shards[count - 1].thread_started) {
+        shard_group_destroy(group);
+        return NULL;
+    }
+
+    printf("[SHARD] Started %d listener shards on port %d (%s)\n",
+           count, port, mode == SERVER_MODE_EVENT_LOOP ? "event loop" :
+                        mode == SERVER_MODE_COROUTINES ? "coroutines" : "thread pool");
+    return group;
+}
+
+void shard_group_drain(shard_group_t* group) {
+    if (!group) return;
+
+    // Thread pool acceptors are woken by proxy_server_drain()
+    for (int i = 0; i < group->count; i++) {
+        listener_shard_t* shard = &group->shards[i];
+        shard->running = 0;
+        if (shard->loop) {
+            event_loop_drain(shard->loop);
+        }
+        if (shard->scheduler) {
+            coroutine_scheduler_drain(shard->scheduler);
+        }
+    }
+}
+
+void shard_group_wait(shard_group_t* group) {
+    if (!group) return;
+
+    for (int i = 0; i < group->count; i++) {
+        if (group->shards[i].thread_started) {
+            pthread_join(group->shards[i].thread, NULL);
+            group->shards[i].thread_started = 0;
+        }
+    }
+}
+
+void shard_group_destroy(shard_group_t* group) {
+    if (!group) return;
+
+    printf("[SHARD] Stopping %d listener shards...\n", group->count);
+
+    // Wake every acceptor: shutting the listener down fails any blocked accept()
+    for (int i = 0; i < group->count; i++) {
+        listener_shard_t* shard = &group->shards[i];
+        shard->running = 0;
+        if (shard->loop) {
+            event_loop_stop(shard->loop);
+        }
+        if (shard->scheduler) {
+            coroutine_scheduler_stop(shard->scheduler);
+        }
+        // A listener handed to the next process must keep working there
+        if (!proxy_server_draining()) {
+            shutdown(shard->listen_fd, SHUT_RDWR);
+        }
+    }
+
+    shard_group_wait(group);
+
+    for (int i = 0; i < group->count; i++) {
+        listener_shard_t* shard = &group->shards[i];
+        if (shard->loop) {
+            event_loop_destroy(shard->loop);
+        }
+        if (shard->scheduler) {
+            coroutine_scheduler_destroy(shard->scheduler);
+        }
+        if (shard->pool) {
+            thread_pool_destroy(shard->pool);
+        }
+        socket_close(shard->listen_fd);
+    }
+
+    free(group);
+    printf("[SHARD] Listener shards stopped\n");
+}
@@ -1,7 +1,17 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // splice()
+#endif
+
 #include "../../include/proxy/platform.h"
+#include "../../include/proxy/coroutine.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
 
 // Platform Compatibility Implementation
 
@@ -43,6 +53,16 @@
         return closesocket(sock);
     }
     
+    int socket_set_nonblocking(socket_t sock) {
+        u_long mode = 1;
+        return ioctlsocket(sock, FIONBIO, &mode) == 0 ? 0 : -1;
+    }
+    
+    int socket_set_blocking(socket_t sock) {
+        u_long mode = 0;
+        return ioctlsocket(sock, FIONBIO, &mode) == 0 ? 0 : -1;
+    }
+    
     // Windows bzero implementation
     void bzero(void *s, size_t n) {
         memset(s, 0, n);
@@ -73,9 +93,28 @@
     
     // Cross-platform socket close
     int socket_close(socket_t sock) {
+#ifdef __linux__
+        uring_forget_fd(sock);
+#endif
         return close(sock);
     }
     
+    int socket_set_nonblocking(socket_t sock) {
+        int flags = fcntl(sock, F_GETFL, 0);
+        if (flags < 0) {
+            return -1;
+        }
+        return fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0 ? 0 : -1;
+    }
+    
+    int socket_set_blocking(socket_t sock) {
+        int flags = fcntl(sock, F_GETFL, 0);
+        if (flags < 0) {
+            return -1;
+        }
+        return fcntl(sock, F_SETFL, flags & ~O_NONBLOCK) == 0 ? 0 : -1;
+    }
+    
     // Unix already has bzero and bcopy, but provide stubs for consistency
     void bzero(void *s, size_t n) {
         memset(s, 0, n);
@@ -86,3 +125,256 @@
     }
     
 #endif
+
+// I/O backend dispatch
+
+static io_backend_t active_io_backend = IO_BACKEND_SOCKETS;
+
+const char* platform_io_backend_name(io_backend_t backend) {
+    return backend == IO_BACKEND_URING ? "io_uring" : "sockets";
+}
+
+io_backend_t platform_io_init(io_backend_t requested) {
+    active_io_backend = IO_BACKEND_SOCKETS;
+
+    if (requested == IO_BACKEND_URING) {
+#ifdef __linux__
+        if (uring_available()) {
+            active_io_backend = IO_BACKEND_URING;
+        } else {
+            printf("[PLATFORM] io_uring unavailable, falling back to sockets\n");
+        }
+#else
+        printf("[PLATFORM] io_uring is Linux only, falling back to sockets\n");
+#endif
+    }
+
+    printf("[PLATFORM] I/O backend: %s\n", platform_io_backend_name(active_io_backend));
+    return active_io_backend;
+}
+
+io_backend_t platform_io_backend(void) {
+    return active_io_backend;
+}
+
+socket_t platform_accept(socket_t sock, struct sockaddr* addr, socklen_t* addrlen) {
+#ifdef __linux__
+    if (active_io_backend == IO_BACKEND_URING) {
+        return uring_accept(sock, addr, addrlen);
+    }
+#endif
+    return accept(sock, addr, addrlen);
+}
+
+int platform_recv(socket_t sock, char* buf, int len, int flags) {
+#ifdef __linux__
+    if (active_io_backend == IO_BACKEND_URING) {
+        return uring_recv(sock, buf, len, flags);
+    }
+    // A coroutine handler parks instead of blocking the scheduler thread
+    if (coroutine_active()) {
+        return coroutine_recv(sock, buf, len, flags);
+    }
+#endif
+    return recv(sock, buf, len, flags);
+}
+
+int platform_send(socket_t sock, const char* buf, int len, int flags) {
+#ifdef __linux__
+    if (active_io_backend == IO_BACKEND_URING) {
+        return uring_send(sock, buf, len, flags);
+    }
+    if (coroutine_active()) {
+        return coroutine_send(sock, buf, len, flags);
+    }
+#endif
+    return send(sock, buf, len, flags);
+}
+
+int platform_send_all(socket_t sock, const char* buf, int len) {
+    int sent = 0;
+    while (sent < len) {
+        int n = platform_send(sock, buf + sent, len - sent, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        sent += n;
+    }
+    return sent;
+}
+
+int platform_send_recv(socket_t sock, const char* request, int request_len, char* response, int response_len) {
+#ifdef __linux__
+    // Request and first read go to the kernel in a single linked submission
+    if (active_io_backend == IO_BACKEND_URING) {
+        return uring_send_recv(sock, request, request_len, response, response_len);
+    }
+    if (coroutine_active()) {
+        if (coroutine_send(sock, request, request_len, 0) != request_len) {
+            return -1;
+        }
+        return coroutine_recv(sock, response, response_len, 0);
+    }
+#endif
+    int sent = 0;
+    while (sent < request_len) {
+        int n = send(sock, request + sent, request_len - sent, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        sent += n;
+    }
+    return recv(sock, response, response_len, 0);
+}
+
+int platform_set_recv_timeout(socket_t sock, int timeout_ms) {
+#ifdef _WIN32
+    DWORD timeout = timeout_ms;
+    return setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+#else
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+#ifdef __linux__
+    // io_uring ignores SO_RCVTIMEO, so the backend arms a linked timeout instead
+    uring_set_recv_timeout(sock, timeout_ms);
+#endif
+    return setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+}
+
+char* platform_io_buffer(int size) {
+#ifdef __linux__
+    if (active_io_backend == IO_BACKEND_URING) {
+        return uring_fixed_buffer(size);
+    }
+#endif
+    (void)size;
+    return NULL;
+}
+
+// Zero-copy relay
+
+#ifdef __linux__
+#define SPLICE_PIPE_SIZE (256 * 1024)
+
+// Each worker thread moves bytes through its own pipe, created on first use
+typedef struct {
+    int read_fd;
+    int write_fd;
+} splice_pipe_t;
+
+static pthread_key_t splice_key;
+static pthread_once_t splice_key_once = PTHREAD_ONCE_INIT;
+
+static void splice_pipe_close(void* arg) {
+    splice_pipe_t* pipe_pair = (splice_pipe_t*)arg;
+    if (pipe_pair) {
+        close(pipe_pair->read_fd);
+        close(pipe_pair->write_fd);
+        free(pipe_pair);
+    }
+}
+
+static void splice_key_create(void) {
+    pthread_key_create(&splice_key, splice_pipe_close);
+}
+
+static splice_pipe_t* splice_pipe_get(void) {
+    pthread_once(&splice_key_once, splice_key_create);
+
+    splice_pipe_t* pipe_pair = pthread_getspecific(splice_key);
+    if (pipe_pair) {
+        return pipe_pair;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("[PLATFORM] pipe2 failed");
+        return NULL;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+
+    pipe_pair = malloc(sizeof(splice_pipe_t));
+    if (!pipe_pair) {
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+    pipe_pair->read_fd = fds[0];
+    pipe_pair->write_fd = fds[1];
+    pthread_setspecific(splice_key, pipe_pair);
+    return pipe_pair;
+}
+
+// A pipe left holding bytes after a failure cannot be reused for another relay
+static void splice_pipe_discard(splice_pipe_t* pipe_pair) {
+    pthread_setspecific(splice_key, NULL);
+    splice_pipe_close(pipe_pair);
+}
+#endif
+
+int platform_splice_supported(void) {
+#ifdef __linux__
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// Move `length` bytes (or until EOF when length < 0) from one socket to another
+// without copying them through user space. Returns the bytes moved, -1 on error;
+// *eof is set when the source closed first.
+long long platform_splice(socket_t from, socket_t to, long long length, int* eof) {
+    *eof = 0;
+#ifdef __linux__
+    splice_pipe_t* pipe_pair = splice_pipe_get();
+    if (!pipe_pair) {
+        return -1;
+    }
+
+    long long moved = 0;
+    while (length < 0 || moved < length) {
+        size_t want = SPLICE_PIPE_SIZE;
+        if (length >= 0 && length - moved < (long long)want) {
+            want = (size_t)(length - moved);
+        }
+
+        ssize_t filled = splice(from, NULL, pipe_pair->write_fd, NULL, want,
+                                SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (filled < 0 && errno == EINTR) {
+            continue;
+        }
+        if (filled < 0) {
+            splice_pipe_discard(pipe_pair);
+            return -1;
+        }
+        if (filled == 0) {
+            *eof = 1;
+            break;
+        }
+
+        // Drain the pipe completely so it is empty for the next relay
+        ssize_t pending = filled;
+        while (pending > 0) {
+            ssize_t drained = splice(pipe_pair->read_fd, NULL, to, NULL, pending,
+                                     SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (drained < 0 && errno == EINTR) {
+                continue;
+            }
+            if (drained <= 0) {
+                splice_pipe_discard(pipe_pair);
+                return -1;
+            }
+            pending -= drained;
+        }
+        moved += filled;
+    }
+    return moved;
+#else
+    (void)from;
+    (void)to;
+    (void)length;
+    return -1;
+#endif
+}
@@ -0,0 +1,616 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // syscall(), MAP_POPULATE, posix_memalign()
+#endif
+
+#include "../../include/proxy/platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// io_uring I/O Backend Implementation
+// Each thread lazily gets its own ring. Blocking socket calls become one
+// submit-and-wait per operation, the acceptor keeps a multishot accept armed,
+// receives into the thread's registered buffer use READ_FIXED, and a request
+// send plus its first response read go to the kernel as one linked batch.
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define URING_QUEUE_DEPTH 64
+#define URING_FIXED_BUFFER_SIZE (64 * 1024)
+#define URING_MAX_TRACKED_FDS 65536
+#define URING_MAX_BACKLOG (1 << 20)  // Accepted clients held at most (bounded by RLIMIT_NOFILE first)
+
+// user_data tags identify what a completion belongs to
+#define URING_TAG_OP      1ULL
+#define URING_TAG_ACCEPT  2ULL
+#define URING_TAG_TIMEOUT 3ULL
+#define URING_TAG(tag, seq) (((uint64_t)(tag) << 56) | ((seq) & 0x00FFFFFFFFFFFFFFULL))
+#define URING_TAG_OF(user_data) ((user_data) >> 56)
+
+typedef struct {
+    int ring_fd;
+
+    // Submission queue
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+
+    // Completion queue
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ptr;
+    size_t sq_len;
+    void* cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+
+    uint64_t next_seq;
+
+    // Registered receive buffer (buffer index 0)
+    char* fixed_buffer;
+    int fixed_size;
+
+    // Multishot accept state
+    int accept_fd;
+    int accept_armed;
+    int accept_error;
+    int* accepted;              // Clients the kernel accepted that uring_accept() has not returned yet
+    int accepted_capacity;
+    int accepted_head;
+    int accepted_count;
+} uring_t;
+
+static pthread_key_t uring_key;
+static pthread_once_t uring_key_once = PTHREAD_ONCE_INIT;
+static int uring_multishot_accept = 0;
+static int uring_recv_timeouts[URING_MAX_TRACKED_FDS];
+
+static int uring_sys_setup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_sys_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_teardown(uring_t* ring) {
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    if (ring->sq_ptr) {
+        munmap(ring->sq_ptr, ring->sq_len);
+    }
+    if (ring->ring_fd >= 0) {
+        close(ring->ring_fd);
+    }
+    free(ring->fixed_buffer);
+    while (ring->accepted_count > 0) {
+        close(ring->accepted[ring->accepted_head]);
+        ring->accepted_head = (ring->accepted_head + 1) % ring->accepted_capacity;
+        ring->accepted_count--;
+    }
+    free(ring->accepted);
+    ring->ring_fd = -1;
+}
+
+static int uring_setup(uring_t* ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->accept_fd = -1;
+
+    ring->ring_fd = uring_sys_setup(URING_QUEUE_DEPTH, &params);
+    if (ring->ring_fd < 0) {
+        return -1;
+    }
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) {
+            ring->sq_len = ring->cq_len;
+        }
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        uring_teardown(ring);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            uring_teardown(ring);
+            return -1;
+        }
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_teardown(ring);
+        return -1;
+    }
+
+    char* sq = (char*)ring->sq_ptr;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+
+    char* cq = (char*)ring->cq_ptr;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+static void uring_thread_exit(void* arg) {
+    uring_t* ring = (uring_t*)arg;
+    if (ring->ring_fd >= 0) {
+        uring_teardown(ring);
+    }
+    free(ring);
+}
+
+static void uring_make_key(void) {
+    pthread_key_create(&uring_key, uring_thread_exit);
+}
+
+// Returns the calling thread's ring, or NULL if one cannot be created
+static uring_t* uring_thread_ring(void) {
+    pthread_once(&uring_key_once, uring_make_key);
+
+    uring_t* ring = (uring_t*)pthread_getspecific(uring_key);
+    if (ring) {
+        return ring->ring_fd >= 0 ? ring : NULL;
+    }
+
+    ring = malloc(sizeof(uring_t));
+    if (!ring) {
+        return NULL;
+    }
+    if (uring_setup(ring) < 0) {
+        printf("[URING] Failed to create ring for thread, using sockets\n");
+        ring->ring_fd = -1;
+    }
+    pthread_setspecific(uring_key, ring);
+    return ring->ring_fd >= 0 ? ring : NULL;
+}
+
+// No SQPOLL: the kernel only reads queued entries inside io_uring_enter()
+static struct io_uring_sqe* uring_get_sqe(uring_t* ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail;
+    if (tail - head >= ring->sq_entries) {
+        return NULL;
+    }
+
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+static int uring_pop_cqe(uring_t* ring, struct io_uring_cqe* out) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return 0;
+    }
+
+    *out = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Submit everything queued and block until at least one completion is available.
+// An interruptible wait fails with EINTR on a signal, like a blocking accept().
+static int uring_submit_and_wait(uring_t* ring, int interruptible) {
+    while (1) {
+        unsigned to_submit = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        int ret = uring_sys_enter(ring->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (ret >= 0) {
+            return 0;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return -1;
+        }
+
+        // Interrupted with completions already posted: let the caller reap them
+        if (*ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        if (interruptible && errno == EINTR) {
+            return -1;
+        }
+    }
+}
+
+// A burst can post a whole completion queue of accepts at once, and other
+// operations on the acceptor's ring reap them too, so the backlog has room
+// for every descriptor the process may hold: an accepted client is never dropped
+static int uring_alloc_backlog(uring_t* ring) {
+    struct rlimit limit;
+    rlim_t capacity = URING_MAX_BACKLOG;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < capacity) {
+        capacity = limit.rlim_cur;
+    }
+
+    ring->accepted = malloc((size_t)capacity * sizeof(int));
+    if (!ring->accepted) {
+        return -1;
+    }
+    ring->accepted_capacity = (int)capacity;
+    return 0;
+}
+
+// Completions that belong to someone else are absorbed here
+static void uring_absorb(uring_t* ring, const struct io_uring_cqe* cqe) {
+    if (URING_TAG_OF(cqe->user_data) != URING_TAG_ACCEPT) {
+        return;  // Linked timeouts and cancelled operations carry nothing to deliver
+    }
+
+    if (cqe->res >= 0) {
+        int slot = (ring->accepted_head + ring->accepted_count) % ring->accepted_capacity;
+        ring->accepted[slot] = cqe->res;
+        ring->accepted_count++;
+    } else {
+        ring->accept_error = -cqe->res;
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        ring->accept_armed = 0;
+    }
+}
+
+// Wait until every completion in user_data[] has arrived and collect the results
+static int uring_wait_all(uring_t* ring, const uint64_t* user_data, int* results, int count) {
+    struct io_uring_cqe cqe;
+    int remaining = count;
+
+    while (1) {
+        while (uring_pop_cqe(ring, &cqe)) {
+            int matched = 0;
+            for (int i = 0; i < count; i++) {
+                if (cqe.user_data == user_data[i]) {
+                    results[i] = cqe.res;
+                    remaining--;
+                    matched = 1;
+                    break;
+                }
+            }
+            if (!matched) {
+                uring_absorb(ring, &cqe);
+            }
+        }
+
+        if (remaining == 0) {
+            return 0;
+        }
+
+        if (uring_submit_and_wait(ring, 0) < 0) {
+            return -1;
+        }
+    }
+}
+
+static int uring_wait_for(uring_t* ring, uint64_t user_data, int* result) {
+    return uring_wait_all(ring, &user_data, result, 1);
+}
+
+static void uring_link_timeout(uring_t* ring, struct io_uring_sqe* op, struct __kernel_timespec* ts, int timeout_ms) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        return;
+    }
+
+    ts->tv_sec = timeout_ms / 1000;
+    ts->tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+
+    op->flags |= IOSQE_IO_LINK;
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)ts;
+    sqe->len = 1;
+    sqe->user_data = URING_TAG(URING_TAG_TIMEOUT, ring->next_seq++);
+}
+
+static void uring_prep_recv(uring_t* ring, struct io_uring_sqe* sqe, int sock, char* buf, int len, int flags) {
+    sqe->fd = sock;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+
+    // Reads landing entirely inside the registered buffer skip per-call page pinning
+    if (flags == 0 && ring->fixed_buffer && buf >= ring->fixed_buffer &&
+        buf + len <= ring->fixed_buffer + ring->fixed_size) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = 0;
+        sqe->off = (uint64_t)-1;
+    } else {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->msg_flags = flags;
+    }
+}
+
+static int uring_result(int res) {
+    if (res == -ECANCELED || res == -ETIME) {
+        errno = EAGAIN;  // Same as a blocking recv hitting SO_RCVTIMEO
+        return -1;
+    }
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
+
+static int uring_recv_timeout(int sock) {
+    if (sock >= 0 && sock < URING_MAX_TRACKED_FDS) {
+        return uring_recv_timeouts[sock];
+    }
+    return 0;
+}
+
+int uring_available(void) {
+    uring_t probe_ring;
+    if (uring_setup(&probe_ring) < 0) {
+        return 0;
+    }
+
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, probe_size);
+    int supported = 0;
+
+    if (probe && uring_sys_register(probe_ring.ring_fd, IORING_REGISTER_PROBE, probe, 256) >= 0) {
+        int needed[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND,
+                         IORING_OP_READ_FIXED, IORING_OP_LINK_TIMEOUT };
+        supported = 1;
+        for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+            if (needed[i] > probe->last_op ||
+                !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+                supported = 0;
+            }
+        }
+
+        // Multishot accept shipped in the same release (5.19) as IORING_OP_SOCKET
+        uring_multishot_accept = IORING_OP_SOCKET <= probe->last_op &&
+                                 (probe->ops[IORING_OP_SOCKET].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free(probe);
+    uring_teardown(&probe_ring);
+
+    if (supported) {
+        printf("[URING] io_uring available (multishot accept: %s)\n",
+               uring_multishot_accept ? "yes" : "no");
+    }
+    return supported;
+}
+
+char* uring_fixed_buffer(int size) {
+    uring_t* ring = uring_thread_ring();
+    if (!ring || size > URING_FIXED_BUFFER_SIZE) {
+        return NULL;
+    }
+
+    if (!ring->fixed_buffer) {
+        void* buffer = NULL;
+        if (posix_memalign(&buffer, 4096, URING_FIXED_BUFFER_SIZE) != 0) {
+            return NULL;
+        }
+
+        struct iovec iov;
+        iov.iov_base = buffer;
+        iov.iov_len = URING_FIXED_BUFFER_SIZE;
+        if (uring_sys_register(ring->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+            printf("[URING] Failed to register fixed buffer (errno %d)\n", errno);
+            free(buffer);
+            return NULL;
+        }
+
+        ring->fixed_buffer = (char*)buffer;
+        ring->fixed_size = URING_FIXED_BUFFER_SIZE;
+    }
+
+    return ring->fixed_buffer;
+}
+
+void uring_set_recv_timeout(int sock, int timeout_ms) {
+    if (sock >= 0 && sock < URING_MAX_TRACKED_FDS) {
+        uring_recv_timeouts[sock] = timeout_ms;
+    }
+}
+
+void uring_forget_fd(int sock) {
+    uring_set_recv_timeout(sock, 0);
+}
+
+int uring_accept(int sock, struct sockaddr* addr, socklen_t* addrlen) {
+    uring_t* ring = uring_thread_ring();
+    if (!ring) {
+        return accept(sock, addr, addrlen);
+    }
+
+    if (ring->accept_fd != sock) {
+        ring->accept_fd = sock;
+        ring->accept_armed = 0;
+    }
+
+    while (1) {
+        if (ring->accepted_count > 0) {
+            int client = ring->accepted[ring->accepted_head];
+            ring->accepted_head = (ring->accepted_head + 1) % ring->accepted_capacity;
+            ring->accepted_count--;
+
+            if (addr && addrlen) {
+                getpeername(client, addr, addrlen);
+            }
+            return client;
+        }
+
+        if (ring->accept_error) {
+            errno = ring->accept_error;
+            ring->accept_error = 0;
+            return -1;
+        }
+
+        // One multishot accept keeps posting a completion per new connection
+        if (!ring->accept_armed) {
+            struct io_uring_sqe* sqe = ring->accepted || uring_alloc_backlog(ring) == 0 ? uring_get_sqe(ring) : NULL;
+            if (!sqe) {
+                return accept(sock, addr, addrlen);
+            }
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = sock;
+            if (uring_multishot_accept) {
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            }
+            sqe->user_data = URING_TAG(URING_TAG_ACCEPT, 0);
+            ring->accept_armed = 1;
+        }
+
+        // Reap whatever has already completed before asking the kernel for more
+        struct io_uring_cqe cqe;
+        int reaped = 0;
+        while (uring_pop_cqe(ring, &cqe)) {
+            uring_absorb(ring, &cqe);
+            reaped = 1;
+        }
+        // A drain wakes the acceptor with a signal: return so it sees it should stop
+        if (!reaped && uring_submit_and_wait(ring, 1) < 0) {
+            return -1;
+        }
+    }
+}
+
+int uring_recv(int sock, char* buf, int len, int flags) {
+    uring_t* ring = uring_thread_ring();
+    struct io_uring_sqe* sqe = ring ? uring_get_sqe(ring) : NULL;
+    if (!sqe) {
+        return recv(sock, buf, len, flags);
+    }
+
+    uint64_t user_data = URING_TAG(URING_TAG_OP, ring->next_seq++);
+    uring_prep_recv(ring, sqe, sock, buf, len, flags);
+    sqe->user_data = user_data;
+
+    struct __kernel_timespec ts;
+    int timeout_ms = uring_recv_timeout(sock);
+    if (timeout_ms > 0) {
+        uring_link_timeout(ring, sqe, &ts, timeout_ms);
+    }
+
+    int res;
+    if (uring_wait_for(ring, user_data, &res) < 0) {
+        return -1;
+    }
+    return uring_result(res);
+}
+
+int uring_send(int sock, const char* buf, int len, int flags) {
+    uring_t* ring = uring_thread_ring();
+    struct io_uring_sqe* sqe = ring ? uring_get_sqe(ring) : NULL;
+    if (!sqe) {
+        return send(sock, buf, len, flags);
+    }
+
+    uint64_t user_data = URING_TAG(URING_TAG_OP, ring->next_seq++);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = sock;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->msg_flags = flags | MSG_NOSIGNAL | MSG_WAITALL;  // Blocking send() semantics: all or error
+    sqe->user_data = user_data;
+
+    int res;
+    if (uring_wait_for(ring, user_data, &res) < 0) {
+        return -1;
+    }
+    return uring_result(res);
+}
+
+int uring_send_recv(int sock, const char* request, int request_len, char* response, int response_len) {
+    uring_t* ring = uring_thread_ring();
+    if (!ring || *ring->sq_tail - *ring->sq_head + 3 > ring->sq_entries) {
+        if (platform_send(sock, request, request_len, 0) != request_len) {
+            return -1;
+        }
+        return platform_recv(sock, response, response_len, 0);
+    }
+
+    // send -> recv [-> link timeout], submitted with a single io_uring_enter()
+    uint64_t send_data = URING_TAG(URING_TAG_OP, ring->next_seq++);
+    struct io_uring_sqe* send_sqe = uring_get_sqe(ring);
+    send_sqe->opcode = IORING_OP_SEND;
+    send_sqe->fd = sock;
+    send_sqe->addr = (uint64_t)(uintptr_t)request;
+    send_sqe->len = request_len;
+    send_sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    send_sqe->flags = IOSQE_IO_LINK;
+    send_sqe->user_data = send_data;
+
+    uint64_t recv_data = URING_TAG(URING_TAG_OP, ring->next_seq++);
+    struct io_uring_sqe* recv_sqe = uring_get_sqe(ring);
+    uring_prep_recv(ring, recv_sqe, sock, response, response_len, 0);
+    recv_sqe->user_data = recv_data;
+
+    struct __kernel_timespec ts;
+    int timeout_ms = uring_recv_timeout(sock);
+    if (timeout_ms > 0) {
+        uring_link_timeout(ring, recv_sqe, &ts, timeout_ms);
+    }
+
+    uint64_t waits[2] = { send_data, recv_data };
+    int results[2];
+    if (uring_wait_all(ring, waits, results, 2) < 0) {
+        return -1;
+    }
+    int send_res = results[0];
+    int recv_res = results[1];
+
+    if (send_res != request_len) {
+        errno = send_res < 0 ? -send_res : EPIPE;
+        return -1;
+    }
+    return uring_result(recv_res);
+}
+
+#endif
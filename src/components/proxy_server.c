@@ -1,42 +1,156 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // sem_timedwait()
+#endif
+
 #include "../../include/proxy/proxy_server.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 
+// Windows compatibility for strcasecmp and shutdown()
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#define SHUT_WR SD_SEND
+#else
+#include <strings.h>
+#include <poll.h>
+#include <time.h>
+#include <netinet/tcp.h>
+
+#define DRAIN_WAKEUP_SIGNAL SIGUSR2  // Interrupts an acceptor blocked in accept() when draining
+#endif
+
 // Core Proxy Server Implementation
 
+// Cleared to stop the single-listener accept loop
+static volatile int server_running = 1;
+
+// Set once the listeners belong to a successor (see upgrade.h)
+static volatile int server_draining = 0;
+static event_loop_t* server_loop = NULL;      // Single-listener event loop, drained in place
+
+// Thread pool accept loops currently running, so draining can interrupt them
+static pthread_mutex_t acceptors_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t acceptors[MAX_LISTENER_SHARDS];
+static int acceptor_count = 0;
+
+// Connections shed at accept time, and those let through because the cache could answer them
+static long long shed_total = 0;
+static long long shed_bypassed_total = 0;
+
+// Stop requests and the server's own return, both waited for by proxy_server_run()
+static sem_t server_events;
+static volatile sig_atomic_t stop_signal = 0;
+static volatile int server_finished = 0;
+
 int proxy_server_init(int port) {
     printf("[INIT] Initializing proxy server on port %d...\n", port);
 
     // Initialize platform-specific networking
     platform_init();
+    proxy_config.io_backend = platform_io_init(proxy_config.io_backend);
+
+    // Select CPUs before any thread is started so every one can be pinned from birth
+    if (affinity_init(proxy_config.cpu_affinity) != 0) {
+        printf("[INIT] Failed to apply --cpu-affinity %s\n", proxy_config.cpu_affinity);
+        return -1;
+    }
 
     // Initialize synchronization primitives
     if (sem_init(&semaphore, 0, MAX_CLIENTS) != 0) {
         printf("[INIT] Failed to initialize semaphore\n");
         return -1;
     }
+    if (sem_init(&server_events, 0, 0) != 0) {
+        printf("[INIT] Failed to initialize server events\n");
+        return -1;
+    }
 
     if (pthread_mutex_init(&lock, NULL) != 0) {
         printf("[INIT] Failed to initialize mutex\n");
         return -1;
     }
 
-    // Initialize thread pool
-    thread_pool = thread_pool_create();
-    if (thread_pool == NULL) {
-        printf("[INIT] Failed to create thread pool\n");
-        return -1;
+    // Fall back to the thread pool where the reactor is unavailable
+    if (proxy_config.mode == SERVER_MODE_EVENT_LOOP && !event_loop_supported()) {
+        printf("[INIT] Event loop not supported on this platform, using thread pool\n");
+        proxy_config.mode = SERVER_MODE_THREAD_POOL;
+    }
+    if (proxy_config.mode == SERVER_MODE_COROUTINES && !coroutines_supported()) {
+        printf("[INIT] Coroutine handlers not supported on this platform, using thread pool\n");
+        proxy_config.mode = SERVER_MODE_THREAD_POOL;
+    }
+
+    // io_uring rings and splice pipes are per thread; handlers sharing a
+    // scheduler thread would interleave on them, so coroutines use plain sockets
+    if (proxy_config.mode == SERVER_MODE_COROUTINES && proxy_config.io_backend != IO_BACKEND_SOCKETS) {
+        printf("[INIT] Coroutine handlers use the sockets I/O backend\n");
+        proxy_config.io_backend = platform_io_init(IO_BACKEND_SOCKETS);
+    }
+    if (proxy_config.mode == SERVER_MODE_COROUTINES && proxy_config.zero_copy) {
+        printf("[INIT] Zero-copy relay not available to coroutine handlers, copying responses\n");
+        proxy_config.zero_copy = 0;
+    }
+
+    if (proxy_config.zero_copy && !platform_splice_supported()) {
+        printf("[INIT] Zero-copy relay not supported on this platform, copying responses\n");
+        proxy_config.zero_copy = 0;
+    }
+
+    if (proxy_config.shards > 0 && !listener_shards_supported()) {
+        printf("[INIT] SO_REUSEPORT shards not supported on this platform, using one listener\n");
+        proxy_config.shards = 0;
+    }
+
+    // A server waiting on the upgrade socket hands over its listeners, and
+    // their layout (one listener or N shards) decides ours
+    if (proxy_config.upgrade_socket) {
+        int sharded = 0;
+        int inherited = upgrade_takeover(proxy_config.upgrade_socket, &sharded);
+        if (inherited < 0) {
+            printf("[INIT] Failed to take over from the running server\n");
+            return -1;
+        }
+        if (inherited > 0 && proxy_config.shards != (sharded ? inherited : 0)) {
+            printf("[INIT] Keeping the running server's listeners (%d shards)\n", sharded ? inherited : 0);
+            proxy_config.shards = sharded ? inherited : 0;
+        }
+    }
+
+    // Initialize thread pool (the event loop serves requests on its own thread,
+    // and every listener shard brings its own worker set)
+    if (proxy_config.mode == SERVER_MODE_THREAD_POOL && proxy_config.shards == 0) {
+        thread_pool = thread_pool_create(proxy_config.min_workers, proxy_config.max_workers);
+        if (thread_pool == NULL) {
+            printf("[INIT] Failed to create thread pool\n");
+            return -1;
+        }
     }
 
-    // Initialize optimized cache
-    optimized_cache = cache_create();
+    // Initialize optimized cache (entries live in slab arenas)
+    slab_use_huge_pages(proxy_config.cache_huge_pages);
+    optimized_cache = cache_create_sized(proxy_config.cache_max_bytes, proxy_config.cache_max_object, CACHE_SHARDS);
     if (optimized_cache == NULL) {
         printf("[INIT] Failed to create optimized cache\n");
         return -1;
     }
 
+    // The previous server keeps serving meanwhile, so a large cache costs no downtime
+    if (upgrade_receive_cache(optimized_cache, proxy_config.cache_handoff) < 0) {
+        printf("[INIT] Handoff from the running server failed\n");
+        return -1;
+    }
+
+    // Concurrent misses on one URL wait for a single upstream fetch
+    request_collapse = collapse_create();
+    if (request_collapse == NULL) {
+        printf("[INIT] Failed to create request collapsing\n");
+        return -1;
+    }
+
     // Initialize connection pool
     connection_pool = connection_pool_create(MAX_POOL_SIZE);
     if (connection_pool == NULL) {
@@ -44,31 +158,252 @@ int proxy_server_init(int port) {
         return -1;
     }
 
+    // Initialize the caching resolver used for every new upstream connection
+    dns_resolver = resolver_create(proxy_config.hosts_file);
+    if (dns_resolver == NULL) {
+        printf("[INIT] Failed to create resolver\n");
+        return -1;
+    }
+
     printf("[INIT] All modules initialized successfully\n");
     return 0;
 }
 
 void proxy_server_start(void) {
-    int server_socket, client_socket;
-    struct sockaddr_in server_address, client_address;
-    socklen_t client_length;
+    int server_socket;
+
+    if (proxy_config.shards > 0) {
+        shard_group = shard_group_start(port_number, proxy_config.shards, proxy_config.mode);
+        if (shard_group == NULL) {
+            printf("[SERVER] Failed to start listener shards\n");
+            return;
+        }
+
+        int listen_fds[MAX_LISTENER_SHARDS];
+        for (int i = 0; i < shard_group->count; i++) {
+            listen_fds[i] = shard_group->shards[i].listen_fd;
+        }
+        upgrade_start(proxy_config.upgrade_socket, listen_fds, shard_group->count, 1);
 
-    // Create server socket
-    server_socket = create_server_socket(port_number);
+        printf("[SERVER] Ready to accept connections (%d shards)...\n", shard_group->count);
+        shard_group_wait(shard_group);
+        return;
+    }
+
+    // Create server socket (or keep the one the previous server handed over)
+    server_socket = upgrade_inherited_listener(0);
+    if (server_socket < 0) {
+        server_socket = create_server_socket(port_number);
+    }
     if (server_socket < 0) {
         printf("[SERVER] Failed to create server socket\n");
         return;
     }
 
     printf("[SERVER] Proxy server listening on port %d\n", port_number);
+
+    // The acceptor (or reactor) takes the first selected CPU; workers start after it
+    if (proxy_config.mode != SERVER_MODE_COROUTINES) {
+        affinity_pin_self(affinity_cpu(-1, 0),
+                          proxy_config.mode == SERVER_MODE_EVENT_LOOP ? "Event loop" : "Acceptor");
+    }
+
+    if (proxy_config.mode == SERVER_MODE_EVENT_LOOP) {
+        event_loop_t* loop = event_loop_create(server_socket);
+        if (loop == NULL) {
+            printf("[SERVER] Failed to create event loop\n");
+            socket_close(server_socket);
+            return;
+        }
+
+        server_loop = loop;
+        upgrade_start(proxy_config.upgrade_socket, &server_socket, 1, 0);
+
+        printf("[SERVER] Ready to accept connections (event loop mode)...\n");
+        event_loop_run(loop);
+        server_loop = NULL;
+        event_loop_destroy(loop);
+        socket_close(server_socket);
+        return;
+    }
+
+    if (proxy_config.mode == SERVER_MODE_COROUTINES) {
+        upgrade_start(proxy_config.upgrade_socket, &server_socket, 1, 0);
+        printf("[SERVER] Ready to accept connections (coroutine mode)...\n");
+        coroutine_schedulers_run(server_socket, thread_pool_default_workers());
+        socket_close(server_socket);
+        return;
+    }
+
+    upgrade_start(proxy_config.upgrade_socket, &server_socket, 1, 0);
     printf("[SERVER] Ready to accept connections...\n");
 
     // Main server loop
-    while (1) {
+    run_accept_loop(server_socket, thread_pool, &server_running);
+    if (server_draining) {
+        thread_pool_wait_idle(thread_pool);
+    }
+
+    socket_close(server_socket);
+}
+
+// Does the request the client already sent need no worker time to speak of
+// (a fresh cache hit, or the status page)? Only looks at bytes that have arrived.
+static int admission_cheap_request(int client_socket) {
+    // Without deferred accepts the request may still be a moment away
+#ifdef _WIN32
+    fd_set read_set;
+    struct timeval wait = { 0, ADMISSION_PEEK_WAIT_MS * 1000 };
+    FD_ZERO(&read_set);
+    FD_SET(client_socket, &read_set);
+    if (select(0, &read_set, NULL, NULL, &wait) <= 0) {
+        return 0;
+    }
+#else
+    struct pollfd pfd;
+    pfd.fd = client_socket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, ADMISSION_PEEK_WAIT_MS) <= 0) {
+        return 0;
+    }
+#endif
+    int flags = MSG_PEEK;
+    char head[ADMISSION_PEEK_SIZE];
+    int length = recv(client_socket, head, sizeof(head) - 1, flags);
+    if (length <= 0) {
+        return 0;
+    }
+    head[length] = '\0';
+
+    // Request line: METHOD SP URL SP VERSION
+    char* url = strchr(head, ' ');
+    if (!url) {
+        return 0;
+    }
+    *url++ = '\0';
+    char* url_end = strchr(url, ' ');
+    if (!url_end) {
+        return 0;
+    }
+    *url_end = '\0';
+
+    if (strcmp(head, "GET") != 0 && strcmp(head, "HEAD") != 0) {
+        return 0;
+    }
+    return strcmp(url, PROXY_STATUS_PATH) == 0 || cache_contains(optimized_cache, url, 0);
+}
+
+// Queue a connection unless the pool could not serve it within the latency
+// target. Overloaded connections get a 503, except cheap requests, which jump
+// the queue. Returns 0 if queued, -1 if answered with a 503 and closed.
+static int admission_queue_client(thread_pool_t* pool, int client_socket) {
+    long long wait_us = proxy_config.latency_target_ms > 0 ? thread_pool_estimate_wait_us(pool) : 0;
+    if (wait_us <= (long long)proxy_config.latency_target_ms * 1000) {
+        if (thread_pool_add_task(pool, client_socket) != 0) {
+            printf("[SERVER] Failed to add task to thread pool\n");
+            __atomic_add_fetch(&shed_total, 1, __ATOMIC_RELAXED);
+            send_overload_response(client_socket, 1);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (admission_cheap_request(client_socket) && thread_pool_add_priority_task(pool, client_socket) == 0) {
+        __atomic_add_fetch(&shed_bypassed_total, 1, __ATOMIC_RELAXED);
+        printf("[ADMIT] Estimated wait %lld ms, admitting cache hit on socket %d ahead of the queue\n",
+               wait_us / 1000, client_socket);
+        return 0;
+    }
+
+    __atomic_add_fetch(&shed_total, 1, __ATOMIC_RELAXED);
+    printf("[ADMIT] Estimated wait %lld ms exceeds %d ms, shedding socket %d\n",
+           wait_us / 1000, proxy_config.latency_target_ms, client_socket);
+    send_overload_response(client_socket, (int)((wait_us + 999999) / 1000000));
+    return -1;
+}
+
+int send_overload_response(int client_socket, int retry_after) {
+    char response[160];
+    char discard[ADMISSION_PEEK_SIZE];
+
+    if (retry_after < 1) {
+        retry_after = 1;
+    }
+    int length = snprintf(response, sizeof(response),
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: %d\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        retry_after);
+
+    // Take in what the client already sent: closing with unread data resets
+    // the connection, and the reset can overtake the 503
+#ifdef _WIN32
+    u_long non_blocking = 1;
+    ioctlsocket(client_socket, FIONBIO, &non_blocking);
+    while (recv(client_socket, discard, sizeof(discard), 0) > 0) {
+    }
+#else
+    while (recv(client_socket, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+    }
+#endif
+
+    int sent = send(client_socket, response, length, 0);
+    shutdown(client_socket, SHUT_WR);
+    socket_close(client_socket);
+    return sent;
+}
+
+static void acceptor_enter(void) {
+    pthread_mutex_lock(&acceptors_lock);
+    if (acceptor_count < MAX_LISTENER_SHARDS) {
+        acceptors[acceptor_count++] = pthread_self();
+    }
+    pthread_mutex_unlock(&acceptors_lock);
+}
+
+static void acceptor_leave(void) {
+    pthread_mutex_lock(&acceptors_lock);
+    for (int i = 0; i < acceptor_count; i++) {
+        if (pthread_equal(acceptors[i], pthread_self())) {
+            acceptors[i] = acceptors[--acceptor_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&acceptors_lock);
+}
+
+void run_accept_loop(int server_socket, thread_pool_t* pool, volatile int* running) {
+    int client_socket;
+    struct sockaddr_in client_address;
+    socklen_t client_length;
+
+    acceptor_enter();
+    while (*running) {
         client_length = sizeof(client_address);
-        client_socket = accept(server_socket, (struct sockaddr*)&client_address, &client_length);
+        // A multishot io_uring accept would keep taking connections from a
+        // listener already handed to a successor
+        client_socket = proxy_config.upgrade_socket
+            ? accept(server_socket, (struct sockaddr*)&client_address, &client_length)
+            : platform_accept(server_socket, (struct sockaddr*)&client_address, &client_length);
 
         if (client_socket < 0) {
+            if (!*running) {
+                break;
+            }
+#ifndef _WIN32
+            // An inherited listener may have been left non-blocking by an event loop
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd;
+                pfd.fd = server_socket;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                poll(&pfd, 1, 1000);
+                continue;
+            }
+#endif
             print_socket_error("Accept failed");
             continue;
         }
@@ -78,20 +413,146 @@ void proxy_server_start(void) {
                ntohs(client_address.sin_port),
                client_socket);
 
-        // Add task to thread pool for processing
-        if (thread_pool_add_task(thread_pool, client_socket) != 0) {
-            printf("[SERVER] Failed to add task to thread pool\n");
-            socket_close(client_socket);
+        // Add task to thread pool for processing. A connection that would wait
+        // past the latency target gets a cheap 503 now instead of a late answer.
+        admission_queue_client(pool, client_socket);
+    }
+    acceptor_leave();
+}
+
+int proxy_server_draining(void) {
+    return server_draining;
+}
+
+#ifndef _WIN32
+static void drain_wakeup(int sig) {
+    (void)sig;
+}
+#endif
+
+void proxy_server_drain(void) {
+    printf("[SERVER] Draining: accepting no new connections, finishing the ones in progress\n");
+    server_draining = 1;
+    server_running = 0;
+
+    if (shard_group) {
+        shard_group_drain(shard_group);
+    }
+    if (server_loop) {
+        event_loop_drain(server_loop);
+    }
+    coroutine_schedulers_drain();
+
+#ifndef _WIN32
+    // No SA_RESTART: the signal fails a blocked accept() with EINTR and the
+    // loop sees it should stop. An acceptor between two accept() calls misses
+    // one signal, so repeat until every loop has left.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = drain_wakeup;
+    sigemptyset(&action.sa_mask);
+    sigaction(DRAIN_WAKEUP_SIGNAL, &action, NULL);
+
+    while (1) {
+        pthread_mutex_lock(&acceptors_lock);
+        int remaining = acceptor_count;
+        for (int i = 0; i < acceptor_count; i++) {
+            pthread_kill(acceptors[i], DRAIN_WAKEUP_SIGNAL);
+        }
+        pthread_mutex_unlock(&acceptors_lock);
+        if (remaining == 0) {
+            break;
         }
+
+        struct timespec pause = { 0, 20 * 1000000L };
+        nanosleep(&pause, NULL);
     }
+#endif
+}
 
-    socket_close(server_socket);
+// Only sem_post(): this runs in signal handlers
+void proxy_server_stop(int sig) {
+    if (sig != 0) {
+        stop_signal = sig;
+    }
+    sem_post(&server_events);
+}
+
+static void* server_thread_main(void* arg) {
+    (void)arg;
+    proxy_server_start();
+    server_finished = 1;
+    sem_post(&server_events);
+    return NULL;
+}
+
+int proxy_server_run(void) {
+    pthread_t server_thread;
+
+#ifndef _WIN32
+    // Shutdown signals stay with the main thread (every server thread inherits the mask)
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+#endif
+    int created = pthread_create(&server_thread, NULL, server_thread_main, NULL);
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+#endif
+    if (created != 0) {
+        printf("[SERVER] Failed to start server thread\n");
+        return -1;
+    }
+
+    // The first stop request drains the server; a second one, or the drain
+    // deadline, gives up on the requests still in flight
+    int draining = 0;
+    struct timespec deadline;
+    while (!server_finished) {
+        int woken = draining ? sem_timedwait(&server_events, &deadline) : sem_wait(&server_events);
+        if (woken != 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ETIMEDOUT) {
+                printf("[SERVER] Drain timeout reached, closing the remaining connections\n");
+                return -1;
+            }
+        }
+        if (server_finished) {
+            break;
+        }
+        if (draining) {
+            printf("[SERVER] Stop requested again, not waiting for in-flight requests\n");
+            return -1;
+        }
+
+        if (stop_signal) {
+            printf("\n[SERVER] Received signal %d, shutting down gracefully...\n", (int)stop_signal);
+        }
+        proxy_server_drain();
+        draining = 1;
+        deadline.tv_sec = time(NULL) + proxy_config.drain_timeout_ms / 1000;
+        deadline.tv_nsec = (proxy_config.drain_timeout_ms % 1000) * 1000000L;
+    }
+
+    pthread_join(server_thread, NULL);
+    return 0;
 }
 
 void proxy_server_shutdown(void) {
     printf("[SHUTDOWN] Shutting down proxy server...\n");
 
+    upgrade_stop();
+
     // Cleanup all modules
+    if (shard_group) {
+        shard_group_destroy(shard_group);
+        shard_group = NULL;
+    }
+
     if (thread_pool) {
         thread_pool_destroy(thread_pool);
         thread_pool = NULL;
@@ -102,11 +563,21 @@ void proxy_server_shutdown(void) {
         optimized_cache = NULL;
     }
 
+    if (request_collapse) {
+        collapse_destroy(request_collapse);
+        request_collapse = NULL;
+    }
+
     if (connection_pool) {
         connection_pool_destroy(connection_pool);
         connection_pool = NULL;
     }
 
+    if (dns_resolver) {
+        resolver_destroy(dns_resolver);
+        dns_resolver = NULL;
+    }
+
     // Cleanup synchronization primitives
     sem_destroy(&semaphore);
     pthread_mutex_destroy(&lock);
@@ -118,6 +589,10 @@ void proxy_server_shutdown(void) {
 }
 
 int create_server_socket(int port) {
+    return create_listener_socket(port, 0);
+}
+
+int create_listener_socket(int port, int reuse_port) {
     int server_socket;
     struct sockaddr_in server_address;
     int reuse = 1;
@@ -137,6 +612,22 @@ int create_server_socket(int port) {
         return -1;
     }
 
+    // Let several listeners bind the same port; the kernel load-balances between them
+    if (reuse_port) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT,
+                       (const char*)&reuse, sizeof(reuse)) < 0) {
+            print_socket_error("Setsockopt SO_REUSEPORT failed");
+            socket_close(server_socket);
+            return -1;
+        }
+#else
+        printf("[SERVER] SO_REUSEPORT not available on this platform\n");
+        socket_close(server_socket);
+        return -1;
+#endif
+    }
+
     // Server address setup
     bzero(&server_address, sizeof(server_address));
     server_address.sin_family = AF_INET;
@@ -150,6 +641,15 @@ int create_server_socket(int port) {
         return -1;
     }
 
+#ifdef TCP_DEFER_ACCEPT
+    // Admission control decides from the request line: have accept() return
+    // connections once the client's first bytes are in
+    if (proxy_config.mode == SERVER_MODE_THREAD_POOL && proxy_config.latency_target_ms > 0) {
+        int defer_seconds = 1;
+        setsockopt(server_socket, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_seconds, sizeof(defer_seconds));
+    }
+#endif
+
     // Listen for connections
     if (listen(server_socket, MAX_CLIENTS) < 0) {
         print_socket_error("Listen failed");
@@ -160,122 +660,456 @@ int create_server_socket(int port) {
     return server_socket;
 }
 
-void handle_client_request(int client_socket) {
-    char request_buffer[MAX_REQUEST_SIZE];
-    int bytes_received;
-    struct ParsedRequest* parsed_request;
-
-    // Receive request from client
-    bytes_received = recv(client_socket, request_buffer, sizeof(request_buffer) - 1, 0);
-    if (bytes_received <= 0) {
-        printf("[REQUEST] Failed to receive data from client\n");
-        socket_close(client_socket);
-        return;
+// Length of the first complete request head in the buffer, 0 if none yet
+static int buffered_request_head(char* buffer, int buffered) {
+    buffer[buffered] = '\0';
+    char* head_end = strstr(buffer, "\r\n\r\n");
+    return head_end ? (int)(head_end - buffer) + 4 : 0;
+}
+
+// Buffer client bytes until a complete request head is present.
+// Returns the head length, 0 when the client closed or went idle, -1 on error.
+static int read_request_head(int client_socket, char* buffer, int* buffered) {
+    while (1) {
+        int head_length = buffered_request_head(buffer, *buffered);
+        if (head_length > 0) {
+            return head_length;
+        }
+
+        if (*buffered >= MAX_REQUEST_SIZE - 1) {
+            printf("[REQUEST] Request headers too large\n");
+            return -1;
+        }
+
+        int bytes_received = platform_recv(client_socket, buffer + *buffered,
+                                           CLIENT_BUFFER_SIZE - 1 - *buffered, 0);
+        if (bytes_received <= 0) {
+            return *buffered > 0 ? -1 : 0;
+        }
+        *buffered += bytes_received;
+    }
+}
+
+// Collect the request body: bytes already buffered after the head, then the rest from the socket
+static char* read_request_body(int client_socket, const char* buffered_body, int buffered_length,
+                               int body_length) {
+    char* body = malloc(body_length);
+    if (!body) {
+        return NULL;
     }
 
-    request_buffer[bytes_received] = '\0';
-    printf("[REQUEST] Received %d bytes from client\n", bytes_received);
+    int have = buffered_length < body_length ? buffered_length : body_length;
+    memcpy(body, buffered_body, have);
+
+    while (have < body_length) {
+        int bytes_received = platform_recv(client_socket, body + have, body_length - have, 0);
+        if (bytes_received <= 0) {
+            free(body);
+            return NULL;
+        }
+        have += bytes_received;
+    }
+    return body;
+}
+
+static void client_request_release(client_request_t* entry) {
+    if (entry->upstream_socket >= 0) {
+        connection_pool_return(connection_pool, entry->upstream_socket, entry->host, entry->port, 0);
+        entry->upstream_socket = -1;
+    }
+    free(entry->body);
+    entry->body = NULL;
+    ParsedRequest_destroy(entry->request);
+    entry->request = NULL;
+}
+
+// Take the next request off the client connection into `entry`.
+// In blocking mode this waits for the client and answers malformed requests itself;
+// in look-ahead mode it only takes a request that is already fully buffered and valid.
+// Returns 1 when a request was queued, 0 when none is available, -1 after an error response.
+static int next_client_request(int client_socket, char* buffer, int* buffered, int blocking,
+                               client_request_t* entry) {
+    int head_length = blocking ? read_request_head(client_socket, buffer, buffered)
+                               : buffered_request_head(buffer, *buffered);
+    if (head_length <= 0) {
+        if (head_length < 0) {
+            printf("[REQUEST] Failed to receive a complete request from client\n");
+            send_error_response(client_socket, 400, "Bad Request");
+        }
+        return head_length;
+    }
 
     // Validate HTTP request
-    if (!validate_http_request(request_buffer, bytes_received)) {
+    if (!validate_http_request(buffer, head_length)) {
+        if (!blocking) return 0;
         printf("[REQUEST] Invalid HTTP request received\n");
         send_error_response(client_socket, 400, "Bad Request");
-        socket_close(client_socket);
-        return;
+        return -1;
     }
 
     // Parse the request
-    parsed_request = ParsedRequest_create();
+    struct ParsedRequest* parsed_request = ParsedRequest_create();
     if (!parsed_request) {
+        if (!blocking) return 0;
         printf("[REQUEST] Failed to create parsed request\n");
         send_error_response(client_socket, 500, "Internal Server Error");
-        socket_close(client_socket);
-        return;
+        return -1;
     }
 
-    if (ParsedRequest_parse(parsed_request, request_buffer, bytes_received) < 0) {
+    if (ParsedRequest_parse(parsed_request, buffer, head_length) < 0) {
+        ParsedRequest_destroy(parsed_request);
+        if (!blocking) return 0;
         printf("[REQUEST] Failed to parse HTTP request\n");
         send_error_response(client_socket, 400, "Bad Request");
+        return -1;
+    }
+
+    // A CONNECT is only taken as the oldest request: everything after its head is tunnel data
+    int tunnel_request = parsed_request->method && strcmp(parsed_request->method, "CONNECT") == 0;
+    if (tunnel_request && !blocking) {
         ParsedRequest_destroy(parsed_request);
-        socket_close(client_socket);
+        return 0;
+    }
+
+    long long body_length = tunnel_request ? 0 : request_body_length(parsed_request);
+    if (body_length < 0 || body_length > MAX_REQUEST_BODY_SIZE ||
+        (!blocking && head_length + body_length > *buffered)) {
+        ParsedRequest_destroy(parsed_request);
+        if (!blocking) return 0;
+        printf("[REQUEST] Unsupported request body framing or size\n");
+        if (body_length == HTTP_BODY_LENGTH_TRANSFER_CODED) {
+            send_error_response(client_socket, 411, "Length Required");
+        } else if (body_length < 0) {
+            send_error_response(client_socket, 400, "Bad Request");
+        } else {
+            send_error_response(client_socket, 413, "Payload Too Large");
+        }
+        return -1;
+    }
+
+    char* body = NULL;
+    if (body_length > 0) {
+        body = read_request_body(client_socket, buffer + head_length,
+                                 *buffered - head_length, (int)body_length);
+        if (!body) {
+            printf("[REQUEST] Failed to receive request body\n");
+            ParsedRequest_destroy(parsed_request);
+            return -1;
+        }
+    }
+
+    printf("[REQUEST] Received %d byte request head from client%s\n", head_length,
+           blocking ? "" : " (pipelined)");
+
+    // Keep whatever followed this request for the next one
+    int consumed = head_length + (int)body_length;
+    if (consumed > *buffered) {
+        consumed = *buffered;
+    }
+    memmove(buffer, buffer + consumed, *buffered - consumed);
+    *buffered -= consumed;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->request = parsed_request;
+    entry->body = body;
+    entry->body_length = (int)body_length;
+    entry->keep_alive = tunnel_request ? 0 : http_request_keep_alive(parsed_request);
+    entry->upstream_socket = -1;
+    return 1;
+}
+
+// Answer a CONNECT: open the target, reply 200 and relay bytes both ways until either side closes.
+// Bytes the client sent after the CONNECT head are the first bytes of the tunnel.
+static void run_client_tunnel(client_request_t* entry, int client_socket, const char* buffered_data,
+                              int buffered) {
+    static const char established[] = "HTTP/1.1 200 Connection Established\r\n\r\n";
+
+    if (!entry->request->path ||
+        extract_connect_target(entry->request->path, entry->host, sizeof(entry->host), &entry->port) < 0) {
+        printf("[TUNNEL] Invalid CONNECT target: %s\n",
+               entry->request->path ? entry->request->path : "NULL");
+        send_error_response(client_socket, 400, "Bad Request");
         return;
     }
 
-    // Forward request to destination server
-    if (forward_request_to_server(parsed_request, client_socket) < 0) {
-        printf("[REQUEST] Failed to forward request to server\n");
+    // Tunnels own their upstream connection for their whole lifetime, so the pool is bypassed
+    int server_socket = create_persistent_connection(entry->host, entry->port);
+    if (server_socket < 0) {
+        printf("[TUNNEL] Failed to connect to %s:%d\n", entry->host, entry->port);
         send_error_response(client_socket, 502, "Bad Gateway");
+        return;
+    }
+
+    tunnel_t* tunnel = tunnel_create(client_socket, server_socket, buffered_data, buffered,
+                                     established, (int)sizeof(established) - 1);
+    if (!tunnel) {
+        send_error_response(client_socket, 500, "Internal Server Error");
+        socket_close(server_socket);
+        return;
+    }
+
+    printf("[TUNNEL] Tunneling client socket %d to %s:%d\n", client_socket, entry->host, entry->port);
+    tunnel_run(tunnel, TUNNEL_IDLE_TIMEOUT);
+    tunnel_destroy(tunnel);
+    socket_close(server_socket);
+}
+
+// Whether one of the first `count` queued requests is for `url`
+static int pipeline_has_url(const client_request_t* pipeline, int count, const char* url) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(pipeline[i].request->path, url) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void handle_client_request(int client_socket) {
+    char request_buffer[CLIENT_BUFFER_SIZE];
+    client_request_t pipeline[PIPELINE_MAX_DEPTH];
+    int queued = 0;
+    int buffered = 0;
+    int requests_read = 0;
+    int requests_served = 0;
+    int reading = 1;
+
+    // Bounds both the wait for a request and the idle gap between requests
+    platform_set_recv_timeout(client_socket, KEEPALIVE_IDLE_TIMEOUT * 1000);
+
+    while (1) {
+        // Fill the pipeline: wait for a request only when none is queued, then take
+        // every further request the client already sent and start its upstream fetch
+        while (reading && queued < PIPELINE_MAX_DEPTH) {
+            client_request_t* entry = &pipeline[queued];
+            int result = next_client_request(client_socket, request_buffer, &buffered,
+                                             queued == 0, entry);
+            if (result <= 0) {
+                if (queued == 0) {
+                    reading = 0;
+                }
+                break;
+            }
+
+            requests_read++;
+            // While draining, the client reconnects to the successor for its next request
+            if (!entry->keep_alive || requests_read >= KEEPALIVE_MAX_REQUESTS || server_draining) {
+                entry->keep_alive = 0;
+                reading = 0;
+            }
+
+            // A URL already queued ahead is left to that request's fetch
+            if (queued > 0 && !pipeline_has_url(pipeline, queued, entry->request->path)) {
+                dispatch_upstream_request(entry);
+            }
+            queued++;
+        }
+
+        if (queued == 0) {
+            break;
+        }
+
+        // Answer the oldest request; responses always go out in request order
+        client_request_t* current = &pipeline[0];
+        if (strcmp(current->request->method, "CONNECT") == 0) {
+            // Never read ahead, so the tunnel is the only request left on the connection
+            run_client_tunnel(current, client_socket, request_buffer, buffered);
+            client_request_release(current);
+            requests_served++;
+            break;
+        }
+
+        if (is_status_request(current->request)) {
+            char status[STATUS_RESPONSE_SIZE];
+            int status_length = format_status_response(status, sizeof(status));
+            platform_send(client_socket, status, status_length, 0);
+            current->keep_alive = 0;
+        } else if (forward_request_to_server(current, client_socket) < 0) {
+            printf("[REQUEST] Failed to forward request to server\n");
+            send_error_response(client_socket, 502, "Bad Gateway");
+            current->keep_alive = 0;
+        }
+        requests_served++;
+
+        int keep_alive = current->keep_alive;
+        client_request_release(current);
+        queued--;
+        memmove(&pipeline[0], &pipeline[1], queued * sizeof(client_request_t));
+
+        if (!keep_alive) {
+            // Requests queued behind a closing response are dropped unanswered
+            while (queued > 0) {
+                client_request_release(&pipeline[--queued]);
+            }
+            break;
+        }
+    }
+
+    if (requests_served > 1) {
+        printf("[REQUEST] Served %d requests on client socket %d\n", requests_served, client_socket);
     }
 
     // Cleanup
-    ParsedRequest_destroy(parsed_request);
     socket_close(client_socket);
 }
 
-int send_error_response(int client_socket, int error_code, const char* message) {
-    char response[1024];
-    int response_length;
+int format_error_response(char* buffer, size_t size, int error_code, const char* message) {
+    char body[256];
+    int body_length = snprintf(body, sizeof(body),
+        "<html><body><h1>%d %s</h1></body></html>", error_code, message);
 
-    response_length = snprintf(response, sizeof(response),
+    return snprintf(buffer, size,
         "HTTP/1.1 %d %s\r\n"
         "Content-Type: text/html\r\n"
         "Content-Length: %d\r\n"
         "Connection: close\r\n"
         "\r\n"
-        "<html><body><h1>%d %s</h1></body></html>",
-        error_code, message, (int)(39 + strlen(message) + 20), error_code, message);
+        "%s",
+        error_code, message, body_length, body);
+}
 
-    return send(client_socket, response, response_length, 0);
+int is_status_request(struct ParsedRequest* request) {
+    return request && request->method && request->path &&
+           strcmp(request->method, "GET") == 0 && strcmp(request->path, PROXY_STATUS_PATH) == 0;
 }
 
-int forward_request_to_server(struct ParsedRequest* request, int client_socket) {
-    if (!request || client_socket <= 0) {
-        printf("[FORWARD] Invalid parameters\n");
-        return -1;
-    }
+// Sum the counters of every worker pool (the shared one, or one per listener shard)
+static void collect_pool_stats(thread_pool_stats_t* total) {
+    thread_pool_t* pools[MAX_LISTENER_SHARDS + 1];
+    int pool_count = 0;
 
-    char host[256];
-    int port = 80;
-    char request_buffer[MAX_REQUEST_SIZE];
-    char response_buffer[MAX_RESPONSE_SIZE];
+    if (thread_pool) {
+        pools[pool_count++] = thread_pool;
+    }
+    if (shard_group) {
+        for (int i = 0; i < shard_group->count; i++) {
+            if (shard_group->shards[i].pool) {
+                pools[pool_count++] = shard_group->shards[i].pool;
+            }
+        }
+    }
 
-    printf("[FORWARD] Request details - Method: %s, Path: %s, Host: %s\n", 
-           request->method ? request->method : "NULL",
-           request->path ? request->path : "NULL",
-           request->host ? request->host : "NULL");
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < pool_count; i++) {
+        thread_pool_stats_t stats;
+        thread_pool_get_stats(pools[i], &stats);
+        total->workers += stats.workers;
+        total->min_workers += stats.min_workers;
+        total->max_workers += stats.max_workers;
+        total->busy_workers += stats.busy_workers;
+        total->queued += stats.queued;
+        if (stats.queue_wait_us > total->queue_wait_us) {
+            total->queue_wait_us = stats.queue_wait_us;   // Worst pool
+        }
+        total->grows += stats.grows;
+        total->shrinks += stats.shrinks;
+        total->executed += stats.executed;
+        total->stolen += stats.stolen;
+        total->rejected += stats.rejected;
+        if (stats.service_us > total->service_us) {
+            total->service_us = stats.service_us;
+        }
+    }
+}
 
-    // Extract host and port from request
-    if (!request->host || extract_host_port(request->host, host, &port) < 0) {
-        printf("[FORWARD] Failed to extract host and port from: %s\n", 
-               request->host ? request->host : "NULL");
-        return -1;
+// Plain-text metrics, one "name value" line each
+int format_status_response(char* buffer, size_t size) {
+    char body[STATUS_RESPONSE_SIZE - 256];
+    thread_pool_stats_t pool;
+    resolver_stats_t dns;
+    tunnel_totals_t tunnels;
+    cache_stats_t cache;
+    collapse_stats_t collapse;
+    slab_stats_t slab;
+
+    collect_pool_stats(&pool);
+    cache_get_stats(optimized_cache, &cache);
+    slab_get_stats(&slab);
+    size_t mapped = slab.arena_bytes + slab.large_bytes;
+    memset(&dns, 0, sizeof(dns));
+    resolver_get_stats(dns_resolver, &dns);
+    tunnel_get_totals(&tunnels);
+    memset(&collapse, 0, sizeof(collapse));
+    collapse_get_stats(request_collapse, &collapse);
+
+    int body_length = snprintf(body, sizeof(body),
+        "proxy_pool_workers %d\n"
+        "proxy_pool_workers_min %d\n"
+        "proxy_pool_workers_max %d\n"
+        "proxy_pool_workers_busy %d\n"
+        "proxy_pool_queued %d\n"
+        "proxy_pool_queue_wait_us %lld\n"
+        "proxy_pool_grows_total %lld\n"
+        "proxy_pool_shrinks_total %lld\n"
+        "proxy_pool_tasks_total %lld\n"
+        "proxy_pool_tasks_stolen_total %lld\n"
+        "proxy_pool_tasks_rejected_total %lld\n"
+        "proxy_pool_service_us %lld\n"
+        "proxy_shed_total %lld\n"
+        "proxy_shed_cache_bypass_total %lld\n"
+        "proxy_dns_hits_total %lld\n"
+        "proxy_dns_negative_hits_total %lld\n"
+        "proxy_dns_misses_total %lld\n"
+        "proxy_dns_failures_total %lld\n"
+        "proxy_tunnels_opened_total %lld\n"
+        "proxy_tunnels_active %lld\n"
+        "proxy_tunnel_bytes_upstream_total %lld\n"
+        "proxy_tunnel_bytes_downstream_total %lld\n"
+        "proxy_cache_bytes %zu\n"
+        "proxy_cache_bytes_max %zu\n"
+        "proxy_cache_entries %d\n"
+        "proxy_cache_object_bytes_max %d\n"
+        "proxy_cache_evictions_total %lld\n"
+        "proxy_cache_rejected_total %lld\n"
+        "proxy_cache_revalidated_total %lld\n"
+        "proxy_cache_fetches_total %lld\n"
+        "proxy_cache_fetches_collapsed_total %lld\n"
+        "proxy_cache_fetch_wait_timeouts_total %lld\n"
+        "proxy_cache_fetches_in_flight %d\n"
+        "proxy_cache_fetches_passed_total %lld\n"
+        "proxy_cache_arenas %d\n"
+        "proxy_cache_arenas_spare %d\n"
+        "proxy_cache_arena_bytes %zu\n"
+        "proxy_cache_arena_occupancy_pct %d\n"
+        "proxy_cache_large_blocks %d\n"
+        "proxy_cache_large_bytes %zu\n"
+        "proxy_cache_fragmentation_pct %d\n",
+        pool.workers, pool.min_workers, pool.max_workers, pool.busy_workers, pool.queued,
+        pool.queue_wait_us, pool.grows, pool.shrinks, pool.executed, pool.stolen, pool.rejected,
+        pool.service_us, __atomic_load_n(&shed_total, __ATOMIC_RELAXED),
+        __atomic_load_n(&shed_bypassed_total, __ATOMIC_RELAXED),
+        dns.hits, dns.negative_hits, dns.misses, dns.failures,
+        tunnels.tunnels_opened, tunnels.tunnels_active, tunnels.bytes_upstream, tunnels.bytes_downstream,
+        cache.bytes_used, cache.max_bytes, cache.entries, cache.max_object, cache.evictions, cache.rejected,
+        cache.revalidated, collapse.fetches, collapse.collapsed, collapse.timeouts, collapse.in_flight,
+        collapse.passes,
+        slab.arenas, slab.spare_arenas, slab.arena_bytes,
+        slab.arena_bytes ? (int)(slab.slot_bytes * 100 / slab.arena_bytes) : 0,
+        slab.large_blocks, slab.large_bytes,
+        mapped ? (int)(100 - slab.requested_bytes * 100 / mapped) : 0);
+    if (body_length < 0 || body_length >= (int)sizeof(body)) {
+        body_length = (int)sizeof(body) - 1;
     }
 
-    printf("[FORWARD] Extracted host: %s, port: %d\n", host, port);
+    return snprintf(buffer, size,
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: %d\r\n"
+        "Cache-Control: no-store\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "%s",
+        body_length, body);
+}
 
-    // Check cache first (use full URL as cache key)
-    char cache_key[512];
-    snprintf(cache_key, sizeof(cache_key), "%s", request->path);
-    
-    cache_node_t* cached = cache_get(optimized_cache, cache_key);
-    if (cached) {
-        // Send cached response
-        printf("[FORWARD] Sending cached response (%d bytes)\n", cached->data_size);
-        send(client_socket, cached->data, cached->data_size, 0);
-        return 0;
-    }
+int send_error_response(int client_socket, int error_code, const char* message) {
+    char response[1024];
+    int response_length = format_error_response(response, sizeof(response), error_code, message);
 
-    // Get connection from pool
-    int server_socket = connection_pool_get(connection_pool, host, port);
-    if (server_socket < 0) {
-        // Create new connection
-        server_socket = create_persistent_connection(host, port);
-        if (server_socket < 0) {
-            printf("[FORWARD] Failed to connect to %s:%d\n", host, port);
-            return -1;
-        }
-    }
+    return platform_send(client_socket, response, response_length, 0);
+}
 
+int build_upstream_request(struct ParsedRequest* request, const char* host, const char* extra_headers,
+                           char* buffer, size_t size) {
     // Extract path from full URL for HTTP request
     char actual_path[256] = "/";
     if (strstr(request->path, "http://")) {
@@ -289,96 +1123,531 @@ int forward_request_to_server(struct ParsedRequest* request, int client_socket)
         actual_path[sizeof(actual_path) - 1] = '\0';
     }
 
-    // Build and send request
-    int request_len = snprintf(request_buffer, sizeof(request_buffer),
+    // Describe the request body, if any (it is sent right after this head)
+    char body_headers[320] = "";
+    long long body_length = request_body_length(request);
+    if (body_length > 0) {
+        struct ParsedHeader* content_type = ParsedHeader_get(request, "Content-Type");
+        snprintf(body_headers, sizeof(body_headers), "%s%.200s%sContent-Length: %lld\r\n",
+                 content_type ? "Content-Type: " : "",
+                 content_type ? content_type->value : "",
+                 content_type ? "\r\n" : "",
+                 body_length);
+    }
+
+    return snprintf(buffer, size,
         "%s %s HTTP/1.1\r\n"
         "Host: %s\r\n"
         "User-Agent: ProxyServer/1.0\r\n"
-        "Connection: close\r\n"
+        "%s"
+        "%s"
+        "Connection: keep-alive\r\n"
         "\r\n",
-        request->method, actual_path, host);
+        request->method, actual_path, host, body_headers, extra_headers ? extra_headers : "");
+}
 
-    printf("[FORWARD] Sending request to %s:%d: %s %s\n", host, port, request->method, actual_path);
+long long request_body_length(struct ParsedRequest* request) {
+    return http_request_body_length(request->buf, (int)request->buflen);
+}
 
-    if (send(server_socket, request_buffer, request_len, 0) < 0) {
-        print_socket_error("Failed to send request to server");
-        socket_close(server_socket);
+// Copy of a relayed response kept for the cache; dropped once it outgrows the cache's object limit
+typedef struct {
+    char* data;
+    int length;
+    int capacity;
+    int enabled;
+} response_capture_t;
+
+static void capture_disable(response_capture_t* capture) {
+    free(capture->data);
+    capture->data = NULL;
+    capture->length = 0;
+    capture->capacity = 0;
+    capture->enabled = 0;
+}
+
+static void capture_append(response_capture_t* capture, const char* data, int length) {
+    if (!capture->enabled || length <= 0) {
+        return;
+    }
+
+    if (capture->length + length > proxy_config.cache_max_object) {
+        cache_note_rejected(optimized_cache);
+        capture_disable(capture);
+        return;
+    }
+
+    if (capture->length + length > capture->capacity) {
+        int new_capacity = capture->capacity ? capture->capacity : RELAY_BUFFER_SIZE;
+        while (new_capacity < capture->length + length) {
+            new_capacity *= 2;
+        }
+        if (new_capacity > proxy_config.cache_max_object) {
+            new_capacity = proxy_config.cache_max_object;
+        }
+
+        char* grown = realloc(capture->data, new_capacity);
+        if (!grown) {
+            capture_disable(capture);
+            return;
+        }
+        capture->data = grown;
+        capture->capacity = new_capacity;
+    }
+
+    memcpy(capture->data + capture->length, data, length);
+    capture->length += length;
+}
+
+// Replay a cached response, re-rewriting its Connection header for this client
+static int send_cached_response(int client_socket, const cache_node_t* cached, int head_only, int* keep_alive) {
+    http_response_framer_t framer;
+    char head_buffer[MAX_RESPONSE_HEAD_SIZE + 64];
+
+    http_response_framer_init(&framer, 0);
+    int head_length = http_response_parse_head(&framer, cached->data, cached->data_size);
+    if (head_length <= 0) {
+        *keep_alive = 0;
+        return platform_send_all(client_socket, cached->data, cached->data_size);
+    }
+
+    if (framer.body_mode == HTTP_BODY_UNTIL_CLOSE) {
+        *keep_alive = 0;
+    }
+
+    int head_out = http_response_rewrite_head(cached->data, head_length, head_buffer, sizeof(head_buffer),
+                                              *keep_alive ? "keep-alive" : "close");
+    if (head_out < 0 || platform_send_all(client_socket, head_buffer, head_out) < 0) {
+        *keep_alive = 0;
         return -1;
     }
+    if (head_only) {
+        return head_out;
+    }
+
+    if (platform_send_all(client_socket, cached->data + head_length, cached->data_size - head_length) < 0) {
+        *keep_alive = 0;
+        return -1;
+    }
+    return cached->data_size;
+}
+
+// Requests that may be replayed on a fresh connection if a pooled one turns out to be dead
+static int request_is_idempotent(struct ParsedRequest* request) {
+    return strcmp(request->method, "GET") == 0 || strcmp(request->method, "HEAD") == 0 ||
+           strcmp(request->method, "PUT") == 0 || strcmp(request->method, "DELETE") == 0;
+}
+
+// Drop an upstream socket that cannot be reused. It may have come from the pool, so it
+// goes back through the pool to release its slot rather than being closed directly.
+static void close_upstream(client_request_t* entry, int server_socket) {
+    connection_pool_return(connection_pool, server_socket, entry->host, entry->port, 0);
+}
+
+// Connect (or reuse a pooled connection) and fill in the entry's upstream target
+static int connect_upstream(client_request_t* entry, int allow_pooled) {
+    struct ParsedRequest* request = entry->request;
+
+    // Extract host and port from request
+    if (!request->host || strlen(request->host) >= sizeof(entry->host) ||
+        extract_host_port(request->host, entry->host, &entry->port) < 0) {
+        printf("[FORWARD] Failed to extract host and port from: %s\n", 
+               request->host ? request->host : "NULL");
+        return -1;
+    }
+
+    // Get connection from pool (the event loop may have left it non-blocking)
+    int server_socket = allow_pooled ? connection_pool_acquire(connection_pool, entry->host, entry->port) : -1;
+    entry->upstream_reused = server_socket > 0;
+    if (server_socket > 0) {
+        socket_set_blocking(server_socket);
+    } else {
+        // Create new connection
+        server_socket = create_persistent_connection(entry->host, entry->port);
+        if (server_socket < 0) {
+            printf("[FORWARD] Failed to connect to %s:%d\n", entry->host, entry->port);
+            return -1;
+        }
+    }
 
-    // Receive response with proper HTTP handling
-    int total_received = 0;
-    int bytes_received;
-    int header_end_found = 0;
-    
     // Set receive timeout to 5 seconds
-    #ifdef _WIN32
-    DWORD timeout = 5000; // 5 seconds in milliseconds
-    setsockopt(server_socket, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
-    #else
-    struct timeval timeout;
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
-    setsockopt(server_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    #endif
-    
-    while (total_received < MAX_RESPONSE_SIZE - 1) {
-        bytes_received = recv(server_socket, 
-                            response_buffer + total_received, 
-                            MAX_RESPONSE_SIZE - total_received - 1, 0);
-        if (bytes_received <= 0) {
-            if (total_received > 0) {
-                // Some data received, break and use what we have
-                printf("[FORWARD] Connection closed by server, using %d bytes\n", total_received);
-                break;
-            } else {
-                printf("[FORWARD] No data received from server\n");
-                socket_close(server_socket);
+    platform_set_recv_timeout(server_socket, 5000);
+    return server_socket;
+}
+
+// Send a pipelined request upstream before earlier responses have been relayed.
+// Only idempotent requests without a body that the cache cannot answer are sent early.
+int dispatch_upstream_request(client_request_t* entry) {
+    struct ParsedRequest* request = entry->request;
+    char request_buffer[MAX_REQUEST_SIZE];
+
+    if (entry->upstream_socket >= 0 || entry->body_length > 0 ||
+        (strcmp(request->method, "GET") != 0 && strcmp(request->method, "HEAD") != 0)) {
+        return -1;
+    }
+
+    // An entry kept for revalidation is asked about in order, with its validators
+    if ((http_request_cache_mode(request) & HTTP_CACHE_LOOKUP) && cache_contains(optimized_cache, request->path, 1)) {
+        return -1;
+    }
+
+    // Nor is a URL another request is already fetching: the response is waited for in order
+    if (collapse_active(request_collapse, request->path)) {
+        return -1;
+    }
+
+    int server_socket = connect_upstream(entry, 1);
+    if (server_socket < 0) {
+        return -1;
+    }
+
+    int request_len = build_upstream_request(request, entry->host, NULL, request_buffer, sizeof(request_buffer));
+    if (platform_send_all(server_socket, request_buffer, request_len) < 0) {
+        close_upstream(entry, server_socket);
+        return -1;
+    }
+
+    printf("[FORWARD] Pipelined request sent early to %s:%d: %s %s\n",
+           entry->host, entry->port, request->method, request->path);
+    entry->upstream_socket = server_socket;
+    return 0;
+}
+
+// Fetch the request from upstream and relay the response, storing it when allowed.
+// `cached` is a pinned stale entry to revalidate (or NULL) and is released here;
+// `fetch_id` is the collapsed fetch this request leads (0 if none).
+static int relay_from_upstream(client_request_t* entry, int client_socket, const char* cache_key,
+                               int head_request, int cacheable, const cache_node_t* cached,
+                               unsigned long long fetch_id) {
+    struct ParsedRequest* request = entry->request;
+    int* keep_alive = &entry->keep_alive;
+    char request_buffer[MAX_REQUEST_SIZE];
+    char relay_storage[RELAY_BUFFER_SIZE];
+    char head_buffer[MAX_RESPONSE_HEAD_SIZE + 64];
+
+    // Prefer the I/O backend's registered buffer so reads skip per-call page pinning
+    char* relay_buffer = platform_io_buffer(RELAY_BUFFER_SIZE);
+    if (!relay_buffer) {
+        relay_buffer = relay_storage;
+    }
+
+    // A stale entry stays pinned while the origin is asked whether it is still current
+    char conditional[MAX_CONDITIONAL_HEADERS];
+    conditional[0] = '\0';
+    if (cached && (entry->upstream_socket >= 0 ||
+                   http_conditional_headers(cached->data, cached->data_size, conditional, sizeof(conditional)) <= 0)) {
+        cache_release(cached);      // Already requested in full, or nothing to validate with
+        cached = NULL;
+    }
+
+    // A pipelined request may already be on its way upstream
+    int server_socket = entry->upstream_socket;
+    entry->upstream_socket = -1;
+    int idempotent = request_is_idempotent(request);
+    int request_len = 0;
+    char* outgoing = NULL;
+
+    http_response_framer_t framer;
+    int head_received = 0;
+    int head_length = 0;
+
+    for (int attempt = 0; ; attempt++) {
+        int bytes_received;
+
+        if (server_socket < 0) {
+            // Non-idempotent requests never risk a pooled connection that may be stale
+            server_socket = connect_upstream(entry, idempotent && attempt == 0);
+            if (server_socket < 0) {
+                if (outgoing != request_buffer) free(outgoing);
+                cache_release(cached);
+                return -1;
+            }
+
+            // Build the request once; a stale pooled connection means sending it again
+            if (!outgoing) {
+                request_len = build_upstream_request(request, entry->host, conditional,
+                                                     request_buffer, sizeof(request_buffer));
+
+                // A request body goes out in the same send as the head
+                outgoing = request_buffer;
+                if (entry->body_length > 0) {
+                    outgoing = malloc(request_len + entry->body_length);
+                    if (!outgoing) {
+                        close_upstream(entry, server_socket);
+                        cache_release(cached);
+                        return -1;
+                    }
+                    memcpy(outgoing, request_buffer, request_len);
+                    memcpy(outgoing + request_len, entry->body, entry->body_length);
+                    request_len += entry->body_length;
+                }
+            }
+
+            printf("[FORWARD] Sending request to %s:%d: %s %s\n", entry->host, entry->port,
+                   request->method, request->path);
+
+            // Send the request and read the first chunk of the response in one submission
+            bytes_received = platform_send_recv(server_socket, outgoing, request_len,
+                                                relay_buffer, RELAY_BUFFER_SIZE);
+        } else {
+            bytes_received = platform_recv(server_socket, relay_buffer, RELAY_BUFFER_SIZE, 0);
+        }
+
+        // A pooled connection the server already closed fails before a single response byte
+        if (bytes_received <= 0 && entry->upstream_reused && idempotent && attempt == 0) {
+            printf("[FORWARD] Pooled connection to %s:%d was stale, retrying on a new connection\n",
+                   entry->host, entry->port);
+            close_upstream(entry, server_socket);
+            server_socket = -1;
+            continue;
+        }
+
+        // Keep reading until the whole response head is buffered
+        http_response_framer_init(&framer, head_request);
+        while (1) {
+            if (bytes_received <= 0) {
+                printf("[FORWARD] No complete response head received from server\n");
+                close_upstream(entry, server_socket);
+                if (outgoing != request_buffer) free(outgoing);
+                cache_release(cached);
                 return -1;
             }
+            head_received += bytes_received;
+
+            // 103 Early Hints and the like are not the answer: wait for the final head
+            head_received = http_response_skip_interim(relay_buffer, head_received);
+            head_length = http_response_parse_head(&framer, relay_buffer, head_received);
+            if (head_length < 0) {
+                printf("[FORWARD] Invalid response head from %s:%d\n", entry->host, entry->port);
+                close_upstream(entry, server_socket);
+                if (outgoing != request_buffer) free(outgoing);
+                cache_release(cached);
+                return -1;
+            }
+            if (head_length > 0) {
+                break;
+            }
+
+            bytes_received = platform_recv(server_socket, relay_buffer + head_received,
+                                           RELAY_BUFFER_SIZE - head_received, 0);
+        }
+        break;
+    }
+    if (outgoing != request_buffer) {
+        free(outgoing);
+    }
+
+    char* host = entry->host;
+    int port = entry->port;
+
+    // Not modified: the stored response, updated with the 304's headers, is stored again and sent
+    if (cached) {
+        if (framer.status_code == 304) {
+            http_cache_policy_t policy;
+            http_revalidated_cache_policy(cached->data, cached->data_size, relay_buffer, head_length,
+                                          time(NULL), &policy);
+            if (policy.storable) {
+                int merged_length = 0;
+                char* merged = http_merge_not_modified(cached->data, cached->data_size, relay_buffer,
+                                                       head_length, &merged_length);
+                int replaced = cache_refresh(optimized_cache, cached, merged, merged_length, policy.expires) == 0 &&
+                               merged != NULL;
+                free(merged);
+
+                const cache_node_t* updated = replaced ? cache_get(optimized_cache, cache_key, NULL) : NULL;
+                if (updated) {
+                    cache_release(cached);
+                    cached = updated;
+                }
+            }
+            connection_pool_return(connection_pool, server_socket, host, port,
+                                   !framer.connection_close && head_received == head_length);
+
+            printf("[FORWARD] %s:%d confirmed the cached response, sending it (%d bytes)\n",
+                   host, port, cached->data_size);
+            send_cached_response(client_socket, cached, head_request, keep_alive);
+            cache_release(cached);
+            return 0;
+        }
+        cache_release(cached);
+    }
+
+    // A close-delimited body can only be ended by closing the client connection too
+    if (framer.body_mode == HTTP_BODY_UNTIL_CLOSE) {
+        *keep_alive = 0;
+    }
+
+    // The client connection is ours to manage, so upstream hop-by-hop headers are replaced
+    int head_out = http_response_rewrite_head(relay_buffer, head_length, head_buffer, sizeof(head_buffer),
+                                              *keep_alive ? "keep-alive" : "close");
+    if (head_out < 0) {
+        printf("[FORWARD] Response head from %s:%d too large to rewrite\n", host, port);
+        close_upstream(entry, server_socket);
+        return -1;
+    }
+
+    // Only responses the headers allow to be stored and that can fit in the cache are copied while streaming
+    response_capture_t capture = { NULL, 0, 0, 0 };
+    time_t cache_expires = 0;
+    int cache_keep_stale = 0;
+    if (cacheable) {
+        http_cache_policy_t policy;
+        http_response_cache_policy(relay_buffer, head_length, time(NULL), &policy);
+        if (!policy.storable) {
+            printf("[FORWARD] Not caching response for %s: %s\n", cache_key, policy.reason);
+        } else if (framer.content_length > proxy_config.cache_max_object) {
+            cache_note_rejected(optimized_cache);
+        } else {
+            capture.enabled = 1;
+            cache_expires = policy.expires;
+            cache_keep_stale = policy.validator;
         }
-        total_received += bytes_received;
-        
-        // Check for end of HTTP headers to determine if we got a complete response
-        if (!header_end_found && total_received >= 4) {
-            response_buffer[total_received] = '\0';
-            if (strstr(response_buffer, "\r\n\r\n")) {
-                header_end_found = 1;
-                // For simple responses, we might have everything
-                if (total_received < 2048) {
-                    break;
+    }
+    // Requests waiting on this fetch would find nothing in the cache: let them go now
+    if (!capture.enabled) {
+        collapse_pass(request_collapse, cache_key, fetch_id);
+    }
+    capture_append(&capture, head_buffer, head_out);
+
+    long long sent_total = 0;
+    int client_failed = 0;
+    int trailing_bytes = 0;
+    if (platform_send_all(client_socket, head_buffer, head_out) < 0) {
+        print_socket_error("Failed to send response to client");
+        client_failed = 1;
+    } else {
+        sent_total += head_out;
+    }
+
+    // Stream the body: whatever arrived with the head first, then one buffer at a time
+    char* pending = relay_buffer + head_length;
+    int pending_length = head_received - head_length;
+
+    while (!client_failed) {
+        if (pending_length > 0) {
+            int body_bytes = http_response_body(&framer, pending, pending_length);
+            if (body_bytes < 0) {
+                break;
+            }
+            // Bytes past the end of the response mean the connection is out of step
+            trailing_bytes = body_bytes < pending_length;
+            capture_append(&capture, pending, body_bytes);
+            if (platform_send_all(client_socket, pending, body_bytes) < 0) {
+                print_socket_error("Failed to send response to client");
+                client_failed = 1;
+                break;
+            }
+            sent_total += body_bytes;
+        }
+
+        if (framer.complete) {
+            break;
+        }
+
+        // Bodies that will not be cached need no user-space copy: splice the rest
+        if (proxy_config.zero_copy && !capture.enabled &&
+            (framer.body_mode == HTTP_BODY_LENGTH || framer.body_mode == HTTP_BODY_UNTIL_CLOSE)) {
+            long long length = framer.body_mode == HTTP_BODY_LENGTH ? framer.body_remaining : -1;
+            int upstream_eof = 0;
+            long long moved = platform_splice(server_socket, client_socket, length, &upstream_eof);
+            if (moved >= 0) {
+                http_response_body_forwarded(&framer, moved);
+                sent_total += moved;
+                if (upstream_eof) {
+                    http_response_finish_on_close(&framer);
                 }
+                printf("[FORWARD] Spliced %lld body bytes to client\n", moved);
             }
+            break;
         }
-        
-        // If we've received a good amount and headers are complete, break
-        if (header_end_found && total_received > 1024) {
+
+        int bytes_received = platform_recv(server_socket, relay_buffer, RELAY_BUFFER_SIZE, 0);
+        if (bytes_received <= 0) {
+            http_response_finish_on_close(&framer);
             break;
         }
+        pending = relay_buffer;
+        pending_length = bytes_received;
     }
 
-    if (total_received > 0) {
-        response_buffer[total_received] = '\0';
-        
-        printf("[FORWARD] Received %d bytes from %s:%d\n", total_received, host, port);
-        
-        // Send response to client
-        int sent = send(client_socket, response_buffer, total_received, 0);
-        if (sent < 0) {
-            print_socket_error("Failed to send response to client");
-        } else {
-            printf("[FORWARD] Sent %d bytes to client\n", sent);
+    printf("[FORWARD] Relayed %lld bytes from %s:%d (%s)\n", sent_total, host, port,
+           framer.complete ? "complete" : "truncated");
+
+    // Cache the response using full URL as key
+    if (framer.complete && capture.enabled && capture.length > 0) {
+        cache_add(optimized_cache, cache_key, capture.data, capture.length, cache_expires, cache_keep_stale);
+    }
+    capture_disable(&capture);
+
+    // Pool the upstream connection only if it sits exactly at a message boundary
+    int reusable = framer.complete && !framer.connection_close && !client_failed && !trailing_bytes;
+    connection_pool_return(connection_pool, server_socket, host, port, reusable);
+
+    // The client connection can only carry another request after a fully framed response
+    if (client_failed || !framer.complete) {
+        *keep_alive = 0;
+    }
+
+    // Once the head went out, an error response can no longer be sent to the client
+    return 0;
+}
+
+int forward_request_to_server(client_request_t* entry, int client_socket) {
+    if (!entry || !entry->request || client_socket <= 0) {
+        printf("[FORWARD] Invalid parameters\n");
+        return -1;
+    }
+
+    struct ParsedRequest* request = entry->request;
+
+    printf("[FORWARD] Request details - Method: %s, Path: %s, Host: %s\n", 
+           request->method ? request->method : "NULL",
+           request->path ? request->path : "NULL",
+           request->host ? request->host : "NULL");
+
+    // Check cache first (use full URL as cache key)
+    char cache_key[512];
+    snprintf(cache_key, sizeof(cache_key), "%s", request->path);
+    
+    // Only GET responses are stored; HEAD is answered from the same entry
+    int head_request = strcmp(request->method, "HEAD") == 0;
+    int cache_mode = http_request_cache_mode(request);
+    int cacheable = (cache_mode & HTTP_CACHE_STORE) != 0;
+
+    int stale = 0;
+    const cache_node_t* cached = (cache_mode & HTTP_CACHE_LOOKUP) ? cache_get(optimized_cache, cache_key, &stale) : NULL;
+
+    // Concurrent misses on this URL share one upstream fetch: the first leads,
+    // the others wait for it and look in the cache again (a request already
+    // sent early has its own response coming)
+    unsigned long long fetch_id = 0;
+    int leading = 0;
+    if ((!cached || stale) && (cache_mode & HTTP_CACHE_LOOKUP) && cacheable && entry->upstream_socket < 0) {
+        leading = collapse_begin(request_collapse, cache_key, &fetch_id);
+        if (!leading) {
+            cache_release(cached);
+            cached = NULL;
+            if (collapse_wait(request_collapse, cache_key, fetch_id) == 0) {
+                cached = cache_get(optimized_cache, cache_key, &stale);
+            }
         }
-        
-        // Cache the response using full URL as key
-        cache_add(optimized_cache, cache_key, response_buffer, total_received);
-        printf("[CACHE] Added entry for URL: %s (size: %d bytes)\n", cache_key, total_received);
     }
 
-    // Return connection to pool
-    connection_pool_return(connection_pool, server_socket, host, port, 1);
+    if (cached && !stale) {
+        // Send cached response straight from the pinned entry (an early upstream fetch for it is simply dropped)
+        printf("[FORWARD] Sending cached response (%d bytes)\n", cached->data_size);
+        send_cached_response(client_socket, cached, head_request, &entry->keep_alive);
+        cache_release(cached);
+        return 0;
+    }
 
-    return total_received > 0 ? 0 : -1;
+    // Nothing usable in the cache, or the leader's response could not be stored: fetch it ourselves
+    int result = relay_from_upstream(entry, client_socket, cache_key, head_request, cacheable, cached,
+                                     leading ? fetch_id : 0);
+    if (leading) {
+        collapse_end(request_collapse, cache_key, fetch_id);
+    }
+    return result;
 }
 
 int parse_request_url(const char* url, char* host, int* port, char* path) {
@@ -0,0 +1,524 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // getaddrinfo(), struct addrinfo
+#endif
+
+#include "../../include/proxy/resolver.h"
+#include "../../include/proxy/coroutine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <stdint.h>
+#include <unistd.h>
+#endif
+
+// Resolver Implementation
+
+static unsigned int resolver_hash(const char* name) {
+    unsigned int hash = 5381;
+    while (*name) {
+        hash = ((hash << 5) + hash) + (unsigned char)*name++;
+    }
+    return hash % RESOLVER_CACHE_BUCKETS;
+}
+
+// Names are cached case-insensitively; returns -1 for names that cannot be valid hosts
+static int resolver_normalize(const char* host, char* name, size_t size) {
+    size_t length = strlen(host);
+    if (length == 0 || length >= size) {
+        return -1;
+    }
+    for (size_t i = 0; i <= length; i++) {
+        name[i] = (char)tolower((unsigned char)host[i]);
+    }
+    return 0;
+}
+
+static void resolver_result_add(resolver_result_t* result, const struct sockaddr* address, socklen_t length) {
+    if (result->count >= RESOLVER_MAX_ADDRESSES || length > (socklen_t)sizeof(struct sockaddr_storage)) {
+        return;
+    }
+    memcpy(&result->addresses[result->count], address, length);
+    result->lengths[result->count] = length;
+    result->count++;
+}
+
+// Copy getaddrinfo() results, IPv4 before IPv6 (the order connections were made before IPv6 support)
+static void resolver_result_fill(resolver_result_t* result, struct addrinfo* list) {
+    result->count = 0;
+    for (int family_pass = 0; family_pass < 2; family_pass++) {
+        int family = family_pass == 0 ? AF_INET : AF_INET6;
+        for (struct addrinfo* info = list; info; info = info->ai_next) {
+            if (info->ai_family == family) {
+                resolver_result_add(result, info->ai_addr, (socklen_t)info->ai_addrlen);
+            }
+        }
+    }
+}
+
+// Run one query on the calling thread. Returns 0 on success, otherwise the getaddrinfo() error.
+static int resolver_query(const char* name, int numeric_only, resolver_result_t* result) {
+    struct addrinfo hints;
+    struct addrinfo* list = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (numeric_only) {
+        hints.ai_flags = AI_NUMERICHOST;
+    }
+
+    int status = getaddrinfo(name, NULL, &hints, &list);
+    if (status != 0) {
+        return status;
+    }
+
+    resolver_result_fill(result, list);
+    freeaddrinfo(list);
+    return result->count > 0 ? 0 : EAI_NONAME;
+}
+
+static resolver_entry_t* resolver_find(resolver_t* resolver, const char* name) {
+    resolver_entry_t* entry = resolver->buckets[resolver_hash(name)];
+    while (entry && strcmp(entry->name, name) != 0) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+static void resolver_unlink(resolver_t* resolver, resolver_entry_t* victim) {
+    resolver_entry_t** link = &resolver->buckets[resolver_hash(victim->name)];
+    while (*link && *link != victim) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = victim->next;
+        resolver->entry_count--;
+        free(victim);
+    }
+}
+
+// Make room for one more entry: drop expired answers first, then the one expiring soonest.
+// Pending and pinned entries are never evicted.
+static void resolver_make_room(resolver_t* resolver, time_t now) {
+    if (resolver->entry_count < RESOLVER_MAX_ENTRIES) {
+        return;
+    }
+
+    resolver_entry_t* soonest = NULL;
+    for (int i = 0; i < RESOLVER_CACHE_BUCKETS; i++) {
+        resolver_entry_t* entry = resolver->buckets[i];
+        while (entry) {
+            resolver_entry_t* next = entry->next;
+            if (entry->state != RESOLVER_ENTRY_PENDING && entry->expires != 0) {
+                if (entry->expires <= now) {
+                    resolver_unlink(resolver, entry);
+                } else if (!soonest || entry->expires < soonest->expires) {
+                    soonest = entry;
+                }
+            }
+            entry = next;
+        }
+    }
+
+    if (resolver->entry_count >= RESOLVER_MAX_ENTRIES && soonest) {
+        resolver_unlink(resolver, soonest);
+    }
+}
+
+static resolver_entry_t* resolver_insert(resolver_t* resolver, const char* name, time_t now) {
+    resolver_make_room(resolver, now);
+
+    resolver_entry_t* entry = calloc(1, sizeof(resolver_entry_t));
+    if (!entry) {
+        return NULL;
+    }
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+
+    unsigned int bucket = resolver_hash(name);
+    entry->next = resolver->buckets[bucket];
+    resolver->buckets[bucket] = entry;
+    resolver->entry_count++;
+    return entry;
+}
+
+// Queue a query for `entry` (caller holds the mutex)
+static void resolver_start_query(resolver_t* resolver, resolver_entry_t* entry) {
+    entry->state = RESOLVER_ENTRY_PENDING;
+    entry->next_job = NULL;
+    if (resolver->jobs_tail) {
+        resolver->jobs_tail->next_job = entry;
+    } else {
+        resolver->jobs_head = entry;
+    }
+    resolver->jobs_tail = entry;
+    resolver->stats.misses++;
+    pthread_cond_signal(&resolver->job_ready);
+}
+
+static void resolver_notify(resolver_t* resolver) {
+#ifdef __linux__
+    uint64_t one = 1;
+    for (int i = 0; i < resolver->wakeup_count; i++) {
+        if (write(resolver->wakeup_fds[i], &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            printf("[DNS] Failed to wake event loop (fd %d)\n", resolver->wakeup_fds[i]);
+        }
+    }
+#else
+    (void)resolver;
+#endif
+}
+
+static void* resolver_thread(void* arg) {
+    resolver_t* resolver = (resolver_t*)arg;
+
+    pthread_mutex_lock(&resolver->mutex);
+    while (1) {
+        while (!resolver->shutdown && !resolver->jobs_head) {
+            pthread_cond_wait(&resolver->job_ready, &resolver->mutex);
+        }
+        if (resolver->shutdown) {
+            break;
+        }
+
+        // Pending entries are never evicted, so the pointer stays valid while unlocked
+        resolver_entry_t* entry = resolver->jobs_head;
+        resolver->jobs_head = entry->next_job;
+        if (!resolver->jobs_head) {
+            resolver->jobs_tail = NULL;
+        }
+        char name[256];
+        snprintf(name, sizeof(name), "%s", entry->name);
+        pthread_mutex_unlock(&resolver->mutex);
+
+        resolver_result_t result;
+        memset(&result, 0, sizeof(result));
+        int status = resolver_query(name, 0, &result);
+
+        pthread_mutex_lock(&resolver->mutex);
+        entry->result = result;
+        if (status == 0) {
+            entry->state = RESOLVER_ENTRY_RESOLVED;
+            entry->expires = time(NULL) + RESOLVER_POSITIVE_TTL;
+            printf("[DNS] Resolved %s (%d addresses, cached for %ds)\n",
+                   name, result.count, RESOLVER_POSITIVE_TTL);
+        } else {
+            entry->state = RESOLVER_ENTRY_FAILED;
+            entry->expires = time(NULL) + RESOLVER_NEGATIVE_TTL;
+            resolver->stats.failures++;
+            printf("[DNS] Failed to resolve %s: %s (cached for %ds)\n",
+                   name, gai_strerror(status), RESOLVER_NEGATIVE_TTL);
+        }
+        pthread_cond_broadcast(&resolver->lookup_done);
+        resolver_notify(resolver);
+    }
+    pthread_mutex_unlock(&resolver->mutex);
+    return NULL;
+}
+
+resolver_t* resolver_create(const char* hosts_file) {
+    resolver_t* resolver = calloc(1, sizeof(resolver_t));
+    if (!resolver) {
+        printf("[DNS] Failed to allocate memory for resolver\n");
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&resolver->mutex, NULL) != 0 ||
+        pthread_cond_init(&resolver->job_ready, NULL) != 0 ||
+        pthread_cond_init(&resolver->lookup_done, NULL) != 0) {
+        printf("[DNS] Failed to initialize resolver synchronization\n");
+        free(resolver);
+        return NULL;
+    }
+
+    if (hosts_file && resolver_load_hosts(resolver, hosts_file) < 0) {
+        resolver_destroy(resolver);
+        return NULL;
+    }
+
+    for (int i = 0; i < RESOLVER_THREADS; i++) {
+        if (pthread_create(&resolver->threads[i], NULL, resolver_thread, resolver) != 0) {
+            printf("[DNS] Failed to start resolver thread %d\n", i);
+            resolver_destroy(resolver);
+            return NULL;
+        }
+        resolver->thread_count++;
+    }
+
+    printf("[DNS] Resolver started with %d threads (ttl %ds, negative ttl %ds)\n",
+           resolver->thread_count, RESOLVER_POSITIVE_TTL, RESOLVER_NEGATIVE_TTL);
+    return resolver;
+}
+
+void resolver_destroy(resolver_t* resolver) {
+    if (!resolver) return;
+
+    pthread_mutex_lock(&resolver->mutex);
+    resolver->shutdown = 1;
+    pthread_cond_broadcast(&resolver->job_ready);
+    pthread_cond_broadcast(&resolver->lookup_done);
+    pthread_mutex_unlock(&resolver->mutex);
+
+    for (int i = 0; i < resolver->thread_count; i++) {
+        pthread_join(resolver->threads[i], NULL);
+    }
+
+    printf("[DNS] Resolver stats: %lld hits, %lld negative hits, %lld misses, %lld shared, %lld failures\n",
+           resolver->stats.hits, resolver->stats.negative_hits, resolver->stats.misses,
+           resolver->stats.shared, resolver->stats.failures);
+
+    for (int i = 0; i < RESOLVER_CACHE_BUCKETS; i++) {
+        resolver_entry_t* entry = resolver->buckets[i];
+        while (entry) {
+            resolver_entry_t* next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+
+    pthread_cond_destroy(&resolver->job_ready);
+    pthread_cond_destroy(&resolver->lookup_done);
+    pthread_mutex_destroy(&resolver->mutex);
+    free(resolver);
+}
+
+// Hosts-file stand-in: "address name [name...]" lines pin names to fixed addresses,
+// so tests can point any host name at a local origin without touching real DNS
+int resolver_load_hosts(resolver_t* resolver, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("[DNS] Failed to open hosts file: %s\n", path);
+        return -1;
+    }
+
+    char line[1024];
+    int pinned = 0;
+    while (fgets(line, sizeof(line), file)) {
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char* address = strtok(line, " \t\r\n");
+        if (!address) {
+            continue;
+        }
+
+        resolver_result_t parsed;
+        memset(&parsed, 0, sizeof(parsed));
+        if (resolver_query(address, 1, &parsed) != 0) {
+            printf("[DNS] Ignoring invalid hosts file address: %s\n", address);
+            continue;
+        }
+
+        char* host;
+        while ((host = strtok(NULL, " \t\r\n")) != NULL) {
+            char name[256];
+            if (resolver_normalize(host, name, sizeof(name)) < 0) {
+                continue;
+            }
+
+            pthread_mutex_lock(&resolver->mutex);
+            resolver_entry_t* entry = resolver_find(resolver, name);
+            if (!entry) {
+                entry = resolver_insert(resolver, name, time(NULL));
+                if (entry) {
+                    pinned++;
+                }
+            }
+            if (entry) {
+                entry->state = RESOLVER_ENTRY_RESOLVED;
+                entry->expires = 0;
+                resolver_result_add(&entry->result, (struct sockaddr*)&parsed.addresses[0], parsed.lengths[0]);
+            }
+            pthread_mutex_unlock(&resolver->mutex);
+        }
+    }
+
+    fclose(file);
+    printf("[DNS] Pinned %d host names from %s\n", pinned, path);
+    return pinned;
+}
+
+// Answer from the cache or start a query. Returns 0/-1 when answered, 1 while pending
+// (caller holds the mutex).
+static int resolver_check(resolver_t* resolver, const char* name, resolver_result_t* result, int* started) {
+    time_t now = time(NULL);
+    resolver_entry_t* entry = resolver_find(resolver, name);
+
+    if (entry && entry->state != RESOLVER_ENTRY_PENDING && (entry->expires == 0 || entry->expires > now)) {
+        if (entry->state == RESOLVER_ENTRY_FAILED) {
+            resolver->stats.negative_hits++;
+            return -1;
+        }
+        resolver->stats.hits++;
+        if (result) {
+            *result = entry->result;
+        }
+        return 0;
+    }
+
+    if (!entry) {
+        entry = resolver_insert(resolver, name, now);
+        if (!entry) {
+            return -1;
+        }
+        resolver_start_query(resolver, entry);
+        *started = 1;
+    } else if (entry->state != RESOLVER_ENTRY_PENDING) {
+        resolver_start_query(resolver, entry);
+        *started = 1;
+    }
+    return 1;
+}
+
+static int resolver_lookup_parked(resolver_t* resolver, const char* name, resolver_result_t* result) {
+    time_t deadline = time(NULL) + RESOLVER_LOOKUP_TIMEOUT;
+    int status = 1;
+
+    while (status == 1) {
+        int remaining = (int)(deadline - time(NULL));
+        if (remaining <= 0 || !coroutine_wait_wakeup(remaining * 1000)) {
+            pthread_mutex_lock(&resolver->mutex);
+            resolver->stats.timeouts++;
+            pthread_mutex_unlock(&resolver->mutex);
+            printf("[DNS] Timed out waiting for %s\n", name);
+            return -1;
+        }
+
+        pthread_mutex_lock(&resolver->mutex);
+        resolver_entry_t* entry = resolver_find(resolver, name);
+        if (!entry || resolver->shutdown) {
+            status = -1;
+        } else if (entry->state == RESOLVER_ENTRY_RESOLVED) {
+            *result = entry->result;
+            status = 0;
+        } else if (entry->state == RESOLVER_ENTRY_FAILED) {
+            status = -1;
+        }
+        pthread_mutex_unlock(&resolver->mutex);
+    }
+    return status;
+}
+
+int resolver_lookup(resolver_t* resolver, const char* host, resolver_result_t* result) {
+    char name[256];
+    resolver_result_t local;
+    if (!result) {
+        result = &local;
+    }
+    if (!host || resolver_normalize(host, name, sizeof(name)) < 0) {
+        return -1;
+    }
+
+    // Literal addresses and a missing resolver never touch the cache
+    if (resolver_query(name, 1, result) == 0) {
+        return 0;
+    }
+    if (!resolver || resolver->thread_count == 0) {
+        int status = resolver_query(name, 0, result);
+        if (status != 0) {
+            printf("[DNS] Failed to resolve %s: %s\n", name, gai_strerror(status));
+            return -1;
+        }
+        return 0;
+    }
+
+    pthread_mutex_lock(&resolver->mutex);
+    int started = 0;
+    int status = resolver_check(resolver, name, result, &started);
+    if (status == 1 && !started) {
+        resolver->stats.shared++;
+    }
+
+    // A coroutine handler parks on its scheduler (woken through the eventfd)
+    // instead of holding the whole scheduler thread on the condition variable
+    if (status == 1 && coroutine_active()) {
+        pthread_mutex_unlock(&resolver->mutex);
+        return resolver_lookup_parked(resolver, name, result);
+    }
+
+    struct timespec deadline;
+    deadline.tv_sec = time(NULL) + RESOLVER_LOOKUP_TIMEOUT;
+    deadline.tv_nsec = 0;
+    while (status == 1 && !resolver->shutdown) {
+        if (pthread_cond_timedwait(&resolver->lookup_done, &resolver->mutex, &deadline) == ETIMEDOUT) {
+            resolver->stats.timeouts++;
+            printf("[DNS] Timed out waiting for %s\n", name);
+            status = -1;
+            break;
+        }
+
+        resolver_entry_t* entry = resolver_find(resolver, name);
+        if (!entry) {
+            status = -1;
+        } else if (entry->state == RESOLVER_ENTRY_RESOLVED) {
+            *result = entry->result;
+            status = 0;
+        } else if (entry->state == RESOLVER_ENTRY_FAILED) {
+            status = -1;
+        }
+    }
+    pthread_mutex_unlock(&resolver->mutex);
+    return status == 0 ? 0 : -1;
+}
+
+int resolver_lookup_nowait(resolver_t* resolver, const char* host, resolver_result_t* result) {
+    char name[256];
+    resolver_result_t local;
+    if (!result) {
+        result = &local;
+    }
+    if (!host || resolver_normalize(host, name, sizeof(name)) < 0) {
+        return -1;
+    }
+
+    if (resolver_query(name, 1, result) == 0) {
+        return 0;
+    }
+    if (!resolver || resolver->thread_count == 0) {
+        return resolver_lookup(resolver, host, result);
+    }
+
+    pthread_mutex_lock(&resolver->mutex);
+    int started = 0;
+    int status = resolver_check(resolver, name, result, &started);
+    pthread_mutex_unlock(&resolver->mutex);
+    return status;
+}
+
+int resolver_add_wakeup(resolver_t* resolver, int fd) {
+    if (!resolver) return -1;
+
+    pthread_mutex_lock(&resolver->mutex);
+    int added = resolver->wakeup_count < RESOLVER_MAX_WAKEUPS;
+    if (added) {
+        resolver->wakeup_fds[resolver->wakeup_count++] = fd;
+    }
+    pthread_mutex_unlock(&resolver->mutex);
+    return added ? 0 : -1;
+}
+
+void resolver_remove_wakeup(resolver_t* resolver, int fd) {
+    if (!resolver) return;
+
+    pthread_mutex_lock(&resolver->mutex);
+    for (int i = 0; i < resolver->wakeup_count; i++) {
+        if (resolver->wakeup_fds[i] == fd) {
+            resolver->wakeup_fds[i] = resolver->wakeup_fds[--resolver->wakeup_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&resolver->mutex);
+}
+
+void resolver_get_stats(resolver_t* resolver, resolver_stats_t* stats) {
+    if (!resolver || !stats) return;
+
+    pthread_mutex_lock(&resolver->mutex);
+    *stats = resolver->stats;
+    pthread_mutex_unlock(&resolver->mutex);
+}
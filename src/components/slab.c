@@ -0,0 +1,362 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // MAP_ANONYMOUS, madvise()
+#endif
+
+#include "../../include/proxy/slab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+// Slab Implementation
+
+#define SLAB_ARENA_HEADER 64            // Arena bookkeeping, ahead of the first slot
+
+// An arena holds slots of one class. Slots past `carved` have never been
+// handed out, so a fresh arena costs no memory until it is used.
+typedef struct slab_arena {
+    struct slab_arena* prev;            // In the class's list of arenas with free slots
+    struct slab_arena* next;
+    int size_class;
+    int capacity;                       // Slots
+    int used;
+    int carved;
+    void* free_list;                    // Freed slots, linked through their first word
+    char* slots;
+} slab_arena_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    slab_arena_t* partial;              // Arenas with a free slot (full ones are in no list)
+    slab_arena_t* spare;                // One empty arena kept for reuse, its pages dropped
+    int arenas;                         // Holding slots (the spare is not counted)
+    size_t used_slots;
+    size_t requested_bytes;
+} slab_class_t;
+
+static slab_class_t classes[SLAB_CLASS_COUNT];
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+static size_t page_size = 4096;
+static int huge_pages = 0;
+static int huge_pages_warned = 0;
+
+static int large_blocks = 0;
+static size_t large_bytes = 0;
+static size_t large_requested = 0;
+
+static void slab_init(void) {
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        pthread_mutex_init(&classes[i].lock, NULL);
+    }
+#ifndef _WIN32
+    long page = sysconf(_SC_PAGESIZE);
+    if (page > 0) {
+        page_size = (size_t)page;
+    }
+#endif
+}
+
+void slab_use_huge_pages(int enabled) {
+    huge_pages = enabled;
+}
+
+// Class 0 holds up to SLAB_MIN_SLOT bytes; above that every power of two is
+// split into four classes
+static int slab_class_of(size_t size) {
+    if (size <= SLAB_MIN_SLOT) {
+        return 0;
+    }
+
+    int bit = 0;
+    for (size_t v = size - 1; v > 1; v >>= 1) {
+        bit++;
+    }
+    size_t base = (size_t)1 << bit;     // base < size <= 2 * base
+    size_t step = base / 4;
+    int quarter = (int)((size - base + step - 1) / step);
+    return (bit - 7) * 4 + quarter;
+}
+
+static size_t slab_class_slot(int size_class) {
+    if (size_class == 0) {
+        return SLAB_MIN_SLOT;
+    }
+    size_t base = (size_t)1 << (7 + (size_class - 1) / 4);
+    return base + (size_t)((size_class - 1) % 4 + 1) * (base / 4);
+}
+
+static size_t slab_round_pages(size_t size) {
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+size_t slab_slot_size(size_t size) {
+    pthread_once(&slab_once, slab_init);
+    return size > SLAB_MAX_SLOT ? slab_round_pages(size) : slab_class_slot(slab_class_of(size));
+}
+
+// ---------------------------------------------------------------------------
+// System memory
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+static void* slab_map_arena(void) {
+    return _aligned_malloc(SLAB_ARENA_SIZE, SLAB_ARENA_SIZE);
+}
+
+static void slab_unmap_arena(void* arena) {
+    _aligned_free(arena);
+}
+
+static void slab_drop_pages(slab_arena_t* arena) {
+    (void)arena;
+}
+
+static void* slab_map_large(size_t size) {
+    return malloc(size);
+}
+
+static void slab_unmap_large(void* block, size_t size) {
+    (void)size;
+    free(block);
+}
+
+#else
+
+// Map twice the arena size and trim, so the arena starts on an arena boundary
+static void* slab_map_arena(void) {
+    size_t span = 2 * (size_t)SLAB_ARENA_SIZE;
+    char* raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    char* arena = (char*)(((uintptr_t)raw + SLAB_ARENA_SIZE - 1) & ~(uintptr_t)(SLAB_ARENA_SIZE - 1));
+    size_t head = (size_t)(arena - raw);
+    if (head > 0) {
+        munmap(raw, head);
+    }
+    if (span - head > SLAB_ARENA_SIZE) {
+        munmap(arena + SLAB_ARENA_SIZE, span - head - SLAB_ARENA_SIZE);
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (huge_pages && madvise(arena, SLAB_ARENA_SIZE, MADV_HUGEPAGE) != 0 && !huge_pages_warned) {
+        huge_pages_warned = 1;
+        printf("[SLAB] Transparent huge pages unavailable, using normal pages\n");
+    }
+#else
+    if (huge_pages && !huge_pages_warned) {
+        huge_pages_warned = 1;
+        printf("[SLAB] Transparent huge pages are Linux only, using normal pages\n");
+    }
+#endif
+    return arena;
+}
+
+static void slab_unmap_arena(void* arena) {
+    munmap(arena, SLAB_ARENA_SIZE);
+}
+
+// Give an empty arena's slot pages back while keeping the mapping
+static void slab_drop_pages(slab_arena_t* arena) {
+    madvise((char*)arena + page_size, SLAB_ARENA_SIZE - page_size, MADV_DONTNEED);
+}
+
+static void* slab_map_large(size_t size) {
+    void* block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return block == MAP_FAILED ? NULL : block;
+}
+
+static void slab_unmap_large(void* block, size_t size) {
+    munmap(block, size);
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// Allocation
+// ---------------------------------------------------------------------------
+
+static void slab_list_push(slab_class_t* cls, slab_arena_t* arena) {
+    arena->prev = NULL;
+    arena->next = cls->partial;
+    if (cls->partial) {
+        cls->partial->prev = arena;
+    }
+    cls->partial = arena;
+}
+
+static void slab_list_remove(slab_class_t* cls, slab_arena_t* arena) {
+    if (arena->prev) {
+        arena->prev->next = arena->next;
+    } else {
+        cls->partial = arena->next;
+    }
+    if (arena->next) {
+        arena->next->prev = arena->prev;
+    }
+    arena->prev = NULL;
+    arena->next = NULL;
+}
+
+static slab_arena_t* slab_arena_create(int size_class) {
+    slab_arena_t* arena = slab_map_arena();
+    if (!arena) {
+        return NULL;
+    }
+
+    arena->prev = NULL;
+    arena->next = NULL;
+    arena->size_class = size_class;
+    arena->capacity = (int)((SLAB_ARENA_SIZE - SLAB_ARENA_HEADER) / slab_class_slot(size_class));
+    arena->used = 0;
+    arena->carved = 0;
+    arena->free_list = NULL;
+    arena->slots = (char*)arena + SLAB_ARENA_HEADER;
+    return arena;
+}
+
+static void* slab_alloc_large(size_t size) {
+    size_t mapped = slab_round_pages(size);
+    void* block = slab_map_large(mapped);
+    if (!block) {
+        return NULL;
+    }
+
+    __atomic_add_fetch(&large_blocks, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&large_bytes, mapped, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&large_requested, size, __ATOMIC_RELAXED);
+    return block;
+}
+
+void* slab_alloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    pthread_once(&slab_once, slab_init);
+    if (size > SLAB_MAX_SLOT) {
+        return slab_alloc_large(size);
+    }
+
+    int size_class = slab_class_of(size);
+    slab_class_t* cls = &classes[size_class];
+
+    pthread_mutex_lock(&cls->lock);
+
+    slab_arena_t* arena = cls->partial;
+    if (!arena) {
+        arena = cls->spare;
+        cls->spare = NULL;
+        if (!arena) {
+            arena = slab_arena_create(size_class);
+            if (!arena) {
+                pthread_mutex_unlock(&cls->lock);
+                return NULL;
+            }
+        }
+        cls->arenas++;
+        slab_list_push(cls, arena);
+    }
+
+    void* block;
+    if (arena->free_list) {
+        block = arena->free_list;
+        arena->free_list = *(void**)block;
+    } else {
+        block = arena->slots + (size_t)arena->carved * slab_class_slot(size_class);
+        arena->carved++;
+    }
+
+    arena->used++;
+    if (arena->used == arena->capacity) {
+        slab_list_remove(cls, arena);
+    }
+    cls->used_slots++;
+    cls->requested_bytes += size;
+
+    pthread_mutex_unlock(&cls->lock);
+    return block;
+}
+
+void slab_free(void* block, size_t size) {
+    if (!block) {
+        return;
+    }
+    if (size > SLAB_MAX_SLOT) {
+        size_t mapped = slab_round_pages(size);
+        slab_unmap_large(block, mapped);
+        __atomic_sub_fetch(&large_blocks, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&large_bytes, mapped, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&large_requested, size, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // Arenas are aligned to their size, so the block's arena is found by masking
+    slab_arena_t* arena = (slab_arena_t*)((uintptr_t)block & ~(uintptr_t)(SLAB_ARENA_SIZE - 1));
+    slab_class_t* cls = &classes[arena->size_class];
+    slab_arena_t* released = NULL;
+
+    pthread_mutex_lock(&cls->lock);
+
+    *(void**)block = arena->free_list;
+    arena->free_list = block;
+    if (arena->used == arena->capacity) {
+        slab_list_push(cls, arena);     // Was full: it has room again
+    }
+    arena->used--;
+    cls->used_slots--;
+    cls->requested_bytes -= size;
+
+    // An empty arena goes back to the system, or becomes the class's spare
+    if (arena->used == 0) {
+        slab_list_remove(cls, arena);
+        cls->arenas--;
+        if (!cls->spare) {
+            arena->free_list = NULL;
+            arena->carved = 0;
+            slab_drop_pages(arena);
+            cls->spare = arena;
+        } else {
+            released = arena;
+        }
+    }
+
+    pthread_mutex_unlock(&cls->lock);
+
+    if (released) {
+        slab_unmap_arena(released);
+    }
+}
+
+void slab_get_stats(slab_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_once(&slab_once, slab_init);
+
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slab_class_t* cls = &classes[i];
+
+        pthread_mutex_lock(&cls->lock);
+        stats->arenas += cls->arenas;
+        stats->spare_arenas += cls->spare != NULL;
+        stats->slot_bytes += cls->used_slots * slab_class_slot(i);
+        stats->requested_bytes += cls->requested_bytes;
+        pthread_mutex_unlock(&cls->lock);
+    }
+    stats->arena_bytes = (size_t)stats->arenas * SLAB_ARENA_SIZE;
+
+    stats->large_blocks = __atomic_load_n(&large_blocks, __ATOMIC_RELAXED);
+    stats->large_bytes = __atomic_load_n(&large_bytes, __ATOMIC_RELAXED);
+    stats->requested_bytes += __atomic_load_n(&large_requested, __ATOMIC_RELAXED);
+}
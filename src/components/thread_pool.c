@@ -1,188 +1,742 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // syscall()
+#endif
+
 #include "../../include/proxy/thread_pool.h"
 #include "../../include/proxy/proxy_server.h"
+#include "../../include/proxy/affinity.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
 // Thread Pool Implementation
 
 // Global synchronization primitives (declared as extern - defined in main)
 extern sem_t semaphore;
 extern pthread_mutex_t lock;
 
+int thread_pool_default_workers(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int cores = (int)info.dwNumberOfProcessors;
+#else
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (cores < 1) {
+        cores = 1;
+    }
+    if (cores > MAX_WORKER_THREADS) {
+        cores = MAX_WORKER_THREADS;
+    }
+    return cores;
+}
+
+#ifdef __linux__
+static void pool_sleep(thread_pool_t* pool, int sequence) {
+    // Returns at once if wake_sequence already moved on
+    syscall(SYS_futex, &pool->wake_sequence, FUTEX_WAIT_PRIVATE, sequence, NULL, NULL, 0);
+}
+
+static void pool_wake(thread_pool_t* pool, int count) {
+    __atomic_add_fetch(&pool->wake_sequence, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &pool->wake_sequence, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+#else
+static void pool_sleep(thread_pool_t* pool, int sequence) {
+    pthread_mutex_lock(&pool->idle_mutex);
+    while (__atomic_load_n(&pool->wake_sequence, __ATOMIC_ACQUIRE) == sequence) {
+        pthread_cond_wait(&pool->work_available, &pool->idle_mutex);
+    }
+    pthread_mutex_unlock(&pool->idle_mutex);
+}
+
+static void pool_wake(thread_pool_t* pool, int count) {
+    pthread_mutex_lock(&pool->idle_mutex);
+    __atomic_add_fetch(&pool->wake_sequence, 1, __ATOMIC_SEQ_CST);
+    if (count == 1) {
+        pthread_cond_signal(&pool->work_available);
+    } else {
+        pthread_cond_broadcast(&pool->work_available);
+    }
+    pthread_mutex_unlock(&pool->idle_mutex);
+}
+#endif
+
+static long long thread_pool_now_us(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (long long)(counter.QuadPart * 1000000 / frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+// Absolute wall-clock deadline `ms` from now (pthread_cond_timedwait)
+static void thread_pool_deadline(struct timespec* deadline, int ms) {
+#ifdef _WIN32
+    FILETIME file_time;
+    GetSystemTimeAsFileTime(&file_time);
+    long long hundred_ns = (((long long)file_time.dwHighDateTime << 32) | file_time.dwLowDateTime)
+                           - 116444736000000000LL;   // 1601 -> 1970
+    deadline->tv_sec = (time_t)(hundred_ns / 10000000);
+    deadline->tv_nsec = (long)(hundred_ns % 10000000) * 100;
+#else
+    clock_gettime(CLOCK_REALTIME, deadline);
+#endif
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+
+static void ring_init(thread_pool_ring_t* ring) {
+    ring->enqueue_pos = 0;
+    ring->dequeue_pos = 0;
+    for (long i = 0; i < THREAD_POOL_RING_SIZE; i++) {
+        ring->slots[i].sequence = i;
+        ring->slots[i].client_socket = -1;
+        ring->slots[i].queued_us = 0;
+    }
+}
+
+// Claim the cell at enqueue_pos, fill it, then hand it to consumers by
+// advancing its sequence. Fails only when the ring is full.
+static int ring_push(thread_pool_ring_t* ring, int client_socket, long long queued_us) {
+    long pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    thread_pool_slot_t* slot;
+
+    while (1) {
+        slot = &ring->slots[pos & (THREAD_POOL_RING_SIZE - 1)];
+        long sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        long diff = sequence - pos;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;              // Consumers have not freed this cell yet
+        } else {
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->client_socket = client_socket;
+    slot->queued_us = queued_us;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Claim the oldest filled cell (owner and thieves alike) and recycle it for
+// the producer one lap later
+static int ring_take(thread_pool_ring_t* ring, long long* queued_us) {
+    long pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    thread_pool_slot_t* slot;
+
+    while (1) {
+        slot = &ring->slots[pos & (THREAD_POOL_RING_SIZE - 1)];
+        long sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        long diff = sequence - (pos + 1);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;              // Empty
+        } else {
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    int client_socket = slot->client_socket;
+    if (queued_us) {
+        *queued_us = slot->queued_us;
+    }
+    __atomic_store_n(&slot->sequence, pos + THREAD_POOL_RING_SIZE, __ATOMIC_RELEASE);
+    return client_socket;
+}
+
+// How long the oldest queued socket has waited so far (0 when the ring is empty)
+static long long ring_head_age(thread_pool_ring_t* ring, long long now_us) {
+    long pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    thread_pool_slot_t* slot = &ring->slots[pos & (THREAD_POOL_RING_SIZE - 1)];
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1) {
+        return 0;
+    }
+    long long queued_us = slot->queued_us;   // A racing take only makes this stale
+    return now_us > queued_us ? now_us - queued_us : 0;
+}
+
+static int ring_depth(thread_pool_ring_t* ring) {
+    long depth = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED) -
+                 __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    return depth > 0 ? (int)depth : 0;
+}
+
+// Priority ring first, then the worker's own ring, then every other ring that
+// ever had a worker (retired workers' rings included, in case a socket landed
+// there late)
+static int take_task(thread_pool_worker_t* worker, long long* queued_us) {
+    thread_pool_t* pool = worker->pool;
+
+    int client_socket = ring_take(&pool->priority, queued_us);
+    if (client_socket > 0) {
+        return client_socket;
+    }
+
+    client_socket = ring_take(&worker->ring, queued_us);
+    if (client_socket > 0) {
+        return client_socket;
+    }
+
+    int span = __atomic_load_n(&pool->worker_span, __ATOMIC_ACQUIRE);
+    for (int i = 1; i < span; i++) {
+        thread_pool_worker_t* victim = &pool->workers[(worker->id + i) % span];
+        client_socket = ring_take(&victim->ring, queued_us);
+        if (client_socket > 0) {
+            __atomic_add_fetch(&worker->stolen, 1, __ATOMIC_RELAXED);
+            return client_socket;
+        }
+    }
+
+    return -1;
+}
+
+// A retiring worker with nothing left to take exits, unless the sizer revived it meanwhile
+static int worker_retired(thread_pool_worker_t* worker) {
+    int expected = THREAD_POOL_WORKER_RETIRING;
+    return __atomic_compare_exchange_n(&worker->state, &expected, THREAD_POOL_WORKER_EXITED, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
 // Worker thread function
 void* worker_thread(void* arg) {
-    thread_pool_t* pool = (thread_pool_t*)arg;
-    
-    printf("[THREAD] Worker thread started\n");
-    
+    thread_pool_worker_t* worker = (thread_pool_worker_t*)arg;
+    thread_pool_t* pool = worker->pool;
+    long long queued_us = 0;
+
+    printf("[THREAD] Worker thread %d started\n", worker->id);
+
     while (1) {
-        pthread_mutex_lock(&pool->queue_mutex);
-        
-        // Wait for tasks in the queue
-        while (pool->task_queue_head == NULL && !pool->shutdown) {
-            pthread_cond_wait(&pool->queue_condition, &pool->queue_mutex);
-        }
-        
-        // Check if we should shutdown
-        if (pool->shutdown) {
-            pthread_mutex_unlock(&pool->queue_mutex);
+        if (__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
             break;
         }
-        
-        // Get task from queue
-        task_t* task = pool->task_queue_head;
-        if (task) {
-            pool->task_queue_head = task->next;
-            if (pool->task_queue_head == NULL) {
-                pool->task_queue_tail = NULL;
+
+        int client_socket = take_task(worker, &queued_us);
+
+        if (client_socket <= 0 && worker_retired(worker)) {
+            printf("[THREAD] Worker thread %d retired\n", worker->id);
+            return NULL;
+        }
+
+        // Nothing queued anywhere: keep polling for a moment before sleeping
+        for (int spin = 0; client_socket <= 0 && spin < THREAD_POOL_SPIN_ROUNDS; spin++) {
+            cpu_relax();
+            client_socket = take_task(worker, &queued_us);
+        }
+
+        if (client_socket <= 0) {
+            // Announce idleness, then look once more so a task pushed before the
+            // producer saw idle_workers is not missed; a wake after the sequence
+            // was read makes the sleep return at once
+            int sequence = __atomic_load_n(&pool->wake_sequence, __ATOMIC_SEQ_CST);
+            __atomic_add_fetch(&pool->idle_workers, 1, __ATOMIC_SEQ_CST);
+
+            client_socket = take_task(worker, &queued_us);
+            if (client_socket <= 0 && !__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) == THREAD_POOL_WORKER_RUNNING) {
+                pool_sleep(pool, sequence);
+            }
+
+            __atomic_sub_fetch(&pool->idle_workers, 1, __ATOMIC_SEQ_CST);
+
+            if (client_socket <= 0) {
+                continue;
             }
-            pool->queue_size--;
         }
-        
-        pthread_mutex_unlock(&pool->queue_mutex);
-        
+
+        // Queue wait feeds the sizing decisions
+        __atomic_add_fetch(&pool->wait_total_us, thread_pool_now_us() - queued_us, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&pool->wait_count, 1, __ATOMIC_RELAXED);
+
         // Process the task
-        if (task) {
-            printf("[WORKER] Processing client socket %d\n", task->client_socket);
-            
-            // Wait for semaphore (connection limiting)
-            sem_wait(&semaphore);
-            
-            // Handle the client request
-            handle_client_request(task->client_socket);
-            
-            // Release semaphore
-            sem_post(&semaphore);
-            
-            // Free the task
-            free(task);
-        }
-    }
-    
-    printf("[THREAD] Worker thread exiting\n");
+        printf("[WORKER] Worker %d processing client socket %d\n", worker->id, client_socket);
+        __atomic_add_fetch(&pool->busy_workers, 1, __ATOMIC_RELAXED);
+
+        // Wait for semaphore (connection limiting)
+        sem_wait(&semaphore);
+
+        // Handle the client request
+        long long started_us = thread_pool_now_us();
+        handle_client_request(client_socket);
+
+        // Release semaphore
+        sem_post(&semaphore);
+
+        // Lossy under concurrent updates, which is fine for an estimate
+        long long elapsed_us = thread_pool_now_us() - started_us;
+        long long service = __atomic_load_n(&pool->service_us, __ATOMIC_RELAXED);
+        service = service ? service + (elapsed_us - service) / THREAD_POOL_SERVICE_WEIGHT : elapsed_us;
+        __atomic_store_n(&pool->service_us, service, __ATOMIC_RELAXED);
+
+        __atomic_sub_fetch(&pool->busy_workers, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&worker->executed, 1, __ATOMIC_RELAXED);
+    }
+
+    printf("[THREAD] Worker thread %d exiting\n", worker->id);
     return NULL;
 }
 
-thread_pool_t* thread_pool_create(void) {
-    thread_pool_t* pool = malloc(sizeof(thread_pool_t));
+// Bring slot `index` into service: revive it if it is still draining, otherwise
+// (after joining a thread that already retired) start a fresh thread
+static int pool_start_worker(thread_pool_t* pool, int index) {
+    thread_pool_worker_t* worker = &pool->workers[index];
+
+    int expected = THREAD_POOL_WORKER_RETIRING;
+    if (__atomic_compare_exchange_n(&worker->state, &expected, THREAD_POOL_WORKER_RUNNING, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    if (expected == THREAD_POOL_WORKER_EXITED) {
+        pthread_join(worker->thread, NULL);
+    }
+
+    // With --cpu-affinity each slot has a fixed CPU on the pool's node; the
+    // node's first CPU is left to the acceptor
+    pthread_attr_t attr;
+    int cpu = affinity_cpu(pool->node, index + 1);
+    int pinned = affinity_thread_attr(&attr, cpu) == 0;
+
+    __atomic_store_n(&worker->state, THREAD_POOL_WORKER_RUNNING, __ATOMIC_RELEASE);
+    int created = pthread_create(&worker->thread, pinned ? &attr : NULL, worker_thread, worker);
+    if (pinned) {
+        pthread_attr_destroy(&attr);
+    }
+    if (created != 0) {
+        printf("[POOL] Failed to create worker thread %d\n", index);
+        __atomic_store_n(&worker->state, THREAD_POOL_WORKER_STOPPED, __ATOMIC_RELEASE);
+        return -1;
+    }
+    if (pinned) {
+        printf("[AFFINITY] Worker %d pinned to CPU %d (node %d)\n", index, cpu, affinity_cpu_node(cpu));
+    }
+
+    if (index >= pool->worker_span) {
+        __atomic_store_n(&pool->worker_span, index + 1, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Join workers that finished retiring
+static void pool_reap_workers(thread_pool_t* pool) {
+    for (int i = 0; i < pool->worker_span; i++) {
+        thread_pool_worker_t* worker = &pool->workers[i];
+        if (__atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) == THREAD_POOL_WORKER_EXITED) {
+            pthread_join(worker->thread, NULL);
+            __atomic_store_n(&worker->state, THREAD_POOL_WORKER_STOPPED, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static int pool_queued(thread_pool_t* pool) {
+    int queued = ring_depth(&pool->priority);
+    int span = __atomic_load_n(&pool->worker_span, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < span; i++) {
+        queued += ring_depth(&pool->workers[i].ring);
+    }
+    return queued;
+}
+
+long long thread_pool_estimate_wait_us(thread_pool_t* pool) {
+    if (!pool) return 0;
+
+    int busy = __atomic_load_n(&pool->busy_workers, __ATOMIC_RELAXED);
+    int active = __atomic_load_n(&pool->active_workers, __ATOMIC_ACQUIRE);
+    int span = __atomic_load_n(&pool->worker_span, __ATOMIC_ACQUIRE);
+    long long now_us = thread_pool_now_us();
+    long long oldest_us = 0;
+    int queued = ring_depth(&pool->priority);
+
+    for (int i = 0; i < span; i++) {
+        thread_pool_ring_t* ring = &pool->workers[i].ring;
+        int depth = ring_depth(ring);
+        if (depth > 0) {
+            long long age_us = ring_head_age(ring, now_us);
+            if (age_us > oldest_us) {
+                oldest_us = age_us;
+            }
+            queued += depth;
+        }
+    }
+    if (busy + queued < active) {
+        return 0;                        // A worker is free
+    }
+
+    // Every socket ahead of this one needs a worker to finish a connection.
+    // The sizer grows the pool under the same pressure, so count the workers
+    // it may still add: shedding starts only once those would not help either.
+    long long service = __atomic_load_n(&pool->service_us, __ATOMIC_RELAXED);
+    long long predicted_us = (queued + 1) * service / pool->max_workers;
+
+    // The service average lags a sudden burst; a socket already waiting that
+    // long says a new one will wait at least as long
+    return predicted_us > oldest_us ? predicted_us : oldest_us;
+}
+
+void thread_pool_wait_idle(thread_pool_t* pool) {
+    if (!pool) return;
+
+    while (pool_queued(pool) > 0 || __atomic_load_n(&pool->busy_workers, __ATOMIC_RELAXED) > 0) {
+        struct timespec pause = { 0, THREAD_POOL_IDLE_POLL_MS * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Sizing thread: one sample per interval. Growing takes THREAD_POOL_GROW_SAMPLES
+// pressured samples in a row and at most doubles the pool; shrinking takes
+// THREAD_POOL_SHRINK_SAMPLES quiet ones and retires a single worker, so the pool
+// does not flap around a load level that sits between the two thresholds.
+static void* pool_sizer_thread(void* arg) {
+    thread_pool_t* pool = (thread_pool_t*)arg;
+    long long last_total_us = 0;
+    long long last_count = 0;
+    int pressured = 0;
+    int quiet = 0;
+
+    pthread_mutex_lock(&pool->sizer_mutex);
+
+    while (!pool->shutdown) {
+        struct timespec deadline;
+        thread_pool_deadline(&deadline, THREAD_POOL_SIZING_INTERVAL_MS);
+        pthread_cond_timedwait(&pool->sizer_wakeup, &pool->sizer_mutex, &deadline);
+        if (pool->shutdown) {
+            break;
+        }
+
+        pool_reap_workers(pool);
+
+        long long total_us = __atomic_load_n(&pool->wait_total_us, __ATOMIC_RELAXED);
+        long long count = __atomic_load_n(&pool->wait_count, __ATOMIC_RELAXED);
+        long long wait_us = count > last_count ? (total_us - last_total_us) / (count - last_count) : 0;
+        last_total_us = total_us;
+        last_count = count;
+        __atomic_store_n(&pool->last_wait_us, wait_us, __ATOMIC_RELAXED);
+
+        int queued = pool_queued(pool);
+        int busy = __atomic_load_n(&pool->busy_workers, __ATOMIC_RELAXED);
+        int active = pool->active_workers;
+
+        // Pressure: sockets wait too long, or wait at all while every worker is tied up in I/O.
+        // Quiet: nothing waiting, at most half the workers busy and waits well under the bar.
+        if (wait_us >= THREAD_POOL_GROW_WAIT_US || (queued > 0 && busy >= active)) {
+            pressured++;
+            quiet = 0;
+        } else if (queued == 0 && busy * 2 <= active && wait_us < THREAD_POOL_GROW_WAIT_US / 4) {
+            quiet++;
+            pressured = 0;
+        } else {
+            pressured = 0;
+            quiet = 0;
+        }
+
+        if (pressured >= THREAD_POOL_GROW_SAMPLES && active < pool->max_workers) {
+            int add = queued > 1 ? queued : 1;
+            if (add > active) {
+                add = active;
+            }
+            if (active + add > pool->max_workers) {
+                add = pool->max_workers - active;
+            }
+
+            int started = 0;
+            while (started < add && pool_start_worker(pool, active + started) == 0) {
+                started++;
+            }
+            if (started > 0) {
+                __atomic_store_n(&pool->active_workers, active + started, __ATOMIC_RELEASE);
+                __atomic_add_fetch(&pool->grows, 1, __ATOMIC_RELAXED);
+                printf("[POOL] Growing to %d workers (queue wait %lld us, %d queued, %d/%d busy)\n",
+                       active + started, wait_us, queued, busy, active);
+            }
+            pressured = 0;
+        } else if (quiet >= THREAD_POOL_SHRINK_SAMPLES && active > pool->min_workers) {
+            // Stop routing to the last worker first, then let it drain and exit
+            __atomic_store_n(&pool->active_workers, active - 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&pool->workers[active - 1].state, THREAD_POOL_WORKER_RETIRING, __ATOMIC_RELEASE);
+            pool_wake(pool, pool->worker_span);
+            __atomic_add_fetch(&pool->shrinks, 1, __ATOMIC_RELAXED);
+            printf("[POOL] Retiring worker %d, shrinking to %d workers (%d busy)\n",
+                   active - 1, active - 1, busy);
+            quiet = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&pool->sizer_mutex);
+    return NULL;
+}
+
+thread_pool_t* thread_pool_create(int min_workers, int max_workers) {
+    return thread_pool_create_on_node(min_workers, max_workers, -1);
+}
+
+thread_pool_t* thread_pool_create_on_node(int min_workers, int max_workers, int node) {
+    if (min_workers <= 0) {
+        min_workers = DEFAULT_MIN_WORKER_THREADS;
+    }
+    if (max_workers > MAX_WORKER_THREADS) {
+        max_workers = MAX_WORKER_THREADS;
+    }
+    if (max_workers < min_workers) {
+        max_workers = min_workers;
+    }
+
+    int initial_workers = DEFAULT_WORKER_THREADS;
+    if (initial_workers < min_workers) {
+        initial_workers = min_workers;
+    }
+    if (initial_workers > max_workers) {
+        initial_workers = max_workers;
+    }
+
+    thread_pool_t* pool = calloc(1, sizeof(thread_pool_t));
     if (!pool) {
         printf("[POOL] Failed to allocate memory for thread pool\n");
         return NULL;
     }
-    
+
+    // The rings are written by the acceptor and read by the workers; keep them
+    // on the node both run on
+    pool->workers = affinity_alloc(max_workers * sizeof(thread_pool_worker_t), node);
+    if (!pool->workers) {
+        printf("[POOL] Failed to allocate memory for worker rings\n");
+        free(pool);
+        return NULL;
+    }
+
     // Initialize pool structure
-    pool->task_queue_head = NULL;
-    pool->task_queue_tail = NULL;
-    pool->queue_size = 0;
-    pool->shutdown = 0;
-    
+    pool->node = node;
+    pool->min_workers = min_workers;
+    pool->max_workers = max_workers;
+
     // Initialize synchronization
-    if (pthread_mutex_init(&pool->queue_mutex, NULL) != 0) {
-        printf("[POOL] Failed to initialize queue mutex\n");
+    if (pthread_mutex_init(&pool->idle_mutex, NULL) != 0) {
+        printf("[POOL] Failed to initialize idle mutex\n");
+        affinity_free(pool->workers, pool->max_workers * sizeof(thread_pool_worker_t));
         free(pool);
         return NULL;
     }
-    
-    if (pthread_cond_init(&pool->queue_condition, NULL) != 0) {
-        printf("[POOL] Failed to initialize queue condition\n");
-        pthread_mutex_destroy(&pool->queue_mutex);
+
+    if (pthread_cond_init(&pool->work_available, NULL) != 0) {
+        printf("[POOL] Failed to initialize idle condition\n");
+        pthread_mutex_destroy(&pool->idle_mutex);
+        affinity_free(pool->workers, pool->max_workers * sizeof(thread_pool_worker_t));
         free(pool);
         return NULL;
     }
-    
+
+    pthread_mutex_init(&pool->sizer_mutex, NULL);
+    pthread_cond_init(&pool->sizer_wakeup, NULL);
+
+    ring_init(&pool->priority);
+    for (int i = 0; i < max_workers; i++) {
+        thread_pool_worker_t* worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->id = i;
+        worker->state = THREAD_POOL_WORKER_STOPPED;
+        ring_init(&worker->ring);
+    }
+
     // Create worker threads
-    for (int i = 0; i < NUM_WORKER_THREADS; i++) {
-        if (pthread_create(&pool->workers[i], NULL, worker_thread, pool) != 0) {
-            printf("[POOL] Failed to create worker thread %d\n", i);
-            
+    for (int i = 0; i < initial_workers; i++) {
+        if (pool_start_worker(pool, i) != 0) {
             // Cleanup already created threads
-            pool->shutdown = 1;
-            pthread_cond_broadcast(&pool->queue_condition);
-            
+            __atomic_store_n(&pool->shutdown, 1, __ATOMIC_RELEASE);
+            pool_wake(pool, i);
+
             for (int j = 0; j < i; j++) {
-                pthread_join(pool->workers[j], NULL);
+                pthread_join(pool->workers[j].thread, NULL);
             }
-            
-            pthread_mutex_destroy(&pool->queue_mutex);
-            pthread_cond_destroy(&pool->queue_condition);
+
+            pthread_mutex_destroy(&pool->idle_mutex);
+            pthread_cond_destroy(&pool->work_available);
+            pthread_mutex_destroy(&pool->sizer_mutex);
+            pthread_cond_destroy(&pool->sizer_wakeup);
+            affinity_free(pool->workers, pool->max_workers * sizeof(thread_pool_worker_t));
             free(pool);
             return NULL;
         }
     }
-    
-    printf("[POOL] Thread pool created with %d worker threads\n", NUM_WORKER_THREADS);
+    pool->active_workers = initial_workers;
+
+    // A fixed-size pool needs no sizing thread
+    if (min_workers < max_workers) {
+        if (pthread_create(&pool->sizer, NULL, pool_sizer_thread, pool) == 0) {
+            pool->sizer_started = 1;
+        } else {
+            printf("[POOL] Failed to start sizing thread, pool stays at %d workers\n", initial_workers);
+        }
+    }
+
+    printf("[POOL] Thread pool created with %d worker threads (min %d, max %d)\n",
+           initial_workers, min_workers, max_workers);
     return pool;
 }
 
+// Called by the acceptor: the socket goes to the next worker in turn (or the
+// first one after it with room), and a parked worker is woken if there is one
+// Order the push before the idle check (pairs with the worker announcing
+// idleness before its last look), then wake one sleeper; whichever worker
+// wakes steals the task if it is not the owner
+static void pool_task_added(thread_pool_t* pool) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->idle_workers, __ATOMIC_SEQ_CST) > 0) {
+        pool_wake(pool, 1);
+    }
+}
+
 int thread_pool_add_task(thread_pool_t* pool, int client_socket) {
     if (!pool || client_socket <= 0) {
         return -1;
     }
-    
-    // Create new task
-    task_t* task = malloc(sizeof(task_t));
-    if (!task) {
-        printf("[POOL] Failed to allocate memory for task\n");
+
+    int active = __atomic_load_n(&pool->active_workers, __ATOMIC_ACQUIRE);
+    unsigned int start = __atomic_fetch_add(&pool->next_worker, 1, __ATOMIC_RELAXED);
+    long long now_us = thread_pool_now_us();
+    int target = -1;
+
+    for (int i = 0; i < active; i++) {
+        int candidate = (int)((start + i) % (unsigned int)active);
+        if (ring_push(&pool->workers[candidate].ring, client_socket, now_us) == 0) {
+            target = candidate;
+            break;
+        }
+    }
+
+    if (target < 0) {
+        // Backpressure: every worker already has a full ring of waiting clients
+        long long rejected = __atomic_add_fetch(&pool->rejected, 1, __ATOMIC_RELAXED);
+        printf("[POOL] All worker rings full, rejecting client socket %d (%lld rejected)\n",
+               client_socket, rejected);
         return -1;
     }
-    
-    task->client_socket = client_socket;
-    task->next = NULL;
-    
-    // Add task to queue
-    pthread_mutex_lock(&pool->queue_mutex);
-    
-    if (pool->task_queue_tail) {
-        pool->task_queue_tail->next = task;
-    } else {
-        pool->task_queue_head = task;
-    }
-    pool->task_queue_tail = task;
-    pool->queue_size++;
-    
-    printf("[POOL] Task added to queue (queue size: %d)\n", pool->queue_size);
-    
-    // Signal waiting threads
-    pthread_cond_signal(&pool->queue_condition);
-    pthread_mutex_unlock(&pool->queue_mutex);
-    
+
+    printf("[POOL] Task added to worker %d ring\n", target);
+    pool_task_added(pool);
     return 0;
 }
 
+int thread_pool_add_priority_task(thread_pool_t* pool, int client_socket) {
+    if (!pool || client_socket <= 0) {
+        return -1;
+    }
+
+    // Falls back to the worker rings when too many are already jumping the queue
+    if (ring_push(&pool->priority, client_socket, thread_pool_now_us()) != 0) {
+        return thread_pool_add_task(pool, client_socket);
+    }
+
+    printf("[POOL] Task added to priority ring\n");
+    pool_task_added(pool);
+    return 0;
+}
+
+void thread_pool_get_stats(thread_pool_t* pool, thread_pool_stats_t* stats) {
+    if (!pool || !stats) return;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->workers = __atomic_load_n(&pool->active_workers, __ATOMIC_ACQUIRE);
+    stats->min_workers = pool->min_workers;
+    stats->max_workers = pool->max_workers;
+    stats->busy_workers = __atomic_load_n(&pool->busy_workers, __ATOMIC_RELAXED);
+    stats->queued = pool_queued(pool);
+    stats->queue_wait_us = __atomic_load_n(&pool->last_wait_us, __ATOMIC_RELAXED);
+    stats->grows = __atomic_load_n(&pool->grows, __ATOMIC_RELAXED);
+    stats->shrinks = __atomic_load_n(&pool->shrinks, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&pool->rejected, __ATOMIC_RELAXED);
+    stats->service_us = __atomic_load_n(&pool->service_us, __ATOMIC_RELAXED);
+
+    int span = __atomic_load_n(&pool->worker_span, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < span; i++) {
+        stats->executed += __atomic_load_n(&pool->workers[i].executed, __ATOMIC_RELAXED);
+        stats->stolen += __atomic_load_n(&pool->workers[i].stolen, __ATOMIC_RELAXED);
+    }
+}
+
 void thread_pool_destroy(thread_pool_t* pool) {
     if (!pool) return;
-    
+
     printf("[POOL] Shutting down thread pool...\n");
-    
+
+    // Stop the sizing thread first so no worker starts or retires meanwhile
+    pthread_mutex_lock(&pool->sizer_mutex);
+    __atomic_store_n(&pool->shutdown, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&pool->sizer_wakeup);
+    pthread_mutex_unlock(&pool->sizer_mutex);
+    if (pool->sizer_started) {
+        pthread_join(pool->sizer, NULL);
+    }
+
     // Signal shutdown
-    pthread_mutex_lock(&pool->queue_mutex);
-    pool->shutdown = 1;
-    pthread_cond_broadcast(&pool->queue_condition);
-    pthread_mutex_unlock(&pool->queue_mutex);
-    
+    pool_wake(pool, pool->worker_span);
+
     // Wait for all worker threads to finish
-    for (int i = 0; i < NUM_WORKER_THREADS; i++) {
-        pthread_join(pool->workers[i], NULL);
-    }
-    
-    // Clean up remaining tasks
-    pthread_mutex_lock(&pool->queue_mutex);
-    task_t* current = pool->task_queue_head;
-    while (current) {
-        task_t* next = current->next;
-        socket_close(current->client_socket);  // Close any pending client connections
-        free(current);
-        current = next;
-    }
-    pthread_mutex_unlock(&pool->queue_mutex);
-    
+    for (int i = 0; i < pool->worker_span; i++) {
+        if (pool->workers[i].state != THREAD_POOL_WORKER_STOPPED) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+    }
+
+    thread_pool_stats_t stats;
+    thread_pool_get_stats(pool, &stats);
+
+    // Close any pending client connections left in the rings
+    int client_socket;
+    while ((client_socket = ring_take(&pool->priority, NULL)) > 0) {
+        socket_close(client_socket);
+    }
+    for (int i = 0; i < pool->worker_span; i++) {
+        while ((client_socket = ring_take(&pool->workers[i].ring, NULL)) > 0) {
+            socket_close(client_socket);
+        }
+    }
+
     // Destroy synchronization objects
-    pthread_mutex_destroy(&pool->queue_mutex);
-    pthread_cond_destroy(&pool->queue_condition);
-    
+    pthread_mutex_destroy(&pool->idle_mutex);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->sizer_mutex);
+    pthread_cond_destroy(&pool->sizer_wakeup);
+
+    printf("[POOL] Workers ran %lld tasks (%lld stolen, %lld rejected; grew %lld times, shrank %lld times)\n",
+           stats.executed, stats.stolen, stats.rejected, stats.grows, stats.shrinks);
+
     // Free the pool
+    affinity_free(pool->workers, pool->max_workers * sizeof(thread_pool_worker_t));
     free(pool);
-    
+
     printf("[POOL] Thread pool destroyed\n");
 }
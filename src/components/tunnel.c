@@ -0,0 +1,330 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // splice(), pipe2()
+#endif
+
+#include "../../include/proxy/tunnel.h"
+#include "../../include/proxy/platform.h"
+#include "../../include/proxy/coroutine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#ifdef _WIN32
+#define SHUT_WR SD_SEND
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Tunnel Implementation
+
+#define TUNNEL_SPLICE_CHUNK 65536    // Default pipe capacity, moved per splice() call
+
+static pthread_mutex_t tunnel_totals_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tunnel_totals_t tunnel_totals;
+
+static int tunnel_would_block(void) {
+#ifdef _WIN32
+    return get_socket_error() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+static int tunnel_interrupted(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    return errno == EINTR;
+#endif
+}
+
+static int tunnel_direction_init(tunnel_direction_t* direction, int from_fd, int to_fd,
+                                 const char* initial, int initial_len) {
+    memset(direction, 0, sizeof(*direction));
+    direction->from_fd = from_fd;
+    direction->to_fd = to_fd;
+    direction->pipe_fds[0] = -1;
+    direction->pipe_fds[1] = -1;
+
+#ifdef __linux__
+    if (pipe2(direction->pipe_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        direction->pipe_fds[0] = -1;
+        direction->pipe_fds[1] = -1;
+    }
+#endif
+
+    // Without a pipe the buffer carries all traffic; with one it only holds the initial data
+    int capacity = direction->pipe_fds[0] < 0 ? TUNNEL_BUFFER_SIZE : 0;
+    if (initial_len > capacity) {
+        capacity = initial_len;
+    }
+    if (capacity > 0) {
+        direction->buffer = malloc(capacity);
+        if (!direction->buffer) {
+            return -1;
+        }
+        direction->buffer_capacity = capacity;
+    }
+
+    if (initial_len > 0) {
+        memcpy(direction->buffer, initial, initial_len);
+        direction->buffer_end = initial_len;
+    }
+    return 0;
+}
+
+static void tunnel_direction_release(tunnel_direction_t* direction) {
+#ifdef __linux__
+    if (direction->pipe_fds[0] >= 0) {
+        close(direction->pipe_fds[0]);
+        close(direction->pipe_fds[1]);
+    }
+#endif
+    direction->pipe_fds[0] = -1;
+    direction->pipe_fds[1] = -1;
+    free(direction->buffer);
+    direction->buffer = NULL;
+}
+
+tunnel_t* tunnel_create(int client_fd, int upstream_fd,
+                        const char* to_upstream, int to_upstream_len,
+                        const char* to_client, int to_client_len) {
+    tunnel_t* tunnel = calloc(1, sizeof(tunnel_t));
+    if (!tunnel) {
+        printf("[TUNNEL] Failed to allocate memory for tunnel\n");
+        return NULL;
+    }
+
+    if (tunnel_direction_init(&tunnel->upstream, client_fd, upstream_fd, to_upstream, to_upstream_len) < 0 ||
+        tunnel_direction_init(&tunnel->downstream, upstream_fd, client_fd, to_client, to_client_len) < 0 ||
+        socket_set_nonblocking(client_fd) < 0 || socket_set_nonblocking(upstream_fd) < 0) {
+        printf("[TUNNEL] Failed to set up tunnel for socket %d\n", client_fd);
+        tunnel_direction_release(&tunnel->upstream);
+        tunnel_direction_release(&tunnel->downstream);
+        free(tunnel);
+        return NULL;
+    }
+
+    tunnel->started = time(NULL);
+    tunnel->last_activity = tunnel->started;
+
+    pthread_mutex_lock(&tunnel_totals_mutex);
+    tunnel_totals.tunnels_opened++;
+    tunnel_totals.tunnels_active++;
+    pthread_mutex_unlock(&tunnel_totals_mutex);
+
+    printf("[TUNNEL] Tunnel opened between socket %d and upstream socket %d (%s)\n",
+           client_fd, upstream_fd, tunnel->upstream.pipe_fds[0] >= 0 ? "splice" : "copy");
+    return tunnel;
+}
+
+// Move bytes in one direction until either side would block.
+// Returns 1 if anything moved, 0 if nothing did, -1 on error.
+static int tunnel_pump_direction(tunnel_direction_t* direction) {
+    int moved = 0;
+
+    while (1) {
+        // Buffered bytes (initial data or copy mode) go out first
+        while (direction->buffer_start < direction->buffer_end) {
+            int sent = send(direction->to_fd, direction->buffer + direction->buffer_start,
+                            direction->buffer_end - direction->buffer_start, MSG_NOSIGNAL);
+            if (sent > 0) {
+                direction->buffer_start += sent;
+                direction->bytes += sent;
+                moved = 1;
+                continue;
+            }
+            if (sent < 0 && tunnel_interrupted()) {
+                continue;
+            }
+            if (sent < 0 && tunnel_would_block()) {
+                return moved;
+            }
+            return -1;
+        }
+        direction->buffer_start = 0;
+        direction->buffer_end = 0;
+
+#ifdef __linux__
+        while (direction->pipe_pending > 0) {
+            ssize_t drained = splice(direction->pipe_fds[0], NULL, direction->to_fd, NULL,
+                                     direction->pipe_pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (drained > 0) {
+                direction->pipe_pending -= (int)drained;
+                direction->bytes += drained;
+                moved = 1;
+                continue;
+            }
+            if (drained < 0 && errno == EINTR) {
+                continue;
+            }
+            if (drained < 0 && errno == EAGAIN) {
+                return moved;
+            }
+            return -1;
+        }
+#endif
+
+        // Source finished and everything is flushed: pass the half-close along
+        if (direction->eof) {
+            if (!direction->shut) {
+                shutdown(direction->to_fd, SHUT_WR);
+                direction->shut = 1;
+                moved = 1;
+            }
+            return moved;
+        }
+
+        int received;
+#ifdef __linux__
+        if (direction->pipe_fds[0] >= 0) {
+            ssize_t filled = splice(direction->from_fd, NULL, direction->pipe_fds[1], NULL,
+                                    TUNNEL_SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            received = (int)filled;
+            if (filled > 0) {
+                direction->pipe_pending = received;
+            }
+        } else
+#endif
+        {
+            received = recv(direction->from_fd, direction->buffer, direction->buffer_capacity, 0);
+            if (received > 0) {
+                direction->buffer_end = received;
+            }
+        }
+
+        if (received > 0) {
+            moved = 1;
+            continue;
+        }
+        if (received == 0) {
+            direction->eof = 1;
+            moved = 1;
+            continue;
+        }
+        if (tunnel_interrupted()) {
+            continue;
+        }
+        if (tunnel_would_block()) {
+            return moved;
+        }
+        return -1;
+    }
+}
+
+int tunnel_pump(tunnel_t* tunnel) {
+    if (!tunnel) return -1;
+
+    int up = tunnel_pump_direction(&tunnel->upstream);
+    int down = tunnel_pump_direction(&tunnel->downstream);
+    if (up < 0 || down < 0) {
+        return -1;
+    }
+    if (up || down) {
+        tunnel->last_activity = time(NULL);
+    }
+
+    // Both sides have closed and every byte has been delivered
+    return tunnel->upstream.shut && tunnel->downstream.shut;
+}
+
+static int tunnel_direction_wants_read(const tunnel_direction_t* direction) {
+    return !direction->eof && direction->pipe_pending == 0 &&
+           direction->buffer_start == direction->buffer_end;
+}
+
+static int tunnel_direction_wants_write(const tunnel_direction_t* direction) {
+    return direction->pipe_pending > 0 || direction->buffer_start < direction->buffer_end;
+}
+
+// Wait up to `timeout_ms` for either socket to become ready for what the pump needs
+static int tunnel_wait(tunnel_t* tunnel, int timeout_ms) {
+    int client_fd = tunnel->upstream.from_fd;
+    int upstream_fd = tunnel->downstream.from_fd;
+    int client_read = tunnel_direction_wants_read(&tunnel->upstream);
+    int client_write = tunnel_direction_wants_write(&tunnel->downstream);
+    int upstream_read = tunnel_direction_wants_read(&tunnel->downstream);
+    int upstream_write = tunnel_direction_wants_write(&tunnel->upstream);
+
+#ifdef _WIN32
+    fd_set read_set, write_set;
+    FD_ZERO(&read_set);
+    FD_ZERO(&write_set);
+    if (client_read) FD_SET(client_fd, &read_set);
+    if (client_write) FD_SET(client_fd, &write_set);
+    if (upstream_read) FD_SET(upstream_fd, &read_set);
+    if (upstream_write) FD_SET(upstream_fd, &write_set);
+
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    return select(0, &read_set, &write_set, NULL, &timeout);
+#else
+    // A socket with nothing to wait for is left out so a hung-up peer cannot spin the loop
+    struct pollfd fds[2];
+    fds[0].fd = (client_read || client_write) ? client_fd : -1;
+    fds[0].events = (client_read ? POLLIN : 0) | (client_write ? POLLOUT : 0);
+    fds[0].revents = 0;
+    fds[1].fd = (upstream_read || upstream_write) ? upstream_fd : -1;
+    fds[1].events = (upstream_read ? POLLIN : 0) | (upstream_write ? POLLOUT : 0);
+    fds[1].revents = 0;
+
+    int ready = coroutine_poll(fds, 2, timeout_ms);
+    if (ready < 0 && errno == EINTR) {
+        return 0;
+    }
+    return ready;
+#endif
+}
+
+int tunnel_run(tunnel_t* tunnel, int idle_timeout) {
+    if (!tunnel) return -1;
+
+    while (1) {
+        int status = tunnel_pump(tunnel);
+        if (status != 0) {
+            return status > 0 ? 0 : -1;
+        }
+
+        if (tunnel_wait(tunnel, 1000) < 0) {
+            return -1;
+        }
+        if (time(NULL) - tunnel->last_activity >= idle_timeout) {
+            printf("[TUNNEL] Closing idle tunnel (socket %d)\n", tunnel->upstream.from_fd);
+            return -1;
+        }
+    }
+}
+
+void tunnel_destroy(tunnel_t* tunnel) {
+    if (!tunnel) return;
+
+    printf("[TUNNEL] Tunnel closed after %ld seconds: %lld bytes up, %lld bytes down\n",
+           (long)(time(NULL) - tunnel->started), tunnel->upstream.bytes, tunnel->downstream.bytes);
+
+    pthread_mutex_lock(&tunnel_totals_mutex);
+    tunnel_totals.tunnels_active--;
+    tunnel_totals.bytes_upstream += tunnel->upstream.bytes;
+    tunnel_totals.bytes_downstream += tunnel->downstream.bytes;
+    pthread_mutex_unlock(&tunnel_totals_mutex);
+
+    tunnel_direction_release(&tunnel->upstream);
+    tunnel_direction_release(&tunnel->downstream);
+    free(tunnel);
+}
+
+void tunnel_get_totals(tunnel_totals_t* totals) {
+    if (!totals) return;
+
+    pthread_mutex_lock(&tunnel_totals_mutex);
+    *totals = tunnel_totals;
+    pthread_mutex_unlock(&tunnel_totals_mutex);
+}
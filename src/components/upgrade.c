@@ -0,0 +1,438 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // struct timeval, CMSG macros
+#endif
+
+#include "../../include/proxy/upgrade.h"
+#include "../../include/proxy/proxy_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Upgrade Implementation
+
+#ifndef _WIN32
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int inherited[MAX_LISTENER_SHARDS];     // Listeners received from the previous server
+static int inherited_count = 0;
+static int takeover_fd = -1;                   // Connection to the previous server until it is released
+
+static int control_fd = -1;                    // Where a successor connects
+static char control_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static int listeners[MAX_LISTENER_SHARDS];     // What a successor receives
+static int listener_count = 0;
+static int listeners_sharded = 0;
+static volatile int handed_over = 0;           // A successor owns the listeners and the control socket
+static pthread_t control_thread;
+
+int upgrade_supported(void) {
+    return 1;
+}
+
+static int upgrade_address(const char* path, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        printf("[UPGRADE] Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+static void upgrade_set_timeouts(int fd) {
+    struct timeval timeout;
+    timeout.tv_sec = UPGRADE_IO_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (UPGRADE_IO_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static int upgrade_write_all(int fd, const void* data, size_t length) {
+    const char* bytes = (const char*)data;
+    while (length > 0) {
+        ssize_t written = send(fd, bytes, length, 0);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+static int upgrade_read_all(int fd, void* data, size_t length) {
+    char* bytes = (char*)data;
+    while (length > 0) {
+        ssize_t received = recv(fd, bytes, length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return -1;
+        }
+        bytes += received;
+        length -= (size_t)received;
+    }
+    return 0;
+}
+
+// New server side
+
+int upgrade_takeover(const char* path, int* sharded) {
+    struct sockaddr_un address;
+    if (!path || upgrade_address(path, &address) < 0) {
+        return path ? -1 : 0;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        print_socket_error("[UPGRADE] Failed to create control socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        int error = errno;
+        close(fd);
+        if (error == ENOENT || error == ECONNREFUSED) {
+            printf("[UPGRADE] No server waiting on %s, starting fresh\n", path);
+            return 0;
+        }
+        printf("[UPGRADE] Cannot reach the running server on %s: %s\n", path, strerror(error));
+        return -1;
+    }
+    upgrade_set_timeouts(fd);
+
+    upgrade_hello_t hello;
+    char control[CMSG_SPACE(sizeof(int) * MAX_LISTENER_SHARDS)];
+    struct iovec iov;
+    struct msghdr message;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = recvmsg(fd, &message, 0);
+
+    int count = 0;
+    for (struct cmsghdr* header = received > 0 ? CMSG_FIRSTHDR(&message) : NULL; header;
+         header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int fds = (int)((header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        if (fds > MAX_LISTENER_SHARDS - count) {
+            fds = MAX_LISTENER_SHARDS - count;
+        }
+        memcpy(inherited + count, CMSG_DATA(header), fds * sizeof(int));
+        count += fds;
+    }
+
+    if (received != (ssize_t)sizeof(hello) || hello.magic != UPGRADE_MAGIC ||
+        hello.version != UPGRADE_VERSION || (message.msg_flags & MSG_CTRUNC) ||
+        count == 0 || count != hello.listener_count) {
+        printf("[UPGRADE] Invalid handoff from the running server on %s\n", path);
+        for (int i = 0; i < count; i++) {
+            close(inherited[i]);
+        }
+        close(fd);
+        return -1;
+    }
+
+    takeover_fd = fd;
+    inherited_count = count;
+    *sharded = hello.sharded;
+    printf("[UPGRADE] Took over %d listening socket%s from the running server\n",
+           count, count == 1 ? "" : "s");
+    return count;
+}
+
+int upgrade_inherited_listener(int index) {
+    return index >= 0 && index < inherited_count ? inherited[index] : -1;
+}
+
+int upgrade_receive_cache(optimized_cache_t* cache, int wanted) {
+    if (takeover_fd < 0) {
+        return 0;
+    }
+
+    char reply = wanted ? UPGRADE_WANT_CACHE : UPGRADE_NO_CACHE;
+    if (upgrade_write_all(takeover_fd, &reply, 1) < 0) {
+        print_socket_error("[UPGRADE] Lost the running server");
+        return -1;
+    }
+    if (!wanted) {
+        return 0;
+    }
+
+    int imported = 0;
+    long long bytes = 0;
+    while (1) {
+        upgrade_record_t record;
+        if (upgrade_read_all(takeover_fd, &record, sizeof(record)) < 0) {
+            printf("[UPGRADE] Cache stream ended early after %d entries\n", imported);
+            return -1;
+        }
+        if (record.url_length == 0) {
+            break;
+        }
+        if (record.url_length > UPGRADE_MAX_URL || record.data_length == 0 ||
+            record.data_length > UPGRADE_MAX_ENTRY) {
+            printf("[UPGRADE] Invalid cache entry (%u byte URL, %u bytes)\n",
+                   record.url_length, record.data_length);
+            return -1;
+        }
+
+        char* url = malloc(record.url_length + 1);
+        char* data = malloc(record.data_length);
+        int ok = url && data &&
+                 upgrade_read_all(takeover_fd, url, record.url_length) == 0 &&
+                 upgrade_read_all(takeover_fd, data, record.data_length) == 0;
+        if (ok) {
+            url[record.url_length] = '\0';
+            // Entries that expired in transit are dropped by cache_import(), unless kept for revalidation
+            if (cache_import(cache, url, data, (int)record.data_length, (time_t)record.timestamp,
+                             (time_t)record.expires, record.keep_stale != 0) == 0) {
+                imported++;
+                bytes += record.data_length;
+            }
+        }
+        free(url);
+        free(data);
+        if (!ok) {
+            printf("[UPGRADE] Failed to receive cache entry %d\n", imported + 1);
+            return -1;
+        }
+    }
+
+    printf("[UPGRADE] Imported %d cache entries (%lld bytes)\n", imported, bytes);
+    return imported;
+}
+
+// Old server side
+
+static int upgrade_send_entry(void* context, const cache_node_t* node, time_t timestamp, time_t expires) {
+    int fd = *(int*)context;
+    upgrade_record_t record;
+    record.url_length = (uint32_t)strlen(node->url);
+    record.data_length = (uint32_t)node->data_size;
+    record.timestamp = (int64_t)timestamp;
+    record.expires = (int64_t)expires;
+    record.keep_stale = node->keep_stale;
+    record.reserved = 0;
+
+    if (record.url_length == 0 || record.url_length > UPGRADE_MAX_URL || record.data_length > UPGRADE_MAX_ENTRY) {
+        return 0;
+    }
+    if (upgrade_write_all(fd, &record, sizeof(record)) < 0 ||
+        upgrade_write_all(fd, node->url, record.url_length) < 0 ||
+        upgrade_write_all(fd, node->data, record.data_length) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// One attempt by a successor; 0 once it is serving on our listeners
+static int upgrade_hand_over(int fd) {
+    upgrade_set_timeouts(fd);
+    printf("[UPGRADE] New server connected, handing over %d listening socket%s\n",
+           listener_count, listener_count == 1 ? "" : "s");
+
+    upgrade_hello_t hello;
+    hello.magic = UPGRADE_MAGIC;
+    hello.version = UPGRADE_VERSION;
+    hello.listener_count = listener_count;
+    hello.sharded = listeners_sharded;
+
+    char control[CMSG_SPACE(sizeof(int) * MAX_LISTENER_SHARDS)];
+    struct iovec iov;
+    struct msghdr message;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    memset(control, 0, sizeof(control));
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * listener_count);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * listener_count);
+    memcpy(CMSG_DATA(header), listeners, sizeof(int) * listener_count);
+
+    if (sendmsg(fd, &message, 0) != (ssize_t)sizeof(hello)) {
+        print_socket_error("[UPGRADE] Failed to send listening sockets");
+        return -1;
+    }
+
+    char reply;
+    if (upgrade_read_all(fd, &reply, 1) < 0) {
+        return -1;
+    }
+    if (reply == UPGRADE_WANT_CACHE) {
+        int sent = cache_export(optimized_cache, upgrade_send_entry, &fd);
+        upgrade_record_t end;
+        memset(&end, 0, sizeof(end));
+        if (sent < 0 || upgrade_write_all(fd, &end, sizeof(end)) < 0) {
+            printf("[UPGRADE] Failed to send the cache\n");
+            return -1;
+        }
+        printf("[UPGRADE] Sent %d cache entries\n", sent);
+    } else if (reply != UPGRADE_NO_CACHE) {
+        return -1;
+    }
+
+    // Both servers accept until the new one is ready; only then does this one stop
+    if (upgrade_read_all(fd, &reply, 1) < 0 || reply != UPGRADE_SERVING) {
+        return -1;
+    }
+    handed_over = 1;
+    return 0;
+}
+
+static void* upgrade_thread(void* arg) {
+    (void)arg;
+
+    while (1) {
+        int fd = accept(control_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            print_socket_error("[UPGRADE] Accept failed on control socket");
+            return NULL;
+        }
+
+        int result = upgrade_hand_over(fd);
+        close(fd);
+        if (result == 0) {
+            break;
+        }
+        printf("[UPGRADE] Handoff aborted, still serving\n");
+    }
+
+    // The path now belongs to the successor; only our descriptor goes
+    close(control_fd);
+    control_fd = -1;
+
+    // The main thread drains, and exits once every connection is done or the deadline passes
+    printf("[UPGRADE] New server is accepting, draining for up to %d ms\n", proxy_config.drain_timeout_ms);
+    proxy_server_stop(0);
+    return NULL;
+}
+
+void upgrade_start(const char* path, const int* listen_fds, int count, int sharded) {
+    if (takeover_fd >= 0) {
+        char serving = UPGRADE_SERVING;
+        if (upgrade_write_all(takeover_fd, &serving, 1) < 0) {
+            print_socket_error("[UPGRADE] Previous server did not take the handoff, it keeps serving");
+        } else {
+            printf("[UPGRADE] Serving; the previous server is draining\n");
+        }
+        close(takeover_fd);
+        takeover_fd = -1;
+    }
+
+    struct sockaddr_un address;
+    if (!path || count <= 0 || upgrade_address(path, &address) < 0) {
+        return;
+    }
+
+    listener_count = count > MAX_LISTENER_SHARDS ? MAX_LISTENER_SHARDS : count;
+    memcpy(listeners, listen_fds, sizeof(int) * listener_count);
+    listeners_sharded = sharded;
+
+    control_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (control_fd < 0) {
+        print_socket_error("[UPGRADE] Failed to create control socket");
+        return;
+    }
+
+    // A previous server's path (or a stale one) is replaced; its owner keeps only a descriptor
+    unlink(path);
+    if (bind(control_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(control_fd, 1) < 0) {
+        print_socket_error("[UPGRADE] Failed to listen on control socket");
+        close(control_fd);
+        control_fd = -1;
+        return;
+    }
+    strcpy(control_path, path);
+
+    // Shutdown signals stay with the main thread
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    int created = pthread_create(&control_thread, NULL, upgrade_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (created != 0) {
+        printf("[UPGRADE] Failed to start upgrade thread\n");
+        close(control_fd);
+        control_fd = -1;
+        unlink(path);
+        return;
+    }
+    pthread_detach(control_thread);
+
+    printf("[UPGRADE] Waiting for a successor on %s\n", path);
+}
+
+void upgrade_stop(void) {
+    if (control_fd >= 0 && !handed_over) {
+        close(control_fd);
+        control_fd = -1;
+        unlink(control_path);
+    }
+}
+
+#else
+
+// Handing sockets to another process needs Unix domain sockets (SCM_RIGHTS)
+int upgrade_supported(void) {
+    return 0;
+}
+
+int upgrade_takeover(const char* path, int* sharded) {
+    (void)sharded;
+    if (path) {
+        printf("[UPGRADE] Listener handoff is not supported on this platform, ignoring --upgrade-socket\n");
+    }
+    return 0;
+}
+
+int upgrade_inherited_listener(int index) {
+    (void)index;
+    return -1;
+}
+
+int upgrade_receive_cache(optimized_cache_t* cache, int wanted) {
+    (void)cache;
+    (void)wanted;
+    return 0;
+}
+
+void upgrade_start(const char* path, const int* listen_fds, int count, int sharded) {
+    (void)path;
+    (void)listen_fds;
+    (void)count;
+    (void)sharded;
+}
+
+void upgrade_stop(void) {
+}
+
+#endif
@@ -1,13 +1,21 @@
 #include "../include/proxy/proxy_server.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 
 // Global server state
 int port_number = DEFAULT_PORT;
+proxy_config_t proxy_config = { SERVER_MODE_THREAD_POOL, 0, IO_BACKEND_SOCKETS, 0, NULL, CONNECT_TIMEOUT_MS,
+                               DEFAULT_MIN_WORKER_THREADS, DEFAULT_MAX_WORKER_THREADS, DEFAULT_LATENCY_TARGET_MS,
+                               NULL, NULL, DEFAULT_DRAIN_TIMEOUT_MS, 1, CACHE_DEFAULT_MAX_BYTES,
+                               MAX_RESPONSE_SIZE, 0 };
 thread_pool_t* thread_pool = NULL;
 optimized_cache_t* optimized_cache = NULL;
 connection_pool_t* connection_pool = NULL;
+resolver_t* dns_resolver = NULL;
+collapse_t* request_collapse = NULL;
+shard_group_t* shard_group = NULL;
 
 // Global synchronization primitives
 sem_t semaphore;
@@ -16,11 +24,61 @@ pthread_mutex_t lock;
 // pthread library variable definition (defined once here, declared extern in pthread.h)
 void (**_pthread_key_dest)(void *) = NULL;
 
-// Signal handler for graceful shutdown
+// Signal handler for graceful shutdown: the main thread drains and exits
 void signal_handler(int sig) {
-    printf("\n[SERVER] Received signal %d, shutting down gracefully...\n", sig);
-    proxy_server_shutdown();
-    exit(0);
+    proxy_server_stop(sig);
+}
+
+// "268435456", "256M" or "1G"; -1 if malformed
+static long long parse_size(const char* text) {
+    char* end;
+    long long value = strtoll(text, &end, 10);
+    if (end == text || value <= 0) {
+        return -1;
+    }
+    switch (*end) {
+        case 'K': case 'k': value *= 1024LL; end++; break;
+        case 'M': case 'm': value *= 1024LL * 1024; end++; break;
+        case 'G': case 'g': value *= 1024LL * 1024 * 1024; end++; break;
+        default: break;
+    }
+    return *end == '\0' ? value : -1;
+}
+
+static void print_usage(const char* program) {
+    printf("[SERVER] Usage: %s [port] [--event-loop | --coroutines] [--shards N|auto] [--io-backend sockets|uring] [--zero-copy]\n", program);
+    printf("[SERVER]        [--hosts-file PATH] [--connect-timeout MS] [--workers N|auto]\n");
+    printf("[SERVER]        [--min-workers N] [--max-workers N] [--latency-target MS] [--cpu-affinity auto|LIST]\n");
+    printf("[SERVER]        [--upgrade-socket PATH] [--drain-timeout MS] [--no-cache-handoff]\n");
+    printf("[SERVER]        [--cache-size BYTES] [--cache-max-object BYTES] [--cache-huge-pages]\n");
+    printf("[SERVER]   --event-loop   Serve all connections from a non-blocking epoll reactor (Linux)\n");
+    printf("[SERVER]   --coroutines   Run each connection's handler as a coroutine on per-core epoll schedulers (Linux)\n");
+    printf("[SERVER]   --shards N     Run N SO_REUSEPORT listener shards, each with its own workers\n");
+    printf("[SERVER]                  (\"auto\" starts one shard per online core)\n");
+    printf("[SERVER]   --io-backend   Socket I/O backend for worker threads (uring falls back to sockets)\n");
+    printf("[SERVER]   --zero-copy    splice() uncached response bodies upstream-to-client (Linux)\n");
+    printf("[SERVER]   --hosts-file   Pin host names to addresses (\"address name...\" lines) ahead of DNS\n");
+    printf("[SERVER]   --connect-timeout MS  Deadline for connecting to an origin (default %d)\n",
+           CONNECT_TIMEOUT_MS);
+    printf("[SERVER]   --workers N    Fixed worker threads per thread pool (\"auto\" = one per core)\n");
+    printf("[SERVER]   --min-workers N / --max-workers N  Bounds the pool grows and shrinks within\n");
+    printf("[SERVER]                  (default %d..%d, sized by queue wait and busy workers)\n",
+           DEFAULT_MIN_WORKER_THREADS, DEFAULT_MAX_WORKER_THREADS);
+    printf("[SERVER]   --latency-target MS  Answer new connections with 503 once their estimated queue\n");
+    printf("[SERVER]                  wait exceeds MS; cache hits still get in (default %d, 0 = off)\n",
+           DEFAULT_LATENCY_TARGET_MS);
+    printf("[SERVER]   --cpu-affinity Pin acceptors, workers and schedulers to CPUs (\"auto\" or e.g. 0-7,16-23),\n");
+    printf("[SERVER]                  node by node, and keep shard worker state on the local NUMA node (Linux)\n");
+    printf("[SERVER]   --upgrade-socket PATH  Take over the listeners of the server waiting on PATH, then\n");
+    printf("[SERVER]                  wait there for the next upgrade (Unix)\n");
+    printf("[SERVER]   --drain-timeout MS  When stopping or handing over, finish in-flight requests for up to MS (default %d)\n",
+           DEFAULT_DRAIN_TIMEOUT_MS);
+    printf("[SERVER]   --no-cache-handoff  Start with an empty cache instead of the previous server's\n");
+    printf("[SERVER]   --cache-size BYTES  Memory the cache may use, keys and metadata included\n");
+    printf("[SERVER]                  (K/M/G suffixes, default %lldM)\n", CACHE_DEFAULT_MAX_BYTES / (1024 * 1024));
+    printf("[SERVER]   --cache-max-object BYTES  Largest response kept in the cache (default %dK)\n",
+           MAX_RESPONSE_SIZE / 1024);
+    printf("[SERVER]   --cache-huge-pages  Back the cache's slab arenas with transparent huge pages (Linux)\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -28,18 +86,143 @@ int main(int argc, char *argv[]) {
     printf("[SERVER] ================================================\n");
 
     // Parse command line arguments
-    if (argc == 2) {
-        port_number = atoi(argv[1]);
-        if (port_number <= 0 || port_number > 65535) {
-            printf("[SERVER] Invalid port number: %s\n", argv[1]);
-            printf("[SERVER] Usage: %s [port]\n", argv[0]);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--event-loop") == 0) {
+            proxy_config.mode = SERVER_MODE_EVENT_LOOP;
+        } else if (strcmp(argv[i], "--coroutines") == 0) {
+            proxy_config.mode = SERVER_MODE_COROUTINES;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) {
+                proxy_config.shards = listener_shards_default_count();
+            } else {
+                proxy_config.shards = atoi(argv[i]);
+                if (proxy_config.shards <= 0 || proxy_config.shards > MAX_LISTENER_SHARDS) {
+                    printf("[SERVER] Invalid shard count: %s\n", argv[i]);
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            }
+        } else if (strcmp(argv[i], "--io-backend") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "uring") == 0) {
+                proxy_config.io_backend = IO_BACKEND_URING;
+            } else if (strcmp(argv[i], "sockets") == 0) {
+                proxy_config.io_backend = IO_BACKEND_SOCKETS;
+            } else {
+                printf("[SERVER] Unknown I/O backend: %s\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--zero-copy") == 0) {
+            proxy_config.zero_copy = 1;
+        } else if (strcmp(argv[i], "--hosts-file") == 0 && i + 1 < argc) {
+            proxy_config.hosts_file = argv[++i];
+        } else if (strcmp(argv[i], "--connect-timeout") == 0 && i + 1 < argc) {
+            i++;
+            proxy_config.connect_timeout_ms = atoi(argv[i]);
+            if (proxy_config.connect_timeout_ms <= 0) {
+                printf("[SERVER] Invalid connect timeout: %s\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            i++;
+            int workers = strcmp(argv[i], "auto") == 0 ? thread_pool_default_workers() : atoi(argv[i]);
+            if (workers <= 0 || workers > MAX_WORKER_THREADS) {
+                printf("[SERVER] Invalid worker count: %s\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            proxy_config.min_workers = workers;
+            proxy_config.max_workers = workers;
+        } else if ((strcmp(argv[i], "--min-workers") == 0 || strcmp(argv[i], "--max-workers") == 0) &&
+                   i + 1 < argc) {
+            int workers = atoi(argv[i + 1]);
+            if (workers <= 0 || workers > MAX_WORKER_THREADS) {
+                printf("[SERVER] Invalid worker count: %s\n", argv[i + 1]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            if (strcmp(argv[i], "--min-workers") == 0) {
+                proxy_config.min_workers = workers;
+            } else {
+                proxy_config.max_workers = workers;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--latency-target") == 0 && i + 1 < argc) {
+            i++;
+            proxy_config.latency_target_ms = atoi(argv[i]);
+            if (proxy_config.latency_target_ms < 0 || (proxy_config.latency_target_ms == 0 && strcmp(argv[i], "0") != 0)) {
+                printf("[SERVER] Invalid latency target: %s\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--cpu-affinity") == 0 && i + 1 < argc) {
+            proxy_config.cpu_affinity = argv[++i];
+        } else if (strcmp(argv[i], "--upgrade-socket") == 0 && i + 1 < argc) {
+            proxy_config.upgrade_socket = argv[++i];
+        } else if (strcmp(argv[i], "--drain-timeout") == 0 && i + 1 < argc) {
+            i++;
+            proxy_config.drain_timeout_ms = atoi(argv[i]);
+            if (proxy_config.drain_timeout_ms <= 0) {
+                printf("[SERVER] Invalid drain timeout: %s\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--no-cache-handoff") == 0) {
+            proxy_config.cache_handoff = 0;
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            i++;
+            proxy_config.cache_max_bytes = parse_size(argv[i]);
+            if (proxy_config.cache_max_bytes < 0) {
+                printf("[SERVER] Invalid cache size: %s\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--cache-max-object") == 0 && i + 1 < argc) {
+            i++;
+            long long max_object = parse_size(argv[i]);
+            if (max_object < 0 || max_object > MAX_CACHE_OBJECT_LIMIT) {
+                printf("[SERVER] Invalid cache object limit: %s\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+            proxy_config.cache_max_object = (int)max_object;
+        } else if (strcmp(argv[i], "--cache-huge-pages") == 0) {
+            proxy_config.cache_huge_pages = 1;
+        } else if (argv[i][0] != '-') {
+            port_number = atoi(argv[i]);
+            if (port_number <= 0 || port_number > 65535) {
+                printf("[SERVER] Invalid port number: %s\n", argv[i]);
+                print_usage(argv[0]);
+                exit(1);
+            }
+        } else {
+            printf("[SERVER] Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
             exit(1);
         }
     }
 
-    // Setup signal handlers for graceful shutdown
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    if (proxy_config.cache_max_object >= proxy_config.cache_max_bytes) {
+        printf("[SERVER] --cache-max-object %d does not fit in --cache-size %lld\n",
+               proxy_config.cache_max_object, proxy_config.cache_max_bytes);
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    if (proxy_config.min_workers > proxy_config.max_workers) {
+        printf("[SERVER] --min-workers %d exceeds --max-workers %d\n",
+               proxy_config.min_workers, proxy_config.max_workers);
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+#ifndef _WIN32
+    // Writes to clients that already hung up must fail with EPIPE, not kill the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
 
     // Initialize the proxy server
     if (proxy_server_init(port_number) != 0) {
@@ -47,9 +230,17 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    // Setup signal handlers for graceful shutdown
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
     printf("[SERVER] Proxy server successfully initialized\n");
-    // (this will run indefinitely)
-    proxy_server_start();
-    proxy_server_shutdown();
+    // (this will run until a signal or a successor stops it)
+    if (proxy_server_run() == 0) {
+        proxy_server_shutdown();
+    } else {
+        // Requests still in flight use the modules: leave their cleanup to the exit
+        upgrade_stop();
+    }
     return 0;
 }
@@ -0,0 +1,182 @@
+// Cache contention microbenchmark
+// Compares the cache behind one lock (one shard, the layout the proxy used
+// to have) against the default CACHE_SHARDS shards in
+// src/components/cache.c. Every thread runs the same mix a busy proxy produces:
+// mostly lookups of a hot set of URLs, plus some inserts of new URLs that keep
+// LRU eviction going. Throughput and per-operation latency are reported for a
+// growing number of threads.
+//
+// Build and run: make bench
+// Usage: ./bench_cache [max threads] [operations per thread]
+//
+// The cache keeps its per-operation log lines; stdout goes to the null device
+// so that only the results (on stderr) are shown.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/proxy/cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define BENCH_CACHE_BYTES (256 * 1024)  // Holds the hot set with room to spare
+#define BENCH_MAX_OBJECT 4096
+#define BENCH_HOT_URLS 512          // Fits in the cache: lookups of these hit
+#define BENCH_URL_SPACE 8192        // Inserts draw from this many URLs
+#define BENCH_INSERT_PERCENT 10
+#define BENCH_MAX_THREADS 64
+#define BENCH_LIFETIME 3600         // Seconds; nothing expires during a run
+
+static const char body[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+typedef struct {
+    optimized_cache_t* cache;
+    pthread_barrier_t* start;
+    unsigned int seed;
+    int operations;
+    long long* latency_ns;          // One sample per operation
+    int hits;
+} bench_thread_t;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// xorshift: cheap and per thread, so the generator adds no shared state
+static unsigned int next_random(unsigned int* state) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void bench_url(char* buffer, size_t size, unsigned int id) {
+    snprintf(buffer, size, "http://origin.example/assets/%u/resource.js", id);
+}
+
+static void* bench_worker(void* arg) {
+    bench_thread_t* thread = (bench_thread_t*)arg;
+    char url[128];
+
+    pthread_barrier_wait(thread->start);
+
+    for (int i = 0; i < thread->operations; i++) {
+        unsigned int roll = next_random(&thread->seed);
+        long long started = now_ns();
+
+        if (roll % 100 < BENCH_INSERT_PERCENT) {
+            bench_url(url, sizeof(url), BENCH_HOT_URLS + (roll / 100) % BENCH_URL_SPACE);
+            cache_add(thread->cache, url, body, (int)sizeof(body) - 1, time(NULL) + BENCH_LIFETIME, 0);
+        } else {
+            bench_url(url, sizeof(url), (roll / 100) % BENCH_HOT_URLS);
+            const cache_node_t* entry = cache_get(thread->cache, url, NULL);
+            if (entry) {
+                thread->hits++;
+                cache_release(entry);
+            }
+        }
+
+        thread->latency_ns[i] = now_ns() - started;
+    }
+    return NULL;
+}
+
+static int compare_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char* name, int shards, int threads, int operations) {
+    optimized_cache_t* cache = cache_create_sized(BENCH_CACHE_BYTES, BENCH_MAX_OBJECT, shards);
+    if (!cache) {
+        fprintf(stderr, "  cannot create a cache with %d shards\n", shards);
+        return;
+    }
+
+    char url[128];
+    for (unsigned int id = 0; id < BENCH_HOT_URLS; id++) {
+        bench_url(url, sizeof(url), id);
+        cache_add(cache, url, body, (int)sizeof(body) - 1, time(NULL) + BENCH_LIFETIME, 0);
+    }
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, threads + 1);
+
+    bench_thread_t state[BENCH_MAX_THREADS];
+    pthread_t ids[BENCH_MAX_THREADS];
+    long long* samples = malloc(sizeof(long long) * (size_t)threads * operations);
+
+    for (int i = 0; i < threads; i++) {
+        state[i].cache = cache;
+        state[i].start = &start;
+        state[i].seed = 2463534242u + (unsigned int)i * 7919u;
+        state[i].operations = operations;
+        state[i].latency_ns = samples + (size_t)i * operations;
+        state[i].hits = 0;
+        pthread_create(&ids[i], NULL, bench_worker, &state[i]);
+    }
+
+    pthread_barrier_wait(&start);
+    long long begin = now_ns();
+    int hits = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        hits += state[i].hits;
+    }
+    long long elapsed = now_ns() - begin;
+
+    long long total = (long long)threads * operations;
+    qsort(samples, (size_t)total, sizeof(long long), compare_ll);
+    long long sum = 0;
+    for (long long i = 0; i < total; i++) {
+        sum += samples[i];
+    }
+    long long lookups = total - total * BENCH_INSERT_PERCENT / 100;
+
+    fprintf(stderr, "  %2d threads  %-12s %10.0f ops/s  mean %7.2f us  p50 %7.2f us  p99 %8.2f us  hit %5.1f%%\n",
+            threads, name,
+            total / (elapsed / 1e9),
+            sum / (double)total / 1000.0,
+            samples[total / 2] / 1000.0,
+            samples[(long long)(total * 0.99)] / 1000.0,
+            lookups > 0 ? 100.0 * hits / lookups : 0.0);
+
+    free(samples);
+    pthread_barrier_destroy(&start);
+    cache_destroy(cache);
+}
+
+int main(int argc, char* argv[]) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 16;
+    int operations = argc > 2 ? atoi(argv[2]) : 100000;
+
+    if (max_threads <= 0 || max_threads > BENCH_MAX_THREADS || operations < 1000) {
+        fprintf(stderr, "Usage: %s [max threads <= %d] [operations per thread >= 1000]\n",
+                argv[0], BENCH_MAX_THREADS);
+        return 1;
+    }
+
+#ifdef _WIN32
+    freopen("NUL", "w", stdout);
+#else
+    freopen("/dev/null", "w", stdout);
+#endif
+
+    fprintf(stderr, "Cache contention, %d%% inserts, %d hot URLs, %d operations per thread\n",
+            BENCH_INSERT_PERCENT, BENCH_HOT_URLS, operations);
+
+    char sharded[32];
+    snprintf(sharded, sizeof(sharded), "%d shards", CACHE_SHARDS);
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        run("single lock", 1, threads, operations);
+        run(sharded, CACHE_SHARDS, threads, operations);
+    }
+    return 0;
+}
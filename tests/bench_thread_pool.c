@@ -0,0 +1,296 @@
+// Thread pool dispatch microbenchmark
+// Compares the single-queue pool the proxy used to run (one linked list behind
+// one mutex/condition pair) against the work-stealing pool in
+// src/components/thread_pool.c. Dispatch latency is the time from handing a
+// socket to the pool until a worker starts on it; handle_client_request() is
+// stubbed out here to record that latency and spin for a fixed service time.
+//
+// Build and run: make bench
+// Usage: ./bench_thread_pool [workers] [tasks]
+//
+// Both pools keep their per-task log lines; stdout goes to the null device so
+// that only the results (on stderr) are shown.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/proxy/thread_pool.h"
+#include "../include/proxy/platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+// Symbols the pool normally gets from the rest of the proxy
+sem_t semaphore;
+pthread_mutex_t lock;
+#ifdef _WIN32
+void (**_pthread_key_dest)(void *) = NULL;
+#endif
+
+static long long* submit_ns;             // Indexed by task id
+static long long* latency_ns;
+static long long service_ns;             // Simulated request handling time
+static int completed;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void handle_client_request(int client_socket) {
+    long long started = now_ns();
+    latency_ns[client_socket] = started - submit_ns[client_socket];
+
+    while (service_ns > 0 && now_ns() - started < service_ns) {
+        // Simulated request work
+    }
+
+    __atomic_add_fetch(&completed, 1, __ATOMIC_RELEASE);
+}
+
+int socket_close(socket_t sock) {
+    (void)sock;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Legacy pool: the pre-work-stealing implementation, kept verbatim in shape
+// ---------------------------------------------------------------------------
+
+typedef struct legacy_task {
+    int client_socket;
+    struct legacy_task* next;
+} legacy_task_t;
+
+typedef struct {
+    pthread_t* workers;
+    int num_workers;
+    legacy_task_t* task_queue_head;
+    legacy_task_t* task_queue_tail;
+    pthread_mutex_t queue_mutex;
+    pthread_cond_t queue_condition;
+    int queue_size;
+    int shutdown;
+} legacy_pool_t;
+
+static void* legacy_worker_thread(void* arg) {
+    legacy_pool_t* pool = (legacy_pool_t*)arg;
+
+    while (1) {
+        pthread_mutex_lock(&pool->queue_mutex);
+
+        while (pool->task_queue_head == NULL && !pool->shutdown) {
+            pthread_cond_wait(&pool->queue_condition, &pool->queue_mutex);
+        }
+
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->queue_mutex);
+            break;
+        }
+
+        legacy_task_t* task = pool->task_queue_head;
+        pool->task_queue_head = task->next;
+        if (pool->task_queue_head == NULL) {
+            pool->task_queue_tail = NULL;
+        }
+        pool->queue_size--;
+
+        pthread_mutex_unlock(&pool->queue_mutex);
+
+        printf("[WORKER] Processing client socket %d\n", task->client_socket);
+        sem_wait(&semaphore);
+        handle_client_request(task->client_socket);
+        sem_post(&semaphore);
+        free(task);
+    }
+
+    return NULL;
+}
+
+static legacy_pool_t* legacy_pool_create(int num_workers) {
+    legacy_pool_t* pool = calloc(1, sizeof(legacy_pool_t));
+    pool->workers = calloc(num_workers, sizeof(pthread_t));
+    pool->num_workers = num_workers;
+    pthread_mutex_init(&pool->queue_mutex, NULL);
+    pthread_cond_init(&pool->queue_condition, NULL);
+
+    for (int i = 0; i < num_workers; i++) {
+        pthread_create(&pool->workers[i], NULL, legacy_worker_thread, pool);
+    }
+    return pool;
+}
+
+static int legacy_pool_add_task(legacy_pool_t* pool, int client_socket) {
+    legacy_task_t* task = malloc(sizeof(legacy_task_t));
+    if (!task) {
+        return -1;
+    }
+    task->client_socket = client_socket;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->queue_mutex);
+    if (pool->task_queue_tail) {
+        pool->task_queue_tail->next = task;
+    } else {
+        pool->task_queue_head = task;
+    }
+    pool->task_queue_tail = task;
+    pool->queue_size++;
+
+    printf("[POOL] Task added to queue (queue size: %d)\n", pool->queue_size);
+
+    pthread_cond_signal(&pool->queue_condition);
+    pthread_mutex_unlock(&pool->queue_mutex);
+    return 0;
+}
+
+static void legacy_pool_destroy(legacy_pool_t* pool) {
+    pthread_mutex_lock(&pool->queue_mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->queue_condition);
+    pthread_mutex_unlock(&pool->queue_mutex);
+
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->queue_mutex);
+    pthread_cond_destroy(&pool->queue_condition);
+    free(pool->workers);
+    free(pool);
+}
+
+// ---------------------------------------------------------------------------
+// Driver
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    const char* name;
+    void* pool;
+    int (*add_task)(void* pool, int client_socket);
+} bench_target_t;
+
+static int legacy_add(void* pool, int client_socket) {
+    return legacy_pool_add_task((legacy_pool_t*)pool, client_socket);
+}
+
+static int stealing_add(void* pool, int client_socket) {
+    return thread_pool_add_task((thread_pool_t*)pool, client_socket);
+}
+
+static void submit(bench_target_t* target, int id) {
+    submit_ns[id] = now_ns();
+    // Bounded rings refuse work when every worker is full: retry like a
+    // backlogged acceptor would
+    while (target->add_task(target->pool, id) != 0) {
+        sched_yield();
+        submit_ns[id] = now_ns();
+    }
+}
+
+static void wait_completed(int count) {
+    while (__atomic_load_n(&completed, __ATOMIC_ACQUIRE) < count) {
+        sched_yield();
+    }
+}
+
+static int compare_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char* scenario, const char* name, int tasks, long long elapsed_ns) {
+    long long* sorted = malloc(sizeof(long long) * tasks);
+    long long total = 0;
+
+    memcpy(sorted, latency_ns + 1, sizeof(long long) * tasks);
+    qsort(sorted, tasks, sizeof(long long), compare_ll);
+    for (int i = 0; i < tasks; i++) {
+        total += sorted[i];
+    }
+
+    fprintf(stderr, "  %-8s %-14s %10.0f tasks/s  mean %8.1f us  p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us\n",
+            scenario, name,
+            tasks / (elapsed_ns / 1e9),
+            total / (double)tasks / 1000.0,
+            sorted[tasks / 2] / 1000.0,
+            sorted[(int)(tasks * 0.99)] / 1000.0,
+            sorted[(int)(tasks * 0.999)] / 1000.0);
+
+    free(sorted);
+}
+
+// Every task submitted back to back: contention on the dispatch path dominates
+static void run_burst(bench_target_t* target, int tasks) {
+    completed = 0;
+    service_ns = 0;
+
+    long long start = now_ns();
+    for (int id = 1; id <= tasks; id++) {
+        submit(target, id);
+    }
+    wait_completed(tasks);
+
+    report("burst", target->name, tasks, now_ns() - start);
+}
+
+// Rounds of one task per worker, each round drained before the next: measures
+// how quickly a sleeping worker picks up new work
+static void run_paced(bench_target_t* target, int tasks, int workers) {
+    completed = 0;
+    service_ns = 5000;
+
+    long long start = now_ns();
+    for (int id = 1; id <= tasks; id++) {
+        submit(target, id);
+        if (id % workers == 0 || id == tasks) {
+            wait_completed(id);
+        }
+    }
+
+    report("paced", target->name, tasks, now_ns() - start);
+}
+
+int main(int argc, char* argv[]) {
+    int workers = argc > 1 ? atoi(argv[1]) : DEFAULT_WORKER_THREADS;
+    int tasks = argc > 2 ? atoi(argv[2]) : 200000;
+    int paced_tasks = tasks / 10;
+
+    if (workers <= 0 || workers > MAX_WORKER_THREADS || tasks < 1000) {
+        fprintf(stderr, "Usage: %s [workers] [tasks >= 1000]\n", argv[0]);
+        return 1;
+    }
+
+#ifdef _WIN32
+    freopen("NUL", "w", stdout);
+#else
+    freopen("/dev/null", "w", stdout);
+#endif
+
+    sem_init(&semaphore, 0, MAX_CLIENTS);
+    pthread_mutex_init(&lock, NULL);
+    submit_ns = calloc(tasks + 1, sizeof(long long));
+    latency_ns = calloc(tasks + 1, sizeof(long long));
+
+    fprintf(stderr, "Dispatch latency, %d workers, %d burst / %d paced tasks\n", workers, tasks, paced_tasks);
+
+    legacy_pool_t* legacy = legacy_pool_create(workers);
+    bench_target_t legacy_target = { "single-queue", legacy, legacy_add };
+    run_burst(&legacy_target, tasks);
+    run_paced(&legacy_target, paced_tasks, workers);
+    legacy_pool_destroy(legacy);
+
+    thread_pool_t* stealing = thread_pool_create(workers, workers);
+    bench_target_t stealing_target = { "work-stealing", stealing, stealing_add };
+    run_burst(&stealing_target, tasks);
+    run_paced(&stealing_target, paced_tasks, workers);
+    thread_pool_destroy(stealing);
+
+    free(submit_ns);
+    free(latency_ns);
+    sem_destroy(&semaphore);
+    return 0;
+}
@@ -0,0 +1,293 @@
+// HTTP parser unit tests
+// Checks src/components/http_parser.c against fixed response heads: framing
+// (interim 1xx responses ahead of the final one, Content-Length validation on
+// responses and requests, Transfer-Encoding and Connection tokens) and the
+// shared-cache rules (freshness lifetimes, merging a 304 into the stored
+// response). No sockets or proxy process are involved.
+//
+// Build and run: make check
+//
+// The parser keeps its log lines; stdout goes to the null device so that
+// only failures and the summary (on stderr) are shown.
+
+#include "../include/proxy/http_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    checks++; \
+    if (!(condition)) { \
+        failures++; \
+        fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+} while (0)
+
+// Parse a complete response head, as the relay paths do after dropping interim heads
+static int parse_head(http_response_framer_t* framer, char* buffer, int* length) {
+    http_response_framer_init(framer, 0);
+    *length = http_response_skip_interim(buffer, *length);
+    return http_response_parse_head(framer, buffer, *length);
+}
+
+static void test_interim_responses(void) {
+    http_response_framer_t framer;
+    char buffer[512];
+    int length;
+
+    // 103 Early Hints, then the real answer
+    length = snprintf(buffer, sizeof(buffer), "%s",
+                      "HTTP/1.1 103 Early Hints\r\nLink: </style.css>; rel=preload\r\n\r\n"
+                      "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello");
+    int head = parse_head(&framer, buffer, &length);
+    CHECK(head > 0);
+    CHECK(framer.status_code == 200);
+    CHECK(framer.body_mode == HTTP_BODY_LENGTH);
+    CHECK(framer.content_length == 5);
+    CHECK(length - head == 5 && memcmp(buffer + head, "hello", 5) == 0);
+
+    // Several interim heads, including an unsolicited 100 Continue
+    length = snprintf(buffer, sizeof(buffer), "%s",
+                      "HTTP/1.1 100 Continue\r\n\r\n"
+                      "HTTP/1.1 102 Processing\r\n\r\n"
+                      "HTTP/1.1 204 No Content\r\n\r\n");
+    CHECK(parse_head(&framer, buffer, &length) > 0);
+    CHECK(framer.status_code == 204);
+    CHECK(framer.complete);
+
+    // The final head has not arrived yet: keep waiting for it
+    length = snprintf(buffer, sizeof(buffer), "%s", "HTTP/1.1 103 Early Hints\r\n\r\nHTTP/1.1 200");
+    CHECK(parse_head(&framer, buffer, &length) == 0);
+    CHECK(length == 12 && memcmp(buffer, "HTTP/1.1 200", 12) == 0);
+
+    // An incomplete interim head stays in the buffer
+    length = snprintf(buffer, sizeof(buffer), "%s", "HTTP/1.1 103 Early Hints\r\nLink: <");
+    CHECK(parse_head(&framer, buffer, &length) == 0);
+    CHECK(length == (int)strlen("HTTP/1.1 103 Early Hints\r\nLink: <"));
+
+    // 101 Switching Protocols is final
+    length = snprintf(buffer, sizeof(buffer), "%s", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n");
+    CHECK(parse_head(&framer, buffer, &length) > 0);
+    CHECK(framer.status_code == 101);
+}
+
+static int parse_length_head(const char* head, http_response_framer_t* framer) {
+    http_response_framer_init(framer, 0);
+    return http_response_parse_head(framer, head, (int)strlen(head));
+}
+
+static void test_content_length(void) {
+    http_response_framer_t framer;
+
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: 42\r\n\r\n", &framer) > 0);
+    CHECK(framer.content_length == 42);
+
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length:7 \r\n\r\n", &framer) > 0);
+    CHECK(framer.content_length == 7);
+
+    // Repeated identical values, on one line or several, are one length
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: 5, 5\r\n\r\n", &framer) > 0);
+    CHECK(framer.content_length == 5);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: 5\r\nContent-Length: 5\r\n\r\n", &framer) > 0);
+    CHECK(framer.content_length == 5);
+
+    // Anything the framing cannot trust is rejected
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n", &framer) < 0);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: 5, 6\r\n\r\n", &framer) < 0);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: 5abc\r\n\r\n", &framer) < 0);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n", &framer) < 0);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: +5\r\n\r\n", &framer) < 0);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: \r\n\r\n", &framer) < 0);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nContent-Length: 99999999999999999999\r\n\r\n", &framer) < 0);
+}
+
+static void test_transfer_coding(void) {
+    http_response_framer_t framer;
+
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: Chunked\r\n\r\n", &framer) > 0);
+    CHECK(framer.body_mode == HTTP_BODY_CHUNKED);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip , chunked\r\nContent-Length: 5\r\n\r\n",
+                            &framer) > 0);
+    CHECK(framer.body_mode == HTTP_BODY_CHUNKED);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n\r\n",
+                            &framer) > 0);
+    CHECK(framer.body_mode == HTTP_BODY_CHUNKED);
+
+    // Chunked not last, or only as part of another token: the body runs to the close
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked, gzip\r\nContent-Length: 5\r\n\r\n",
+                            &framer) > 0);
+    CHECK(framer.body_mode == HTTP_BODY_UNTIL_CLOSE && framer.connection_close);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nTransfer-Encoding: xchunked\r\n\r\n", &framer) > 0);
+    CHECK(framer.body_mode == HTTP_BODY_UNTIL_CLOSE);
+
+    // Connection options are whole tokens too
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nConnection: x-close\r\nContent-Length: 0\r\n\r\n", &framer) > 0);
+    CHECK(!framer.connection_close);
+    CHECK(parse_length_head("HTTP/1.1 200 OK\r\nConnection: Upgrade, CLOSE\r\nContent-Length: 0\r\n\r\n",
+                            &framer) > 0);
+    CHECK(framer.connection_close);
+}
+
+static long long request_length(const char* head) {
+    return http_request_body_length(head, (int)strlen(head));
+}
+
+static void test_request_content_length(void) {
+    CHECK(request_length("GET / HTTP/1.1\r\nHost: a\r\n\r\n") == 0);
+    CHECK(request_length("POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 42\r\n\r\n") == 42);
+    CHECK(request_length("POST / HTTP/1.1\r\nContent-Length: 5, 5\r\n\r\n") == 5);
+    CHECK(request_length("POST / HTTP/1.1\r\nContent-Length: 5\r\ncontent-length: 5\r\n\r\n") == 5);
+
+    // Malformed or conflicting lengths cannot frame the body
+    CHECK(request_length("POST / HTTP/1.1\r\nContent-Length: 5abc\r\n\r\n") == HTTP_BODY_LENGTH_INVALID);
+    CHECK(request_length("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n") == HTTP_BODY_LENGTH_INVALID);
+    CHECK(request_length("POST / HTTP/1.1\r\nContent-Length: 5, 6\r\n\r\n") == HTTP_BODY_LENGTH_INVALID);
+    CHECK(request_length("POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n") ==
+          HTTP_BODY_LENGTH_INVALID);
+    CHECK(request_length("POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: x\r\n\r\n") ==
+          HTTP_BODY_LENGTH_INVALID);
+
+    // Transfer codings are refused before the length is looked at
+    CHECK(request_length("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n") ==
+          HTTP_BODY_LENGTH_TRANSFER_CODED);
+    CHECK(request_length("POST / HTTP/1.1\r\nTransfer-Encoding: identity\r\nContent-Length: 5\r\n\r\n") == 5);
+}
+
+// All heads are dated DATE; "now" is passed explicitly
+#define DATE "Sun, 06 Nov 1994 08:49:37 GMT"
+
+static time_t policy_for(const char* head, time_t now, http_cache_policy_t* policy) {
+    http_response_cache_policy(head, (int)strlen(head), now, policy);
+    return policy->expires - now;
+}
+
+static void test_freshness(void) {
+    http_cache_policy_t policy;
+    time_t date = http_parse_date(DATE, (int)strlen(DATE));
+    CHECK(date == 784111777);
+
+    // Explicit lifetimes: s-maxage wins over max-age, which wins over Expires
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nCache-Control: max-age=60\r\n\r\n", date, &policy) == 60);
+    CHECK(policy.storable && !policy.validator);
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nCache-Control: public, max-age=60, s-maxage=30\r\n"
+                     "Expires: Sun, 06 Nov 1994 09:49:37 GMT\r\n\r\n", date, &policy) == 30);
+    CHECK(policy.storable);
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nExpires: Sun, 06 Nov 1994 09:49:37 GMT\r\n\r\n",
+                     date, &policy) == 3600);
+    CHECK(policy.storable);
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nCache-Control: max-age=999999999999\r\n\r\n", date, &policy) ==
+          (time_t)HTTP_MAX_LIFETIME);
+
+    // An invalid Expires means already expired
+    policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nExpires: 0\r\n\r\n", date, &policy);
+    CHECK(!policy.storable);
+
+    // Age on arrival: the Age header, or the time since Date if that is larger
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nCache-Control: max-age=60\r\nAge: 20\r\n\r\n",
+                     date, &policy) == 40);
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nCache-Control: max-age=300\r\nAge: 20\r\n\r\n",
+                     date + 100, &policy) == 200);
+    policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nCache-Control: max-age=60\r\nAge: 70\r\n\r\n", date, &policy);
+    CHECK(!policy.storable);
+
+    // Heuristic lifetime: a tenth of the time since Last-Modified, at most a day
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nLast-Modified: Sat, 05 Nov 1994 22:49:37 GMT\r\n\r\n",
+                     date, &policy) == 3600);
+    CHECK(policy.storable && policy.validator);
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nDate: " DATE "\r\nLast-Modified: Thu, 06 Oct 1994 08:49:37 GMT\r\n\r\n",
+                     date, &policy) == HTTP_HEURISTIC_MAX_LIFETIME);
+    policy_for("HTTP/1.1 302 Found\r\nDate: " DATE "\r\nLast-Modified: Thu, 06 Oct 1994 08:49:37 GMT\r\n\r\n",
+               date, &policy);
+    CHECK(!policy.storable);
+    policy_for("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n", date, &policy);
+    CHECK(!policy.storable);
+
+    // no-cache keeps a revalidatable response, stale from the start
+    CHECK(policy_for("HTTP/1.1 200 OK\r\nCache-Control: no-cache, max-age=60\r\nETag: \"v1\"\r\n\r\n",
+                     date, &policy) == 0);
+    CHECK(policy.storable && policy.validator);
+
+    // Never stored
+    policy_for("HTTP/1.1 200 OK\r\nCache-Control: no-store, max-age=60\r\n\r\n", date, &policy);
+    CHECK(!policy.storable);
+    policy_for("HTTP/1.1 200 OK\r\nCache-Control: private, max-age=60\r\n\r\n", date, &policy);
+    CHECK(!policy.storable);
+    policy_for("HTTP/1.1 206 Partial Content\r\nCache-Control: max-age=60\r\n\r\n", date, &policy);
+    CHECK(!policy.storable);
+}
+
+static time_t revalidated_for(const char* stored, const char* not_modified, time_t now, http_cache_policy_t* policy) {
+    http_revalidated_cache_policy(stored, (int)strlen(stored), not_modified, (int)strlen(not_modified), now, policy);
+    return policy->expires - now;
+}
+
+static void test_revalidation(void) {
+    http_cache_policy_t policy;
+    time_t date = http_parse_date(DATE, (int)strlen(DATE));
+    const char* stored = "HTTP/1.1 200 OK\r\nDate: Sun, 06 Nov 1994 08:32:57 GMT\r\nCache-Control: max-age=60\r\n"
+                         "ETag: \"v1\"\r\nLast-Modified: Sat, 05 Nov 1994 22:49:37 GMT\r\nContent-Length: 5\r\n\r\n";
+
+    // The 304's Date restarts the stored lifetime; its Cache-Control replaces the stored one
+    CHECK(revalidated_for(stored, "HTTP/1.1 304 Not Modified\r\nDate: " DATE "\r\n\r\n", date, &policy) == 60);
+    CHECK(policy.storable && policy.validator);
+    CHECK(revalidated_for(stored, "HTTP/1.1 304 Not Modified\r\nDate: " DATE "\r\nCache-Control: max-age=120\r\n\r\n",
+                          date, &policy) == 120);
+    revalidated_for(stored, "HTTP/1.1 304 Not Modified\r\nDate: " DATE "\r\nCache-Control: no-store\r\n\r\n",
+                    date, &policy);
+    CHECK(!policy.storable);
+
+    // A stored Expires still counts when the 304 does not replace it
+    CHECK(revalidated_for("HTTP/1.1 200 OK\r\nExpires: Sun, 06 Nov 1994 09:49:37 GMT\r\nETag: \"v1\"\r\n\r\n",
+                          "HTTP/1.1 304 Not Modified\r\nDate: " DATE "\r\n\r\n", date, &policy) == 3600);
+
+    // Only a 304 confirms the stored response
+    revalidated_for(stored, "HTTP/1.1 200 OK\r\nDate: " DATE "\r\n\r\n", date, &policy);
+    CHECK(!policy.storable);
+
+    // The stored copy takes the 304's fields and keeps its own body and framing
+    const char* response = "HTTP/1.1 200 OK\r\nDate: Sun, 06 Nov 1994 08:32:57 GMT\r\nAge: 30\r\n"
+                           "Cache-Control: max-age=60\r\nETag: \"v1\"\r\nContent-Length: 5\r\n\r\nhello";
+    const char* not_modified = "HTTP/1.1 304 Not Modified\r\nDate: " DATE "\r\nETag: \"v2\"\r\n"
+                               "Cache-Control: max-age=120\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    int merged_length = 0;
+    char* merged = http_merge_not_modified(response, (int)strlen(response), not_modified,
+                                           (int)strlen(not_modified), &merged_length);
+    CHECK(merged != NULL);
+    if (merged) {
+        const char* expected = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nDate: " DATE "\r\nETag: \"v2\"\r\n"
+                               "Cache-Control: max-age=120\r\n\r\nhello";
+        CHECK(merged_length == (int)strlen(expected) && memcmp(merged, expected, merged_length) == 0);
+        free(merged);
+    }
+    CHECK(http_merge_not_modified(response, (int)strlen(response), "HTTP/1.1 200 OK\r\n\r\n", 19,
+                                  &merged_length) == NULL);
+
+    // The conditional request carries both validators
+    char conditional[256];
+    CHECK(http_conditional_headers(stored, (int)strlen(stored), conditional, sizeof(conditional)) > 0);
+    CHECK(strstr(conditional, "If-None-Match: \"v1\"\r\n") != NULL);
+    CHECK(strstr(conditional, "If-Modified-Since: Sat, 05 Nov 1994 22:49:37 GMT\r\n") != NULL);
+    CHECK(http_conditional_headers("HTTP/1.1 200 OK\r\n\r\n", 19, conditional, sizeof(conditional)) == 0);
+}
+
+int main(void) {
+#ifdef _WIN32
+    freopen("NUL", "w", stdout);
+#else
+    freopen("/dev/null", "w", stdout);
+#endif
+
+    test_interim_responses();
+    test_content_length();
+    test_transfer_coding();
+    test_request_content_length();
+    test_freshness();
+    test_revalidation();
+
+    fprintf(stderr, "%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}